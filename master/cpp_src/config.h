@@ -22,12 +22,43 @@
 /* epoll max events one poll */
 #define EPOLL_MAXEV    8192
 
+/* io_uring提交队列大小，完成队列为其4倍。每个fd最多同时有一个poll请求 */
+#define URING_ENTRIES  4096
+
 /* buffer chunk size for socket recv or send */
 #define BUFFER_CHUNK    8192
 /* 大型buffer缓冲区分界线，采用不同的内存分配策略 */
 #define BUFFER_LARGE    65535
 /* 小型buffer每次分配的chunk数量 */
 #define BUFFER_CHUNK_SIZE 512
+/* 分段发送缓冲区单次writev的最大segment数量，不能超过系统IOV_MAX(1024) */
+#define BUFFER_MAX_IOV    64
+/* 广播的共享帧小于这个值时直接拷贝，不挂引用segment */
+#define BUFFER_SHARE_MIN  256
+
+/* 多线程io时，主线程与io线程之间消息队列的大小，满了会先缓存到溢出数组 */
+#define REACTOR_QUEUE     65536
+/* 多线程io时，io线程的最大数量 */
+#define REACTOR_MAX       32
+
+/* 数据库线程与主线程之间无锁队列的大小。满了主线程先缓存到溢出队列，子线程则等待 */
+#define THREAD_QUEUE      16384
+
+/* 单个lsql的mysql连接池最大连接数量 */
+#define SQL_POOL_MAX      32
+
+/* 单个异步寻路线程池(lastar_pool)最大线程数量 */
+#define ASTAR_POOL_MAX    32
+
+/* lmongo一次bulk写入默认最多合并的操作数量 */
+#define MONGO_BATCH_MAX   1000
+
+/* lmongo流式查询默认每批返回的文档数量 */
+#define MONGO_STREAM_BATCH   512
+/* 流式查询已返回但主线程还没处理的批数上限，超过时子线程暂停读取游标 */
+#define MONGO_STREAM_PENDING 4
+/* 主线程每一轮事件循环最多处理的流式查询批数，剩下的放到下一轮 */
+#define MONGO_STREAM_LOOP    2
 
 /* sql buffer chunk size */
 #define SQL_CHUNK    64
@@ -63,6 +94,12 @@
 
 /* acism 替换缓冲区默认大小 */
 #define ACISM_REPLACE_DEFAULT  2048
+/* acism 批量过滤最大线程数，每个线程至少处理的字符串数量 */
+#define ACISM_THREAD_MAX       8
+#define ACISM_THREAD_CHUNK     1024
+
+/* rpc调用的编码方式，通信双方必须一致。CDC_STREAM需要加载相同的字段列表文件 */
+#define RPC_CODEC    codec::CDC_STREAM
 
 /* 数据包解析方式 FLATBUFFERS_PARSE/PROTOBUF_PARSE */
 #define PROTOBUF_PARSE
@@ -75,7 +112,7 @@
  */
 #define MAX_CLT_CAST 256
 
-// 格子地图最大的格子数量
-#define MAX_MAP_GRID 256
+// 格子地图每条边最大的格子数量，大地图远距离寻路用hpa
+#define MAX_MAP_GRID 4096
 
 #endif /* __CONFIG_H__ */
@@ -21,6 +21,15 @@ ev::ev()
     timermax = 0;
     timercnt = 0;
 
+    timer_backend = TIMER_HEAP;
+    wheel_tick = 0;
+    memset( wheel_near,0,sizeof(wheel_near) );
+    memset( wheel_lvl,0,sizeof(wheel_lvl) );
+
+    backend_fd = -1;
+    backend_type = BACKEND_EPOLL;
+    uring = NULL;
+
     ev_rt_now = get_time ();
 
     update_clock();
@@ -47,11 +56,54 @@ ev::~ev()
     delete []timers;
     timers = NULL;
 
-    if ( backend_fd >= 0 )
+    backend_destroy();
+}
+
+/* 切换后端，已监听的fd会在下一轮循环中注册到新后端 */
+int32 ev::set_backend( int32 backend )
+{
+    if ( backend == backend_type ) return backend_type;
+
+    if ( BACKEND_URING == backend )
     {
-        ::close( backend_fd );
-        backend_fd = -1;
+        int32 epoll_fd = backend_fd;
+        if ( !uring_init() )
+        {
+            ERROR( "io_uring not support,fallback to epoll" );
+            return backend_type;
+        }
+
+        ::close( epoll_fd );
+        backend_type = BACKEND_URING;
+    }
+    else if ( BACKEND_EPOLL == backend )
+    {
+        backend_destroy();
+        backend_type = BACKEND_EPOLL;
+        backend_init();
+    }
+    else
+    {
+        ERROR( "ev::set_backend unknow backend:%d",backend );
+        return backend_type;
     }
+
+    /* 旧后端中的注册已随之销毁，所有fd重新ADD */
+    fdchangecnt = 0;
+    for ( uint32 fd = 0;fd < anfdmax;fd ++ )
+    {
+        ANFD *anfd = anfds + fd;
+
+        anfd->emask = 0;
+        anfd->reify = 0;
+        if ( anfd->w )
+        {
+            anfd->reify = EPOLL_CTL_ADD;
+            fd_change( fd );
+        }
+    }
+
+    return backend_type;
 }
 
 int32 ev::run()
@@ -172,6 +224,11 @@ void ev::fd_reify()
  */
 void ev::backend_modify( int32 fd,int32 events,int32 reify )
 {
+    if ( BACKEND_URING == backend_type )
+    {
+        return uring_modify( fd,events,reify );
+    }
+
     struct epoll_event ev;
     /* valgrind: uninitialised byte(s) */
     memset( &ev,0,sizeof(ev) );
@@ -239,6 +296,20 @@ void ev::backend_init()
     }
 }
 
+void ev::backend_destroy()
+{
+    if ( BACKEND_URING == backend_type )
+    {
+        uring_destroy();
+    }
+    else if ( backend_fd >= 0 )
+    {
+        ::close( backend_fd );
+    }
+
+    backend_fd = -1;
+}
+
 ev_tstamp ev::get_time()
 {
     struct timespec ts;
@@ -308,6 +379,8 @@ void ev::time_update()
 
 void ev::backend_poll( ev_tstamp timeout )
 {
+    if ( BACKEND_URING == backend_type ) return uring_poll( timeout );
+
     /* epoll wait times cannot be larger than (LONG_MAX - 999UL) / HZ msecs,
      * which is below the default libev max wait time, however.
      */
@@ -385,6 +458,8 @@ void ev::clear_pending( ev_watcher *w )
 
 void ev::timers_reify()
 {
+    if ( TIMER_WHEEL == timer_backend ) return wheel_reify();
+
     while (timercnt && (timers [HEAP0])->at < mn_now)
     {
         ev_timer *w = timers [HEAP0];
@@ -417,6 +492,17 @@ int32 ev::timer_start( ev_timer *w )
 
     assert ( "libev: negative repeat value", w->repeat >= 0. );
 
+    if ( TIMER_WHEEL == timer_backend )
+    {
+        ++timercnt;
+        return wheel_add( w );
+    }
+
+    return heap_insert( w );
+}
+
+int32 ev::heap_insert( ev_timer *w )
+{
     ++timercnt;
     int32 active = timercnt + HEAP0 - 1;
     array_resize ( ANHE, timers, timermax, uint32(active + 1), array_noinit );
@@ -425,7 +511,8 @@ int32 ev::timer_start( ev_timer *w )
 
     assert ( "libev: internal timer heap corruption", timers [w->active] == w );
 
-    return active;
+    /* up_heap后定时器的位置可能已经变了，不能返回插入时的位置 */
+    return w->active;
 }
 
 int32 ev::timer_stop( ev_timer *w )
@@ -433,6 +520,12 @@ int32 ev::timer_stop( ev_timer *w )
     clear_pending( w );
     if ( expect_false(!w->is_active()) ) return 0;
 
+    if ( TIMER_WHEEL == timer_backend )
+    {
+        --timercnt;
+        wheel_remove( w );
+    }
+    else
     {
         int32 active = w->active;
 
@@ -452,6 +545,58 @@ int32 ev::timer_stop( ev_timer *w )
     return 0;
 }
 
+/* 切换定时器的实现，已启动的定时器(at为绝对时间)直接挂到新的实现中 */
+int32 ev::set_timer_backend( int32 backend )
+{
+    if ( backend == timer_backend ) return timer_backend;
+
+    if ( TIMER_WHEEL == backend )
+    {
+        timer_backend = TIMER_WHEEL;
+        wheel_tick = wheel_now();
+        for ( uint32 i = 0;i < timercnt;i ++ )
+        {
+            ev_timer *w = timers [i + HEAP0];
+            w->active = wheel_add( w );
+        }
+    }
+    else if ( TIMER_HEAP == backend )
+    {
+        uint32 cnt = timercnt;
+
+        timercnt = 0;
+        timer_backend = TIMER_HEAP;
+        for ( int32 i = 0;i < WHEEL_NEAR;i ++ )
+        {
+            while ( wheel_near[i] )
+            {
+                ev_timer *w = wheel_near[i];
+                wheel_remove( w );
+                w->active = heap_insert( w );
+            }
+        }
+        for ( int32 level = 0;level < WHEEL_LEVEL;level ++ )
+        {
+            for ( int32 i = 0;i < WHEEL_LVL;i ++ )
+            {
+                while ( wheel_lvl[level][i] )
+                {
+                    ev_timer *w = wheel_lvl[level][i];
+                    wheel_remove( w );
+                    w->active = heap_insert( w );
+                }
+            }
+        }
+        assert( "ev::set_timer_backend timer lost",cnt == timercnt );
+    }
+    else
+    {
+        ERROR( "ev::set_timer_backend unknow backend:%d",backend );
+    }
+
+    return timer_backend;
+}
+
 void ev::down_heap( ANHE *heap,int32 N,int32 k )
 {
     ANHE he = heap [k];
@@ -528,7 +673,8 @@ ev_tstamp ev::wait_time()
 
     if (timercnt) /* 如果有定时器，睡眠时间不超过定时器触发时间，以免sleep过头 */
     {
-        ev_tstamp to = (timers [HEAP0])->at - mn_now;
+        ev_tstamp to = TIMER_WHEEL == timer_backend
+            ? wheel_wait_time() : (timers [HEAP0])->at - mn_now;
         if (waittime > to) waittime = to;
     }
 
@@ -11,6 +11,20 @@
  *   这时需要调整事件大小，重新编译。
  */
 
+/*
+ * for io_uring(可选后端，需要内核5.11以上，见ev_uring.cpp)
+ * 1.每个fd用一个IORING_OP_POLL_ADD(oneshot)监听，触发后在处理完成事件时重新挂上，
+ *   效果等同epoll的LT模式
+ * 2.一轮主循环中所有fd的修改(poll add/remove)和等待只用一次io_uring_enter完成，而epoll
+ *   每次修改都需要一次epoll_ctl
+ * 3.同一个fd可能被关闭后又重用，poll请求的user_data包含fd和一个自增的generation，过期
+ *   的完成事件直接丢弃
+ * 4.只替换了epoll的监听，socket的recv、send仍是在回调里每个socket一次系统调用，
+ *   并且每个事件都要重新挂一次poll，活跃socket少时比epoll慢。
+ *   multishot poll(IORING_POLL_ADD_MULTI)是边缘触发，不能和IORING_POLL_ADD_LEVEL一起
+ *   用，而socket、accept的回调都按LT模式只读一次，因此仍是oneshot后重新挂上
+ */
+
 
 #ifndef __EV_H__
 #define __EV_H__
@@ -30,6 +44,7 @@ typedef struct
   ev_io *w;
   uint8 reify;  /* EPOLL_CTL_ADD、EPOLL_CTL_MOD、EPOLL_CTL_DEL */
   uint8 emask;  /* epoll event register in epoll */
+  uint32 egen;  /* io_uring poll generation */
 } ANFD;
 
 /* stores the pending event set for a given watcher */
@@ -43,16 +58,52 @@ typedef struct
 typedef ev_timer *ANHE;
 typedef int32 ANCHANGE;
 
+/* 时间轮，精度为1毫秒。第一层256个槽，后面4层每层64个槽，共可表示2^32毫秒 */
+#define WHEEL_NEAR_BITS 8
+#define WHEEL_LVL_BITS  6
+#define WHEEL_LEVEL     4
+#define WHEEL_NEAR      (1 << WHEEL_NEAR_BITS)
+#define WHEEL_LVL       (1 << WHEEL_LVL_BITS)
+#define WHEEL_NEAR_MASK (WHEEL_NEAR - 1)
+#define WHEEL_LVL_MASK  (WHEEL_LVL - 1)
+
 /* epoll does sometimes return early, this is just to avoid the worst */
 // TODO:尚不清楚这个机制(libev的 backend_mintime = 1e-3秒)，应该是要传个非0值
 #define EPOLL_MIN_TM 1
 
+struct ev_uring;
+
 class ev
 {
+public:
+    typedef enum
+    {
+        BACKEND_EPOLL = 1,
+        BACKEND_URING = 2
+    }backend_t;
+
+    /* 定时器实现：二叉堆，start、stop为O(logN)；时间轮，start、stop、触发都为O(1) */
+    typedef enum
+    {
+        TIMER_HEAP  = 1,
+        TIMER_WHEEL = 2
+    }timer_backend_t;
 public:
     ev();
     virtual ~ev();
 
+    /* 切换后端，已监听的fd会重新注册。内核不支持io_uring时仍使用epoll
+     * return: 实际使用的后端
+     */
+    int32 set_backend( int32 backend );
+    inline int32 get_backend() const { return backend_type; }
+
+    /* 切换定时器的实现，已启动的定时器会迁移过去
+     * return: 实际使用的实现
+     */
+    int32 set_timer_backend( int32 backend );
+    inline int32 get_timer_backend() const { return timer_backend; }
+
     int32 run();
     int32 quit();
     
@@ -84,9 +135,16 @@ protected:
     ANHE *timers;
     uint32 timermax;
     uint32 timercnt;
+
+    int32 timer_backend;
+    int64 wheel_tick; /* 时间轮当前已处理到的毫秒数(单调时钟) */
+    ev_timer *wheel_near[WHEEL_NEAR];
+    ev_timer *wheel_lvl[WHEEL_LEVEL][WHEEL_LVL];
     
     int32 backend_fd;
+    int32 backend_type;
     epoll_event epoll_events[EPOLL_MAXEV];
+    struct ev_uring *uring; /* io_uring后端的队列信息 */
     
     int64 ev_now_ms; // 主循环时间，毫秒
     ev_tstamp ev_rt_now;
@@ -99,9 +157,18 @@ protected:
     void fd_change( int32 fd );
     void fd_reify();
     void backend_init();
+    void backend_destroy();
     void backend_modify( int32 fd,int32 events,int32 reify );
     void time_update();
     void backend_poll( ev_tstamp timeout );
+
+    bool uring_init();
+    void uring_destroy();
+    void uring_modify( int32 fd,int32 events,int32 reify );
+    void uring_poll( ev_tstamp timeout );
+    void uring_poll_add( int32 fd,int32 events );
+    struct io_uring_sqe *uring_get_sqe();
+    int32 uring_enter( uint32 min_complete,ev_tstamp timeout );
     void fd_event( int32 fd,int32 revents );
     void feed_event( ev_watcher *w,int32 revents );
     void invoke_pending();
@@ -111,6 +178,18 @@ protected:
     void up_heap( ANHE *heap,int32 k );
     void adjust_heap( ANHE *heap,int32 N,int32 k );
     void reheap( ANHE *heap,int32 N );
+    int32 heap_insert( ev_timer *w );
+
+    inline int64 wheel_now() const
+    {
+        return static_cast<int64>( mn_now*1e3 );
+    }
+    ev_tstamp wheel_wait_time();
+    int32 wheel_add( ev_timer *w,bool cascade = false );
+    void wheel_remove( ev_timer *w );
+    void wheel_shift();
+    void wheel_reify();
+    void wheel_cascade( int32 level,int32 index );
 };
 
 #endif /* __EV_H__ */
@@ -0,0 +1,335 @@
+/*
+ * io_uring后端
+ * 1.不依赖liburing，直接用syscall操作，只用到了poll相关的功能
+ * 2.需要内核5.11以上(IORING_FEAT_EXT_ARG，io_uring_enter可以直接带超时)，不支持时
+ *   set_backend返回epoll
+ * 3.提交队列只在io_uring_enter时由内核读取(没有使用SQPOLL)，因此一轮循环中填充的所有
+ *   sqe和等待事件只需要一次系统调用
+ * 4.这只是一个监听就绪事件的后端，收发数据不经过io_uring。IORING_OP_RECV/SEND需要
+ *   缓冲区在完成前一直有效，而socket关闭、缓冲区扩容都不会等待内核，所以省掉的只是
+ *   epoll_ctl，不是recv/send
+ * 5.每个触发的事件都要重新挂一个POLL_ADD，虽然和等待在同一次io_uring_enter中提交，不增加
+ *   系统调用，但内核里每个事件多一次poll注册，而epoll LT不需要。1000对socket全部互相
+ *   收发时两者cpu耗时差不多，只有少量socket活跃时io_uring要慢10%~25%
+ *   (见example/ev_performance.lua)，因此默认仍用epoll
+ */
+
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #include <linux/io_uring.h>
+    #endif
+#endif
+
+#include "ev_def.h"
+#include "ev.h"
+#include "ev_watcher.h"
+
+#if defined(IORING_FEAT_EXT_ARG) && defined(__NR_io_uring_setup)
+    #define EV_USE_URING 1
+#endif
+
+#ifdef EV_USE_URING
+
+/* poll remove等不需要处理的完成事件 */
+#define URING_UD_NONE         0xFFFFFFFFFFFFFFFFULL
+#define URING_MAKE_UD(fd,gen) ((uint64(gen) << 32) | uint32(fd))
+
+struct ev_uring
+{
+    int32 fd;
+
+    /* 提交队列 */
+    uint32 *sq_head;
+    uint32 *sq_tail;
+    uint32 *sq_array;
+    uint32 sq_mask;
+    uint32 sq_entries;
+    struct io_uring_sqe *sqes;
+
+    /* 完成队列 */
+    uint32 *cq_head;
+    uint32 *cq_tail;
+    uint32 cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+};
+
+bool ev::uring_init()
+{
+    struct io_uring_params params;
+    memset( &params,0,sizeof(params) );
+
+    /* 完成队列大一些，避免大量fd同时触发时溢出 */
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_ENTRIES*4;
+
+    int32 fd = syscall( __NR_io_uring_setup,URING_ENTRIES,&params );
+    if ( fd < 0 ) return false;
+
+    /* 需要带超时的io_uring_enter，并且完成队列溢出时内核不能丢弃事件 */
+    if ( !(params.features & IORING_FEAT_EXT_ARG)
+        || !(params.features & IORING_FEAT_NODROP) )
+    {
+        ::close( fd );
+        return false;
+    }
+
+    uring = new ev_uring();
+    memset( uring,0,sizeof(struct ev_uring) );
+    uring->fd = fd;
+
+    uring->sq_ring_size =
+        params.sq_off.array + params.sq_entries*sizeof(uint32);
+    uring->cq_ring_size =
+        params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+    uring->sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if ( single_mmap )
+    {
+        uring->sq_ring_size = uring->cq_ring_size =
+            MATH_MAX( uring->sq_ring_size,uring->cq_ring_size );
+    }
+
+    void *sq_ring = mmap( NULL,uring->sq_ring_size,PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE,fd,IORING_OFF_SQ_RING );
+    if ( MAP_FAILED == sq_ring ) goto FAIL;
+    uring->sq_ring = sq_ring;
+
+    if ( single_mmap )
+    {
+        uring->cq_ring = sq_ring;
+    }
+    else
+    {
+        void *cq_ring = mmap( NULL,uring->cq_ring_size,PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE,fd,IORING_OFF_CQ_RING );
+        if ( MAP_FAILED == cq_ring ) goto FAIL;
+        uring->cq_ring = cq_ring;
+    }
+
+    {
+        void *sqes = mmap( NULL,uring->sqes_size,PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE,fd,IORING_OFF_SQES );
+        if ( MAP_FAILED == sqes ) goto FAIL;
+        uring->sqes = static_cast<struct io_uring_sqe *>( sqes );
+    }
+
+    {
+        char *sq = static_cast<char *>( uring->sq_ring );
+        uring->sq_head    = reinterpret_cast<uint32 *>(sq + params.sq_off.head);
+        uring->sq_tail    = reinterpret_cast<uint32 *>(sq + params.sq_off.tail);
+        uring->sq_array   = reinterpret_cast<uint32 *>(sq + params.sq_off.array);
+        uring->sq_mask    = *reinterpret_cast<uint32 *>(sq + params.sq_off.ring_mask);
+        uring->sq_entries =
+            *reinterpret_cast<uint32 *>(sq + params.sq_off.ring_entries);
+
+        char *cq = static_cast<char *>( uring->cq_ring );
+        uring->cq_head = reinterpret_cast<uint32 *>(cq + params.cq_off.head);
+        uring->cq_tail = reinterpret_cast<uint32 *>(cq + params.cq_off.tail);
+        uring->cq_mask = *reinterpret_cast<uint32 *>(cq + params.cq_off.ring_mask);
+        uring->cqes    =
+            reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+    }
+
+    if ( fcntl( fd,F_SETFD,FD_CLOEXEC ) < 0 ) goto FAIL;
+
+    backend_fd = fd;
+    return true;
+
+FAIL:
+    ERROR( "ev::uring_init fail:%s",strerror(errno) );
+    uring_destroy();
+    return false;
+}
+
+void ev::uring_destroy()
+{
+    if ( !uring ) return;
+
+    if ( uring->sqes ) munmap( uring->sqes,uring->sqes_size );
+    if ( uring->cq_ring && uring->cq_ring != uring->sq_ring )
+    {
+        munmap( uring->cq_ring,uring->cq_ring_size );
+    }
+    if ( uring->sq_ring ) munmap( uring->sq_ring,uring->sq_ring_size );
+
+    ::close( uring->fd );
+
+    delete uring;
+    uring = NULL;
+}
+
+/* 提交所有未提交的sqe，并且等待至少min_complete个完成事件
+ * @timeout: 等待时间，毫秒
+ */
+int32 ev::uring_enter( uint32 min_complete,ev_tstamp timeout )
+{
+    uint32 flags = 0;
+    void *argp = NULL;
+    size_t argsz = 0;
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    if ( min_complete > 0 )
+    {
+        int64 ns = static_cast<int64>( timeout*1e6 );
+        ts.tv_sec  = ns / 1000000000;
+        ts.tv_nsec = ns % 1000000000;
+
+        memset( &arg,0,sizeof(arg) );
+        arg.ts = reinterpret_cast<uint64>( &ts );
+
+        argp  = &arg;
+        argsz = sizeof(arg);
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    }
+
+    /* 没有使用SQPOLL，内核在这次调用中消费提交队列，未提交的数量就是tail - head */
+    uint32 to_submit = *uring->sq_tail
+        - __atomic_load_n( uring->sq_head,__ATOMIC_ACQUIRE );
+
+    return syscall( __NR_io_uring_enter,
+        uring->fd,to_submit,min_complete,flags,argp,argsz );
+}
+
+struct io_uring_sqe *ev::uring_get_sqe()
+{
+    uint32 tail = *uring->sq_tail;
+    uint32 head = __atomic_load_n( uring->sq_head,__ATOMIC_ACQUIRE );
+
+    /* 提交队列已满，先提交(不等待)再获取 */
+    if ( expect_false(tail - head >= uring->sq_entries) )
+    {
+        if ( uring_enter( 0,0 ) < 0 )
+        {
+            FATAL( "ev::uring_get_sqe submit errno(%d)",errno );
+        }
+        head = __atomic_load_n( uring->sq_head,__ATOMIC_ACQUIRE );
+        assert( "io_uring submit queue full",tail - head < uring->sq_entries );
+    }
+
+    uint32 index = tail & uring->sq_mask;
+    struct io_uring_sqe *sqe = uring->sqes + index;
+
+    memset( sqe,0,sizeof(*sqe) );
+    uring->sq_array[index] = index;
+    __atomic_store_n( uring->sq_tail,tail + 1,__ATOMIC_RELEASE );
+
+    return sqe;
+}
+
+void ev::uring_poll_add( int32 fd,int32 events )
+{
+    struct io_uring_sqe *sqe = uring_get_sqe();
+
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = fd;
+    sqe->poll32_events = (events & EV_READ  ? POLLIN  : 0)
+                       | (events & EV_WRITE ? POLLOUT : 0);
+    sqe->user_data     = URING_MAKE_UD( fd,anfds[fd].egen );
+}
+
+/* 与epoll不同，这里不需要区分ADD、MOD、DEL，都是删除旧的poll请求再挂一个新的
+ * 删除的请求只是放到提交队列，在下一次uring_enter时才会提交
+ */
+void ev::uring_modify( int32 fd,int32 events,int32 reify )
+{
+    ANFD *anfd = anfds + fd;
+
+    /* 旧的poll请求可能已触发而未重新挂上，这时删除会返回ENOENT，忽略即可 */
+    if ( anfd->emask )
+    {
+        struct io_uring_sqe *sqe = uring_get_sqe();
+
+        sqe->opcode    = IORING_OP_POLL_REMOVE;
+        sqe->fd        = -1;
+        sqe->addr      = URING_MAKE_UD( fd,anfd->egen );
+        sqe->user_data = URING_UD_NONE;
+    }
+
+    /* 之前的poll请求都作废了，即使它们的完成事件还在队列中 */
+    ++anfd->egen;
+
+    if ( events ) uring_poll_add( fd,events );
+}
+
+void ev::uring_poll( ev_tstamp timeout )
+{
+    if ( expect_false(uring_enter( 1,timeout ) < 0) )
+    {
+        /* ETIME为超时，EBUSY为完成队列溢出(内核暂存在溢出链表)，直接处理完成队列即可 */
+        if ( ETIME != errno && EINTR != errno && EBUSY != errno )
+        {
+            FATAL( "ev::uring_poll io_uring_enter errno(%d)",errno );
+            return;
+        }
+    }
+
+    uint32 head = *uring->cq_head;
+    uint32 tail = __atomic_load_n( uring->cq_tail,__ATOMIC_ACQUIRE );
+    for ( ;head != tail;++head )
+    {
+        const struct io_uring_cqe *cqe = uring->cqes + (head & uring->cq_mask);
+
+        uint64 ud = cqe->user_data;
+        if ( URING_UD_NONE == ud ) continue;
+
+        int32 fd = static_cast<int32>( ud & 0xFFFFFFFF );
+        uint32 gen = static_cast<uint32>( ud >> 32 );
+        if ( expect_false(uint32(fd) >= anfdmax) ) continue;
+
+        /* fd已修改了监听事件或者已关闭重用，这是一个过期的事件 */
+        ANFD *anfd = anfds + fd;
+        if ( gen != anfd->egen || !anfd->emask ) continue;
+
+        int32 got = 0;
+        int32 res = cqe->res;
+        if ( expect_false(res < 0) )
+        {
+            /* 和epoll LT一样，出错后回调仍会继续收到事件，因此要重新挂上。EBADF表示fd已
+             * 失效，挂上也只会立即再次出错，只能等回调停止该watcher
+             */
+            ERROR( "ev::uring_poll fd(%d) errno(%d)",fd,-res );
+            got = EV_READ | EV_WRITE;
+
+            if ( EBADF != -res ) uring_poll_add( fd,anfd->emask );
+        }
+        else
+        {
+            got = (res & (POLLOUT | POLLERR | POLLHUP) ? EV_WRITE : 0)
+                | (res & (POLLIN  | POLLERR | POLLHUP) ? EV_READ  : 0);
+
+            /* oneshot模式，重新挂上以实现epoll LT的效果 */
+            uring_poll_add( fd,anfd->emask );
+        }
+
+        got &= anfd->emask;
+        if ( got ) fd_event( fd,got );
+    }
+
+    __atomic_store_n( uring->cq_head,tail,__ATOMIC_RELEASE );
+}
+
+#else /* EV_USE_URING */
+
+/* 系统头文件太旧，不支持io_uring，只能使用epoll */
+bool ev::uring_init() { return false; }
+void ev::uring_destroy() {}
+int32 ev::uring_enter( uint32 min_complete,ev_tstamp timeout ) { return -1; }
+struct io_uring_sqe *ev::uring_get_sqe() { return NULL; }
+void ev::uring_poll_add( int32 fd,int32 events ) {}
+void ev::uring_modify( int32 fd,int32 events,int32 reify ) {}
+void ev::uring_poll( ev_tstamp timeout ) {}
+
+#endif /* EV_USE_URING */
@@ -159,6 +159,12 @@ public:
     ev_tstamp at;
     ev_tstamp repeat;
 
+    /* 使用时间轮时，同一个槽的定时器组成双向链表
+     * prev指向前一个定时器的next或者槽本身，删除时不需要知道在哪个槽
+     */
+    ev_timer *next;
+    ev_timer **prev;
+
 public:
     using ev_base<ev_timer>::set;
 
@@ -167,6 +173,9 @@ public:
     {
         at       = 0.;
         repeat   = 0.;
+
+        next     = NULL;
+        prev     = NULL;
     }
 
     ~ev_timer()
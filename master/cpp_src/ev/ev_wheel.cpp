@@ -0,0 +1,165 @@
+/*
+ * 时间轮(hashed hierarchical timing wheel)，参考linux内核及skynet的定时器
+ * 1.精度为1毫秒，wheel_tick为已处理到的单调时钟毫秒数
+ * 2.第一层256个槽，每个槽对应1毫秒。后面4层每层64个槽，第N层每个槽对应256*64^(N-1)毫秒
+ * 3.每当第一层走完一轮，把上层对应槽中的定时器重新分配到下层(cascade)
+ * 4.start、stop都是O(1)，每个定时器最多被cascade WHEEL_LEVEL次
+ * 5.超过2^32毫秒的定时器放到最后一层，cascade时会重新计算位置，不会延迟触发
+ */
+
+#include <cmath>
+
+#include "ev_def.h"
+#include "ev.h"
+#include "ev_watcher.h"
+
+/* 定时器到期的毫秒数，向上取整保证不会比堆实现提前触发
+ * at是浮点数，重复定时器每次加上repeat，刚好落在整毫秒上时误差可能让它比整毫秒
+ * 大一点点，直接向上取整就会晚1毫秒触发，下一次又早1毫秒，周期忽长忽短。因此先减去
+ * 1微秒再取整(单调时钟运行很久后浮点误差也远小于1微秒)，最多比堆实现早1微秒
+ */
+static inline int64 wheel_expire( ev_tstamp at )
+{
+    return static_cast<int64>( std::ceil( at*1e3 - 1e-3 ) );
+}
+
+/* 把定时器放到对应的槽
+ * @cascade:是否由wheel_shift调用。cascade时当前tick的槽还没处理，过期的定时器放到
+ *     当前槽，这一轮就触发。其他时候当前槽已经处理过了，只能放到下一个tick
+ */
+int32 ev::wheel_add( ev_timer *w,bool cascade )
+{
+    int64 tick = wheel_tick;
+    int64 expire = wheel_expire( w->at );
+
+    if ( expire <= tick ) expire = cascade ? tick : tick + 1;
+
+    ev_timer **slot = NULL;
+    if ( (expire | WHEEL_NEAR_MASK) == (tick | WHEEL_NEAR_MASK) )
+    {
+        slot = wheel_near + (expire & WHEEL_NEAR_MASK);
+    }
+    else
+    {
+        int32 level = 0;
+        int32 shift = WHEEL_NEAR_BITS;
+        int64 mask  = (int64(1) << (WHEEL_NEAR_BITS + WHEEL_LVL_BITS)) - 1;
+        while ( level < WHEEL_LEVEL - 1 && (expire | mask) != (tick | mask) )
+        {
+            ++level;
+            shift += WHEEL_LVL_BITS;
+            mask   = (mask << WHEEL_LVL_BITS) | WHEEL_LVL_MASK;
+        }
+
+        slot = wheel_lvl[level] + ((expire >> shift) & WHEEL_LVL_MASK);
+    }
+
+    w->next = *slot;
+    w->prev = slot;
+    if ( *slot ) (*slot)->prev = &w->next;
+    *slot = w;
+
+    return 1;
+}
+
+void ev::wheel_remove( ev_timer *w )
+{
+    assert( "ev::wheel_remove timer not in wheel",w->prev );
+
+    *(w->prev) = w->next;
+    if ( w->next ) w->next->prev = w->prev;
+
+    w->next = NULL;
+    w->prev = NULL;
+}
+
+/* 把上层一个槽中的定时器重新分配 */
+void ev::wheel_cascade( int32 level,int32 index )
+{
+    ev_timer *w = wheel_lvl[level][index];
+    wheel_lvl[level][index] = NULL;
+
+    while ( w )
+    {
+        ev_timer *next = w->next;
+
+        w->next = NULL;
+        w->prev = NULL;
+        wheel_add( w,true );
+
+        w = next;
+    }
+}
+
+/* 前进一个tick，如果第一层走完一轮则逐层cascade */
+void ev::wheel_shift()
+{
+    int64 tick = ++wheel_tick;
+
+    int32 shift = WHEEL_NEAR_BITS;
+    int64 mask  = WHEEL_NEAR - 1;
+    for ( int32 level = 0;level < WHEEL_LEVEL;level ++ )
+    {
+        if ( tick & mask ) break;
+
+        int32 index = static_cast<int32>( (tick >> shift) & WHEEL_LVL_MASK );
+        wheel_cascade( level,index );
+        if ( index ) break;
+
+        shift += WHEEL_LVL_BITS;
+        mask   = (mask << WHEEL_LVL_BITS) | WHEEL_LVL_MASK;
+    }
+}
+
+void ev::wheel_reify()
+{
+    int64 now = wheel_now();
+    while ( wheel_tick < now )
+    {
+        wheel_shift();
+
+        ev_timer **slot = wheel_near + (wheel_tick & WHEEL_NEAR_MASK);
+        while ( *slot )
+        {
+            ev_timer *w = *slot;
+
+            assert( "libev: invalid timer detected", w->is_active () );
+
+            /* first reschedule or stop timer */
+            if (w->repeat)
+            {
+                wheel_remove( w );
+
+                w->at += w->repeat;
+                if ( w->at < mn_now ) w->at = mn_now;
+
+                wheel_add( w );
+            }
+            else
+            {
+                w->stop(); /* nonrepeating: stop timer */
+            }
+
+            feed_event( w,EV_TIMER );
+        }
+    }
+}
+
+/* 距离下一个定时器触发的时间(秒)。只查找第一层，找不到则等到第一层这一轮结束 */
+ev_tstamp ev::wheel_wait_time()
+{
+    int64 base = wheel_tick & ~int64(WHEEL_NEAR_MASK);
+    int32 index = static_cast<int32>( wheel_tick & WHEEL_NEAR_MASK );
+
+    int64 expire = base + WHEEL_NEAR;
+    for ( int32 i = index + 1;i < WHEEL_NEAR;i ++ )
+    {
+        if ( wheel_near[i] )
+        {
+            expire = base + i;
+            break;
+        }
+    }
+
+    return expire*1e-3 - mn_now;
+}
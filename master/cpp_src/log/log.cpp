@@ -45,21 +45,18 @@ private:
     char _context[size];
 };
 
-log::log()
+log::log() : _cache( LOG_MAX_COUNT ),_free( LOG_MAX_COUNT )
 {
-    _cache = new log_one_list_t();
-    _flush = new log_one_list_t();
+    _flush_size.store( 0 );
 }
 
 log::~log()
 {
-    assert( "log not flush",_cache->empty() && _flush->empty() );
+    assert( "log not flush",
+        _cache.empty() && _flush.empty() && _overflow.empty() );
 
-    delete _cache;
-    delete _flush;
-
-    _cache = NULL;
-    _flush = NULL;
+    class log_one *one = NULL;
+    while ( _free.pop( one ) ) delete one;
 
     for ( int idx = 0;idx < LOG_SIZE_MAX;++idx )
     {
@@ -72,24 +69,39 @@ log::~log()
 }
 
 // 等待处理的日志数量
-size_t log::pending_size()
+size_t log::pending_size() const
+{
+    return _cache.size() + _overflow.size() + _flush_size.load();
+}
+
+// 缓存队列超过一半或者已经溢出，需要唤醒日志线程尽快写入，不用等到超时
+bool log::need_flush() const
+{
+    return !_overflow.empty() || _cache.size() >= _cache.capacity()/2;
+}
+
+// 把溢出的日志按顺序写入缓存队列
+void log::flush_overflow()
 {
-    return _cache->size() + _flush->size();
+    size_t idx = 0;
+    while ( idx < _overflow.size() && _cache.push( _overflow[idx] ) ) ++idx;
+
+    _overflow.erase( _overflow.begin(),_overflow.begin() + idx );
 }
 
-// 交换缓存和待写入队列
+// 从缓存队列取出主线程写入的日志，日志线程调用
 bool log::swap()
 {
-    if (!_flush->empty() ) return false;
+    if ( !_flush.empty() ) return false;
 
-    log_one_list_t *swap_tmp = _flush;
-    _flush = _cache;
-    _cache = swap_tmp;
+    class log_one *one = NULL;
+    while ( _cache.pop( one ) ) _flush.push_back( one );
 
+    _flush_size.store( _flush.size() );
     return true;
 }
 
-// 主线程写入缓存，上层加锁
+// 主线程写入缓存
 int32 log::write_cache( time_t tm,
     const char *path,const char *ctx,size_t len,log_out_t out )
 {
@@ -107,7 +119,12 @@ int32 log::write_cache( time_t tm,
     one->set_ctx( ctx,len );
     snprintf( one->_path,PATH_MAX,"%s",path );
 
-    _cache->push_back( one );
+    if ( expect_false( !_overflow.empty() ) ) flush_overflow();
+    if ( expect_false( !_overflow.empty() || !_cache.push( one ) ) )
+    {
+        _overflow.push_back( one );
+    }
+
     return 0;
 }
 
@@ -173,7 +190,7 @@ bool log::flush_one_file( log_one_list_t::iterator pos )
         }
 
         ++pos;
-    }while ( pos != _flush->end() );
+    }while ( pos != _flush.end() );
 
     fclose( pf );
     return true;
@@ -182,8 +199,8 @@ bool log::flush_one_file( log_one_list_t::iterator pos )
 // 日志线程写入文件
 void log::flush()
 {
-    log_one_list_t::iterator itr = _flush->begin();
-    for ( ;itr != _flush->end(); ++itr )
+    log_one_list_t::iterator itr = _flush.begin();
+    for ( ;itr != _flush.end(); ++itr )
     {
         log_one *one = *itr;
         if ( 0 == one->_len ) continue;
@@ -209,16 +226,24 @@ void log::flush()
     }
 }
 
-// 回收内存到内存池，上层加锁
+// 日志线程把写完的内存归还给主线程，队列满了直接释放
 void log::collect_mem()
 {
-    log_one_list_t::iterator itr = _flush->begin();
-    for ( ;itr != _flush->end(); ++itr )
+    log_one_list_t::iterator itr = _flush.begin();
+    for ( ;itr != _flush.end(); ++itr )
     {
-        deallocate_one( *itr );
+        if ( !_free.push( *itr ) ) delete *itr;
     }
 
-    _flush->clear();
+    _flush.clear();
+    _flush_size.store( 0 );
+}
+
+// 主线程回收日志线程归还的内存到内存池
+void log::collect_free()
+{
+    class log_one *one = NULL;
+    while ( _free.pop( one ) ) deallocate_one( one );
 }
 
 // 内存池分配逻辑
@@ -260,6 +285,7 @@ class log_one *log::allocate_one( size_t len )
         if ( len <= LOG_SIZE[lt] )
         {
             log_one_list_t *pool = &(_mem_pool[lt]);
+            if ( expect_false(pool->empty()) ) collect_free();
             if ( expect_false(pool->empty()) )
             {
                 allocate_pool( static_cast<log_size_t>(lt) );
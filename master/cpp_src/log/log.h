@@ -2,9 +2,11 @@
 #define __LOG_H__
 
 #include <map>
+#include <atomic>
 #include <vector>
 
 #include "../global/global.h"
+#include "../thread/spsc_queue.h"
 
 class log_one;
 
@@ -37,22 +39,34 @@ public:
     log();
     ~log();
 
+    /* 日志线程调用 */
     bool swap();
     void flush();
     void collect_mem();
-    size_t pending_size();
+
+    /* 主线程调用 */
+    bool need_flush() const;
+    void flush_overflow();
+    size_t pending_size() const;
     int32 write_cache( time_t tm,
         const char *path,const char *ctx,size_t len,log_out_t out );
 private:
+    void collect_free();
     void allocate_pool( log_size_t lt );
     class log_one *allocate_one( size_t len );
     void deallocate_one( class log_one *one );
     bool flush_one_file( log_one_list_t::iterator pos );
     int32 flush_one_ctx( FILE *pf,const struct log_one *one );
 private:
-    log_one_list_t *_cache;   // 主线程写入缓存队列
-    log_one_list_t *_flush;   // 日志线程写入文件队列
-    log_one_list_t _mem_pool[LOG_SIZE_MAX];  // 内存池，防止内存频繁分配
+    /* 主线程和日志线程之间用无锁队列，不再加锁 */
+    spsc_queue<class log_one *> _cache; // 主线程写入缓存队列
+    spsc_queue<class log_one *> _free ; // 日志线程写完后归还给主线程的内存
+
+    log_one_list_t _overflow; // 缓存队列满时主线程的溢出队列
+    log_one_list_t _flush;    // 日志线程写入文件队列
+    std::atomic<uint32> _flush_size; // 日志线程待写入的数量，主线程统计用
+
+    log_one_list_t _mem_pool[LOG_SIZE_MAX];  // 内存池，只在主线程访问
 
     /* 日志分配内存大小*/
     static const size_t LOG_SIZE[LOG_SIZE_MAX];
@@ -9,13 +9,23 @@ thread_log::~thread_log()
 {
 }
 
+/* 子线程退出后，主线程溢出队列中的日志由主线程直接写入 */
+void thread_log::stop()
+{
+    thread::stop();
+
+    while ( _log.pending_size() > 0 )
+    {
+        _log.flush_overflow();
+        routine( NTF_NONE );
+    }
+}
+
 size_t thread_log::busy_job( size_t *finished,size_t *unfinished )
 {
-    lock();
     size_t unfinished_sz = _log.pending_size();
 
     if ( is_busy() ) unfinished_sz += 1;
-    unlock();
 
     if ( finished ) *finished = 0;
     if ( unfinished ) *unfinished = unfinished_sz;
@@ -29,9 +39,13 @@ void thread_log::write(
     static class ev *ev = static_global::ev();
 
     /* 时间必须取主循环的帧，不能取即时的时间戳 */
-    lock();
     _log.write_cache( ev->now(),path,ctx,len,out_type );
-    unlock();
+
+    /* 平时由日志线程定时写入，缓存太多时才唤醒，通知是合并的 */
+    if ( expect_false( _log.need_flush() ) && active() )
+    {
+        notify_child( NTF_CUSTOM );
+    }
 }
 
 void thread_log::raw_write( 
@@ -72,16 +86,12 @@ void thread_log::routine( notify_t notify )
 {
     UNUSED( notify );
 
-    /* 把主线程缓存的数据交换到日志线程，尽量减少锁竞争 */
-    lock();
+    /* 从无锁队列取出主线程缓存的日志 */
     _log.swap();
-    unlock();
 
     // 日志线程写入文件
     _log.flush();
 
-    // 回收内存
-    lock();
+    // 回收内存，归还给主线程
     _log.collect_mem();
-    unlock();
 }
@@ -11,6 +11,7 @@ public:
     thread_log();
     ~thread_log();
 
+    void stop();
     size_t busy_job( size_t *finished = NULL,size_t *unfinished = NULL );
     void raw_write( const char *path,log_out_t out,const char *fmt,... );
     void write(const char *path,const char *ctx,size_t len,log_out_t out_type);
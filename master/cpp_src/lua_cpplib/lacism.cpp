@@ -2,39 +2,144 @@
 #include <sys/stat.h>
 
 #include "lacism.h"
+#include "ltools.h"
+#include "../system/static_global.h"
 
-lacism::lacism( lua_State *L )
+////////////////////////////////////////////////////////////////////////////////
+acism_loader::acism_loader( class lacism *owner ) : thread( "acism_loader" )
 {
-    _psp   = NULL;
-    _pattv = NULL;
-    _loaded  = 0;
+    _owner = owner;
+
+    _seq = 0;
+    _done_seq = 0;
+    _build_seq = 0;
+
     _case_sensitive = 1;
+    _request_seq = 0;
 
-    _patt.ptr = NULL;
-    _patt.len = 0;
+    _dict = NULL;
+    _dict_seq = 0;
+    _ecode = 0;
+}
 
-    memset( &_memrpl,0,sizeof(MEMRPL) );
+acism_loader::~acism_loader()
+{
+    /* 线程已停止，构建好但没来得及替换的直接释放 */
+    if ( _dict ) lacism::free_dict( _dict );
+    _dict = NULL;
 }
 
-lacism::~lacism()
+size_t acism_loader::busy_job( size_t *finished,size_t *unfinished )
 {
-    if ( _patt.ptr )
+    lock();
+    size_t finished_sz = _dict_seq > _done_seq ? 1 : 0;
+    size_t unfinished_sz = _request_seq > _dict_seq ? 1 : 0;
+    unlock();
+
+    if ( finished ) *finished = finished_sz;
+    if ( unfinished ) *unfinished = unfinished_sz;
+
+    return finished_sz + unfinished_sz;
+}
+
+/* 请求加载，上一次的还没构建完时只保留最后一次请求 */
+void acism_loader::load( const char *path,int32 case_sensitive )
+{
+    lock();
+    _path = path;
+    _case_sensitive = case_sensitive;
+    _request_seq = ++_seq;
+    unlock();
+
+    notify_child( NTF_CUSTOM );
+}
+
+void acism_loader::routine( notify_t notify )
+{
+    if ( NTF_CUSTOM != notify ) return;
+
+    lock();
+    std::string path = _path;
+    int32 case_sensitive = _case_sensitive;
+    int32 seq = _request_seq;
+    unlock();
+
+    if ( seq == _build_seq ) return;
+    _build_seq = seq;
+
+    int32 ecode = 0;
+    struct acism_dict *dict = lacism::load_dict(
+        path.c_str(),case_sensitive,ecode );
+
+    lock();
+    if ( _dict ) lacism::free_dict( _dict );
+    _dict = dict;
+    _dict_seq = seq;
+    _dict_path = path;
+    _ecode = ecode;
+    unlock();
+
+    notify_parent( NTF_CUSTOM );
+}
+
+void acism_loader::notification( notify_t notify )
+{
+    if ( NTF_CUSTOM == notify )
     {
-        delete []_patt.ptr;
-        _patt.ptr = NULL;
-        _patt.len = 0;
+        lock();
+        struct acism_dict *dict = _dict;
+        int32 seq = _dict_seq;
+        int32 ecode = _ecode;
+        std::string path = _dict_path;
+        _dict = NULL;
+        unlock();
+
+        if ( seq <= _done_seq ) return;
+        _done_seq = seq;
+
+        if ( !dict )
+        {
+            ERROR( "acism load file[%s] fail:%s",path.c_str(),strerror(ecode) );
+            return;
+        }
+        _owner->swap_dict( dict );
     }
+    else if ( NTF_ERROR == notify )
+    {
+        ERROR( "acism loader thread error:%s",get_name() );
+    }
+    else
+    {
+        assert( "unknow acism loader event",false );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+lacism::lacism( lua_State *L )
+{
+    _dict    = NULL;
+    _loader  = NULL;
+    _loaded  = 0;
+
+    memset( &_memrpl,0,sizeof(MEMRPL) );
+    memset( _arena,0,sizeof(_arena) );
+}
 
-    if ( _pattv )
+lacism::~lacism()
+{
+    /* 进程退出时线程已经被thread_mgr停止了 */
+    if ( _loader )
     {
-        delete []_pattv;
-        _pattv = NULL;
+        if ( _loader->active() ) _loader->stop();
+
+        delete _loader;
+        _loader = NULL;
     }
 
-    if ( _psp )
+    if ( _dict )
     {
-        acism_destroy(_psp);
-        _psp = NULL;
+        free_dict( _dict );
+        _dict = NULL;
     }
 
     if ( _memrpl.rpl_text )
@@ -42,6 +147,12 @@ lacism::~lacism()
         delete []_memrpl.rpl_text;
         _memrpl.rpl_text = NULL;
     }
+
+    for ( int32 idx = 0;idx < ACISM_THREAD_MAX;idx ++ )
+    {
+        delete []_arena[idx].rpl_text;
+        _arena[idx].rpl_text = NULL;
+    }
 }
 
 /* 返回0,继续搜索
@@ -58,35 +169,73 @@ int32 lacism::on_replace( int32 strnum,int32 textpos,void *context )
 {
     assert( "acism on_replace NULL context",context );
 
-    class lacism *acism = static_cast<class lacism *>(context);
-    return acism->do_replace( strnum,textpos );
+    return do_replace( static_cast<MEMRPL *>(context),strnum,textpos );
 }
 
-int32 lacism::do_replace( int32 strnum,int32 textpos )
+int32 lacism::do_replace( MEMRPL *rpl,int32 strnum,int32 textpos )
 {
-    assert( "acism do_replace buffer error",(size_t)textpos > _memrpl.text_pos );
+    assert( "acism do_replace buffer error",(size_t)textpos > rpl->text_pos );
 
-    size_t pattv_len = _pattv[strnum].len;
-    size_t str_len = textpos - pattv_len - _memrpl.text_pos;
-    size_t mem_len = str_len + _memrpl.word_len + _memrpl.rpl_len;
+    size_t pattv_len = rpl->pattv[strnum].len;
+    size_t str_len = textpos - pattv_len - rpl->text_pos;
+    size_t mem_len = str_len + rpl->word_len + rpl->rpl_len;
 
     /* 必须是<=，防止mem_len为0的情况 */
-    if (  _memrpl.rpl_size <= mem_len ) _memrpl.reserved( mem_len );
+    if (  rpl->rpl_size <= mem_len ) rpl->reserved( mem_len );
 
-    assert( "acism do_replace buffer overflow",_memrpl.rpl_size >= mem_len );
+    assert( "acism do_replace buffer overflow",rpl->rpl_size >= mem_len );
 
-    memcpy( _memrpl.rpl_text + _memrpl.rpl_len,
-        _memrpl.text + _memrpl.text_pos,str_len);
-    _memrpl.rpl_len += str_len;
+    memcpy( rpl->rpl_text + rpl->rpl_len,rpl->text + rpl->text_pos,str_len);
+    rpl->rpl_len += str_len;
 
-    memcpy( _memrpl.rpl_text + _memrpl.rpl_len,_memrpl.word,_memrpl.word_len );
-    _memrpl.rpl_len += _memrpl.word_len;
+    memcpy( rpl->rpl_text + rpl->rpl_len,rpl->word,rpl->word_len );
+    rpl->rpl_len += rpl->word_len;
 
-    _memrpl.text_pos = textpos;
+    rpl->text_pos = textpos;
 
     return 0; /* continue replace */
 }
 
+/* 替换后的字符串追加到rpl->rpl_text，没有关键字时res._pos为0，不写入 */
+void lacism::replace_text( const struct acism_dict *dict,
+    MEMRPL *rpl,const MEMREF &text,struct acism_result &res )
+{
+    size_t offset = rpl->rpl_len;
+
+    rpl->text     = text.ptr;
+    rpl->text_pos = 0;
+    rpl->pattv    = dict->_pattv;
+
+    (void)acism_scan( dict->_psp, text,
+        (ACISM_ACTION*)lacism::on_replace, rpl, dict->_case_sensitive );
+
+    if ( 0 == rpl->text_pos )
+    {
+        res._pos = 0;
+        return;
+    }
+
+    if ( rpl->text_pos < text.len )
+    {
+        size_t str_len = text.len - rpl->text_pos;
+        size_t mem_len = rpl->rpl_len + str_len;
+        if ( rpl->rpl_size <= mem_len )
+        {
+            rpl->reserved( mem_len );
+        }
+
+        memcpy( rpl->rpl_text + rpl->rpl_len,rpl->text + rpl->text_pos,
+            str_len );
+
+        rpl->text_pos = text.len;
+        rpl->rpl_len += str_len;
+    }
+
+    res._pos    = 1;
+    res._offset = offset;
+    res._len    = rpl->rpl_len - offset;
+}
+
 /* 扫描关键字,扫描到其中一个即中止 */
 int32 lacism::scan( lua_State *L )
 {
@@ -96,7 +245,7 @@ int32 lacism::scan( lua_State *L )
     }
 
     /* no worlds loaded */
-    if ( !_pattv || !_psp )
+    if ( !_dict || !_dict->_psp )
     {
         lua_pushinteger( L,0 );
         return 1;
@@ -107,8 +256,8 @@ int32 lacism::scan( lua_State *L )
 
     MEMREF text   = {str, len};
 
-    int32 textpos = acism_scan( _psp, text,
-        (ACISM_ACTION*)lacism::on_match, _pattv,_case_sensitive );
+    int32 textpos = acism_scan( _dict->_psp, text,
+        (ACISM_ACTION*)lacism::on_match, _dict->_pattv,_dict->_case_sensitive );
 
     lua_pushinteger( L,textpos );
     return 1;
@@ -128,46 +277,202 @@ int32 lacism::replace( lua_State *L )
     _memrpl.word = luaL_checklstring( L,2,&(_memrpl.word_len) );
 
     /* no worlds loaded */
-    if ( !_pattv || !_psp )
+    if ( !_dict || !_dict->_psp )
     {
         lua_pushvalue( L,1 );
         return 1;
     }
 
-    _memrpl.text     = text.ptr;
-    _memrpl.rpl_len  = 0;
-    _memrpl.text_pos = 0;
-
-    (void)acism_scan( _psp, text,
-        (ACISM_ACTION*)lacism::on_replace, this, _case_sensitive );
+    struct acism_result res;
 
-    if ( 0 == _memrpl.rpl_len )
+    _memrpl.rpl_len = 0;
+    replace_text( _dict,&_memrpl,text,res );
+    if ( 0 == res._pos )
     {
         lua_pushvalue( L,1 );
         return 1;
     }
 
-    if ( _memrpl.text_pos < text.len )
+    lua_pushlstring( L,_memrpl.rpl_text + res._offset,res._len );
+
+    return 1;
+}
+
+struct acism_task
+{
+    const struct acism_dict *dict;
+    const MEMREF *text;
+    struct acism_result *result;
+    size_t count;
+    MEMRPL *arena;  /* 为NULL表示只扫描 */
+};
+
+static void acism_routine( int32 index,void *arg )
+{
+    struct acism_task *task = static_cast<struct acism_task *>( arg ) + index;
+    const struct acism_dict *dict = task->dict;
+
+    for ( size_t idx = 0;idx < task->count;idx ++ )
     {
-        size_t str_len = text.len - _memrpl.text_pos;
-        size_t mem_len = _memrpl.rpl_len + str_len;
-        if ( _memrpl.rpl_size <= mem_len )
+        struct acism_result &res = task->result[idx];
+        if ( !task->arena )
         {
-            _memrpl.reserved( mem_len );
+            res._pos = acism_scan( dict->_psp, task->text[idx],
+                (ACISM_ACTION*)lacism::on_match,
+                dict->_pattv,dict->_case_sensitive );
+            continue;
         }
 
-        memcpy( _memrpl.rpl_text + _memrpl.rpl_len,_memrpl.text + _memrpl.text_pos,
-            str_len );
+        res._arena = index;
+        lacism::replace_text( dict,task->arena,task->text[idx],res );
+    }
+}
+
+/* 检查批量过滤的参数，把字符串取到_text中，返回字符串数量
+ * 字符串在参数的table中引用着，过滤完成前不会被gc
+ */
+int32 lacism::check_list( lua_State *L,int32 thread_cnt )
+{
+    if ( !_loaded )
+    {
+        return luaL_error( L,"no pattern load yet" );
+    }
+
+    lUAL_CHECKTABLE( L,1 );
+    if ( thread_cnt <= 0 || thread_cnt > ACISM_THREAD_MAX )
+    {
+        return luaL_error( L,"acism thread count illegal:%d",thread_cnt );
+    }
+
+    int32 count = static_cast<int32>( lua_rawlen( L,1 ) );
+
+    _text.resize( count );
+    _result.resize( count );
+    for ( int32 idx = 0;idx < count;idx ++ )
+    {
+        lua_rawgeti( L,1,idx + 1 );
+
+        /* 数字转换成的字符串不在table中，出栈后可能被gc，因此只接受字符串 */
+        if ( LUA_TSTRING != lua_type( L,-1 ) )
+        {
+            return luaL_error( L,"acism list expect string at %d",idx + 1 );
+        }
+
+        MEMREF &text = _text[idx];
+        text.ptr = lua_tolstring( L,-1,&(text.len) );
+        lua_pop( L,1 );
+    }
+
+    return count;
+}
 
-        _memrpl.text_pos = text.len;
-        _memrpl.rpl_len += str_len;
+/* 过滤_text中的字符串，结果在_result
+ * @word:替换的字符串，为NULL表示只扫描
+ * @thread_cnt:最多使用的线程数，字符串少时不开线程
+ */
+void lacism::filter_list( const char *word,size_t word_len,int32 thread_cnt )
+{
+    size_t count = _text.size();
+
+    int32 chunk_cnt = task_pool::split( count,ACISM_THREAD_CHUNK,thread_cnt );
+
+    // 平均分成chunk_cnt段，交给线程池并行处理，每段用各自的替换缓冲区
+    struct acism_task task[ACISM_THREAD_MAX];
+    for ( int32 idx = 0;idx < chunk_cnt;idx ++ )
+    {
+        size_t begin = count * idx / chunk_cnt;
+        size_t end   = count * ( idx + 1 ) / chunk_cnt;
+
+        task[idx].dict      = _dict;
+        task[idx].text      = &_text[0] + begin;
+        task[idx].result    = &_result[0] + begin;
+        task[idx].count     = end - begin;
+        task[idx].arena     = NULL;
+        if ( word )
+        {
+            MEMRPL &arena  = _arena[idx];
+            arena.rpl_len  = 0;
+            arena.word     = word;
+            arena.word_len = word_len;
+
+            task[idx].arena = &arena;
+        }
     }
 
-    lua_pushlstring( L,_memrpl.rpl_text,_memrpl.rpl_len );
+    static_global::task_pool()->run( acism_routine,task,chunk_cnt );
+}
+
+/* 批量扫描关键字
+ * @list:字符串数组
+ * @result:结果table，result[i]为list[i]扫描到关键字的位置，0表示没有
+ * @thread_cnt:最多使用的线程数，默认1
+ * 返回字符串数量。result是复用的，不会清除多余的元素
+ */
+int32 lacism::scan_list( lua_State *L )
+{
+    lUAL_CHECKTABLE( L,2 );
+    int32 thread_cnt = luaL_optinteger( L,3,1 );
 
+    int32 count = check_list( L,thread_cnt );
+    bool has_dict = _dict && _dict->_psp;
+    if ( count > 0 && has_dict )
+    {
+        filter_list( NULL,0,thread_cnt );
+    }
+
+    for ( int32 idx = 0;idx < count;idx ++ )
+    {
+        lua_pushinteger( L,has_dict ? _result[idx]._pos : 0 );
+        lua_rawseti( L,2,idx + 1 );
+    }
+
+    lua_pushinteger( L,count );
     return 1;
 }
 
+/* 批量替换关键字
+ * @list:字符串数组
+ * @word:替换为此字符串
+ * @result:结果table，result[i]为list[i]替换后的字符串
+ * @thread_cnt:最多使用的线程数，默认1
+ * 返回字符串数量。result是复用的，不会清除多余的元素
+ * 替换后的字符串写到每个线程各自的缓冲区，缓冲区在多次调用之间复用
+ */
+int32 lacism::replace_list( lua_State *L )
+{
+    size_t word_len = 0;
+    const char *word = luaL_checklstring( L,2,&word_len );
+
+    lUAL_CHECKTABLE( L,3 );
+    int32 thread_cnt = luaL_optinteger( L,4,1 );
+
+    int32 count = check_list( L,thread_cnt );
+    bool has_dict = _dict && _dict->_psp;
+    if ( count > 0 && has_dict )
+    {
+        filter_list( word,word_len,thread_cnt );
+    }
+
+    for ( int32 idx = 0;idx < count;idx ++ )
+    {
+        const struct acism_result &res = _result[idx];
+        if ( !has_dict || 0 == res._pos )
+        {
+            lua_rawgeti( L,1,idx + 1 );
+        }
+        else
+        {
+            const MEMRPL &arena = _arena[res._arena];
+            lua_pushlstring( L,arena.rpl_text + res._offset,res._len );
+        }
+        lua_rawseti( L,3,idx + 1 );
+    }
+
+    lua_pushinteger( L,count );
+    return 1;
+}
+
+/* 同步加载关键字，关键字多时会阻塞主线程，热更用load_async */
 int32 lacism::load_from_file( lua_State *L )
 {
     const char *path = luaL_checkstring( L,1 );
@@ -178,42 +483,136 @@ int32 lacism::load_from_file( lua_State *L )
         case_sensitive = lua_toboolean( L,2 );
     }
 
-    if ( this->acism_slurp( path ) )
+    int32 ecode = 0;
+    struct acism_dict *dict = load_dict( path,case_sensitive,ecode );
+    if ( !dict )
     {
-        return luaL_error( L,"can't read file[%s]:",path,strerror(errno) );
+        return luaL_error( L,"can't read file[%s]:%s",path,strerror(ecode) );
     }
 
+    swap_dict( dict );
+
+    lua_pushinteger( L,dict->_npatts );
+    return 1;
+}
+
+/* 在子线程加载关键字，完成后自动替换，加载完成前仍使用旧的关键字
+ * 加载失败只打印错误日志，旧的关键字不受影响
+ */
+int32 lacism::load_async( lua_State *L )
+{
+    const char *path = luaL_checkstring( L,1 );
+    int32 case_sensitive = 1;
+
+    if ( lua_isboolean( L,2 ) )
+    {
+        case_sensitive = lua_toboolean( L,2 );
+    }
+
+    if ( !_loader ) _loader = new acism_loader( this );
+    if ( !_loader->active() && !_loader->start() )
+    {
+        return luaL_error( L,"acism loader thread start fail" );
+    }
+
+    _loader->load( path,case_sensitive );
+    return 0;
+}
+
+/* 是否有异步加载未完成 */
+int32 lacism::is_loading( lua_State *L )
+{
+    lua_pushboolean( L,_loader && _loader->is_loading() );
+    return 1;
+}
+
+void lacism::swap_dict( struct acism_dict *dict )
+{
+    /* 只在主线程替换，扫描也都在主线程发起，替换时不会有其他线程在使用旧的 */
+    if ( _dict ) free_dict( _dict );
+
+    _dict = dict;
     _loaded = 1;/* mark file loaded */
+}
+
+/* 加载关键字并构建自动机，可以在子线程调用。出错返回NULL，错误码在ecode */
+struct acism_dict *lacism::load_dict(
+    const char *path,int32 case_sensitive,int32 &ecode )
+{
+    struct acism_dict *dict = new struct acism_dict();
+
+    dict->_patt.ptr = NULL;
+    dict->_patt.len = 0;
+    dict->_pattv    = NULL;
+    dict->_psp      = NULL;
+    dict->_npatts   = 0;
+    dict->_case_sensitive = case_sensitive;
+
+    ecode = acism_slurp( dict->_patt,path );
+    if ( ecode )
+    {
+        free_dict( dict );
+        return NULL;
+    }
+
+    MEMBUF &patt = dict->_patt;
     if ( !case_sensitive )
     {
-        for ( size_t i = 0;i < _patt.len;i ++ )
+        for ( size_t i = 0;i < patt.len;i ++ )
         {
-            *(_patt.ptr + i) = ::tolower( *(_patt.ptr + i) );
+            *(patt.ptr + i) = ::tolower( *(patt.ptr + i) );
         }
     }
 
-    int32 npatts = 0;
-    if ( _patt.ptr )
+    if ( patt.ptr )
     {
-        _pattv = this->acism_refsplit( _patt.ptr, '\n', &npatts );
-        _psp = acism_create( _pattv, npatts );
+        dict->_pattv = acism_refsplit( patt.ptr, '\n', &(dict->_npatts) );
+        dict->_psp = acism_create( dict->_pattv, dict->_npatts );
     }
-    _case_sensitive = case_sensitive;
 
-    lua_pushinteger( L,npatts );
-    return 1;
+    return dict;
+}
+
+void lacism::free_dict( struct acism_dict *dict )
+{
+    if ( dict->_patt.ptr )
+    {
+        delete []dict->_patt.ptr;
+        dict->_patt.ptr = NULL;
+        dict->_patt.len = 0;
+    }
+
+    if ( dict->_pattv )
+    {
+        delete [](char *)dict->_pattv;
+        dict->_pattv = NULL;
+    }
+
+    if ( dict->_psp )
+    {
+        acism_destroy( dict->_psp );
+        dict->_psp = NULL;
+    }
+
+    delete dict;
 }
 
-int32 lacism::acism_slurp( const char *path )
+int32 lacism::acism_slurp( MEMBUF &patt,const char *path )
 {
     int32 fd = ::open( path, O_RDONLY );
     if ( fd < 0 ) return errno;
 
     struct stat s;
-    if ( fstat(fd, &s) || !S_ISREG(s.st_mode) )
+    if ( fstat(fd, &s) )
     {
+        int32 ecode = errno;
         ::close( fd );
-        return errno;
+        return ecode;
+    }
+    if ( !S_ISREG(s.st_mode) )
+    {
+        ::close( fd );
+        return EINVAL;
     }
 
     /* empty file,do nothing */
@@ -226,22 +625,26 @@ int32 lacism::acism_slurp( const char *path )
     /* In a 32-bit implementation, ACISM can handle about 10MB of pattern text.
      * Aho-Corasick-Interleaved_State_Matrix.pdf
      */
+    if ( s.st_size >= 1024*1024*10 )
+    {
+        ::close( fd );
+        return EFBIG;
+    }
 
-    assert( "filter worlds file too large",s.st_size < 1024*1024*10 );
-
-    assert( "patt.ptr not free",!_patt.ptr ); /* code hot fix ? */
+    assert( "patt.ptr not free",!patt.ptr );
 
-    _patt.ptr = new char[s.st_size+1];
-    _patt.len = s.st_size;
+    patt.ptr = new char[s.st_size+1];
+    patt.len = s.st_size;
 
-    if ( _patt.len != (unsigned)read(fd, _patt.ptr, _patt.len) )
+    if ( patt.len != (unsigned)read(fd, patt.ptr, patt.len) )
     {
+        int32 ecode = errno ? errno : EIO;
         ::close( fd );
-        return errno;
+        return ecode;
     }
 
     ::close(fd);
-    _patt.ptr[_patt.len] = 0;
+    patt.ptr[patt.len] = 0;
 
     return  0;
 }
@@ -25,7 +25,10 @@ extern "C" {
 #endif
 
 
+#include <string>
+#include <vector>
 #include "../global/global.h"
+#include "../thread/thread.h"
 
 typedef struct { char *ptr; size_t len; }	MEMBUF;
 typedef struct
@@ -37,6 +40,7 @@ typedef struct
     char *rpl_text;                         /* 替换后的字符串 */
     const char *word;                       /* 替换为此字符串 */
     const char *text;                       /* 原字符串 */
+    MEMREF const *pattv;                    /* 关键字列表 */
 
     void reserved( size_t bytes )
     {
@@ -57,6 +61,66 @@ typedef struct
     }
 } MEMRPL;
 
+/* 一份关键字及其自动机，构建完成后只读，多个线程可以同时扫描 */
+struct acism_dict
+{
+    MEMBUF _patt;
+    MEMREF *_pattv;
+    ACISM *_psp;
+    int32 _npatts;
+    int32 _case_sensitive;
+};
+
+/* 批量过滤时每个字符串的结果 */
+struct acism_result
+{
+    int32 _pos;     /* scan为匹配到的位置，replace为非0表示有替换，0表示没有 */
+    int32 _arena;   /* 替换后的字符串在哪个缓冲区 */
+    size_t _offset; /* 替换后的字符串在缓冲区中的位置 */
+    size_t _len;
+};
+
+class lacism;
+
+/* 关键字加载线程
+ * 关键字多的时候构建自动机要几百毫秒，热更时放到子线程构建，完成后在主线程
+ * 替换，替换前仍使用旧的关键字
+ */
+class acism_loader : public thread
+{
+public:
+    explicit acism_loader( class lacism *owner );
+    ~acism_loader();
+
+    /* 以下函数只能在主线程调用 */
+    void load( const char *path,int32 case_sensitive );
+    bool is_loading() const { return _done_seq != _seq; }
+
+    size_t busy_job( size_t *finished = NULL,size_t *unfinished = NULL );
+private:
+    bool uninitialize() { return true; }
+    bool initialize() { return true; }
+
+    void routine( notify_t notify );
+    void notification( notify_t notify );
+private:
+    class lacism *_owner;
+    int32 _seq;      /* 请求序号，只在主线程访问 */
+    int32 _done_seq; /* 主线程已处理的序号 */
+    int32 _build_seq;/* 子线程已构建的序号，只在子线程访问 */
+
+    /* 以下变量主线程、子线程都会访问，需要加锁 */
+    std::string _path;
+    int32 _case_sensitive;
+    int32 _request_seq;
+
+    /* 构建结果，主线程取走前有新的结果则丢弃旧的 */
+    std::string _dict_path;
+    struct acism_dict *_dict;
+    int32 _dict_seq;
+    int32 _ecode;
+};
+
 class lacism
 {
 public:
@@ -66,11 +130,26 @@ public:
     int32 scan( lua_State *L );
     int32 replace( lua_State *L );
     int32 load_from_file( lua_State *L );
+    int32 load_async( lua_State *L );
+    int32 is_loading( lua_State *L );
 
-    int32 do_replace( int32 strnum,int32 textpos );
+    /* 批量过滤，一次调用处理一个数组的字符串 */
+    int32 scan_list( lua_State *L );
+    int32 replace_list( lua_State *L );
+
+    /* 替换关键字，旧的释放 */
+    void swap_dict( struct acism_dict *dict );
+
+    static struct acism_dict *load_dict(
+        const char *path,int32 case_sensitive,int32 &ecode );
+    static void free_dict( struct acism_dict *dict );
 
     static int32 on_match( int32 strnum, int32 textpos, MEMREF const *pattv );
     static int32 on_replace( int32 strnum,int32 textpos,void *context );
+    static int32 do_replace( MEMRPL *rpl,int32 strnum,int32 textpos );
+    /* 替换text中的关键字，结果追加到rpl中 */
+    static void replace_text( const struct acism_dict *dict,
+        MEMRPL *rpl,const MEMREF &text,struct acism_result &res );
 private:
     /* 这几个函数在acism.h或msutil.h中都有类似的函数
      * 重写原因如下:
@@ -79,15 +158,21 @@ private:
      * 3.msutil根本就不在libacism.a中，需要改动makefile
      * 4.大小写的处理是在acism.c上修改的，原因是_acism.h中的写法在C++中编译不过
      */
-    int32 acism_slurp( const char *path );
-    MEMREF *acism_refsplit( char *text, char sep, int *pcount );
+    static int32 acism_slurp( MEMBUF &patt,const char *path );
+    static MEMREF *acism_refsplit( char *text, char sep, int *pcount );
+
+    int32 check_list( lua_State *L,int32 thread_cnt );
+    void filter_list( const char *word,size_t word_len,int32 thread_cnt );
 private:
-    ACISM *_psp;
-    MEMBUF _patt;
     int32 _loaded;
-    MEMREF *_pattv;
+    struct acism_dict *_dict;
+    class acism_loader *_loader;
     MEMRPL _memrpl;
-    int32 _case_sensitive;
+
+    /* 批量过滤用，放这里避免每次分配 */
+    std::vector<MEMREF> _text;
+    std::vector<struct acism_result> _result;
+    MEMRPL _arena[ACISM_THREAD_MAX];
 };
 
 #endif /* __LACISM_H__ */
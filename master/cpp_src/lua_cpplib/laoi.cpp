@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "ltools.h"
 #include "laoi.h"
 #include "../scene/scene_include.h"
@@ -12,7 +14,7 @@
         ITER iter = list->begin(); \
         for (;iter != list->end();iter ++) \
         { \
-            const struct entity_ctx *ctx = FROM_ITER; \
+            const entity_ctx *ctx = FROM_ITER; \
             FILTER \
             { \
                 lua_pushinteger(L,ctx->_id); \
@@ -26,56 +28,105 @@
     }while(0)
 
 #define VECTOR_TBL_PACK(tbl_idx,list,FILTER) \
-    TABLE_PACK(tbl_idx,list,entity_vector_t::const_iterator,*iter,FILTER)
+    TABLE_PACK(tbl_idx,list, \
+        typename entity_vector_t::const_iterator,*iter,FILTER)
+
+#define WATCH_TBL_PACK(tbl_idx,list,FILTER) \
+    TABLE_PACK(tbl_idx,list, \
+        typename watch_vector_t::const_iterator,iter->_ctx,FILTER)
 
 #define MAP_TBL_PACK(tbl_idx,list,FILTER) \
-    TABLE_PACK(tbl_idx,list,entity_set_t::const_iterator,iter->second,FILTER)
+    TABLE_PACK(tbl_idx,list, \
+        typename entity_set_t::const_iterator,iter->second,FILTER)
+
+/* 实体进入场景，不同的aoi算法参数不一样
+ * @visual_width,visual_height:实体自己的视野，九宫格aoi所有实体视野一样，忽略
+ */
+// 是否支持每个实体单独设置视野，grid_aoi所有实体用同一个视野
+static bool is_entity_visual_support(const grid_aoi *aoi)
+{
+    UNUSED(aoi);
+    return false;
+}
+
+static bool is_entity_visual_support(const list_aoi *aoi)
+{
+    UNUSED(aoi);
+    return true;
+}
 
-laoi::~laoi()
+static int32 raw_enter_entity(grid_aoi *aoi,
+    grid_aoi::entity_id_t id,int32 x,int32 y,uint8 type,uint8 event,
+    grid_aoi::entity_vector_t *list,int32 visual_width,int32 visual_height)
 {
+    assert("grid aoi not support entity visual",
+        visual_width < 0 && visual_height < 0);
+
+    return aoi->enter_entity(id,x,y,type,event,list);
 }
 
-laoi::laoi( lua_State *L )
+static int32 raw_enter_entity(list_aoi *aoi,
+    list_aoi::entity_id_t id,int32 x,int32 y,uint8 type,uint8 event,
+    list_aoi::entity_vector_t *list,int32 visual_width,int32 visual_height)
 {
+    return aoi->enter_entity(
+        id,x,y,type,event,list,visual_width,visual_height);
 }
 
-int32 laoi::set_visual_range( lua_State *L ) // 设置视野
+template< class T >
+laoi_t<T>::~laoi_t()
+{
+}
+
+template< class T >
+laoi_t<T>::laoi_t( lua_State *L )
+{
+}
+
+template< class T >
+int32 laoi_t<T>::set_visual_range( lua_State *L ) // 设置视野
 {
     // 这里的宽高都是指格子数
     int32 width = luaL_checkinteger(L,1);
     int32 height = luaL_checkinteger(L,2);
-    grid_aoi::set_visual_range(width,height);
+    T::set_visual_range(width,height);
 
     return 0;
 }
 
-int32 laoi::set_size( lua_State *L ) // 设置宽高
+template< class T >
+int32 laoi_t<T>::set_size( lua_State *L ) // 设置宽高
 {
     // 这里的宽高都是指像素，因为地图的大小可能并不刚好符合格子数，后面再做转换
     int32 width = luaL_checkinteger(L,1);
     int32 height = luaL_checkinteger(L,2);
 
-    grid_aoi::set_size(width,height);
+    if (T::set_size(width,height) < 0)
+    {
+        return luaL_error(L,"aoi size too large: %d,%d",width,height);
+    }
 
     return 0;
 }
 
 // 获取某个类型的实体
-int32 laoi::get_all_entitys(lua_State *L)
+template< class T >
+int32 laoi_t<T>::get_all_entitys(lua_State *L)
 {
     // 可以多个实体类型，按位表示
     int32 type_mask = luaL_checkinteger(L,1);
 
     lUAL_CHECKTABLE(L,2); // 用来保存返回的实体id的table
 
-    MAP_TBL_PACK(2,(&_entity_set),TYPE_FILTER);
+    MAP_TBL_PACK(2,(&this->_entity_set),TYPE_FILTER);
 
     return 0;
 }
 
 // 获取关注自己的实体列表
 // 常用于自己释放技能、扣血、特效等广播给周围的人
-int32 laoi::get_watch_me_entitys(lua_State *L)
+template< class T >
+int32 laoi_t<T>::get_watch_me_entitys(lua_State *L)
 {
     entity_id_t id = luaL_checkinteger(L,1);
 
@@ -84,7 +135,7 @@ int32 laoi::get_watch_me_entitys(lua_State *L)
     int32 type_mask = luaL_optinteger(L,3,-1);
     int32 event_mask = luaL_optinteger(L,4,-1);
 
-    const struct entity_ctx *ctx = get_entity_ctx(id);
+    const entity_ctx *ctx = this->get_entity_ctx(id);
     if (!ctx)
     {
         lua_pushinteger(L,-1);
@@ -94,17 +145,18 @@ int32 laoi::get_watch_me_entitys(lua_State *L)
 #define TE_FILTER if (ctx \
     && (-1 == type_mask || (type_mask & ctx->_type)) \
     && (-1 == event_mask || (event_mask & ctx->_event)))
-    VECTOR_TBL_PACK(2,ctx->_watch_me,TE_FILTER);
+    WATCH_TBL_PACK(2,(&ctx->_watch_me),TE_FILTER);
 #undef TE_FILTER
 
-    lua_pushinteger(L,ctx->_watch_me->size());
+    lua_pushinteger(L,ctx->_watch_me.size());
     return 1;
 }
 
 /* 获取某一范围内实体
  * 底层这里只支持矩形，如果是其他形状的，上层根据实体位置再筛选即可
  */
-int32 laoi::get_entitys( lua_State *L )
+template< class T >
+int32 laoi_t<T>::get_entitys( lua_State *L )
 {
     // 可以多个实体类型，按位表示
     int32 type_mask = luaL_checkinteger(L,1);
@@ -117,33 +169,34 @@ int32 laoi::get_entitys( lua_State *L )
     int32 destx = luaL_checkinteger(L,5);
     int32 desty = luaL_checkinteger(L,6);
 
-    entity_vector_t *list = new_entity_vector();
-    int32 ecode = grid_aoi::get_entitys(list,srcx,srcy,destx,desty);
+    entity_vector_t *list = this->new_entity_vector();
+    int32 ecode = T::get_entitys(list,srcx,srcy,destx,desty);
     if (0 != ecode)
     {
-        del_entity_vector(list);
+        this->del_entity_vector(list);
         return luaL_error(L,"aoi get entitys error:%d",ecode);
     }
 
     VECTOR_TBL_PACK(2,list,TYPE_FILTER);
 
-    del_entity_vector(list);
+    this->del_entity_vector(list);
 
     return 0;
 }
 
 // 处理实体退出场景
-int32 laoi::exit_entity( lua_State *L )
+template< class T >
+int32 laoi_t<T>::exit_entity( lua_State *L )
 {
     entity_id_t id = luaL_checkinteger(L,1);
 
     entity_vector_t *list = NULL;
-    if (lua_istable(L,2)) list = new_entity_vector();
+    if (lua_istable(L,2)) list = this->new_entity_vector();
 
-    int32 ecode = grid_aoi::exit_entity(id,list);
+    int32 ecode = T::exit_entity(id,list);
     if ( 0 != ecode )
     {
-        if (list) del_entity_vector(list);
+        if (list) this->del_entity_vector(list);
 
         return luaL_error(L,"aoi exit entitys error:%d",ecode);
     }
@@ -152,12 +205,13 @@ int32 laoi::exit_entity( lua_State *L )
 
     VECTOR_TBL_PACK(2,list,EVENT_FILTER);
 
-    del_entity_vector(list);
+    this->del_entity_vector(list);
 
     return 0;
 }
 
-int32 laoi::enter_entity( lua_State *L )
+template< class T >
+int32 laoi_t<T>::enter_entity( lua_State *L )
 {
     entity_id_t id = luaL_checkinteger(L,1);
     // 实体像素坐标
@@ -168,13 +222,23 @@ int32 laoi::enter_entity( lua_State *L )
     // 关注的事件，目前没有定义事件类型，1表示关注所有事件，0表示都不关注
     uint8 event = static_cast<uint8>(luaL_checkinteger(L,5));
 
+    // 实体自己的视野格子数，不传则使用默认视野
+    int32 visual_width = luaL_optinteger(L,7,-1);
+    int32 visual_height = luaL_optinteger(L,8,-1);
+    if ((visual_width >= 0 || visual_height >= 0)
+        && !is_entity_visual_support(this))
+    {
+        return luaL_error(L,"aoi not support entity visual range");
+    }
+
     entity_vector_t *list = NULL;
-    if (lua_istable(L,6)) list = new_entity_vector();
+    if (lua_istable(L,6)) list = this->new_entity_vector();
 
-    int32 ecode = grid_aoi::enter_entity(id,x,y,type,event,list);
+    int32 ecode = raw_enter_entity(this,
+        id,x,y,type,event,list,visual_width,visual_height);
     if ( 0 != ecode )
     {
-        if (list) del_entity_vector(list);
+        if (list) this->del_entity_vector(list);
 
         return luaL_error(L,"aoi enter entitys error:%d",ecode);
     }
@@ -183,11 +247,12 @@ int32 laoi::enter_entity( lua_State *L )
 
     VECTOR_TBL_PACK(6,list,EVENT_FILTER);
 
-    del_entity_vector(list);
+    this->del_entity_vector(list);
     return 0;
 }
 
-int32 laoi::update_entity( lua_State *L )
+template< class T >
+int32 laoi_t<T>::update_entity( lua_State *L )
 {
     entity_id_t id = luaL_checkinteger(L,1);
     // 实体像素坐标
@@ -198,16 +263,16 @@ int32 laoi::update_entity( lua_State *L )
     entity_vector_t *list_in = NULL;
     entity_vector_t *list_out = NULL;
 
-    if (lua_istable(L,4)) list = new_entity_vector();
-    if (lua_istable(L,5)) list_in = new_entity_vector();
-    if (lua_istable(L,6)) list_out = new_entity_vector();
+    if (lua_istable(L,4)) list = this->new_entity_vector();
+    if (lua_istable(L,5)) list_in = this->new_entity_vector();
+    if (lua_istable(L,6)) list_out = this->new_entity_vector();
 
-    int32 ecode = grid_aoi::update_entity(id,x,y,list,list_in,list_out);
+    int32 ecode = T::update_entity(id,x,y,list,list_in,list_out);
     if ( 0 != ecode )
     {
-        if (list) del_entity_vector(list);
-        if (list_in) del_entity_vector(list_in);
-        if (list_out) del_entity_vector(list_out);
+        if (list) this->del_entity_vector(list);
+        if (list_in) this->del_entity_vector(list_in);
+        if (list_out) this->del_entity_vector(list_out);
 
         return luaL_error(L,"aoi update entitys error:%d",ecode);
     }
@@ -216,15 +281,142 @@ int32 laoi::update_entity( lua_State *L )
     if (list_in) { VECTOR_TBL_PACK(5,list_in,EVENT_FILTER); }
     if (list_out) { VECTOR_TBL_PACK(6,list_out,EVENT_FILTER); }
 
-    if (list) del_entity_vector(list);
-    if (list_in) del_entity_vector(list_in);
-    if (list_out) del_entity_vector(list_out);
+    if (list) this->del_entity_vector(list);
+    if (list_in) this->del_entity_vector(list_in);
+    if (list_out) this->del_entity_vector(list_out);
 
     return 0;
 }
 
+// 记录一次移动产生的事件，只记录关注事件的实体
+template< class T >
+void laoi_t<T>::append_event(
+    event_vector_t &events,entity_id_t id,const entity_vector_t *list)
+{
+    typename entity_vector_t::const_iterator iter = list->begin();
+    for (;iter != list->end();iter ++)
+    {
+        const entity_ctx *ctx = *iter;
+        EVENT_FILTER
+        {
+            events.push_back(watch_event_t(ctx->_id,id));
+        }
+    }
+}
+
+/* 按接收事件的实体分组，打包为
+ * {接收者id,数量,实体id...,接收者id,数量,实体id...,n = 总长度}
+ * 同一个接收者的事件保持移动的顺序
+ */
+template< class T >
+void laoi_t<T>::pack_event(lua_State *L,int32 tbl_idx,event_vector_t &events)
+{
+    std::stable_sort(events.begin(),events.end(),event_cmp);
+
+    int32 index = 1;
+    size_t beg = 0;
+    while (beg < events.size())
+    {
+        entity_id_t watcher = events[beg].first;
+
+        size_t end = beg + 1;
+        while (end < events.size() && watcher == events[end].first) end ++;
+
+        lua_pushinteger(L,watcher);
+        lua_rawseti(L,tbl_idx,index ++);
+        lua_pushinteger(L,end - beg);
+        lua_rawseti(L,tbl_idx,index ++);
+        for (;beg < end;beg ++)
+        {
+            lua_pushinteger(L,events[beg].second);
+            lua_rawseti(L,tbl_idx,index ++);
+        }
+    }
+
+    lua_pushstring( L,"n" );
+    lua_pushinteger(L,index - 1);
+    lua_rawset(L,tbl_idx);
+}
+
+/* 批量更新实体位置
+ * @moves:{id,x,y,id,x,y,...}，像素坐标。有n字段则以n为长度
+ * @list,list_in,list_out:同update_entity，但是按接收事件的实体分组，见pack_event
+ * 某个实体更新出错(实体不存在、坐标非法)时跳过该实体，其他实体照常更新
+ * @return: 全部成功返回nil，否则返回出错的实体id列表
+ */
+template< class T >
+int32 laoi_t<T>::update_entitys( lua_State *L )
+{
+    lUAL_CHECKTABLE(L,1);
+
+    lua_getfield(L,1,"n");
+    int32 n = lua_isnil(L,-1) ?
+        (int32)lua_rawlen(L,1) : (int32)lua_tointeger(L,-1);
+    lua_pop(L,1);
+
+    if (0 != n % 3) return luaL_error(L,"aoi update entitys size error:%d",n);
+
+    entity_vector_t *list = NULL;
+    entity_vector_t *list_in = NULL;
+    entity_vector_t *list_out = NULL;
+
+    if (lua_istable(L,2)) list = this->new_entity_vector();
+    if (lua_istable(L,3)) list_in = this->new_entity_vector();
+    if (lua_istable(L,4)) list_out = this->new_entity_vector();
+
+    _ev_update.clear();
+    _ev_in.clear();
+    _ev_out.clear();
+
+    // 出错的实体id放到栈顶的table，只有出错时才创建
+    int32 fail_idx = 0;
+    int32 fail_cnt = 0;
+    for (int32 idx = 1;idx <= n;idx += 3)
+    {
+        lua_rawgeti(L,1,idx);
+        lua_rawgeti(L,1,idx + 1);
+        lua_rawgeti(L,1,idx + 2);
+        entity_id_t id = lua_tointeger(L,-3);
+        int32 x = (int32)lua_tonumber(L,-2);
+        int32 y = (int32)lua_tonumber(L,-1);
+        lua_pop(L,3);
+
+        if (list) list->clear();
+        if (list_in) list_in->clear();
+        if (list_out) list_out->clear();
+
+        int32 ecode = T::update_entity(id,x,y,list,list_in,list_out);
+        if (expect_false(0 != ecode))
+        {
+            if (!fail_idx)
+            {
+                lua_newtable(L);
+                fail_idx = lua_gettop(L);
+            }
+            lua_pushinteger(L,id);
+            lua_rawseti(L,fail_idx,++fail_cnt);
+            continue;
+        }
+
+        if (list) append_event(_ev_update,id,list);
+        if (list_in) append_event(_ev_in,id,list_in);
+        if (list_out) append_event(_ev_out,id,list_out);
+    }
+
+    if (list) this->del_entity_vector(list);
+    if (list_in) this->del_entity_vector(list_in);
+    if (list_out) this->del_entity_vector(list_out);
+
+    if (lua_istable(L,2)) pack_event(L,2,_ev_update);
+    if (lua_istable(L,3)) pack_event(L,3,_ev_in);
+    if (lua_istable(L,4)) pack_event(L,4,_ev_out);
+
+    return fail_idx ? 1 : 0;
+}
+
 // 两个位置在aoi中是否一致
-int32 laoi::is_same_pos( lua_State *L )
+template< class T >
+int32 laoi_t<T>::is_same_pos( lua_State *L )
 {
     // 像素坐标
     int32 src_x = (int32)luaL_checknumber(L,1);
@@ -240,4 +432,7 @@ int32 laoi::is_same_pos( lua_State *L )
     int32 dy = PIX_TO_GRID(dest_y);
 
     return sx == dx && sy == dy;
-}
\ No newline at end of file
+}
+
+template class laoi_t< grid_aoi >;
+template class laoi_t< list_aoi >;
@@ -2,13 +2,27 @@
 #define __LAOI_H__
 
 #include <lua.hpp>
+#include <vector>
 #include "../scene/grid_aoi.h"
+#include "../scene/list_aoi.h"
 
-class laoi : public grid_aoi
+/* aoi脚本接口，T为aoi算法(grid_aoi、list_aoi)，各算法的接口是一样的 */
+template< class T >
+class laoi_t : public T
 {
 public:
-    ~laoi();
-    explicit laoi( lua_State *L );
+    typedef typename T::entity_ctx entity_ctx;
+    typedef typename T::entity_id_t entity_id_t;
+    typedef typename T::entity_set_t entity_set_t;
+    typedef typename T::watch_vector_t watch_vector_t;
+    typedef typename T::entity_vector_t entity_vector_t;
+
+    // 批量更新时记录的事件，first为接收事件的实体id，second为触发事件的实体id
+    typedef std::pair< entity_id_t,entity_id_t > watch_event_t;
+    typedef std::vector< watch_event_t > event_vector_t;
+public:
+    ~laoi_t();
+    explicit laoi_t( lua_State *L );
 
     int32 set_size( lua_State *L ); // 设置宽高，格子像素
     int32 set_visual_range( lua_State *L ); // 设置视野
@@ -23,9 +37,33 @@ public:
     int32 exit_entity( lua_State *L );
     int32 enter_entity( lua_State *L );
     int32 update_entity( lua_State *L );
+    /* 批量更新实体位置，一帧内所有移动的实体只调用一次
+     * 返回的事件按接收事件的实体分组，见laoi.cpp
+     */
+    int32 update_entitys( lua_State *L );
 
     // 两个位置在aoi中是否一致
     int32 is_same_pos( lua_State *L );
+private:
+    void append_event(event_vector_t &events,
+        entity_id_t id,const entity_vector_t *list);
+    void pack_event(lua_State *L,int32 tbl_idx,event_vector_t &events);
+
+    static bool event_cmp(const watch_event_t &a,const watch_event_t &b)
+    {
+        return a.first < b.first;
+    }
+private:
+    /* 批量更新时的事件列表，放这里避免每帧分配 */
+    event_vector_t _ev_update;
+    event_vector_t _ev_in;
+    event_vector_t _ev_out;
 };
 
+extern template class laoi_t< grid_aoi >;
+extern template class laoi_t< list_aoi >;
+
+typedef laoi_t< grid_aoi > laoi; // 九宫格aoi
+typedef laoi_t< list_aoi > llist_aoi; // 十字链表aoi
+
 #endif /* __LAOI_H__ */
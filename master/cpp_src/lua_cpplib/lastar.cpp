@@ -15,10 +15,22 @@ int32 lastar::search( lua_State *L ) // 寻路
     const static int32 tbl_stack = 6;
     lUAL_CHECKTABLE(L,tbl_stack);
 
+    // 寻路方式，默认a*。怪物追击这类频繁寻路的，地图只区分可行走、不可行走时用jps
+    // 大地图上远距离寻路(如自动寻路到某个npc)用hpa
+    int32 mode = luaL_optinteger(L,7,a_star::SM_ASTAR);
+    if ( mode < 0 || mode >= a_star::SM_MAX )
+    {
+        return luaL_error( L,"astar search mode error:%d",mode );
+    }
+
     class grid_map *map = *udata;
     if ( !map ) return 0;
 
-    if ( !a_star::search(map,x,y,dx,dy) ) return 0;
+    // 地图数据修改过的，重新计算跳跃距离、重建被修改的簇
+    if ( a_star::SM_JPS == mode ) map->build_jump_dist();
+    if ( a_star::SM_HPA == mode ) map->build_hpa();
+
+    if ( !a_star::search(map,x,y,dx,dy,mode) ) return 0;
 
     const std::vector<uint16> &path = a_star::get_path();
 
@@ -0,0 +1,324 @@
+#include <unistd.h> /* usleep */
+
+#include "lmap.h"
+#include "ltools.h"
+#include "lastar_pool.h"
+#include "../system/static_global.h"
+
+////////////////////////////////////////////////////////////////////////////////
+astar_worker::astar_worker( class lastar_pool *owner,int32 index )
+    : queue_thread(_name)
+{
+    _owner = owner;
+
+    snprintf( _name,sizeof(_name),"lastar_%d",index );
+}
+
+astar_worker::~astar_worker()
+{
+    /* 线程已停止，剩下的都是来不及处理的，地图的引用由lastar_pool处理 */
+    struct astar_result res;
+    while ( _result.pop( res ) ) delete res._path;
+
+    std::vector<struct astar_result>::iterator itr = _exit_result.begin();
+    for ( ;itr != _exit_result.end();itr ++ ) delete itr->_path;
+}
+
+void astar_worker::routine( notify_t notify )
+{
+    /* 退出时未处理的请求由主线程取消，不再寻路。lastar_pool析构时地图可能已经
+     * 被gc了，不能再访问
+     */
+    if ( NTF_EXIT == notify ) return;
+
+    invoke_job();
+}
+
+void astar_worker::invoke_job()
+{
+    struct astar_job job;
+
+    while ( active() && pop_query( job ) )
+    {
+        bool found = _a_star.search(
+            job._map,job._x,job._y,job._dx,job._dy,job._mode );
+
+        push_result( job,found );
+    }
+
+    notify_query_full();
+}
+
+void astar_worker::push_result( const struct astar_job &job,bool found )
+{
+    struct astar_result res;
+
+    res._id   = job._id;
+    res._ref  = job._ref;
+    res._map  = job._map;
+    res._path = found ? new std::vector<uint16>( _a_star.get_path() ) : NULL;
+
+    /* 结果队列满了说明主线程处理不过来，子线程等待即可。主线程停止线程时不会
+     * 再处理结果，先放到_exit_result，join之后由主线程处理
+     */
+    while ( expect_false( !_result.push( res ) ) )
+    {
+        if ( !active() )
+        {
+            _exit_result.push_back( res );
+            return;
+        }
+
+        notify_parent( NTF_CUSTOM );
+        usleep( 1000 );
+    }
+
+    notify_parent( NTF_CUSTOM );
+}
+
+/* 线程停止后才能调用，没来得及寻路的请求按没找到路径返回，脚本的回调不会丢 */
+void astar_worker::cancel_job()
+{
+    assert( "astar worker cancel job while active",!active() );
+
+    struct astar_job job;
+    struct astar_result res;
+    while ( pop_query( job ) )
+    {
+        res._id   = job._id;
+        res._ref  = job._ref;
+        res._map  = job._map;
+        res._path = NULL;
+
+        _exit_result.push_back( res );
+    }
+}
+
+bool astar_worker::pop_result( struct astar_result &res )
+{
+    if ( _result.pop( res ) ) return true;
+
+    /* 主线程上active为false时，线程已经join了 */
+    if ( active() || _exit_result.empty() ) return false;
+
+    res = _exit_result.back();
+    _exit_result.pop_back();
+
+    return true;
+}
+
+void astar_worker::notification( notify_t notify )
+{
+    if ( NTF_CUSTOM == notify )
+    {
+        flush_query();
+        _owner->invoke_result();
+    }
+    else if ( NTF_ERROR == notify )
+    {
+        ERROR( "astar thread error:%s",get_name() );
+    }
+    else
+    {
+        assert( "unknow astar event",false );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+lastar_pool::lastar_pool( lua_State *L )
+{
+    _id = luaL_checkinteger( L,2 );
+
+    lua_newtable( L );
+    _tbl_ref = luaL_ref( L,LUA_REGISTRYINDEX );
+}
+
+lastar_pool::~lastar_pool()
+{
+    /* 这时地图可能已经被gc了，不能再处理地图的引用，脚本应该先调用stop */
+    stop_worker();
+
+    luaL_unref( static_global::state(),LUA_REGISTRYINDEX,_tbl_ref );
+}
+
+void lastar_pool::stop_worker()
+{
+    std::vector<class astar_worker *>::iterator itr = _worker.begin();
+    for ( ;itr != _worker.end();itr ++ )
+    {
+        class astar_worker *worker = *itr;
+        if ( worker->active() ) worker->stop();
+
+        delete worker;
+    }
+
+    _worker.clear();
+}
+
+void lastar_pool::release_job( lua_State *L,int32 ref,class lmap *map )
+{
+    map->del_async_ref();
+    luaL_unref( L,LUA_REGISTRYINDEX,ref );
+}
+
+/* 启动寻路线程
+ * @count:线程数量，默认1个
+ */
+int32 lastar_pool::start( lua_State *L )
+{
+    if ( !_worker.empty() && _worker.front()->active() )
+    {
+        return luaL_error( L,"astar thread already active" );
+    }
+
+    const int32 count = luaL_optinteger( L,1,1 );
+    if ( count < 1 || count > ASTAR_POOL_MAX )
+    {
+        return luaL_error( L,"astar pool size illegal:%d",count );
+    }
+
+    stop_worker(); /* 之前stop了的线程 */
+
+    for ( int32 index = 0;index < count;index ++ )
+    {
+        class astar_worker *worker = new astar_worker( this,index );
+        if ( !worker->start() )
+        {
+            delete worker;
+            stop_worker();
+
+            return luaL_error( L,"astar thread start fail" );
+        }
+
+        _worker.push_back( worker );
+    }
+
+    return 0;
+}
+
+/* 停止寻路线程，已完成的结果照常回调，未处理的请求按没找到路径回调 */
+int32 lastar_pool::stop( lua_State *L )
+{
+    std::vector<class astar_worker *>::iterator itr = _worker.begin();
+    for ( ;itr != _worker.end();itr ++ )
+    {
+        if ( (*itr)->active() ) (*itr)->stop();
+
+        (*itr)->cancel_job();
+    }
+
+    invoke_result();
+
+    return 0;
+}
+
+/* 异步寻路
+ * @id:回调id
+ * @map:地图对象，寻路完成前不能修改
+ * @x,y,dx,dy:起点、终点坐标
+ * @mode:寻路方式，同lastar::search
+ */
+int32 lastar_pool::search( lua_State *L )
+{
+    if ( _worker.empty() || !_worker.front()->active() )
+    {
+        return luaL_error( L,"astar thread not active" );
+    }
+
+    int32 id = luaL_checkinteger( L,1 );
+    class lmap** udata = (class lmap**)luaL_checkudata( L,2,"Map" );
+
+    int32 x  = luaL_checkinteger( L,3 );
+    int32 y  = luaL_checkinteger( L,4 );
+    int32 dx = luaL_checkinteger( L,5 );
+    int32 dy = luaL_checkinteger( L,6 );
+
+    int32 mode = luaL_optinteger( L,7,a_star::SM_ASTAR );
+    if ( mode < 0 || mode >= a_star::SM_MAX )
+    {
+        return luaL_error( L,"astar search mode error:%d",mode );
+    }
+
+    class lmap *map = *udata;
+    if ( !map ) return luaL_error( L,"astar search map is NULL" );
+
+    // 子线程只读地图数据，需要预先计算的在这里算好
+    if ( a_star::SM_JPS == mode ) map->build_jump_dist();
+    if ( a_star::SM_HPA == mode ) map->build_hpa();
+
+    struct astar_job job;
+    job._id   = id;
+    job._map  = map;
+    job._mode = mode;
+    job._x    = x;
+    job._y    = y;
+    job._dx   = dx;
+    job._dy   = dy;
+
+    // 引用地图，寻路完成前不会被gc
+    lua_pushvalue( L,2 );
+    job._ref = luaL_ref( L,LUA_REGISTRYINDEX );
+    map->add_async_ref();
+
+    astar_worker::least_pending( _worker )->push_query( job );
+    return 0;
+}
+
+/* 把各个线程的结果一次回调到脚本：astar_read_event(pool_id,results,n)
+ * results为{id,cnt,x1,y1,...,xcnt,ycnt,id,cnt,...}，cnt为路径格子数，0表示没找到
+ * 路径，n为results中有效的元素个数。results是复用的，脚本不能保存
+ */
+void lastar_pool::invoke_result()
+{
+    static lua_State *L = static_global::state();
+    lua_pushcfunction( L,traceback );
+
+    lua_getglobal( L,"astar_read_event" );
+    lua_pushinteger( L,_id );
+    lua_rawgeti( L,LUA_REGISTRYINDEX,_tbl_ref );
+
+    int32 tbl_stack = lua_gettop( L );
+
+    int32 tbl_idx = 0;
+    struct astar_result res;
+    std::vector<class astar_worker *>::iterator itr = _worker.begin();
+    for ( ;itr != _worker.end();itr ++ )
+    {
+        while ( (*itr)->pop_result( res ) )
+        {
+            const std::vector<uint16> *path = res._path;
+            int32 path_sz = path ? static_cast<int32>( path->size() ) : 0;
+
+            lua_pushinteger( L,res._id );
+            lua_rawseti( L,tbl_stack,++tbl_idx );
+            lua_pushinteger( L,path_sz/2 );
+            lua_rawseti( L,tbl_stack,++tbl_idx );
+
+            // 原来的路径是反向的，这里还原
+            for ( int32 idx = path_sz - 1;idx > 0;idx -= 2 )
+            {
+                lua_pushinteger( L,(*path)[idx - 1] );
+                lua_rawseti( L,tbl_stack,++tbl_idx );
+                lua_pushinteger( L,(*path)[idx] );
+                lua_rawseti( L,tbl_stack,++tbl_idx );
+            }
+
+            delete res._path;
+            release_job( L,res._ref,res._map );
+        }
+    }
+
+    if ( 0 == tbl_idx )
+    {
+        lua_pop( L,4 ); /* traceback,function,id,table */
+        return;
+    }
+
+    lua_pushinteger( L,tbl_idx );
+    if ( LUA_OK != lua_pcall( L,3,0,1 ) )
+    {
+        ERROR( "astar call back error:%s",lua_tostring( L,-1 ) );
+        lua_pop( L,1 ); /* remove error message */
+    }
+    lua_pop( L,1 ); /* remove traceback */
+}
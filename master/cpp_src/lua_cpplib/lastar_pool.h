@@ -0,0 +1,93 @@
+#ifndef __LASTAR_POOL_H__
+#define __LASTAR_POOL_H__
+
+#include <lua.hpp>
+#include <vector>
+#include "../global/global.h"
+#include "../thread/queue_thread.h"
+#include "../scene/a_star.h"
+
+class lmap;
+class lastar_pool;
+
+/* 异步寻路请求 */
+struct astar_job
+{
+    int32 _id;  // 回调id
+    int32 _ref; // 地图在registry中的引用，寻路完成前不会被gc
+    class lmap *_map;
+    int32 _mode; // 寻路方式，见a_star::search_mode
+    int32 _x;
+    int32 _y;
+    int32 _dx;
+    int32 _dy;
+};
+
+/* 异步寻路结果 */
+struct astar_result
+{
+    int32 _id;
+    int32 _ref;
+    class lmap *_map;
+    std::vector<uint16> *_path; // 同a_star::get_path，NULL表示没找到路径
+};
+
+/* 寻路线程，有自己的a_star寻路缓存，地图数据在寻路过程中只读，多个线程共用 */
+class astar_worker
+    : public queue_thread<struct astar_job,struct astar_result>
+{
+public:
+    astar_worker( class lastar_pool *owner,int32 index );
+    ~astar_worker();
+
+    /* 以下函数只能在主线程调用 */
+    void cancel_job();
+    bool pop_result( struct astar_result &res );
+private:
+    bool uninitialize() { return true; }
+    bool initialize() { return true; }
+
+    void routine( notify_t notify );
+    void notification( notify_t notify );
+
+    void invoke_job();
+    void push_result( const struct astar_job &job,bool found );
+private:
+    class lastar_pool *_owner;
+    class a_star _a_star; // 只在子线程访问
+    char _name[32];
+
+    /* 线程停止时结果队列满了的结果，join之后由主线程取出 */
+    std::vector<struct astar_result> _exit_result;
+};
+
+/* 异步寻路线程池
+ * 1.长距离寻路可能要好几毫秒，放到子线程做，不占用主线程的帧时间
+ * 2.请求交给最闲的线程，不保证结果的顺序
+ * 3.jps、hpa需要的地图数据在主线程提交请求时预先构建好，子线程只读
+ * 4.有请求未完成的地图不能修改(lmap::fill会报错)
+ * 5.各线程的结果在主线程一次性回调到脚本，见invoke_result
+ */
+class lastar_pool
+{
+public:
+    explicit lastar_pool( lua_State *L );
+    ~lastar_pool();
+
+    int32 start ( lua_State *L );
+    int32 stop  ( lua_State *L );
+    int32 search( lua_State *L );
+
+    /* 线程有结果时在主线程调用 */
+    void invoke_result();
+private:
+    void stop_worker();
+    void release_job( lua_State *L,int32 ref,class lmap *map );
+private:
+    int32 _id;
+    int32 _tbl_ref; // 回调结果用的table，避免每次创建
+
+    std::vector<class astar_worker *> _worker;
+};
+
+#endif /* __LASTAR_POOL_H__ */
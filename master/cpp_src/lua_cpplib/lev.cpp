@@ -44,6 +44,38 @@ int32 lev::backend( lua_State *L )
     return run(); /* this won't return until backend stop */
 }
 
+/* 设置事件循环后端，内核不支持io_uring时仍使用epoll
+ * ev:set_backend( ev.BACKEND_URING )
+ * return: 实际使用的后端
+ */
+int32 lev::set_backend( lua_State *L )
+{
+    int32 backend = luaL_checkinteger( L,1 );
+    if ( BACKEND_EPOLL != backend && BACKEND_URING != backend )
+    {
+        return luaL_error( L,"unknow backend:%d",backend );
+    }
+
+    lua_pushinteger( L,ev::set_backend( backend ) );
+    return 1;
+}
+
+/* 设置定时器实现，已启动的定时器会迁移到新的实现
+ * ev:set_timer_backend( ev.TIMER_WHEEL )
+ * return: 实际使用的实现
+ */
+int32 lev::set_timer_backend( lua_State *L )
+{
+    int32 backend = luaL_checkinteger( L,1 );
+    if ( TIMER_HEAP != backend && TIMER_WHEEL != backend )
+    {
+        return luaL_error( L,"unknow timer backend:%d",backend );
+    }
+
+    lua_pushinteger( L,ev::set_timer_backend( backend ) );
+    return 1;
+}
+
 // 帧时间
 int32 lev::time( lua_State *L )
 {
@@ -57,10 +89,45 @@ int32 lev::ms_time( lua_State *L ) // 帧时间，ms
     return 1;
 }
 
-int32 lev::who_busy( lua_State *L ) // 看下哪条线程繁忙
+/* 看下哪条线程繁忙
+ * ev:who_busy( true ) 返回所有线程的状态，可用于查看mysql连接池各连接的负载
+ * { { name = "lsql_1_0",busy = false,finished = 0,unfinished = 0 },... }
+ */
+int32 lev::who_busy( lua_State *L )
 {
     size_t finished = 0;
     size_t unfinished = 0;
+
+    if ( lua_toboolean( L,1 ) )
+    {
+        const thread_mgr::thread_mpt_t &threads =
+            static_global::thread_mgr()->get_threads();
+
+        int32 index = 0;
+        lua_createtable( L,threads.size(),0 );
+
+        thread_mgr::thread_mpt_t::const_iterator itr = threads.begin();
+        for ( ;itr != threads.end();itr ++ )
+        {
+            class thread *thd = itr->second;
+            thd->busy_job( &finished,&unfinished );
+
+            lua_createtable( L,0,4 );
+            lua_pushstring( L,thd->get_name() );
+            lua_setfield( L,-2,"name" );
+            lua_pushboolean( L,thd->is_busy() );
+            lua_setfield( L,-2,"busy" );
+            lua_pushinteger( L,finished );
+            lua_setfield( L,-2,"finished" );
+            lua_pushinteger( L,unfinished );
+            lua_setfield( L,-2,"unfinished" );
+
+            lua_rawseti( L,-2,++index );
+        }
+
+        return 1;
+    }
+
     const char *who = 
         static_global::thread_mgr()->who_is_busy(finished,unfinished);
 
@@ -253,6 +320,7 @@ ev_tstamp lev::wait_time()
 void lev::running( int64 ms_now )
 {
     invoke_sending ();
+    static_global::network_mgr()->invoke_reactor();
     invoke_signal  ();
     invoke_app_ev  (ms_now);
 
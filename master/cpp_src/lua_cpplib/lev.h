@@ -25,6 +25,8 @@ public:
 
     int32 signal( lua_State *L );
     int32 set_app_ev( lua_State *L ); // 设置脚本主循环回调
+    int32 set_backend( lua_State *L ); // 设置事件循环后端(epoll、io_uring)
+    int32 set_timer_backend( lua_State *L ); // 设置定时器实现(二叉堆、时间轮)
 
     int32 pending_send( class socket *s );
     void remove_pending( int32 pending );
@@ -1,18 +1,35 @@
 #include "lmap.h"
 #include "../scene/scene_include.h"
+#include "../system/static_global.h"
 
 lmap::~lmap()
 {
+    if ( LUA_NOREF != _base_ref )
+    {
+        luaL_unref( static_global::state(),LUA_REGISTRYINDEX,_base_ref );
+    }
 }
 
 lmap::lmap( lua_State *L )
 {
+    _async_ref = 0;
+    _base_ref = LUA_NOREF;
+    _base = NULL;
 }
 
+/* 加载地图数据
+ * @path:编译好的地图文件路径，由shell/map.sh从tiled导出的地图转换
+ */
 int32 lmap::load( lua_State *L ) // 加载地图数据
 {
-    // TODO: 地图数据格式定下来才能做
-    return 0;
+    const char *path = luaL_checkstring(L,1);
+
+    if ( grid_map::has_data() ) return luaL_error( L,"map already have data" );
+
+    bool ok = grid_map::load_file( path );
+
+    lua_pushboolean( L,ok );
+    return 1;
 }
 
 int32 lmap::set( lua_State *L ) // 设置地图信息(用于动态创建地图)
@@ -23,6 +40,8 @@ int32 lmap::set( lua_State *L ) // 设置地图信息(用于动态创建地图)
 
     if ( width < 0 || height < 0 ) return 0;
 
+    if ( grid_map::has_data() ) return luaL_error( L,"map already have data" );
+
     bool ok = grid_map::set( id,width,height );
 
     lua_pushboolean( L,ok );
@@ -35,6 +54,12 @@ int32 lmap::fill( lua_State *L ) // (用于动态创建地图)
     int32 y    = luaL_checkinteger(L,2); // 填充的坐标y
     int32 cost = luaL_checkinteger(L,3); // 该格子的消耗
 
+    // 子线程正在用这个地图寻路
+    if ( _async_ref > 0 )
+    {
+        return luaL_error( L,"map fill while async search pending" );
+    }
+
     bool ok = grid_map::fill( x,y,cost );
 
     lua_pushboolean( L,ok );
@@ -52,19 +77,36 @@ int32 lmap::get_size( lua_State *L )   // 获取地图宽高
     return 2;
 }
 
-int32 lmap::fork( lua_State *L ) // 复制一份地图(用于动态修改地图数据)
+/* 复制一份地图(用于动态修改地图数据)
+ * 配置的地图数据多个副本共用，副本里需要动态修改的(可破坏的墙、副本里的阻挡等)复制
+ * 一份再修改。复制的地图和原地图共用格子数据，只有修改的块才复制，见grid_map::fork
+ * @base:原地图，复制的地图引用原地图，保证原地图后销毁
+ */
+int32 lmap::fork( lua_State *L )
 {
-    // TODO:以后可能会加上区域属性，一些属性需要动态修改
-    // 这时候我们可以复制一份地图数据，而不会直接修改基础配置数据
-
     class lmap** udata = (class lmap**)luaL_checkudata( L, 1, "Map" );
 
-    class grid_map *map = *udata;
-    if ( !map ) return 0;
+    class lmap *base = *udata;
+    if ( !base ) return 0;
 
-    // TODO:暂时没有对应的数据来做
+    if ( LUA_NOREF != _base_ref )
+    {
+        return luaL_error( L,"map already fork" );
+    }
+
+    // 已经set、load过的地图不能再fork，否则grid_map::fork断言失败
+    if ( grid_map::has_data() ) return luaL_error( L,"map already have data" );
+
+    bool ok = grid_map::fork( base );
+    if ( ok )
+    {
+        lua_pushvalue( L,1 );
+        _base_ref = luaL_ref( L,LUA_REGISTRYINDEX );
+        _base = base;
+    }
 
-    return 0;
+    lua_pushboolean( L,ok );
+    return 1;
 }
 
 int32 lmap::get_pass_cost( lua_State *L ) // 获取通过某个格子的消耗
@@ -83,3 +125,20 @@ int32 lmap::get_pass_cost( lua_State *L ) // 获取通过某个格子的消耗
 
     return 1;
 }
+
+int32 lmap::get_region( lua_State *L ) // 获取格子所属的区域
+{
+    int32 x = (int32)luaL_checknumber(L,1); // 坐标x
+    int32 y = (int32)luaL_checknumber(L,2); // 坐标y
+
+    // 传进来的参数是否为像素坐标
+    if ( 0 != lua_toboolean( L,3 ) )
+    {
+        x = PIX_TO_GRID( x );
+        y = PIX_TO_GRID( y );
+    }
+
+    lua_pushinteger( L,grid_map::get_region( x,y ) );
+
+    return 1;
+}
@@ -16,6 +16,25 @@ public:
     int32 fork( lua_State *L ); // 复制一份地图(用于动态修改地图数据)
     int32 get_size( lua_State *L ); // 获取地图宽高
     int32 get_pass_cost( lua_State *L ); // 获取通过某个格子的消耗
+    int32 get_region( lua_State *L ); // 获取格子所属的区域
+
+    /* 异步寻路的引用计数，有未完成的异步寻路时地图不能修改
+     * fork出来的地图可能在用原地图的跳跃距离、抽象图，原地图也要引用
+     */
+    void add_async_ref()
+    {
+        ++ _async_ref;
+        if ( _base ) _base->add_async_ref();
+    }
+    void del_async_ref()
+    {
+        -- _async_ref;
+        if ( _base ) _base->del_async_ref();
+    }
+private:
+    int32 _async_ref;
+    int32 _base_ref; // fork的原地图在registry中的引用
+    class lmap *_base; // fork的原地图
 };
 
 #endif /* __LMAP_H__ */
@@ -1,5 +1,6 @@
 #include <ctime> // for clock
 #include <cstdarg>
+#include <unistd.h> /* usleep */
 #include "lmongo.h"
 
 #include "ltools.h"
@@ -7,14 +8,33 @@
 
 #include "../system/static_global.h"
 
-lmongo::lmongo( lua_State *L ) : thread("lmongo")
+lmongo::lmongo( lua_State *L )
+    : queue_thread("lmongo")
 {
     _valid = -1;
     _dbid = luaL_checkinteger( L,2 );
+
+    _batch_count = 0;
+    _batch_time  = 0;
+    _batch_window.store( 0 );
+    _batch_max.store( MONGO_BATCH_MAX );
+    _stream_pending.store( 0 );
 }
 
 lmongo::~lmongo()
 {
+    /* 线程已停止，剩下的都是关服时来不及处理的 */
+    const struct mongo_query *query = NULL;
+    while ( pop_query( query ) ) delete query;
+
+    /* 关服时没ping通，合并的写操作没执行 */
+    for ( auto &iter : _batch )
+    {
+        for ( auto query : iter.second ) delete query;
+    }
+
+    const struct mongo_result *res = NULL;
+    while ( _result.pop( res ) ) delete res;
 }
 
 // 连接数据库
@@ -46,6 +66,25 @@ int32 lmongo::stop( lua_State *L )
     return 0;
 }
 
+/* 设置批量写入
+ * @window:合并窗口，毫秒。0表示不合并，每个操作单独执行
+ * @max:一次bulk最多包含的操作数量，达到后不等窗口结束立即执行
+ */
+int32 lmongo::set_batch( lua_State *L )
+{
+    int32 window = luaL_checkinteger( L,1 );
+    int32 max    = luaL_optinteger( L,2,MONGO_BATCH_MAX );
+    if ( window < 0 || max <= 0 )
+    {
+        return luaL_error( L,"mongo set batch invalid argument" );
+    }
+
+    _batch_window.store( window );
+    _batch_max.store( max );
+
+    return 0;
+}
+
 // 该连接是否已连接上(不是当前状态，仅仅是第一次连接上)
 int32 lmongo::valid( lua_State *L )
 {
@@ -73,21 +112,6 @@ bool lmongo::initialize()
     return true;
 }
 
-size_t lmongo::busy_job( size_t *finished,size_t *unfinished )
-{
-    lock();
-    size_t finished_sz = _result.size();
-    size_t unfinished_sz = _query.size();
-
-    if ( is_busy() ) unfinished_sz += 1;
-    unlock();
-
-    if ( finished ) *finished = finished_sz;
-    if ( unfinished ) *unfinished = unfinished_sz;
-
-    return finished_sz + unfinished_sz;
-}
-
 void lmongo::routine( notify_t notify )
 {
     /* 如果某段时间连不上，只能由下次超时后触发
@@ -108,7 +132,7 @@ bool lmongo::uninitialize()
     }
     else
     {
-        invoke_command();
+        invoke_command( false );
     }
 
     _mongo.disconnect();
@@ -120,6 +144,7 @@ void lmongo::notification( notify_t notify )
 {
     if ( NTF_CUSTOM == notify )
     {
+        flush_query();
         invoke_result();
     }
     else if ( NTF_ERROR == notify )
@@ -132,24 +157,6 @@ void lmongo::notification( notify_t notify )
     }
 }
 
-void lmongo::push_query( const struct mongo_query *query )
-{
-    /* socket缓冲区大小是有限制的。如果query队列不为空，则表示已通知过子线程，无需再
-     * 次通知。避免写入socket缓冲区满造成Resource temporarily unavailable
-     */
-    bool _notify = false;
-
-    lock();
-    if ( _query.empty() )  /* 不要使用_query.size() */
-    {
-        _notify = true;
-    }
-    _query.push( query );
-    unlock();
-
-    if ( _notify ) notify_child( NTF_CUSTOM );
-}
-
 int32 lmongo::count( lua_State *L )
 {
     if ( !active() )
@@ -189,29 +196,14 @@ int32 lmongo::count( lua_State *L )
     return 0;
 }
 
-const struct mongo_result *lmongo::pop_result()
-{
-    const struct mongo_result *res = NULL;
-
-    lock();
-    if ( !_result.empty() )
-    {
-        res = _result.front();
-        _result.pop();
-    }
-
-    unlock();
-
-    return res;
-}
-
 void lmongo::invoke_result()
 {
     static lua_State *L = static_global::state();
     lua_pushcfunction( L,traceback );
 
+    int32 stream = 0;
     const struct mongo_result *res = NULL;
-    while ( (res = pop_result()) )
+    while ( _result.pop( res ) )
     {
         // 发起请求到返回主线程的时间，毫秒.thread是db线程耗时
         static thread_log *logger = static_global::async_log();
@@ -235,7 +227,11 @@ void lmongo::invoke_result()
                 res->_error.message,real,res->_elaspe);
         }
         // 为0表示不需要回调到脚本
-        if ( 0 == res->_qid ) continue;
+        if ( 0 == res->_qid )
+        {
+            delete res;
+            continue;
+        }
 
         lua_getglobal( L,"mongodb_read_event" );
 
@@ -244,7 +240,11 @@ void lmongo::invoke_result()
         lua_pushinteger( L,res->_error.code );
 
         int32 nargs = 3;
-        if ( res->_data )
+        if ( MQT_STREAM == res->_mqt )
+        {
+            nargs += stream_to_lua( L,res );
+        }
+        else if ( res->_data )
         {
             struct error_collector error;
             bson_type_t root_type =
@@ -269,94 +269,335 @@ void lmongo::invoke_result()
             lua_pop(L,1); /* remove error message */
         }
 
+        bool is_stream = MQT_STREAM == res->_mqt;
         delete res;
+
+        /* 流式查询的结果分散到多轮事件循环中处理，避免一次解码太多数据卡住主线程
+         * 本轮处理不完的，通知自己下一轮继续
+         */
+        if ( is_stream && ++stream >= MONGO_STREAM_LOOP )
+        {
+            if ( !_result.empty() ) notify_parent( NTF_CUSTOM );
+            break;
+        }
     }
     lua_pop(L,1); /* remove stacktrace */
 }
 
-const struct mongo_query *lmongo::pop_query()
+/* 把流式查询的一批结果转换为lua数组，再加上是否还有数据的标识
+ * 直接用bson_reader在结果的内存上逐个解码文档，不需要额外的内存拷贝
+ * @return:压栈的参数数量
+ */
+int32 lmongo::stream_to_lua( lua_State *L,const struct mongo_result *res )
 {
-    const struct mongo_query *query = NULL;
+    /* 先减计数，子线程可以继续读取游标 */
+    _stream_pending.fetch_sub( 1,std::memory_order_release );
 
-    lock();
-    if ( !_query.empty() )
+    lua_createtable( L,res->_raw_count,0 );
+    if ( res->_raw_len > 0 )
     {
-        query = _query.front();
-        _query.pop();
+        bson_reader_t *reader =
+            bson_reader_new_from_data( res->_raw,res->_raw_len );
+
+        int32 index = 0;
+        const bson_t *doc = NULL;
+        while ( ( doc = bson_reader_read( reader,NULL ) ) )
+        {
+            struct error_collector error;
+            if ( lbs_do_decode( L,doc,BSON_TYPE_DOCUMENT,&error ) < 0 )
+            {
+                ERROR( "mongo stream decode error:%s",error.what );
+                continue;
+            }
+
+            lua_rawseti( L,-2,++index );
+        }
+
+        bson_reader_destroy( reader );
     }
 
-    unlock();
+    lua_pushboolean( L,res->_more );
 
-    return query;
+    return 2;
 }
 
-/* 缓冲区大小有限，如果已经通知过了，则不需要重复通知 */
+/* 结果队列满了说明主线程处理不过来，子线程等待即可。主线程停止线程时不会再处理
+ * 结果，不能一直等
+ */
 void lmongo::push_result( const struct mongo_result *result )
 {
-    bool is_notify = false;
-
-    lock();
-    if ( _result.empty() )
+    while ( expect_false( !_result.push( result ) ) )
     {
-        is_notify = true;
+        if ( !active() )
+        {
+            ERROR( "mongo result queue full,result drop:%d",result->_qid );
+            delete result;
+            return;
+        }
+
+        notify_parent( NTF_CUSTOM );
+        usleep( 1000 );
     }
-    _result.push( result );
-    unlock();
 
-    if ( is_notify ) notify_parent( NTF_CUSTOM );
+    notify_parent( NTF_CUSTOM );
 }
 
-/* 在子线程触发查询命令 */
-void lmongo::invoke_command()
+/* 在子线程执行单个查询命令 */
+void lmongo::do_command( const struct mongo_query *query )
 {
-    const struct mongo_query *query = NULL;
-    while ( (query = pop_query()) )
+    bool ok = false;
+    clock_t begin = clock();
+    struct mongo_result *res = new mongo_result();
+    switch( query->_mqt )
     {
-        bool ok = false;
-        clock_t begin = clock();
-        struct mongo_result *res = new mongo_result();
-        switch( query->_mqt )
+        case MQT_COUNT  : ok = _mongo.count( query,res );break;
+        case MQT_FIND   : ok = _mongo.find ( query,res );break;
+        case MQT_FMOD   : ok = _mongo.find_and_modify( query,res );break;
+        case MQT_INSERT : ok = _mongo.insert( query,res );break;
+        case MQT_UPDATE : ok = _mongo.update( query,res );break;
+        case MQT_REMOVE : ok = _mongo.remove( query,res );break;
+        default:
         {
-            case MQT_COUNT  : ok = _mongo.count( query,res );break;
-            case MQT_FIND   : ok = _mongo.find ( query,res );break;
-            case MQT_FMOD   : ok = _mongo.find_and_modify( query,res );break;
-            case MQT_INSERT : ok = _mongo.insert( query,res );break;
-            case MQT_UPDATE : ok = _mongo.update( query,res );break;
-            case MQT_REMOVE : ok = _mongo.remove( query,res );break;
-            default:
-            {
-                ERROR( "unknow handle mongo command type:%d\n",query->_mqt );
-                delete res;
-                delete query;
-                continue;
-            }
+            ERROR( "unknow handle mongo command type:%d\n",query->_mqt );
+            delete res;
+            delete query;
+            return;
         }
+    }
 
-        if ( ok )
-        {
-            assert( "mongo result check", 0 == res->_error.code );
-        }
-        else
+    if ( ok )
+    {
+        assert( "mongo result check", 0 == res->_error.code );
+    }
+    else
+    {
+        assert( "mongo result check", 0 != res->_error.code );
+    }
+
+    res->_qid  = query->_qid;
+    res->_mqt  = query->_mqt;
+    res->_time = query->_time;
+    snprintf( res->_clt,MONGO_VAR_LEN,"%s",query->_clt );
+    res->_elaspe = ((float)(clock() - begin))/CLOCKS_PER_SEC;
+
+    if ( query->_query )
+    {
+        char *json = bson_as_json( query->_query, NULL );
+        snprintf( res->_query,MONGO_VAR_LEN,"%s",json );
+        bson_free( json );
+    }
+
+    push_result( res );
+
+    delete query;
+}
+
+/* 写操作放到对应collection的合并队列，数量达到上限时立即执行 */
+void lmongo::add_batch( const struct mongo_query *query )
+{
+    if ( 0 == _batch_count ) _batch_time = ev::get_time() * 1e3;
+
+    batch_list_t &list = _batch[query->_clt];
+    list.push_back( query );
+    _batch_count ++;
+
+    if ( list.size() >= (size_t)_batch_max.load( std::memory_order_relaxed ) )
+    {
+        do_batch( query->_clt,list.data(),list.size() );
+
+        _batch_count -= list.size();
+        list.clear();
+    }
+}
+
+/* 执行一次bulk写入，每个需要回调或者出错的操作单独返回结果 */
+void lmongo::do_batch( const char *clt,
+    const struct mongo_query **queries,size_t count )
+{
+    clock_t begin = clock();
+
+    // bson_error_t没有设置为0的话，没有错误时里面是随机值
+    std::vector<bson_error_t> errors( count );
+    memset( errors.data(),0,sizeof(bson_error_t)*count );
+
+    struct mongo_result *summary = new mongo_result();
+    _mongo.bulk( clt,queries,errors.data(),count,&summary->_error );
+
+    float elaspe = ((float)(clock() - begin))/CLOCKS_PER_SEC;
+    for ( size_t idx = 0;idx < count;idx ++ )
+    {
+        const struct mongo_query *query = queries[idx];
+        const bson_error_t &error = errors[idx];
+
+        // 不需要回调也没出错的操作，由summary统一记录日志即可
+        if ( 0 == query->_qid && 0 == error.code )
         {
-            assert( "mongo result check", 0 != res->_error.code );
+            delete query;
+            continue;
         }
 
-        res->_qid  = query->_qid;
-        res->_mqt  = query->_mqt;
-        res->_time = query->_time;
-        snprintf( res->_clt,MONGO_VAR_LEN,"%s",query->_clt );
-        res->_elaspe = ((float)(clock() - begin))/CLOCKS_PER_SEC;
+        struct mongo_result *res = new mongo_result();
+        res->_qid    = query->_qid;
+        res->_mqt    = query->_mqt;
+        res->_time   = query->_time;
+        res->_error  = error;
+        res->_elaspe = elaspe;
+        snprintf( res->_clt,MONGO_VAR_LEN,"%s",clt );
 
         if ( query->_query )
         {
-            snprintf( res->_query,MONGO_VAR_LEN,
-                "%s",bson_as_json (query->_query, NULL) );
+            char *json = bson_as_json( query->_query, NULL );
+            snprintf( res->_query,MONGO_VAR_LEN,"%s",json );
+            bson_free( json );
         }
 
         push_result( res );
 
         delete query;
     }
+
+    /* 整体的错误已经体现在各个操作中，summary只用于记录日志 */
+    memset( &summary->_error,0,sizeof(bson_error_t) );
+
+    summary->_qid    = 0;
+    summary->_mqt    = MQT_BULK;
+    summary->_time   = queries[0]->_time;
+    summary->_elaspe = elaspe;
+    snprintf( summary->_clt,MONGO_VAR_LEN,"%s",clt );
+    snprintf( summary->_query,MONGO_VAR_LEN,"count:%zu",count );
+
+    push_result( summary );
+}
+
+/* 流式查询，每读取到_batch个文档就返回一批结果，不等整个游标读完
+ * 主线程处理不过来时暂停读取，避免结果都堆积在内存中
+ */
+void lmongo::do_stream( const struct mongo_query *query )
+{
+    clock_t begin = clock();
+
+    char json[MONGO_VAR_LEN] = { 0 };
+    if ( query->_query )
+    {
+        char *str = bson_as_json( query->_query, NULL );
+        snprintf( json,MONGO_VAR_LEN,"%s",str );
+        bson_free( str );
+    }
+
+    _mongo.open_cursor( query );
+
+    const bson_t *doc = NULL;
+    struct mongo_result *res = NULL;
+    while ( _mongo.next_cursor( &doc ) )
+    {
+        if ( !res ) res = new mongo_result();
+
+        res->append_raw( doc,query->_batch );
+        if ( res->_raw_count < query->_batch ) continue;
+
+        res->_more = true;
+        push_stream( res,query,json,begin );
+
+        res = NULL;
+        begin = clock();
+    }
+
+    /* 最后一批(可能为空)，带上游标的错误 */
+    if ( !res ) res = new mongo_result();
+    _mongo.close_cursor( &res->_error );
+
+    res->_more = false;
+    push_stream( res,query,json,begin );
+
+    delete query;
+}
+
+void lmongo::push_stream( struct mongo_result *res,
+    const struct mongo_query *query,const char *json,clock_t begin )
+{
+    /* 等主线程处理，停止线程时主线程不再处理结果，不能一直等 */
+    while ( expect_false( _stream_pending.load(
+        std::memory_order_acquire ) >= MONGO_STREAM_PENDING ) && active() )
+    {
+        usleep( 1000 );
+    }
+
+    res->_qid    = query->_qid;
+    res->_mqt    = query->_mqt;
+    res->_time   = query->_time;
+    res->_elaspe = ((float)(clock() - begin))/CLOCKS_PER_SEC;
+    snprintf( res->_clt,MONGO_VAR_LEN,"%s",query->_clt );
+    snprintf( res->_query,MONGO_VAR_LEN,"%s",json );
+
+    _stream_pending.fetch_add( 1,std::memory_order_release );
+    push_result( res );
+}
+
+/* 执行所有等待合并的写操作 */
+void lmongo::flush_batch()
+{
+    if ( 0 == _batch_count ) return;
+
+    for ( auto &iter : _batch )
+    {
+        batch_list_t &list = iter.second;
+        if ( list.empty() ) continue;
+
+        do_batch( iter.first.c_str(),list.data(),list.size() );
+        list.clear();
+    }
+
+    _batch_count = 0;
+}
+
+/* 在子线程触发查询命令
+ * @is_wait:队列为空时，是否等待合并窗口结束再执行合并的写操作
+ */
+void lmongo::invoke_command( bool is_wait )
+{
+    const struct mongo_query *query = NULL;
+    while ( true )
+    {
+        if ( pop_query( query ) )
+        {
+            int32 window = _batch_window.load( std::memory_order_relaxed );
+            if ( window > 0 && ( MQT_INSERT == query->_mqt
+                || MQT_UPDATE == query->_mqt || MQT_REMOVE == query->_mqt ) )
+            {
+                add_batch( query );
+                continue;
+            }
+
+            /* 其他操作之前，先执行已合并的写操作，保证执行顺序 */
+            flush_batch();
+            if ( MQT_STREAM == query->_mqt )
+            {
+                do_stream( query );
+            }
+            else
+            {
+                do_command( query );
+            }
+            continue;
+        }
+
+        notify_query_full();
+
+        if ( 0 == _batch_count ) break;
+
+        /* 窗口还没结束，等待主线程写入更多的操作，最多等到窗口结束。停止线程时不再
+         * 等待
+         */
+        int64 now = ev::get_time() * 1e3;
+        int32 window = _batch_window.load( std::memory_order_relaxed );
+        if ( is_wait && active() && now < _batch_time + window )
+        {
+            wait_child( static_cast<int32>( _batch_time + window - now ) );
+            continue;
+        }
+
+        flush_batch();
+    }
 }
 
 // 把对应的json字符串或者lua table参数转换为bson
@@ -441,6 +682,41 @@ int32 lmongo::find( lua_State *L )
 }
 
 
+/* 流式查询，结果分批回调，每次回调带上是否还有数据的标识
+ * find_stream( id,collection,query,opts,batch )
+ */
+int32 lmongo::find_stream( lua_State *L )
+{
+    if ( !active() )
+    {
+        return luaL_error( L,"mongo thread not active" );
+    }
+
+    int32 id = luaL_checkinteger( L,1 );
+    const char *collection = luaL_checkstring( L,2 );
+    if ( !collection )
+    {
+        return luaL_error( L,"mongo find_stream:collection not specify" );
+    }
+
+    int32 batch = luaL_optinteger( L,5,MONGO_STREAM_BATCH );
+    if ( id <= 0 || batch <= 0 )
+    {
+        return luaL_error( L,"mongo find_stream:invalid id or batch" );
+    }
+
+    bson_t *query = string_or_table_to_bson( L,3,1 );
+    bson_t *opts  = string_or_table_to_bson( L,4,0,query,END_BSON );
+
+    struct mongo_query *mongo_stream = new mongo_query();
+    mongo_stream->set( id,MQT_STREAM );
+    mongo_stream->set_stream( collection,query,opts,batch );
+
+    push_query( mongo_stream );
+
+    return 0;
+}
+
 /* find( id,collection,query,sort,update,fields,remove,upsert,new ) */
 int32 lmongo::find_and_modify( lua_State *L )
 {
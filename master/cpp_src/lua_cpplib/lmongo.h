@@ -1,9 +1,12 @@
 #ifndef __LMONGO_H__
 #define __LMONGO_H__
 
-#include <queue>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
 
-#include "../thread/thread.h"
+#include "../thread/queue_thread.h"
 #include "../mongo/mongo.h"
 
 // 由于指针可能是NULL，故用-1来表示。但是这并不百分百安全。不过在这里，顶多只是内存泄漏
@@ -12,7 +15,14 @@
 #define END_BSON (bson_t *)-1
 
 struct lua_State;
-class lmongo : public thread
+
+/* mongodb连接，一个线程按队列顺序执行
+ * 开启批量写入(set_batch)后，同一个collection的insert、update、remove在合并窗口
+ * 内合并为一次bulk操作，减少和数据库的交互次数。其他操作执行前会先把已合并的写入
+ * 执行完，保证读到的是之前写入的数据。每个操作的回调仍单独触发
+ */
+class lmongo : public queue_thread
+    <const struct mongo_query *,const struct mongo_result *>
 {
 public:
     ~lmongo();
@@ -28,8 +38,8 @@ public:
     int32 update   ( lua_State *L );
     int32 remove   ( lua_State *L );
     int32 find_and_modify( lua_State *L );
-
-    size_t busy_job( size_t *finished = NULL,size_t *unfinished = NULL );
+    int32 set_batch( lua_State *L );
+    int32 find_stream( lua_State *L );
 private:
     /* for thread */
     bool uninitialize();
@@ -38,23 +48,38 @@ private:
     void notification( notify_t notify );
 
     void invoke_result();
-    void invoke_command();
+    void invoke_command( bool is_wait = true );
+
+    void do_command( const struct mongo_query *query );
+    void add_batch( const struct mongo_query *query );
+    void do_batch( const char *clt,
+        const struct mongo_query **queries,size_t count );
+    void flush_batch();
+
+    void do_stream( const struct mongo_query *query );
+    void push_stream( struct mongo_result *res,
+        const struct mongo_query *query,const char *json,clock_t begin );
+    int32 stream_to_lua( lua_State *L,const struct mongo_result *res );
 
-    void push_query( const struct mongo_query *query );
     void push_result( const struct mongo_result *result );
     bson_t *string_or_table_to_bson( 
         lua_State *L,int index,int opt = -1,bson_t *bs = END_BSON,... );
-
-    const struct mongo_result *pop_result();
-    const struct mongo_query  *pop_query ();
 private:
     class mongo _mongo;
 
     int32 _valid;
     int32 _dbid;
 
-    std::queue<const struct mongo_query  *> _query ;
-    std::queue<const struct mongo_result *> _result;
+    /* 等待合并的写操作，按collection区分，只在子线程访问 */
+    typedef std::vector<const struct mongo_query *> batch_list_t;
+    std::map< std::string,batch_list_t > _batch;
+    size_t _batch_count; // 等待合并的操作数量
+    int64 _batch_time; // 第一个等待合并的操作加入的时间，毫秒
+
+    std::atomic<int32> _batch_window; // 合并窗口，毫秒。0表示不合并
+    std::atomic<int32> _batch_max; // 一次bulk最多包含的操作数量
+
+    std::atomic<int32> _stream_pending; // 流式查询已返回但主线程还没处理的批数
 };
 
 #endif /* __LMONGO_H__ */
@@ -3,6 +3,7 @@
 #include "ltools.h"
 #include "../system/static_global.h"
 
+#include "../net/io_reactor.h"
 #include "../net/header_include.h"
 #include "../net/packet/http_packet.h"
 #include "../net/packet/stream_packet.h"
@@ -18,6 +19,15 @@ lnetwork_mgr::~lnetwork_mgr()
         delete sk;
     }
 
+    /* 连接都已关闭，io线程会关闭剩下的fd */
+    std::vector<class io_reactor *>::iterator rt_itr = _reactor.begin();
+    for ( ;rt_itr != _reactor.end();rt_itr ++ )
+    {
+        (*rt_itr)->stop();
+        delete *rt_itr;
+    }
+    _reactor.clear();
+
     _owner_map.clear();
     _socket_map.clear();
     _session_map.clear();
@@ -51,6 +61,65 @@ void lnetwork_mgr::invoke_delete()
     _deleting.clear();
 }
 
+/* 唤醒io线程处理本轮主循环产生的消息，每个io线程一轮只唤醒一次 */
+void lnetwork_mgr::invoke_reactor()
+{
+    std::vector<class io_reactor *>::iterator itr = _reactor.begin();
+    for ( ;itr != _reactor.end();itr ++ )
+    {
+        (*itr)->invoke_notify();
+    }
+}
+
+/* 为新连接选择一个io线程，选连接数最少的 */
+class io_reactor *lnetwork_mgr::select_reactor( socket::conn_t conn_ty ) const
+{
+    if ( _reactor.empty() || socket::CNT_SCCN != conn_ty ) return NULL;
+
+    class io_reactor *reactor = _reactor[0];
+    for ( size_t idx = 1;idx < _reactor.size();idx ++ )
+    {
+        if ( _reactor[idx]->get_conn_count() < reactor->get_conn_count() )
+        {
+            reactor = _reactor[idx];
+        }
+    }
+
+    return reactor;
+}
+
+/* 开启多线程io，之后accept的客户端连接由io线程负责收发、ssl及拆包，主线程只负责
+ * 解码及回调脚本。只能在监听客户端之前调用一次
+ * network_mgr:set_io_thread( count )
+ */
+int32 lnetwork_mgr::set_io_thread( lua_State *L )
+{
+    int32 count = luaL_checkinteger( L,1 );
+    if ( count <= 0 || count > REACTOR_MAX )
+    {
+        return luaL_error( L,"illegal io thread count:%d",count );
+    }
+
+    if ( !_reactor.empty() )
+    {
+        return luaL_error( L,"io thread already start" );
+    }
+
+    for ( int32 idx = 0;idx < count;idx ++ )
+    {
+        class io_reactor *reactor = new class io_reactor( idx );
+        if ( !reactor->start() )
+        {
+            delete reactor;
+            return luaL_error( L,"io thread start fail" );
+        }
+
+        _reactor.push_back( reactor );
+    }
+
+    return 0;
+}
+
 /* 产生一个唯一的连接id
  * 之所以不用系统的文件描述符fd，是因为fd对于上层逻辑不可控。比如一个fd被释放，可能在多个进程
  * 之间还未处理完，此fd就被重用了。当前的连接id不太可能会在短时间内重用。
@@ -317,6 +386,72 @@ int32 lnetwork_mgr::load_one_schema( lua_State *L )
     return 1;
 }
 
+/* 不经过socket直接编码
+ * network_mgr:encode( codec_type,schema,object,... )
+ * bson、stream编码object后面的所有参数，protobuf等只编码后面的第一个table
+ */
+int32 lnetwork_mgr::encode( lua_State *L )
+{
+    int32 type         = luaL_checkinteger( L,1 );
+    const char *schema = luaL_checkstring ( L,2 );
+    const char *object = luaL_checkstring ( L,3 );
+
+    codec *encoder = static_global::codec_mgr()->
+        get_codec( static_cast<codec::codec_t>(type) );
+    if ( !encoder ) return luaL_error( L,"invalid codec type:%d",type );
+
+    cmd_cfg_t cfg;
+    memset( &cfg,0,sizeof(cfg) );
+    snprintf( cfg._schema,MAX_SCHEMA_NAME,"%s",schema );
+    snprintf( cfg._object,MAX_SCHEMA_NAME,"%s",object );
+
+    const char *buffer = NULL;
+    int32 len = encoder->encode( L,4,&buffer,&cfg );
+    if ( len < 0 )
+    {
+        encoder->finalize();
+        return luaL_error( L,"encode error" );
+    }
+
+    lua_pushlstring( L,buffer,len );
+    encoder->finalize();
+
+    return 1;
+}
+
+/* 不经过socket直接解码
+ * network_mgr:decode( codec_type,schema,object,buffer )
+ */
+int32 lnetwork_mgr::decode( lua_State *L )
+{
+    int32 type         = luaL_checkinteger( L,1 );
+    const char *schema = luaL_checkstring ( L,2 );
+    const char *object = luaL_checkstring ( L,3 );
+
+    size_t len = 0;
+    const char *buffer = luaL_checklstring( L,4,&len );
+
+    codec *decoder = static_global::codec_mgr()->
+        get_codec( static_cast<codec::codec_t>(type) );
+    if ( !decoder ) return luaL_error( L,"invalid codec type:%d",type );
+
+    cmd_cfg_t cfg;
+    memset( &cfg,0,sizeof(cfg) );
+    snprintf( cfg._schema,MAX_SCHEMA_NAME,"%s",schema );
+    snprintf( cfg._object,MAX_SCHEMA_NAME,"%s",object );
+
+    int32 top = lua_gettop( L );
+    int32 cnt = decoder->decode( L,buffer,static_cast<int32>(len),&cfg );
+    decoder->finalize();
+    if ( cnt < 0 )
+    {
+        lua_settop( L,top );
+        return luaL_error( L,"decode error" );
+    }
+
+    return cnt;
+}
+
 /* 设置(客户端)连接所有者 */
 int32 lnetwork_mgr::set_conn_owner( lua_State *L )
 {
@@ -597,6 +732,32 @@ int32 lnetwork_mgr::set_recv_buffer_size( lua_State *L )
     return 0;
 }
 
+/* 设置发送缓冲区分段模式
+ * 分段模式下发送缓冲区由多个内存块组成，写入时不需要移动、拷贝旧数据，用writev发送
+ * network_mgr:set_send_segment( conn_id,true )
+ */
+int32 lnetwork_mgr::set_send_segment( lua_State *L )
+{
+    uint32 conn_id = luaL_checkinteger( L,1 );
+    bool segment   = lua_toboolean( L,2 );
+
+    socket_map_t::iterator itr = _socket_map.find( conn_id );
+    if ( itr == _socket_map.end() )
+    {
+        return luaL_error( L,"no such socket found" );
+    }
+
+    class socket *_socket = itr->second;
+    if ( _socket->send_buffer().data_size() > 0 )
+    {
+        return luaL_error( L,"can not set segment while sending" );
+    }
+
+    _socket->set_send_segment( segment );
+
+    return 0;
+}
+
 /* 通过onwer获取socket连接 */
 class socket *lnetwork_mgr::get_conn_by_owner( owner_t owner ) const
 {
@@ -751,6 +912,13 @@ int32 lnetwork_mgr::set_conn_codec( lua_State *L ) /* 设置socket的编译方
         return luaL_error( L,"invalid codec type" );
     }
 
+    // 可选的编码(如upb)没有编译进来
+    if ( codec::CDC_NONE != codec_type && !static_global::codec_mgr()->
+        get_codec( static_cast<codec::codec_t>( codec_type ) ) )
+    {
+        return luaL_error( L,"codec not support:%d",codec_type );
+    }
+
     if ( sk->set_codec_type( static_cast<codec::codec_t>( codec_type ) ) < 0 )
     {
         return luaL_error( L,"set conn codec error" );
@@ -892,6 +1060,7 @@ int32 lnetwork_mgr::send_ctrl_packet ( lua_State *L )
 
 /* 广播到所有连接到当前进程的服务器
  * srv_multicast( conn_list,codec_type,cmd,errno,pkt )
+ * 返回成功写入发送缓冲区的连接数
  */
 int32 lnetwork_mgr::srv_multicast( lua_State *L )
 {
@@ -922,9 +1091,9 @@ int32 lnetwork_mgr::srv_multicast( lua_State *L )
 
     codec *encoder = static_global::codec_mgr()
         ->get_codec( static_cast<codec::codec_t>(codec_ty) );
-    if ( !cfg )
+    if ( !encoder )
     {
-        return luaL_error( L,"no codec conf found: %d",cmd );
+        return luaL_error( L,"invalid codec type:%d",codec_ty );
     }
 
     const char *buffer = NULL;
@@ -942,6 +1111,11 @@ int32 lnetwork_mgr::srv_multicast( lua_State *L )
         return luaL_error( L,"buffer size over MAX_PACKET_LEN" );
     }
 
+    /* 数据帧只构造一次，同一packet类型的socket共用 */
+    class shared_frame *frames[packet::PKT_MAX] = { NULL };
+
+    int32 sent = 0; // 成功写入发送缓冲区的连接数
+
     lua_pushnil(L);  /* first key */
     while ( lua_next(L, 1) != 0 )
     {
@@ -949,32 +1123,56 @@ int32 lnetwork_mgr::srv_multicast( lua_State *L )
         {
             lua_pop( L, 1 );
             encoder->finalize();
+            shared_frame::release( frames,packet::PKT_MAX );
             return luaL_error( L,"conn list expect integer" );
         }
 
         uint32 conn_id = static_cast<uint32>( lua_tointeger(L,-1) );
 
         lua_pop( L, 1 );
-        class packet *pkt = raw_check_packet( L,conn_id,socket::CNT_SSCN );
-        if ( !pkt )
+        class socket *sk = get_conn_by_conn_id( conn_id );
+        if ( !sk || socket::CNT_SSCN != sk->conn_type() || !sk->get_packet() )
         {
             ERROR( "srv_multicast conn not found:%ud",conn_id );
             continue;
         }
 
-        if ( pkt->raw_pack_ss( cmd,ecode,_session,buffer,len ) < 0 )
+        class packet *pkt = sk->get_packet();
+        packet::packet_t pkt_ty = pkt->type();
+        if ( !frames[pkt_ty] )
+        {
+            frames[pkt_ty] = pkt->make_ss_frame( cmd,ecode,_session,buffer,len );
+        }
+
+        // 该packet类型不支持共享帧，单独打包
+        if ( !frames[pkt_ty] )
+        {
+            if ( pkt->raw_pack_ss( cmd,ecode,_session,buffer,len ) < 0 )
+            {
+                ERROR( "srv_multicast can not raw_pack_ss:%ud",conn_id );
+                continue;
+            }
+            ++sent;
+            continue;
+        }
+
+        if ( sk->append_frame( frames[pkt_ty] ) < 0 )
         {
-            ERROR( "srv_multicast can not raw_pack_ss:%ud",conn_id );
+            ERROR( "srv_multicast can not append frame:%ud",conn_id );
             continue;
         }
+        ++sent;
     }
 
     encoder->finalize();
-    return 0;
+    shared_frame::release( frames,packet::PKT_MAX );
+    lua_pushinteger( L,sent );
+    return 1;
 }
 
 /* 网关进程广播数据到客户端
  * clt_multicast( conn_list,codec_type,cmd,errno,pkt )
+ * 返回成功写入发送缓冲区的连接数
  */
 int32 lnetwork_mgr::clt_multicast( lua_State *L )
 {
@@ -1005,9 +1203,9 @@ int32 lnetwork_mgr::clt_multicast( lua_State *L )
 
     codec *encoder = static_global::codec_mgr()
         ->get_codec( static_cast<codec::codec_t>(codec_ty) );
-    if ( !cfg )
+    if ( !encoder )
     {
-        return luaL_error( L,"no codec conf found: %d",cmd );
+        return luaL_error( L,"invalid codec type:%d",codec_ty );
     }
 
     const char *buffer = NULL;
@@ -1025,6 +1223,11 @@ int32 lnetwork_mgr::clt_multicast( lua_State *L )
         return luaL_error( L,"buffer size over MAX_PACKET_LEN" );
     }
 
+    /* 数据帧只构造一次，同一packet类型的socket共用 */
+    class shared_frame *frames[packet::PKT_MAX] = { NULL };
+
+    int32 sent = 0; // 成功写入发送缓冲区的连接数
+
     lua_pushnil(L);  /* first key */
     while ( lua_next(L, 1) != 0 )
     {
@@ -1032,28 +1235,51 @@ int32 lnetwork_mgr::clt_multicast( lua_State *L )
         {
             lua_pop( L, 1 );
             encoder->finalize();
+            shared_frame::release( frames,packet::PKT_MAX );
             return luaL_error( L,"conn list expect integer" );
         }
 
         uint32 conn_id = static_cast<uint32>( lua_tointeger(L,-1) );
 
         lua_pop( L, 1 );
-        class packet *pkt = raw_check_packet( L,conn_id,socket::CNT_SSCN );
-        if ( !pkt )
+        class socket *sk = get_conn_by_conn_id( conn_id );
+        if ( !sk || socket::CNT_SCCN != sk->conn_type() || !sk->get_packet() )
         {
             ERROR( "clt_multicast conn not found:%ud",conn_id );
             continue;
         }
 
-        if ( pkt->raw_pack_clt( cmd,ecode,buffer,len ) < 0 )
+        class packet *pkt = sk->get_packet();
+        packet::packet_t pkt_ty = pkt->type();
+        if ( !frames[pkt_ty] )
+        {
+            frames[pkt_ty] = pkt->make_clt_frame( cmd,ecode,buffer,len );
+        }
+
+        // 该packet类型不支持共享帧，单独打包
+        if ( !frames[pkt_ty] )
+        {
+            if ( pkt->raw_pack_clt( cmd,ecode,buffer,len ) < 0 )
+            {
+                ERROR( "clt_multicast can not raw_pack_clt:%ud",conn_id );
+                continue;
+            }
+            ++sent;
+            continue;
+        }
+
+        if ( sk->append_frame( frames[pkt_ty] ) < 0 )
         {
-            ERROR( "clt_multicast can not raw_pack_ss:%ud",conn_id );
+            ERROR( "clt_multicast can not append frame:%ud",conn_id );
             continue;
         }
+        ++sent;
     }
 
     encoder->finalize();
-    return 0;
+    shared_frame::release( frames,packet::PKT_MAX );
+    lua_pushinteger( L,sent );
+    return 1;
 }
 
 /* 非网关数据广播数据到客户端
@@ -31,6 +31,8 @@ public:
     int32 set_curr_session( lua_State *L ); /* 设置当前服务器的session */
 
     int32 load_one_schema( lua_State *L ); /* 加载schema文件 */
+    int32 encode( lua_State *L ); /* 不经过socket直接编码，用于测试、缓存数据包 */
+    int32 decode( lua_State *L ); /* 不经过socket直接解码，用于测试 */
     int32 get_http_header( lua_State *L ); /* 获取http报文头数据 */
 
     /* 这三个是通用接口，数据打包差异是通过packet的多态实现的 */
@@ -51,8 +53,10 @@ public:
 
     int32 set_send_buffer_size( lua_State *L ); /* 设置发送缓冲区大小 */
     int32 set_recv_buffer_size( lua_State *L ); /* 设置接收缓冲区大小 */
+    int32 set_send_segment( lua_State *L ); /* 设置发送缓冲区分段模式 */
 
     int32 new_ssl_ctx( lua_State *L ); /* 创建一个ssl上下文 */
+    int32 set_io_thread( lua_State *L ); /* 开启多线程io */
 
     /* socket基本操作 */
     int32 close   ( lua_State *L );
@@ -63,6 +67,10 @@ public:
 public:
     /* 删除无效的连接 */
     void invoke_delete();
+    /* 唤醒io线程处理本轮主循环产生的消息 */
+    void invoke_reactor();
+    /* 为新连接选择一个io线程，未开启多线程io或者不是客户端连接返回NULL */
+    class io_reactor *select_reactor( socket::conn_t conn_ty ) const;
 
     /* 通过所有者查找连接id */
     uint32 get_conn_id_by_owner( owner_t owner ) const;
@@ -109,6 +117,7 @@ private:
     socket_map_t _socket_map;
 
     std::vector<uint32> _deleting;/* 异步删除的socket */
+    std::vector<class io_reactor *> _reactor; /* 多线程io模式下的io线程 */
     /* owner-conn_id 映射,ssc数据包转发时需要 */
     map_t<owner_t,uint32> _owner_map;
 
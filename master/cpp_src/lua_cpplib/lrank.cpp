@@ -83,6 +83,121 @@ int32 linsertion_rank::get_id_by_rank(lua_State *L)
     return 1;
 }
 
+// ========================== skiplist rank =================================
+int32 lskiplist_rank::remove(lua_State *L)
+{
+    base_rank::object_id_t id = luaL_checkinteger(L,1);
+
+    int32 ret = skiplist_rank::remove(id);
+
+    lua_pushboolean(L,ret == 0);
+    return 1;
+}
+
+int32 lskiplist_rank::insert(lua_State *L)
+{
+    base_rank::object_id_t id = luaL_checkinteger(L,1);
+
+    // 可以传入一个或多个排序因子，至少传入一个
+    int32 factor_idx = 1;
+    base_rank::factor_t factor = {0}; // 全部初始化为0
+    factor[0] = luaL_checkinteger(L,2);
+    for (int32 idx = 1;idx < MAX_RANK_FACTOR;idx ++)
+    {
+        // 没有默认为0
+        if (!lua_isinteger(L,2 + idx)) break;
+        factor[factor_idx++] = lua_tointeger(L,2 + idx);
+    }
+
+    int32 ret = skiplist_rank::insert(id,factor,factor_idx);
+    if (0 != ret)
+    {
+        return luaL_error(L,"rank insert error,code:%d",ret);
+    }
+
+    return 0;
+}
+
+int32 lskiplist_rank::update(lua_State *L)
+{
+    base_rank::object_id_t id = luaL_checkinteger(L,1);
+    base_rank::raw_factor_t factor = luaL_checkinteger(L,2);
+
+    int32 factor_idx = luaL_optinteger(L,3,1);
+
+    int32 ret = skiplist_rank::update(id,factor,factor_idx);
+
+    // 有可能未能进入排行榜，更新失败
+    lua_pushboolean(L,ret == 0);
+    return 1;
+}
+
+int32 lskiplist_rank::get_factor(lua_State *L)
+{
+    base_rank::object_id_t id = luaL_checkinteger(L,1);
+    const base_rank::raw_factor_t *factor = skiplist_rank::get_factor(id);
+    if (!factor) return 0;
+
+    int32 max_factor = skiplist_rank::get_max_factor();
+
+    lua_checkstack( L,max_factor );
+    for (int32 idx = 0;idx < max_factor;idx ++)
+    {
+        lua_pushinteger(L,factor[idx]);
+    }
+    return max_factor;
+}
+
+int32 lskiplist_rank::get_rank_by_id(lua_State *L)
+{
+    base_rank::object_id_t id = luaL_checkinteger(L,1);
+
+    lua_pushinteger(L,skiplist_rank::get_rank_by_id(id));
+
+    return 1;
+}
+
+int32 lskiplist_rank::get_id_by_rank(lua_State *L)
+{
+    int32 rank = luaL_checkinteger(L,1);
+
+    lua_pushinteger(L,skiplist_rank::get_id_by_rank(rank));
+
+    return 1;
+}
+
+/* 获取排名在[from,to]之间的对象id，依次放到table中
+ * 第N页(每页size个)即get_range((N - 1)*size + 1,N*size,tbl)
+ * 同get_top_n，最后设置一个n表示数量，返回数量
+ */
+int32 lskiplist_rank::get_range(lua_State *L)
+{
+    int32 from = luaL_checkinteger(L,1);
+    int32 to   = luaL_checkinteger(L,2);
+
+    int32 tbl_idx = 3;
+    lUAL_CHECKTABLE(L,tbl_idx);
+
+    int32 count = 0;
+    int32 max_count = to - from + 1;
+
+    // 只有定位第一个是O(logN)，后面的顺序遍历
+    const node_t *node = get_node_by_rank(from < 1 ? 1 : from);
+    if (from < 1) max_count -= 1 - from;
+    for (;node && count < max_count;node = node->next())
+    {
+        lua_pushinteger(L,node->_id);
+        lua_rawseti(L,tbl_idx,++count);
+    }
+
+    lua_pushstring( L,"n" );
+    lua_pushinteger(L,count);
+    lua_rawset(L,tbl_idx);
+
+    lua_pushinteger(L,count);
+    return 1;
+}
+
 // ========================== bucket rank =================================
 
 // 插入一个排序对象
@@ -110,6 +225,99 @@ int32 lbucket_rank::insert(lua_State *L)
     return 0;
 }
 
+/* 批量插入，避免大量对象时每个对象调用一次
+ * @list:{id,factor1,...,id,factor1,...}，每个对象factor_cnt个因子
+ * @factor_cnt:每个对象的排序因子数量，默认1
+ */
+int32 lbucket_rank::insert_list(lua_State *L)
+{
+    int32 tbl_idx = 1;
+    lUAL_CHECKTABLE(L,tbl_idx);
+
+    int32 factor_cnt = luaL_optinteger(L,2,1);
+    if (factor_cnt <= 0 || factor_cnt > MAX_RANK_FACTOR)
+    {
+        return luaL_error(L,"rank factor count illegal:%d",factor_cnt);
+    }
+
+    int32 len = static_cast<int32>(lua_rawlen(L,tbl_idx));
+    if (0 != len % (factor_cnt + 1))
+    {
+        return luaL_error(L,"rank insert list length illegal:%d",len);
+    }
+
+    bucket_rank::reserve(bucket_rank::get_count() + len / (factor_cnt + 1));
+
+    base_rank::factor_t factor = {0}; // 没有的因子为0
+    for (int32 idx = 1;idx <= len;idx += factor_cnt + 1)
+    {
+        lua_rawgeti(L,tbl_idx,idx);
+        base_rank::object_id_t id = lua_tointeger(L,-1);
+        for (int32 fi = 0;fi < factor_cnt;fi ++)
+        {
+            lua_rawgeti(L,tbl_idx,idx + 1 + fi);
+            factor[fi] = lua_tointeger(L,-1);
+        }
+        lua_pop(L,factor_cnt + 1);
+
+        bucket_rank::insert(id,factor);
+    }
+
+    lua_pushinteger(L,len / (factor_cnt + 1));
+    return 1;
+}
+
+/* 排序
+ * @thread_cnt:最多使用的线程数，默认1，数量少时不会开线程
+ */
+int32 lbucket_rank::sort(lua_State *L)
+{
+    int32 thread_cnt = luaL_optinteger(L,1,1);
+    if (thread_cnt <= 0 || thread_cnt > RANK_SORT_THREAD_MAX)
+    {
+        return luaL_error(L,"rank sort thread count illegal:%d",thread_cnt);
+    }
+
+    bucket_rank::sort(thread_cnt);
+    return 0;
+}
+
+int32 lbucket_rank::get_factor(lua_State *L)
+{
+    base_rank::object_id_t id = luaL_checkinteger(L,1);
+
+    check_sort();
+    const base_rank::raw_factor_t *factor = bucket_rank::get_factor(id);
+    if (!factor) return 0;
+
+    lua_checkstack( L,MAX_RANK_FACTOR );
+    for (int32 idx = 0;idx < MAX_RANK_FACTOR;idx ++)
+    {
+        lua_pushinteger(L,factor[idx]);
+    }
+    return MAX_RANK_FACTOR;
+}
+
+int32 lbucket_rank::get_rank_by_id(lua_State *L)
+{
+    base_rank::object_id_t id = luaL_checkinteger(L,1);
+
+    check_sort();
+    lua_pushinteger(L,bucket_rank::get_rank_by_id(id));
+
+    return 1;
+}
+
+int32 lbucket_rank::get_id_by_rank(lua_State *L)
+{
+    int32 rank = luaL_checkinteger(L,1);
+
+    check_sort();
+    lua_pushinteger(L,bucket_rank::get_id_by_rank(rank));
+
+    return 1;
+}
+
 // 获取前N名对象
 int32 lbucket_rank::get_top_n(lua_State *L)
 {
@@ -118,23 +326,17 @@ int32 lbucket_rank::get_top_n(lua_State *L)
     int32 tbl_idx = 2;
     lUAL_CHECKTABLE(L,tbl_idx);
 
+    check_sort();
+
     // 类似table.pack的做法，最后设置一个n表示数量
-    int32 count = 0;
-    bucket_list_t::const_iterator iter = _bucket_list.begin();
-    for (;iter != _bucket_list.end();iter ++)
+    int32 count = bucket_rank::get_count();
+    if (top_n < count) count = top_n < 0 ? 0 : top_n;
+    for (int32 idx = 0;idx < count;idx ++)
     {
-        const bucket_t &bucket = iter->second;
-        bucket_t::const_iterator biter = bucket.begin();
-        for (;biter != bucket.end();biter ++)
-        {
-            lua_pushinteger(L,*biter);
-            lua_rawseti(L,tbl_idx,++count);
-
-            if (count >= top_n) goto DONE;
-        }
+        lua_pushinteger(L,_item[idx]._id);
+        lua_rawseti(L,tbl_idx,idx + 1);
     }
 
-DONE:
     lua_pushstring( L,"n" ); 
     lua_pushinteger(L,count);
     lua_rawset(L,tbl_idx);
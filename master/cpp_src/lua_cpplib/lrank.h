@@ -46,6 +46,47 @@ public:
     int32 get_id_by_rank(lua_State *L);
 };
 
+class lskiplist_rank : public skiplist_rank
+{
+public:
+    ~lskiplist_rank() {};
+    explicit lskiplist_rank(lua_State *L) {};
+
+    int32 clear(lua_State *L) { skiplist_rank::clear();return 0; };
+
+    int32 remove(lua_State *L);
+    int32 insert(lua_State *L);
+    int32 update(lua_State *L);
+
+    int32 get_count(lua_State *L)
+    {
+        lua_pushinteger(L,skiplist_rank::get_count());
+        return 1;
+    }
+
+    int32 set_max_count(lua_State *L)
+    {
+        int32 max_count = luaL_checkinteger(L,1);
+        if (max_count <= 0 || max_count > 1024000)
+        {
+            return luaL_error(L,"max count illegal:%d",max_count);
+        }
+        skiplist_rank::set_max_count(max_count);
+        return 0;
+    }
+
+    int32 get_max_factor(lua_State *L)
+    {
+        lua_pushinteger(L,skiplist_rank::get_max_factor());
+        return 1;
+    }
+
+    int32 get_factor(lua_State *L);
+    int32 get_rank_by_id(lua_State *L);
+    int32 get_id_by_rank(lua_State *L);
+    int32 get_range(lua_State *L); // 获取某一段排名的对象，用于分页
+};
+
 class lbucket_rank : public bucket_rank
 {
 public:
@@ -53,13 +94,22 @@ public:
     explicit lbucket_rank(lua_State *L) {};
 
     int32 insert(lua_State *L);
+    int32 insert_list(lua_State *L); // 批量插入
+    int32 sort(lua_State *L);
     int32 get_top_n(lua_State *L);
 
+    int32 get_factor(lua_State *L);
+    int32 get_rank_by_id(lua_State *L);
+    int32 get_id_by_rank(lua_State *L);
+
     int32 clear(lua_State *L) { bucket_rank::clear();return 0; }
     int32 get_count(lua_State *L)
     {
         lua_pushinteger(L,bucket_rank::get_count());return 1;
     }
+private:
+    // 有插入没排序的，查询前先排序
+    void check_sort() { if (!is_sorted()) bucket_rank::sort(); }
 };
 
 #endif /* __LRANK_H__ */
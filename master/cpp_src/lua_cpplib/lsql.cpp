@@ -1,61 +1,46 @@
+#include <unistd.h> /* usleep */
+
 #include "lsql.h"
 #include "ltools.h"
 #include "../system/static_global.h"
 
-lsql::lsql( lua_State *L ) : thread("lsql")
+////////////////////////////////////////////////////////////////////////////////
+sql_worker::sql_worker( class lsql *owner,int32 dbid,int32 index )
+    : queue_thread(_name)
 {
+    _owner = owner;
+    _index = index;
     _valid = -1;
-    _dbid = luaL_checkinteger( L,2 );
-}
 
-lsql::~lsql()
-{
+    snprintf( _name,sizeof(_name),"lsql_%d_%d",dbid,index );
 }
 
-size_t lsql::busy_job( size_t *finished,size_t *unfinished )
+sql_worker::~sql_worker()
 {
-    lock();
-    size_t finished_sz = _result.size();
-    size_t unfinished_sz = _query.size();
-
-    if ( is_busy() ) unfinished_sz += 1;
-    unlock();
-
-    if ( finished ) *finished = finished_sz;
-    if ( unfinished ) *unfinished = unfinished_sz;
+    /* 线程已停止，剩下的都是关服时来不及处理的 */
+    const struct sql_query *query = NULL;
+    while ( pop_query( query ) ) delete query;
 
-    return finished_sz + unfinished_sz;
+    struct sql_result res;
+    while ( _result.pop( res ) ) delete res._res;
 }
 
-// 是否有效(只判断是否连接上，后续断线等不检测)
-int32 lsql::valid ( lua_State *L )
+bool sql_worker::start( const char *host,int32 port,
+    const char *usr,const char *pwd,const char *dbname )
 {
-    lua_pushinteger( L,_valid );
+    _valid = -1;
+    _sql.set( host,port,usr,pwd,dbname );
 
-    return 1;
+    return thread::start( 5 );  /* 5s ping一下mysql */
 }
 
-/* 连接mysql并启动线程 */
-int32 lsql::start( lua_State *L )
+void sql_worker::stop()
 {
-    if ( active() )
-    {
-        return luaL_error( L,"sql thread already active" );
-    }
-
-    const char *host   = luaL_checkstring  ( L,1 );
-    const int32 port   = luaL_checkinteger ( L,2 );
-    const char *usr    = luaL_checkstring  ( L,3 );
-    const char *pwd    = luaL_checkstring  ( L,4 );
-    const char *dbname = luaL_checkstring  ( L,5 );
-
-    _sql.set( host,port,usr,pwd,dbname );
-
-    thread::start( 5 );  /* 10s ping一下mysql */
-    return 0;
+    _valid = -1;
+    thread::stop();
 }
 
-void lsql::routine( notify_t notify )
+void sql_worker::routine( notify_t notify )
 {
     /* 如果某段时间连不上，只能由下次超时后触发
      * 超时时间由thread::start参数设定
@@ -66,45 +51,44 @@ void lsql::routine( notify_t notify )
     invoke_sql();
 }
 
-const struct sql_query *lsql::pop_query()
+void sql_worker::invoke_sql( bool is_return )
 {
     const struct sql_query *query = NULL;
 
-    lock();
-    if ( !_query.empty() )
+    while ( pop_query( query ) )
     {
-        query = _query.front();
-        _query.pop();
-    }
-    unlock();
-
-    return query;
-}
-
-void lsql::invoke_sql( bool is_return )
-{
-    const struct sql_query *query = NULL;
-
-    while ( ( query = pop_query() ) )
-    {
-        const char *stmt = query->_stmt;
-        assert( "empty sql statement",stmt && query->_size > 0 );
-
+        int32 ecode = 0;
         struct sql_res *res = NULL;
-        if ( expect_false( _sql.query( stmt,query->_size ) ) )
+        if ( query->_prepare )
         {
-            ERROR( "sql query error:%s",_sql.error() );
-            ERROR( "sql will not exec:%s",stmt );
+            ecode = execute_stmt( query,&res );
+            if ( expect_false( ecode ) )
+            {
+                ERROR( "sql execute error(%d):%s",ecode,query->get_stmt() );
+            }
         }
         else
         {
-            /* 对于select之类的查询，即使不需要回调，也要取出结果
-             * 不然将会导致连接不同步
-             */
-            if ( _sql.result( &res ) )
+            const char *stmt = query->_stmt;
+            assert( "empty sql statement",stmt && query->_size > 0 );
+
+            if ( expect_false( _sql.query( stmt,query->_size ) ) )
             {
-                ERROR( "sql result error[%s]:%s",stmt,_sql.error() );
+                ERROR( "sql query error:%s",_sql.error() );
+                ERROR( "sql will not exec:%s",stmt );
             }
+            else
+            {
+                /* 对于select之类的查询，即使不需要回调，也要取出结果
+                 * 不然将会导致连接不同步
+                 */
+                if ( _sql.result( &res ) )
+                {
+                    ERROR( "sql result error[%s]:%s",stmt,_sql.error() );
+                }
+            }
+
+            ecode = _sql.get_errno();
         }
 
         /* 关服的时候不需要回调到脚本
@@ -112,7 +96,7 @@ void lsql::invoke_sql( bool is_return )
          */
         if ( is_return && query->_id > 0 )
         {
-            push_result( query->_id,res );
+            push_result( query->_id,ecode,res );
         }
         else
         {
@@ -122,32 +106,270 @@ void lsql::invoke_sql( bool is_return )
         delete query;
         query = NULL;
     }
+
+    notify_query_full();
+}
+
+/* 执行预处理语句。连接断开重连后，之前prepare的语句都失效了，需要重新prepare
+ * 再执行一次
+ */
+int32 sql_worker::execute_stmt(
+    const struct sql_query *query,struct sql_res **res )
+{
+    const struct sql_stmt *prepare = query->_prepare;
+
+    size_t sid = prepare->_sid;
+    if ( _stmt.size() <= sid ) _stmt.resize( sid + 1,NULL );
+
+    int32 ecode = 0;
+    for ( int32 retry = 0;retry < 2;retry ++ )
+    {
+        MYSQL_STMT *handle = _stmt[sid];
+        if ( !handle )
+        {
+            handle = _sql.prepare( prepare->_stmt,prepare->_size,ecode );
+            if ( !handle ) return ecode;
+
+            _stmt[sid] = handle;
+        }
+
+        ecode = _sql.execute( handle,query,res );
+        if ( 0 == ecode || !sql::is_stmt_lost( ecode ) ) return ecode;
+
+        _sql.close_stmt( handle );
+        _stmt[sid] = NULL;
+
+        if ( 0 != _sql.ping() ) return ecode;
+    }
+
+    return ecode;
+}
+
+void sql_worker::close_stmt()
+{
+    std::vector<MYSQL_STMT *>::iterator itr = _stmt.begin();
+    for ( ;itr != _stmt.end();itr ++ )
+    {
+        if ( *itr ) _sql.close_stmt( *itr );
+    }
+
+    _stmt.clear();
+}
+
+bool sql_worker::pop_result( struct sql_result &res )
+{
+    return _result.pop( res );
+}
+
+void sql_worker::notification( notify_t notify )
+{
+    if ( NTF_CUSTOM == notify )
+    {
+        flush_query();
+        _owner->invoke_result();
+    }
+    else if ( NTF_ERROR == notify )
+    {
+        ERROR( "sql thread error:%s",get_name() );
+    }
+    else
+    {
+        assert( "unknow sql event",false );
+    }
+}
+
+bool sql_worker::uninitialize()
+{
+    if ( _sql.ping() )
+    {
+        ERROR( "mysql ping fail at cleanup,data may lost:%s",_sql.error() );
+        /* TODO write to file ? */
+    }
+    else
+    {
+        invoke_sql( false );
+    }
+
+    close_stmt();
+    _sql.disconnect() ;
+    mysql_thread_end();
+
+    return true;
+}
+
+bool sql_worker::initialize()
+{
+    mysql_thread_init();
+
+    int32 ok = _sql.connect();
+    if ( ok > 0 )
+    {
+        _valid = 0;
+        mysql_thread_end();
+        notify_parent( NTF_ERROR );
+        return false;
+    }
+    else if ( -1 == ok )
+    {
+        // 初始化正常，但是需要稍后重试
+        return true;
+    }
+
+    _valid = 1;
+    return true;
+}
+
+void sql_worker::push_result( int32 id,int32 ecode,struct sql_res *res )
+{
+    /* 需要回调的应该都有结果，没有的话可能是逻辑错误 */
+    if ( !res )
+    {
+        ERROR( "sql query do not have result" );
+    }
+
+    struct sql_result result;
+
+    result._id    = id;
+    result._ecode = ecode;
+    result._res   = res;
+
+    /* 结果队列满了说明主线程处理不过来，子线程等待即可。主线程停止线程时不会
+     * 再处理结果，不能一直等
+     */
+    while ( expect_false( !_result.push( result ) ) )
+    {
+        if ( !active() )
+        {
+            ERROR( "sql result queue full,result drop:%d",id );
+            delete res;
+            return;
+        }
+
+        notify_parent( NTF_CUSTOM );
+        usleep( 1000 );
+    }
+
+    notify_parent( NTF_CUSTOM );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+lsql::lsql( lua_State *L )
+{
+    _dbid = luaL_checkinteger( L,2 );
+}
+
+lsql::~lsql()
+{
+    stop_worker();
+
+    /* 连接线程都停止了，才能释放预处理语句 */
+    std::vector<struct sql_stmt *>::iterator itr = _stmt.begin();
+    for ( ;itr != _stmt.end();itr ++ ) delete *itr;
+
+    _stmt.clear();
+}
+
+void lsql::stop_worker()
+{
+    std::vector<class sql_worker *>::iterator itr = _worker.begin();
+    for ( ;itr != _worker.end();itr ++ )
+    {
+        class sql_worker *worker = *itr;
+        if ( worker->active() ) worker->stop();
+
+        delete worker;
+    }
+
+    _worker.clear();
+}
+
+// 是否有效(只判断是否连接上，后续断线等不检测)
+// 有一个连接失败则返回0，有一个连接中则返回-1，全部连接上才返回1
+int32 lsql::valid ( lua_State *L )
+{
+    int32 valid = _worker.empty() ? -1 : 1;
+
+    std::vector<class sql_worker *>::const_iterator itr = _worker.begin();
+    for ( ;itr != _worker.end();itr ++ )
+    {
+        int32 ok = (*itr)->valid();
+        if ( 0 == ok ) { valid = 0;break; }
+        if ( -1 == ok ) valid = -1;
+    }
+
+    lua_pushinteger( L,valid );
+
+    return 1;
+}
+
+/* 连接mysql并启动线程
+ * @pool:连接数量，默认1个
+ */
+int32 lsql::start( lua_State *L )
+{
+    if ( !_worker.empty() && _worker.front()->active() )
+    {
+        return luaL_error( L,"sql thread already active" );
+    }
+
+    const char *host   = luaL_checkstring  ( L,1 );
+    const int32 port   = luaL_checkinteger ( L,2 );
+    const char *usr    = luaL_checkstring  ( L,3 );
+    const char *pwd    = luaL_checkstring  ( L,4 );
+    const char *dbname = luaL_checkstring  ( L,5 );
+    const int32 pool   = luaL_optinteger   ( L,6,1 );
+
+    if ( pool < 1 || pool > SQL_POOL_MAX )
+    {
+        return luaL_error( L,"sql pool size illegal:%d",pool );
+    }
+
+    stop_worker(); /* 之前stop了的连接 */
+
+    for ( int32 index = 0;index < pool;index ++ )
+    {
+        class sql_worker *worker = new sql_worker( this,_dbid,index );
+        if ( !worker->start( host,port,usr,pwd,dbname ) )
+        {
+            delete worker;
+            stop_worker();
+
+            return luaL_error( L,"sql thread start fail" );
+        }
+
+        _worker.push_back( worker );
+    }
+
+    return 0;
 }
 
 int32 lsql::stop( lua_State *L )
 {
-    _valid = -1;
-    thread::stop();
+    std::vector<class sql_worker *>::iterator itr = _worker.begin();
+    for ( ;itr != _worker.end();itr ++ )
+    {
+        if ( (*itr)->active() ) (*itr)->stop();
+    }
 
     return 0;
 }
 
-void lsql::push_query( const struct sql_query *query )
+/* 指定了key的sql按key分配到固定的连接，否则分配给最闲的连接 */
+class sql_worker *lsql::select_worker( int64 key )
 {
-    lock();
-    bool notify = _query.empty() ? true : false;
-    _query.push( query );
-    unlock();
+    if ( key > 0 ) return _worker[key % _worker.size()];
 
-    /* 子线程的socket是阻塞的。主线程检测到子线程正常处理sql则无需告知。防止
-     * 子线程socket缓冲区满造成Resource temporarily unavailable
-     */
-    if ( notify ) notify_child( NTF_CUSTOM );
+    return sql_worker::least_pending( _worker );
 }
 
+/* 执行sql
+ * @id:回调id，0表示不需要回调
+ * @stmt:sql语句
+ * @key:可选，相同key的sql在同一个连接上按顺序执行，一般是玩家id
+ */
 int32 lsql::do_sql( lua_State *L )
 {
-    if ( !active() )
+    if ( _worker.empty() || !_worker.front()->active() )
     {
         return luaL_error( L,"sql thread not active" );
     }
@@ -160,43 +382,96 @@ int32 lsql::do_sql( lua_State *L )
         return luaL_error( L,"sql select,empty sql statement" );
     }
 
+    int64 key = luaL_optinteger( L,3,0 );
 
     struct sql_query *query = new sql_query( id,size,stmt );
 
-    push_query( query );
+    select_worker( key )->push_query( query );
     return 0;
 }
 
-void lsql::notification( notify_t notify )
+/* 登记一个预处理语句，返回语句id，用于do_stmt
+ * 语句在各个连接第一次执行时才prepare，因此语法错误要到执行时才返回
+ */
+int32 lsql::prepare( lua_State *L )
 {
-    if ( NTF_CUSTOM == notify )
+    size_t size = 0;
+    const char *stmt = luaL_checklstring( L,1,&size );
+    if ( !stmt || size == 0 )
     {
-        invoke_result();
+        return luaL_error( L,"sql prepare,empty sql statement" );
     }
-    else if ( NTF_ERROR == notify )
+
+    int32 sid = static_cast<int32>( _stmt.size() ) + 1;
+    _stmt.push_back( new sql_stmt( sid,size,stmt ) );
+
+    lua_pushinteger( L,sid );
+    return 1;
+}
+
+/* 执行预处理语句
+ * @id:回调id，0表示不需要回调
+ * @sid:prepare返回的语句id
+ * @key:相同key的sql在同一个连接上按顺序执行，不需要则传0或者nil
+ * @...:语句参数，支持nil、boolean、integer、number、string
+ */
+int32 lsql::do_stmt( lua_State *L )
+{
+    if ( _worker.empty() || !_worker.front()->active() )
     {
-        ERROR( "sql thread error" );
+        return luaL_error( L,"sql thread not active" );
     }
-    else
+
+    int32 id  = luaL_checkinteger( L,1 );
+    int32 sid = luaL_checkinteger( L,2 );
+    int64 key = luaL_optinteger( L,3,0 );
+    if ( sid < 1 || sid > static_cast<int32>( _stmt.size() ) )
     {
-        assert( "unknow sql event",false );
+        return luaL_error( L,"sql statement not prepare:%d",sid );
     }
-}
 
-int32 lsql::pop_result( struct sql_result &res )
-{
-    lock();
-    if ( _result.empty() )
+    int32 top = lua_gettop( L );
+    struct sql_query *query = new sql_query( id,_stmt[sid - 1] );
+    if ( top > 3 ) query->_params.resize( top - 3 );
+
+    for ( int32 index = 4;index <= top;index ++ )
     {
-        unlock();
-        return 0;
+        struct sql_col &param = query->_params[index - 4];
+        switch ( lua_type( L,index ) )
+        {
+            case LUA_TNIL :
+                param.set_nil();
+                break;
+            case LUA_TBOOLEAN :
+                param.set_int( lua_toboolean( L,index ) );
+                break;
+            case LUA_TNUMBER :
+                if ( lua_isinteger( L,index ) )
+                {
+                    param.set_int( lua_tointeger( L,index ) );
+                }
+                else
+                {
+                    param.set_num( lua_tonumber( L,index ) );
+                }
+                break;
+            case LUA_TSTRING :
+            {
+                size_t len = 0;
+                const char *str = lua_tolstring( L,index,&len );
+                param.set_str( query->_arena,str,len );
+            }break;
+            default :
+            {
+                delete query;
+                return luaL_error( L,"sql statement param type error:%s",
+                    lua_typename( L,lua_type( L,index ) ) );
+            }
+        }
     }
 
-    res = _result.front();
-    _result.pop();
-    unlock();
-
-    return 1;
+    select_worker( key )->push_query( query );
+    return 0;
 }
 
 void lsql::invoke_result()
@@ -204,27 +479,34 @@ void lsql::invoke_result()
     static lua_State *L = static_global::state();
     lua_pushcfunction( L,traceback );
 
-    /* sql_result是一个比较小的结构体，因此不使用指针 */
+    /* sql_result是一个比较小的结构体，因此不使用指针
+     * 各个连接的结果都取出来，哪个连接的通知先到就无所谓了
+     */
     struct sql_result res;
-    while ( pop_result( res ) )
+    std::vector<class sql_worker *>::iterator itr = _worker.begin();
+    for ( ;itr != _worker.end();itr ++ )
     {
-        lua_getglobal( L,"mysql_read_event" );
-        lua_pushinteger( L,_dbid );
-        lua_pushinteger( L,res._id );
-        lua_pushinteger( L,res._ecode );
+        class sql_worker *worker = *itr;
+        while ( worker->pop_result( res ) )
+        {
+            lua_getglobal( L,"mysql_read_event" );
+            lua_pushinteger( L,_dbid );
+            lua_pushinteger( L,res._id );
+            lua_pushinteger( L,res._ecode );
 
-        int32 nargs = 3;
-        int32 args  = mysql_to_lua( L,res._res );
-        if ( args > 0 )         nargs += args;
+            int32 nargs = 3;
+            int32 args  = mysql_to_lua( L,res._res );
+            if ( args > 0 )         nargs += args;
 
-        if ( LUA_OK != lua_pcall( L,nargs,0,1 ) )
-        {
-            ERROR( "sql call back error:%s",lua_tostring( L,-1 ) );
-            lua_pop(L,1); /* remove error message */
-        }
+            if ( LUA_OK != lua_pcall( L,nargs,0,1 ) )
+            {
+                ERROR( "sql call back error:%s",lua_tostring( L,-1 ) );
+                lua_pop(L,1); /* remove error message */
+            }
 
-        delete res._res;
-        res._res = NULL;
+            delete res._res;
+            res._res = NULL;
+        }
     }
     lua_pop(L,1); /* remove traceback */
 }
@@ -232,37 +514,16 @@ void lsql::invoke_result()
 int32 lsql::field_to_lua( lua_State *L,
     const struct sql_field &field,const struct sql_col &col )
 {
+    /* 数据在db线程已经转换为对应的类型 */
     lua_pushstring( L,field._name );
-    switch ( field._type )
+    switch ( col._type )
     {
-        case MYSQL_TYPE_TINY      :
-        case MYSQL_TYPE_SHORT     :
-        case MYSQL_TYPE_LONG      :
-        case MYSQL_TYPE_TIMESTAMP :
-        case MYSQL_TYPE_INT24     :
-            lua_pushinteger( L,static_cast<LUA_INTEGER>(atoi(col._value)) );
-            break;
-        case MYSQL_TYPE_LONGLONG  :
-            lua_pushint64( L,atoll(col._value) );
-            break;
-        case MYSQL_TYPE_FLOAT   :
-        case MYSQL_TYPE_DOUBLE  :
-        case MYSQL_TYPE_DECIMAL :
-            lua_pushnumber( L,static_cast<LUA_NUMBER>(atof(col._value)) );
-            break;
-        case MYSQL_TYPE_VARCHAR     :
-        case MYSQL_TYPE_TINY_BLOB   :
-        case MYSQL_TYPE_MEDIUM_BLOB :
-        case MYSQL_TYPE_LONG_BLOB   :
-        case MYSQL_TYPE_BLOB        :
-        case MYSQL_TYPE_VAR_STRING  :
-        case MYSQL_TYPE_STRING      :
-            lua_pushlstring( L,col._value,col._size );
-            break;
-        default :
-            lua_pushnil( L );
-            ERROR( "unknow mysql type:%d\n",field._type );
+        case SQL_COL_INT : lua_pushint64 ( L,col._int );break;
+        case SQL_COL_NUM :
+            lua_pushnumber( L,static_cast<LUA_NUMBER>(col._num) );
             break;
+        case SQL_COL_STR : lua_pushlstring( L,col._value,col._size );break;
+        default : lua_pushnil( L );break;
     }
 
     return 0;
@@ -275,26 +536,22 @@ int32 lsql::mysql_to_lua( lua_State *L,const struct sql_res *res )
 
     assert( "sql result over boundary",
         res->_num_cols == res->_fields.size()
-        &&res->_num_rows == res->_rows.size() );
+        &&res->_num_rows*res->_num_cols == res->_cols.size() );
 
     lua_createtable( L,res->_num_rows,0 ); /* 创建数组，元素个数为num_rows */
 
     const std::vector<sql_field> &fields = res->_fields;
-    const std::vector<sql_row  > &rows   = res->_rows;
     for ( uint32 row = 0;row < res->_num_rows;row ++ )
     {
         lua_pushinteger( L,row + 1 ); /* lua table从1开始 */
         lua_createtable( L,0,res->_num_cols ); /* 创建hash表，元素个数为num_cols */
 
-        const std::vector<sql_col> &cols = rows[row]._cols;
         for ( uint32 col = 0;col < res->_num_cols;col ++ )
         {
-            assert( "sql result column "
-                "over boundary",res->_num_cols == cols.size() );
+            const struct sql_col &value = res->get_col( row,col );
+            if ( SQL_COL_NIL == value._type ) continue;/* 值为NULL */
 
-            if ( !cols[col]._value ) continue;/* 值为NULL */
-
-            field_to_lua( L,fields[col],cols[col] );
+            field_to_lua( L,fields[col],value );
             lua_rawset( L, -3 );
         }
 
@@ -303,65 +560,3 @@ int32 lsql::mysql_to_lua( lua_State *L,const struct sql_res *res )
 
     return 1;
 }
-
-bool lsql::uninitialize()
-{
-    if ( _sql.ping() )
-    {
-        ERROR( "mysql ping fail at cleanup,data may lost:%s",_sql.error() );
-        /* TODO write to file ? */
-    }
-    else
-    {
-        invoke_sql( false );
-    }
-
-    _sql.disconnect() ;
-    mysql_thread_end();
-
-    return true;
-}
-
-bool lsql::initialize()
-{
-    mysql_thread_init();
-
-    int32 ok = _sql.connect();
-    if ( ok > 0 )
-    {
-        _valid = 0;
-        mysql_thread_end();
-        notify_parent( NTF_ERROR );
-        return false;
-    }
-    else if ( -1 == ok )
-    {
-        // 初始化正常，但是需要稍后重试
-        return true;
-    }
-
-    _valid = 1;
-    return true;
-}
-
-void lsql::push_result( int32 id,struct sql_res *res )
-{
-    /* 需要回调的应该都有结果，没有的话可能是逻辑错误 */
-    if ( !res )
-    {
-        ERROR( "sql query do not have result" );
-    }
-
-    struct sql_result result;
-
-    result._id    = id;
-    result._ecode = _sql.get_errno();
-    result._res   = res;
-
-    lock();
-    bool notify = _result.empty() ? true : false;
-    _result.push( result );
-    unlock();
-
-    if ( notify ) notify_parent( NTF_CUSTOM );
-}
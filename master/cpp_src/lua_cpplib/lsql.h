@@ -2,50 +2,88 @@
 #define __LSQL_H__
 
 #include <lua.hpp>
-#include <queue>
+#include <vector>
 #include "../global/global.h"
-#include "../thread/thread.h"
+#include "../thread/queue_thread.h"
 #include "../mysql/sql.h"
 
-class lsql : public thread
+class lsql;
+
+/* mysql连接池中的一个连接，每个连接一个线程，按队列顺序执行sql */
+class sql_worker
+    : public queue_thread<const struct sql_query *,struct sql_result>
 {
 public:
-    explicit lsql( lua_State *L );
-    ~lsql();
+    sql_worker( class lsql *owner,int32 dbid,int32 index );
+    ~sql_worker();
 
-    int32 valid ( lua_State *L );
-    int32 start ( lua_State *L );
-    int32 stop  ( lua_State *L );
-    int32 do_sql( lua_State *L );
+    void stop ();
+    bool start( const char *host,int32 port,
+        const char *usr,const char *pwd,const char *dbname );
 
-    size_t busy_job( size_t *finished = NULL,size_t *unfinished = NULL );
+    /* 只能在主线程调用 */
+    bool pop_result( struct sql_result &res );
+
+    inline int32 valid() const { return _valid; }
+    inline int32 get_index() const { return _index; }
 private:
     bool uninitialize();
     bool initialize();
 
-    void invoke_result();
-
     void invoke_sql ( bool is_return = true );
-    void push_result( int32 id,struct sql_res *res );
+    void push_result( int32 id,int32 ecode,struct sql_res *res );
+
+    void close_stmt();
+    int32 execute_stmt( const struct sql_query *query,struct sql_res **res );
 
     void routine( notify_t notify );
     void notification( notify_t notify );
+private:
+    class lsql *_owner;
+    class sql _sql;
+
+    int32 _index;
+    int32 _valid; // -1连接中，0失败，1成功
+    char _name[32]; // 线程名字，区分连接池中不同的连接
+
+    /* 本连接上已prepare的语句，下标为sql_stmt的_sid，只在子线程访问 */
+    std::vector<MYSQL_STMT *> _stmt;
+};
+
+/* mysql连接池
+ * 1.每个连接一个线程，不相关的sql可以在不同的连接上并行执行
+ * 2.指定了key(比如玩家id)的sql总是在同一个连接上执行，保证同一个key的sql顺序
+ * 3.没指定key的sql交给最闲的连接，连接数大于1时不保证执行顺序
+ * 4.结果在主线程按各个连接的完成顺序回调到脚本
+ * 5.预处理语句在主线程登记，各个连接第一次执行时才prepare，参数和结果都走二进制协议
+ */
+class lsql
+{
+public:
+    explicit lsql( lua_State *L );
+    ~lsql();
+
+    int32 valid ( lua_State *L );
+    int32 start ( lua_State *L );
+    int32 stop  ( lua_State *L );
+    int32 do_sql( lua_State *L );
+    int32 prepare( lua_State *L );
+    int32 do_stmt( lua_State *L );
+
+    /* 连接有结果时在主线程调用 */
+    void invoke_result();
+private:
+    void stop_worker();
+    class sql_worker *select_worker( int64 key );
 
     int32 mysql_to_lua( lua_State *L,const struct sql_res *res );
     int32 field_to_lua( lua_State *L,
         const struct sql_field &field,const struct sql_col &col );
-
-    const struct sql_query *pop_query();
-    void push_query( const struct sql_query *query );
-    int32 pop_result( struct sql_result &res );
 private:
-    class sql _sql;
-
     int32 _dbid;
-    int32 _valid; // -1连接中，0失败，1成功
 
-    std::queue<struct sql_result > _result;
-    std::queue<const struct sql_query *> _query ;
+    std::vector<class sql_worker *> _worker;
+    std::vector<struct sql_stmt *> _stmt; // 预处理语句，下标为_sid - 1
 };
 
 #endif /* __LSQL_H__ */
@@ -10,6 +10,7 @@
 #include "lrank.h"
 #include "lutil.h"
 #include "lastar.h"
+#include "lastar_pool.h"
 #include "lmongo.h"
 #include "lstate.h"
 #include "lclass.h"
@@ -52,10 +53,12 @@ int32 luaopen_ev    ( lua_State *L );
 int32 luaopen_sql   ( lua_State *L );
 int32 luaopen_log   ( lua_State *L );
 int32 luaopen_aoi   ( lua_State *L );
+int32 luaopen_list_aoi( lua_State *L );
 int32 luaopen_map   ( lua_State *L );
 int32 luaopen_rank  ( lua_State *L );
 int32 luaopen_timer ( lua_State *L );
 int32 luaopen_astar ( lua_State *L );
+int32 luaopen_astar_pool( lua_State *L );
 int32 luaopen_acism ( lua_State *L );
 int32 luaopen_mongo ( lua_State *L );
 int32 luaopen_network_mgr( lua_State *L );
@@ -76,10 +79,12 @@ void lstate::open_cpp()
     luaopen_sql   (L);
     luaopen_log   (L);
     luaopen_aoi   (L);
+    luaopen_list_aoi(L);
     luaopen_map   (L);
     luaopen_rank  (L);
     luaopen_timer (L);
     luaopen_astar (L);
+    luaopen_astar_pool(L);
     luaopen_acism (L);
     luaopen_mongo (L);
     luaopen_network_mgr(L);
@@ -100,6 +105,13 @@ int32 luaopen_ev( lua_State *L )
     lc.def<&lev::who_busy> ("who_busy" );
     lc.def<&lev::real_time>("real_time");
     lc.def<&lev::set_app_ev>("set_app_ev");
+    lc.def<&lev::set_backend>("set_backend");
+    lc.def<&lev::set_timer_backend>("set_timer_backend");
+
+    lc.set( "BACKEND_EPOLL",ev::BACKEND_EPOLL );
+    lc.set( "BACKEND_URING",ev::BACKEND_URING );
+    lc.set( "TIMER_HEAP",ev::TIMER_HEAP );
+    lc.set( "TIMER_WHEEL",ev::TIMER_WHEEL );
 
     return 0;
 }
@@ -124,6 +136,8 @@ int32 luaopen_sql( lua_State *L )
     lc.def<&lsql::stop>  ( "stop"  );
 
     lc.def<&lsql::do_sql> ( "do_sql" );
+    lc.def<&lsql::prepare> ( "prepare" );
+    lc.def<&lsql::do_stmt> ( "do_stmt" );
 
     return 0;
 }
@@ -141,6 +155,8 @@ int32 luaopen_mongo( lua_State *L )
     lc.def<&lmongo::update>          ( "update"          );
     lc.def<&lmongo::remove>          ( "remove"          );
     lc.def<&lmongo::find_and_modify> ( "find_and_modify" );
+    lc.def<&lmongo::find_stream>     ( "find_stream"     );
+    lc.def<&lmongo::set_batch>       ( "set_batch"       );
 
     return 0;
 }
@@ -166,6 +182,10 @@ int32 luaopen_acism( lua_State *L )
     lc.def<&lacism::scan> ( "scan" );
     lc.def<&lacism::replace> ( "replace" );
     lc.def<&lacism::load_from_file> ( "load_from_file" );
+    lc.def<&lacism::load_async> ( "load_async" );
+    lc.def<&lacism::is_loading> ( "is_loading" );
+    lc.def<&lacism::scan_list> ( "scan_list" );
+    lc.def<&lacism::replace_list> ( "replace_list" );
 
     return 0;
 }
@@ -178,6 +198,8 @@ int32 luaopen_network_mgr( lua_State *L )
     lc.def<&lnetwork_mgr::listen> ( "listen" );
     lc.def<&lnetwork_mgr::connect> ( "connect" );
     lc.def<&lnetwork_mgr::load_one_schema> ( "load_one_schema" );
+    lc.def<&lnetwork_mgr::encode> ( "encode" );
+    lc.def<&lnetwork_mgr::decode> ( "decode" );
     lc.def<&lnetwork_mgr::set_curr_session> ( "set_curr_session" );
 
     lc.def<&lnetwork_mgr::set_conn_session> ( "set_conn_session" );
@@ -208,8 +230,10 @@ int32 luaopen_network_mgr( lua_State *L )
 
     lc.def<&lnetwork_mgr::set_send_buffer_size> ( "set_send_buffer_size" );
     lc.def<&lnetwork_mgr::set_recv_buffer_size> ( "set_recv_buffer_size" );
+    lc.def<&lnetwork_mgr::set_send_segment> ( "set_send_segment" );
 
     lc.def<&lnetwork_mgr::new_ssl_ctx> ( "new_ssl_ctx" );
+    lc.def<&lnetwork_mgr::set_io_thread> ( "set_io_thread" );
 
     lc.set( "CNT_NONE",socket::CNT_NONE );
     lc.set( "CNT_CSCN",socket::CNT_CSCN );
@@ -230,6 +254,9 @@ int32 luaopen_network_mgr( lua_State *L )
     lc.set( "CDC_STREAM"  ,codec::CDC_STREAM  );
     lc.set( "CDC_FLATBUF" ,codec::CDC_FLATBUF );
     lc.set( "CDC_PROTOBUF",codec::CDC_PROTOBUF);
+#ifdef USE_UPB
+    lc.set( "CDC_UPB"     ,codec::CDC_UPB     ); // 编译时USE_UPB=1才有
+#endif
 
     return 0;
 }
@@ -248,12 +275,34 @@ int32 luaopen_aoi( lua_State *L )
     lc.def<&laoi::exit_entity> ( "exit_entity" );
     lc.def<&laoi::enter_entity> ( "enter_entity" );
     lc.def<&laoi::update_entity> ( "update_entity" );
+    lc.def<&laoi::update_entitys> ( "update_entitys" );
 
     lc.def<&laoi::is_same_pos> ( "is_same_pos" );
 
     return 0;
 }
 
+int32 luaopen_list_aoi( lua_State *L )
+{
+    lclass<llist_aoi> lc(L,"ListAoi");
+
+    lc.def<&llist_aoi::set_size> ( "set_size" );
+    lc.def<&llist_aoi::set_visual_range> ( "set_visual_range" );
+
+    lc.def<&llist_aoi::get_entitys> ( "get_entitys" );
+    lc.def<&llist_aoi::get_all_entitys> ( "get_all_entitys" );
+    lc.def<&llist_aoi::get_watch_me_entitys> ( "get_watch_me_entitys" );
+
+    lc.def<&llist_aoi::exit_entity> ( "exit_entity" );
+    lc.def<&llist_aoi::enter_entity> ( "enter_entity" );
+    lc.def<&llist_aoi::update_entity> ( "update_entity" );
+    lc.def<&llist_aoi::update_entitys> ( "update_entitys" );
+
+    lc.def<&llist_aoi::is_same_pos> ( "is_same_pos" );
+
+    return 0;
+}
+
 int32 luaopen_map( lua_State *L )
 {
     lclass<lmap> lc(L,"Map");
@@ -264,6 +313,7 @@ int32 luaopen_map( lua_State *L )
     lc.def<&lmap::fork> ( "fork" );
     lc.def<&lmap::get_size> ( "get_size" );
     lc.def<&lmap::get_pass_cost> ( "get_pass_cost" );
+    lc.def<&lmap::get_region> ( "get_region" );
 
     return 0;
 }
@@ -282,11 +332,29 @@ int32 luaopen_rank( lua_State *L )
     lc_insertion_rank.def< &linsertion_rank::get_rank_by_id > ("get_rank_by_id");
     lc_insertion_rank.def< &linsertion_rank::get_id_by_rank > ("get_id_by_rank");
 
+    lclass< lskiplist_rank > lc_skiplist_rank(L,"Skiplist_rank");
+    lc_skiplist_rank.def< &lskiplist_rank::clear > ("clear");
+    lc_skiplist_rank.def< &lskiplist_rank::remove > ("remove");
+    lc_skiplist_rank.def< &lskiplist_rank::insert > ("insert");
+    lc_skiplist_rank.def< &lskiplist_rank::update > ("update");
+    lc_skiplist_rank.def< &lskiplist_rank::get_count > ("get_count");
+    lc_skiplist_rank.def< &lskiplist_rank::set_max_count > ("set_max_count");
+    lc_skiplist_rank.def< &lskiplist_rank::get_max_factor > ("get_max_factor");
+    lc_skiplist_rank.def< &lskiplist_rank::get_factor > ("get_factor");
+    lc_skiplist_rank.def< &lskiplist_rank::get_rank_by_id > ("get_rank_by_id");
+    lc_skiplist_rank.def< &lskiplist_rank::get_id_by_rank > ("get_id_by_rank");
+    lc_skiplist_rank.def< &lskiplist_rank::get_range > ("get_range");
+
     lclass< lbucket_rank > lc_bucket_rank(L,"Bucket_rank");
     lc_bucket_rank.def< &lbucket_rank::clear > ("clear");
     lc_bucket_rank.def< &lbucket_rank::insert > ("insert");
     lc_bucket_rank.def< &lbucket_rank::get_count > ("get_count");
     lc_bucket_rank.def< &lbucket_rank::get_top_n > ("get_top_n");
+    lc_bucket_rank.def< &lbucket_rank::insert_list > ("insert_list");
+    lc_bucket_rank.def< &lbucket_rank::sort > ("sort");
+    lc_bucket_rank.def< &lbucket_rank::get_factor > ("get_factor");
+    lc_bucket_rank.def< &lbucket_rank::get_rank_by_id > ("get_rank_by_id");
+    lc_bucket_rank.def< &lbucket_rank::get_id_by_rank > ("get_id_by_rank");
 
     return 0;
 }
@@ -297,5 +365,20 @@ int32 luaopen_astar( lua_State *L )
 
     lc.def<&lastar::search>  ( "search" );
 
+    lc.set( "ASTAR",a_star::SM_ASTAR );
+    lc.set( "JPS",a_star::SM_JPS );
+    lc.set( "HPA",a_star::SM_HPA );
+
+    return 0;
+}
+
+int32 luaopen_astar_pool( lua_State *L )
+{
+    lclass<lastar_pool> lc(L,"AstarPool");
+
+    lc.def<&lastar_pool::start>  ( "start"  );
+    lc.def<&lastar_pool::stop>   ( "stop"   );
+    lc.def<&lastar_pool::search> ( "search" );
+
     return 0;
 }
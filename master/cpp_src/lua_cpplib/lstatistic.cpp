@@ -21,6 +21,10 @@ int32 lstatistic::dump( lua_State *L )
     dump_thread( L );
     lua_rawset( L,-3 );
 
+    lua_pushstring( L,"multicast" );
+    dump_multicast( stat->get_multicast(),L );
+    lua_rawset( L,-3 );
+
     return 1;
 
 #undef DUMP_BASE_COUNTER
@@ -54,6 +58,28 @@ void lstatistic::dump_base_counter(
     }
 }
 
+void lstatistic::dump_multicast(
+    const statistic::multicast_counter &counter,lua_State *L )
+{
+    lua_createtable( L,0,4 );
+
+    lua_pushstring( L,"copy" );
+    lua_pushnumber( L,counter._copy );
+    lua_rawset( L,-3 );
+
+    lua_pushstring( L,"copy_bytes" );
+    lua_pushnumber( L,counter._copy_bytes );
+    lua_rawset( L,-3 );
+
+    lua_pushstring( L,"refer" );
+    lua_pushnumber( L,counter._refer );
+    lua_rawset( L,-3 );
+
+    lua_pushstring( L,"refer_bytes" );
+    lua_pushnumber( L,counter._refer_bytes );
+    lua_rawset( L,-3 );
+}
+
 void lstatistic::dump_thread( lua_State *L )
 {
     const thread_mgr::thread_mpt_t &threads =
@@ -10,6 +10,8 @@ public:
     static int32 dump( lua_State *L );
 private:
     static void dump_thread( lua_State *L );
+    static void dump_multicast(
+        const statistic::multicast_counter &counter,lua_State *L );
     static void dump_base_counter( 
         const statistic::base_counter_t &counter,lua_State *L );
 };
@@ -1,3 +1,4 @@
+#include <vector>
 #include "mongo.h"
 
 void mongo::init()
@@ -13,11 +14,14 @@ void mongo::cleanup()
 mongo::mongo()
 {
     _conn = NULL;
+    _cursor = NULL;
+    _collection = NULL;
 }
 
 mongo::~mongo()
 {
     assert( "mongo db not clean yet",NULL == _conn );
+    assert( "mongo cursor not close yet",NULL == _cursor );
 }
 
 void mongo::set( const char *ip,
@@ -181,6 +185,38 @@ bool mongo::find ( const struct mongo_query *mq,struct mongo_result *res )
     return true;
 }
 
+void mongo::open_cursor( const struct mongo_query *mq )
+{
+    assert( "mongo open cursor,inactivity connection",_conn );
+    assert( "mongo open cursor,already open",NULL == _cursor );
+
+    _collection = mongoc_client_get_collection( _conn, _db, mq->_clt );
+
+    /* batchSize只影响和数据库之间每次getMore的数量，由opts指定，这里不修改 */
+    _cursor = mongoc_collection_find_with_opts(
+        _collection, mq->_query, mq->_fields, NULL );
+}
+
+bool mongo::next_cursor( const bson_t **doc )
+{
+    assert( "mongo next cursor,cursor not open",_cursor );
+
+    return mongoc_cursor_next( _cursor, doc );
+}
+
+bool mongo::close_cursor( bson_error_t *error )
+{
+    bool ok = !mongoc_cursor_error( _cursor,error );
+
+    mongoc_cursor_destroy( _cursor );
+    mongoc_collection_destroy( _collection );
+
+    _cursor = NULL;
+    _collection = NULL;
+
+    return ok;
+}
+
 bool mongo::find_and_modify (
     const struct mongo_query *mq,struct mongo_result *res )
 {
@@ -259,3 +295,190 @@ bool mongo::remove( const struct mongo_query *mq,struct mongo_result *res )
 
     return ok;
 }
+
+/* update的文档不是以$开头的操作符时，mongoc_collection_update是整个替换，bulk
+ * 里需要用replace_one，否则会报错
+ */
+static bool is_replace( const bson_t *update )
+{
+    bson_iter_t iter;
+    if ( !bson_iter_init( &iter,update ) || !bson_iter_next( &iter ) )
+    {
+        return false;
+    }
+
+    return '$' != bson_iter_key( &iter )[0];
+}
+
+bool mongo::append_bulk( mongoc_bulk_operation_t *bulk,
+    const struct mongo_query *mq,bson_error_t *error )
+{
+    bool ok = false;
+    switch( mq->_mqt )
+    {
+        case MQT_INSERT:
+        {
+            ok = mongoc_bulk_operation_insert_with_opts(
+                bulk,mq->_query,NULL,error );
+        }break;
+        case MQT_UPDATE:
+        {
+            bson_t opts;
+            bson_init( &opts );
+            if ( mq->_flags & MONGOC_UPDATE_UPSERT )
+            {
+                BSON_APPEND_BOOL( &opts,"upsert",true );
+            }
+
+            if ( is_replace( mq->_update ) )
+            {
+                ok = mongoc_bulk_operation_replace_one_with_opts(
+                    bulk,mq->_query,mq->_update,&opts,error );
+            }
+            else if ( mq->_flags & MONGOC_UPDATE_MULTI_UPDATE )
+            {
+                ok = mongoc_bulk_operation_update_many_with_opts(
+                    bulk,mq->_query,mq->_update,&opts,error );
+            }
+            else
+            {
+                ok = mongoc_bulk_operation_update_one_with_opts(
+                    bulk,mq->_query,mq->_update,&opts,error );
+            }
+            bson_destroy( &opts );
+        }break;
+        case MQT_REMOVE:
+        {
+            /* 和mongoc_collection_remove保持一致，以flags为准 */
+            if ( mq->_flags & MONGOC_REMOVE_SINGLE_REMOVE )
+            {
+                ok = mongoc_bulk_operation_remove_one_with_opts(
+                    bulk,mq->_query,NULL,error );
+            }
+            else
+            {
+                ok = mongoc_bulk_operation_remove_many_with_opts(
+                    bulk,mq->_query,NULL,error );
+            }
+        }break;
+        default:
+        {
+            assert( "mongo bulk,unsupport query type",false );
+        }break;
+    }
+
+    return ok;
+}
+
+bool mongo::bulk( const char *clt,const struct mongo_query **mq,
+    bson_error_t *errors,size_t count,bson_error_t *error )
+{
+    assert( "mongo bulk,inactivity connection",_conn );
+    assert( "mongo bulk,empty query",mq && count > 0 );
+
+    mongoc_collection_t *collection =
+        mongoc_client_get_collection( _conn, _db, clt );
+
+    /* 合并的操作来自不同的逻辑(比如不同玩家的存库)，互不相关。默认的ordered模式
+     * 遇到错误即停止，后面的操作不会执行，因此这里用unordered，一个出错不影响其他
+     */
+    bson_t bulk_opts;
+    bson_init( &bulk_opts );
+    BSON_APPEND_BOOL( &bulk_opts,"ordered",false );
+    mongoc_bulk_operation_t *bulk =
+        mongoc_collection_create_bulk_operation_with_opts(
+            collection,&bulk_opts );
+    bson_destroy( &bulk_opts );
+
+    /* 参数错误(比如update文档不合法)的操作不加入bulk，直接设置错误 */
+    std::vector<size_t> bulk_idx;
+    bulk_idx.reserve( count );
+    for ( size_t idx = 0;idx < count;idx ++ )
+    {
+        if ( append_bulk( bulk,mq[idx],errors + idx ) )
+        {
+            bulk_idx.push_back( idx );
+            continue;
+        }
+
+        if ( 0 == errors[idx].code ) errors[idx].code = -1;
+    }
+
+    if ( bulk_idx.empty() )
+    {
+        *error = errors[0];
+        mongoc_bulk_operation_destroy( bulk );
+        mongoc_collection_destroy ( collection );
+        return false;
+    }
+
+    bson_t reply;
+    bool ok = 0 != mongoc_bulk_operation_execute( bulk,&reply,error );
+
+    if ( !ok )
+    {
+        /* writeErrors: [{index:0,code:11000,errmsg:"..."}]，index为bulk中的
+         * 下标。unordered模式下只有writeErrors中的操作失败，其他的都已执行
+         */
+        bool has_write_err = false;
+        bson_iter_t iter;
+        bson_iter_t write_err;
+        if ( bson_iter_init_find( &iter,&reply,"writeErrors" )
+            && bson_iter_recurse( &iter,&write_err ) )
+        {
+            while ( bson_iter_next( &write_err ) )
+            {
+                bson_iter_t field;
+                if ( !bson_iter_recurse( &write_err,&field ) ) continue;
+
+                int32 code = -1;
+                size_t index = bulk_idx.size();
+                const char *errmsg = "";
+                while ( bson_iter_next( &field ) )
+                {
+                    const char *key = bson_iter_key( &field );
+                    if ( 0 == strcmp( key,"index" ) )
+                    {
+                        index = bson_iter_int32( &field );
+                    }
+                    else if ( 0 == strcmp( key,"code" ) )
+                    {
+                        code = bson_iter_int32( &field );
+                    }
+                    else if ( 0 == strcmp( key,"errmsg" ) )
+                    {
+                        errmsg = bson_iter_utf8( &field,NULL );
+                    }
+                }
+
+                if ( index >= bulk_idx.size() ) continue;
+
+                bson_error_t &e = errors[bulk_idx[index]];
+                e.domain = error->domain;
+                e.code   = code;
+                snprintf( e.message,sizeof(e.message),"%s",errmsg );
+
+                has_write_err = true;
+            }
+        }
+
+        /* 没有writeErrors(比如网络错误)或者有writeConcernError时，无法确定哪些
+         * 操作成功了，全部视为失败
+         */
+        if ( !has_write_err
+            || bson_iter_init_find( &iter,&reply,"writeConcernErrors" ) )
+        {
+            for ( size_t index = 0;index < bulk_idx.size();index ++ )
+            {
+                bson_error_t &e = errors[bulk_idx[index]];
+                if ( 0 == e.code ) e = *error;
+            }
+        }
+    }
+
+    bson_destroy( &reply );
+    mongoc_bulk_operation_destroy( bulk );
+    mongoc_collection_destroy ( collection );
+
+    return ok && bulk_idx.size() == count;
+}
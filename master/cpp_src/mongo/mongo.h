@@ -23,11 +23,13 @@ typedef enum
     MQT_INSERT = 4,
     MQT_UPDATE = 5,
     MQT_REMOVE = 6,
+    MQT_BULK   = 7, // 合并后的批量写入，只用于日志
+    MQT_STREAM = 8, // 流式查询，结果分批返回
     MQT_MAX
 }mqt_t; /* mongo_query_type */
 
 static const char* MQT_NAME[] =
-    {"none","count","find","find_and_modify","insert","update","remove"};
+    {"none","count","find","find_and_modify","insert","update","remove","bulk","find_stream"};
 
 static_assert( MQT_MAX == array_size(MQT_NAME),"mongo name define" );
 
@@ -46,6 +48,7 @@ struct mongo_query
     bson_t *_sort;
     bson_t *_update;
     int32 _flags;
+    int32 _batch; // 流式查询每批返回的文档数量
     int64 _time; // 请求的时间戳，毫秒
 
     mongo_query()
@@ -63,6 +66,7 @@ struct mongo_query
         _sort          = NULL;
         _update        = NULL;
         _flags         = 0;
+        _batch         = 0;
         _time          = static_global::ev()->ms_now();;
     }
 
@@ -103,6 +107,13 @@ struct mongo_query
         _fields = fields;
     }
 
+    void set_stream( const char *clt,
+        bson_t *query,bson_t *fields,int32 batch )
+    {
+        set_find( clt,query,fields );
+        _batch = batch;
+    }
+
     void set_find_modify( const char *clt,bson_t *query,
         bson_t *sort,bson_t *update,bson_t *fields = NULL,
         bool is_remove = false,bool upsert = false,bool is_new = false )
@@ -154,8 +165,23 @@ struct mongo_result
     char  _clt[MONGO_VAR_LEN]; // collection
     char  _query[MONGO_VAR_LEN]; // 查询条件，日志用
 
+    /* 流式查询的结果，文档按bson原始格式连续存放，主线程用bson_reader直接
+     * 在这块内存上解码，不需要再组装成一个大的bson数组
+     */
+    uint8 *_raw;
+    size_t _raw_len;
+    size_t _raw_cap;
+    int32  _raw_count;
+    bool   _more; // 流式查询后面是否还有数据
+
     mongo_result()
     {
+        _raw       = NULL;
+        _raw_len   = 0;
+        _raw_cap   = 0;
+        _raw_count = 0;
+        _more      = false;
+
         _qid    = 0;
         _time   = 0;
         _elaspe = 0.0;
@@ -172,11 +198,33 @@ struct mongo_result
     ~mongo_result()
     {
         if ( _data ) bson_destroy( _data );
+        if ( _raw  ) free( _raw );
 
+        _raw    = NULL;
         _qid    = 0;
         _mqt    = MQT_NONE;
         _data   = NULL;
     }
+
+    /* 追加一个文档到流式查询结果
+     * @hint:首次分配时预估的文档数量，避免频繁realloc
+     */
+    void append_raw( const bson_t *doc,int32 hint )
+    {
+        size_t new_len = _raw_len + doc->len;
+        if ( new_len > _raw_cap )
+        {
+            size_t new_cap = _raw_cap ? _raw_cap * 2 : doc->len * hint;
+            if ( new_cap < new_len ) new_cap = new_len;
+
+            _raw = (uint8 *)realloc( _raw,new_cap );
+            _raw_cap = new_cap;
+        }
+
+        memcpy( _raw + _raw_len,bson_get_data( doc ),doc->len );
+        _raw_len = new_len;
+        _raw_count ++;
+    }
 };
 
 class mongo
@@ -202,6 +250,21 @@ public:
     bool find   ( const struct mongo_query *mq,struct mongo_result *res );
     bool find_and_modify( const struct mongo_query *mq,struct mongo_result *res );
 
+    /* 把同一个collection的insert、update、remove合并为一次bulk操作执行
+     * 每个操作的错误写入errors中对应的位置(调用前需要清零)，返回是否全部成功
+     */
+    bool bulk( const char *clt,const struct mongo_query **mq,
+        bson_error_t *errors,size_t count,bson_error_t *error );
+
+    /* 流式查询，同一时间只能打开一个游标
+     * next_cursor返回的文档在下一次调用前有效
+     */
+    void open_cursor( const struct mongo_query *mq );
+    bool next_cursor( const bson_t **doc );
+    bool close_cursor( bson_error_t *error );
+private:
+    bool append_bulk( mongoc_bulk_operation_t *bulk,
+        const struct mongo_query *mq,bson_error_t *error );
 private:
     int32 _port;
     char  _ip [MONGO_VAR_LEN];
@@ -210,6 +273,9 @@ private:
     char  _db [MONGO_VAR_LEN];
 
     mongoc_client_t *_conn;
+
+    mongoc_cursor_t *_cursor;
+    mongoc_collection_t *_collection;
 };
 
 #endif
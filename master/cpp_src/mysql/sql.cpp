@@ -1,5 +1,6 @@
 #include "sql.h"
 #include <errmsg.h>
+#include <mysqld_error.h>
 
 /* Call mysql_library_init() before any other MySQL functions. It is not
  * thread-safe, so call it before threads are created, or protect the call with
@@ -227,7 +228,7 @@ int32 sql::result( struct sql_res **res )
         (*res)->_num_rows = num_rows;
         (*res)->_num_cols = num_fields;
         (*res)->_fields.resize( num_fields );
-        (*res)->_rows.resize  ( num_rows   );
+        (*res)->_cols.resize  ( num_rows*num_fields );
 
         uint32 index = 0;
         MYSQL_FIELD *field;
@@ -246,16 +247,14 @@ int32 sql::result( struct sql_res **res )
         index = 0;
         while ( (row = mysql_fetch_row(result)) )
         {
-            struct sql_row &res_row = (*res)->_rows[index];
-            res_row._cols.resize( num_fields );
-
             /* mysql_fetch_lengths() is valid only for the current row of the
              * result set
              */
             size_t *lengths = mysql_fetch_lengths( result );
             for ( uint32 i = 0;i < num_fields;i ++ )
             {
-                res_row._cols[i].set( row[i],lengths[i] );
+                text_to_col( *res,(*res)->_cols[index*num_fields + i],
+                    (*res)->_fields[i]._type,row[i],lengths[i] );
             }
 
             ++index;
@@ -268,6 +267,286 @@ int32 sql::result( struct sql_res **res )
     return mysql_errno( _conn );
 }
 
+/* 文本协议的结果都是字符串，在db线程就转换为对应的类型，主线程不再解析 */
+void sql::text_to_col( struct sql_res *res,struct sql_col &col,
+    enum_field_types type,const char *value,size_t size )
+{
+    if ( !value ) return; /* 值为NULL */
+
+    switch ( type )
+    {
+        case MYSQL_TYPE_TINY      :
+        case MYSQL_TYPE_SHORT     :
+        case MYSQL_TYPE_LONG      :
+        case MYSQL_TYPE_TIMESTAMP :
+        case MYSQL_TYPE_INT24     :
+        case MYSQL_TYPE_LONGLONG  :
+            col.set_int( strtoll( value,NULL,10 ) );
+            break;
+        case MYSQL_TYPE_FLOAT   :
+        case MYSQL_TYPE_DOUBLE  :
+        case MYSQL_TYPE_DECIMAL :
+            col.set_num( strtod( value,NULL ) );
+            break;
+        case MYSQL_TYPE_VARCHAR     :
+        case MYSQL_TYPE_TINY_BLOB   :
+        case MYSQL_TYPE_MEDIUM_BLOB :
+        case MYSQL_TYPE_LONG_BLOB   :
+        case MYSQL_TYPE_BLOB        :
+        case MYSQL_TYPE_VAR_STRING  :
+        case MYSQL_TYPE_STRING      :
+            col.set_str( res->_arena,value,size );
+            break;
+        default :
+            ERROR( "unknow mysql type:%d\n",type );
+            break;
+    }
+}
+
+MYSQL_STMT *sql::prepare( const char *stmt,size_t size,int32 &ecode )
+{
+    assert( "sql prepare,connection not valid",_conn );
+
+    MYSQL_STMT *handle = mysql_stmt_init( _conn );
+    if ( !handle )
+    {
+        ecode = mysql_errno( _conn );
+        return NULL;
+    }
+
+    if ( mysql_stmt_prepare( handle,stmt,size ) )
+    {
+        ecode = mysql_stmt_errno( handle );
+        ERROR( "mysql prepare error[%s]:%s",stmt,mysql_stmt_error( handle ) );
+
+        mysql_stmt_close( handle );
+        return NULL;
+    }
+
+    /* 让mysql_stmt_store_result计算每一列的最大长度，用来分配字符串的缓冲区 */
+    my_bool update_max = 1;
+    mysql_stmt_attr_set( handle,STMT_ATTR_UPDATE_MAX_LENGTH,&update_max );
+
+    ecode = 0;
+    return handle;
+}
+
+void sql::close_stmt( MYSQL_STMT *handle )
+{
+    mysql_stmt_close( handle );
+}
+
+bool sql::is_stmt_lost( int32 ecode )
+{
+    return CR_SERVER_LOST == ecode || CR_SERVER_GONE_ERROR == ecode
+        || CR_NO_PREPARE_STMT == ecode || ER_UNKNOWN_STMT_HANDLER == ecode;
+}
+
+int32 sql::execute( MYSQL_STMT *handle,
+    const struct sql_query *query,struct sql_res **res )
+{
+    assert( "sql execute,connection not valid",_conn );
+
+    size_t count = query->_params.size();
+    if ( mysql_stmt_param_count( handle ) != count )
+    {
+        ERROR( "mysql execute param count not match[%s]:%d",
+            query->get_stmt(),(int32)count );
+        return CR_INVALID_PARAMETER_NO;
+    }
+
+    /* 参数直接指向query中的数据，执行完之前query不会释放 */
+    std::vector<MYSQL_BIND> binds( count );
+    if ( count > 0 ) memset( &binds.front(),0,sizeof(MYSQL_BIND)*count );
+    for ( size_t index = 0;index < count;index ++ )
+    {
+        MYSQL_BIND &bind = binds[index];
+        const struct sql_col &param = query->_params[index];
+        switch ( param._type )
+        {
+            case SQL_COL_INT :
+                bind.buffer_type = MYSQL_TYPE_LONGLONG;
+                bind.buffer = const_cast<int64 *>( &(param._int) );
+                break;
+            case SQL_COL_NUM :
+                bind.buffer_type = MYSQL_TYPE_DOUBLE;
+                bind.buffer = const_cast<double *>( &(param._num) );
+                break;
+            case SQL_COL_STR :
+                bind.buffer_type = MYSQL_TYPE_STRING;
+                bind.buffer = const_cast<char *>( param._value );
+                bind.buffer_length = param._size;
+                break;
+            default :
+                bind.buffer_type = MYSQL_TYPE_NULL;
+                break;
+        }
+    }
+
+    if ( ( count > 0 && mysql_stmt_bind_param( handle,&binds.front() ) )
+        || mysql_stmt_execute( handle ) )
+    {
+        return mysql_stmt_errno( handle );
+    }
+
+    return stmt_result( handle,res );
+}
+
+/* 二进制协议的结果已经是对应的类型，直接取出来，不需要再解析字符串 */
+int32 sql::stmt_result( MYSQL_STMT *handle,struct sql_res **res )
+{
+    /* insert、update之类的没有结果集 */
+    MYSQL_RES *meta = mysql_stmt_result_metadata( handle );
+    if ( !meta ) return mysql_stmt_errno( handle );
+
+    if ( mysql_stmt_store_result( handle ) )
+    {
+        mysql_free_result( meta );
+        return mysql_stmt_errno( handle );
+    }
+
+    uint32 num_rows = mysql_stmt_num_rows( handle );
+    if ( 0 >= num_rows ) /* we got empty set */
+    {
+        mysql_free_result( meta );
+        mysql_stmt_free_result( handle );
+
+        return 0;
+    }
+
+    uint32 num_fields = mysql_num_fields( meta );
+    assert( "mysql result field count zero",num_fields > 0 );
+
+    *res = new sql_res();
+    (*res)->_num_rows = num_rows;
+    (*res)->_num_cols = num_fields;
+    (*res)->_fields.resize( num_fields );
+    (*res)->_cols.resize  ( num_rows*num_fields );
+
+    /* 每一列的接收缓冲区，整数、浮点直接取值，字符串按该列的最大长度分配 */
+    std::vector<MYSQL_BIND> binds( num_fields );
+    std::vector<int64 > ints( num_fields );
+    std::vector<double> nums( num_fields );
+    std::vector<unsigned long> lengths( num_fields );
+    std::vector<my_bool> is_null( num_fields );
+    std::vector<size_t > offsets( num_fields );
+    std::vector<char> buffer;
+
+    memset( &binds.front(),0,sizeof(MYSQL_BIND)*num_fields );
+
+    uint32 index = 0;
+    size_t buffer_size = 0;
+    MYSQL_FIELD *field;
+    while( (field = mysql_fetch_field( meta )) )
+    {
+        assert( "fetch field more than field count",index < num_fields );
+        (*res)->_fields[index]._type = field->type;
+        snprintf(
+            (*res)->_fields[index]._name,SQL_FIELD_LEN,"%s",field->name );
+
+        MYSQL_BIND &bind = binds[index];
+        bind.length  = &lengths[index];
+        bind.is_null = &is_null[index];
+        switch ( field->type )
+        {
+            case MYSQL_TYPE_TINY     :
+            case MYSQL_TYPE_SHORT    :
+            case MYSQL_TYPE_LONG     :
+            case MYSQL_TYPE_INT24    :
+            case MYSQL_TYPE_LONGLONG :
+            case MYSQL_TYPE_YEAR     :
+                bind.buffer_type = MYSQL_TYPE_LONGLONG;
+                bind.buffer = &ints[index];
+                bind.is_unsigned = ( field->flags & UNSIGNED_FLAG ) ? 1 : 0;
+                break;
+            case MYSQL_TYPE_FLOAT  :
+            case MYSQL_TYPE_DOUBLE :
+                bind.buffer_type = MYSQL_TYPE_DOUBLE;
+                bind.buffer = &nums[index];
+                break;
+            default :
+                /* 其他类型(包括时间、decimal)都以字符串取出，再按文本协议转换 */
+                bind.buffer_type = MYSQL_TYPE_STRING;
+                bind.buffer_length = field->max_length + 1;
+                offsets[index] = buffer_size;
+                buffer_size += bind.buffer_length;
+                break;
+        }
+
+        ++index;
+    }
+
+    /* 字符串缓冲区一次分配，全部确定后再设置指针 */
+    buffer.resize( buffer_size > 0 ? buffer_size : 1 );
+    for ( index = 0;index < num_fields;index ++ )
+    {
+        if ( MYSQL_TYPE_STRING != binds[index].buffer_type ) continue;
+
+        binds[index].buffer = &buffer[offsets[index]];
+    }
+
+    if ( mysql_stmt_bind_result( handle,&binds.front() ) )
+    {
+        int32 ecode = mysql_stmt_errno( handle );
+
+        delete *res;
+        *res = NULL;
+        mysql_free_result( meta );
+        mysql_stmt_free_result( handle );
+        return ecode;
+    }
+
+    uint32 row = 0;
+    int32 rc = 0;
+    while ( row < num_rows && ( 0 == (rc = mysql_stmt_fetch( handle ))
+        || MYSQL_DATA_TRUNCATED == rc ) )
+    {
+        for ( index = 0;index < num_fields;index ++ )
+        {
+            struct sql_col &col = (*res)->_cols[row*num_fields + index];
+            if ( is_null[index] ) continue;
+
+            const MYSQL_BIND &bind = binds[index];
+            if ( MYSQL_TYPE_LONGLONG == bind.buffer_type )
+            {
+                /* 超过int64的无符号数只能用浮点表示 */
+                if ( bind.is_unsigned && ints[index] < 0 )
+                {
+                    col.set_num( static_cast<double>(
+                        static_cast<uint64>( ints[index] ) ) );
+                }
+                else
+                {
+                    col.set_int( ints[index] );
+                }
+            }
+            else if ( MYSQL_TYPE_DOUBLE == bind.buffer_type )
+            {
+                col.set_num( nums[index] );
+            }
+            else
+            {
+                /* 以字符串取出的列(时间、decimal等)按文本协议的规则转换，
+                 * 保证同一个查询不管走哪个协议，得到的类型都一样
+                 */
+                char *value = static_cast<char *>( bind.buffer );
+                size_t size = lengths[index];
+                if ( size >= bind.buffer_length ) size = bind.buffer_length - 1;
+                value[size] = 0;
+
+                text_to_col( *res,col,(*res)->_fields[index]._type,value,size );
+            }
+        }
+
+        ++row;
+    }
+
+    mysql_free_result( meta );
+    mysql_stmt_free_result( handle );
+
+    return 0; /* success */
+}
+
 uint32 sql::get_errno()
 {
     assert( "sql get_errno,connection not valid",_conn );
@@ -20,10 +20,22 @@ public:
     int32 result ( sql_res **res );
     int32 query( const char *stmt,size_t size );
 
+    /* 预处理语句(二进制协议)，出错返回NULL，错误码放到ecode */
+    MYSQL_STMT *prepare( const char *stmt,size_t size,int32 &ecode );
+    /* 执行预处理语句并取出结果，返回错误码，0表示成功 */
+    int32 execute( MYSQL_STMT *handle,
+        const struct sql_query *query,struct sql_res **res );
+    void close_stmt( MYSQL_STMT *handle );
+    /* 该错误是否需要重新prepare(连接断开后预处理语句都失效了) */
+    static bool is_stmt_lost( int32 ecode );
+
     static void library_init();
     static void library_end (); /* 释放sql库，仅在程序不再使用sql时调用 */
 private:
     int32 raw_connect();
+    int32 stmt_result( MYSQL_STMT *handle,struct sql_res **res );
+    static void text_to_col( struct sql_res *res,struct sql_col &col,
+        enum_field_types type,const char *value,size_t size );
 private:
     bool _is_cn;
     MYSQL *_conn;
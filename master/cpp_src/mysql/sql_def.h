@@ -7,6 +7,7 @@
 
 #define SQL_FIELD_LEN    64
 #define SQL_VAR_LEN      64
+#define SQL_ARENA_BLOCK  8192
 
 /*
 enum enum_field_types { MYSQL_TYPE_DECIMAL, MYSQL_TYPE_TINY,
@@ -39,44 +40,101 @@ struct sql_field
     enum_field_types    _type; /* define in mysql_com.h */
 };
 
-struct sql_col
+/* 列数据类型，在db线程就转换好，主线程直接压入lua */
+typedef enum
 {
-    size_t _size;
-    char *_value;
-
-    sql_col()
+    SQL_COL_NIL = 0, // NULL
+    SQL_COL_INT = 1, // 整数
+    SQL_COL_NUM = 2, // 浮点数
+    SQL_COL_STR = 3, // 字符串或者二进制，数据在sql_arena中，以\0结尾
+}sql_col_t;
+
+/* 一块连续增长的内存，用于存放一个结果集(或者一个查询参数)中所有的字符串，
+ * 避免每一列都new一次。只能整体释放
+ */
+class sql_arena
+{
+public:
+    sql_arena()
     {
-        _size  = 0;
-        _value = NULL;
+        _left = 0;
+        _cur  = NULL;
     }
 
-    ~sql_col()
+    ~sql_arena()
     {
-        if ( _value ) delete []_value;
+        std::vector<char *>::iterator itr = _blocks.begin();
+        for ( ;itr != _blocks.end();itr ++ ) delete [](*itr);
 
-        _size  = 0;
-        _value = NULL;
+        _blocks.clear();
     }
 
-    void set( const char *value,size_t size)
+    char *alloc( size_t size )
     {
-        assert ( "sql col not clean",0 == _size && !_value );
-        if ( !value || 0 >= size ) return;  /* 结果为NULL */
+        if ( expect_false( size > _left ) )
+        {
+            /* 超过一个块大小的数据单独分配，不浪费当前块剩余的空间 */
+            if ( size > SQL_ARENA_BLOCK/4 )
+            {
+                char *big = new char[size];
+                _blocks.push_back( big );
+                return big;
+            }
+
+            _cur  = new char[SQL_ARENA_BLOCK];
+            _left = SQL_ARENA_BLOCK;
+            _blocks.push_back( _cur );
+        }
+
+        char *ptr = _cur;
+
+        _cur  += size;
+        _left -= size;
+        return ptr;
+    }
 
-        _size  = size;  /* 注意没加1 */
-        _value = new char[size+1];
+    /* 复制一份数据，统一加\0结尾，方便打印 */
+    const char *dup( const char *value,size_t size )
+    {
+        char *ptr = alloc( size + 1 );
 
-        /* 无论何种数据类型(包括寸进制)，都统一加\0
-         * 方便后面转换为int之类时可以直接atoi
-         */
-        memcpy( _value,value,size );
-        _value[size]         = '\0';
+        memcpy( ptr,value,size );
+        ptr[size] = '\0';
+        return ptr;
     }
+private:
+    size_t _left;
+    char  *_cur ;
+    std::vector<char *> _blocks;
 };
 
-struct sql_row
+struct sql_col
 {
-    std::vector<sql_col> _cols;
+    int32  _type; /* sql_col_t */
+    size_t _size; /* 字符串长度，不包括\0 */
+    union
+    {
+        int64  _int;
+        double _num;
+        const char *_value;
+    };
+
+    sql_col()
+    {
+        _type = SQL_COL_NIL;
+        _size = 0;
+        _int  = 0;
+    }
+
+    inline void set_nil() { _type = SQL_COL_NIL; }
+    inline void set_int( int64 val ) { _type = SQL_COL_INT;_int = val; }
+    inline void set_num( double val ) { _type = SQL_COL_NUM;_num = val; }
+    inline void set_str( sql_arena &arena,const char *value,size_t size )
+    {
+        _type  = SQL_COL_STR;
+        _size  = size;
+        _value = arena.dup( value,size );
+    }
 };
 
 struct sql_res
@@ -84,7 +142,13 @@ struct sql_res
     uint32 _num_rows;  // 行数
     uint32 _num_cols;  // 列数
     std::vector<sql_field> _fields; // 字段名
-    std::vector<sql_row  > _rows  ; // 行数据
+    std::vector<sql_col  > _cols  ; // 所有行的数据，按行连续存放
+    class sql_arena _arena; // 所有字符串数据
+
+    inline const struct sql_col &get_col( uint32 row,uint32 col ) const
+    {
+        return _cols[row*_num_cols + col];
+    }
 };
 
 /* 查询结果 */
@@ -95,6 +159,35 @@ struct sql_result
     struct sql_res *_res;
 };
 
+/* 预处理语句，由主线程创建，各个连接在第一次使用时各自prepare
+ * 创建后不会修改，直到lsql销毁(此时所有连接线程已停止)
+ */
+struct sql_stmt
+{
+    explicit sql_stmt( int32 sid,size_t size,const char *stmt )
+    {
+        _sid  = sid;
+        _size = size;
+
+        _stmt = new char[size + 1];
+        memcpy( _stmt,stmt,size );
+        _stmt[size] = 0;
+    }
+
+    ~sql_stmt()
+    {
+        if ( _stmt ) delete []_stmt;
+
+        _sid  = 0;
+        _size = 0;
+        _stmt = NULL;
+    }
+
+    int32  _sid;
+    size_t _size;
+    char  *_stmt;
+};
+
 /* 查询请求 */
 struct sql_query
 {
@@ -102,12 +195,22 @@ struct sql_query
     {
         _id   = id;
         _size = size;
+        _prepare = NULL;
 
         _stmt = new char[size + 1];
         memcpy( _stmt,stmt,size );
         _stmt[size] = 0; // 保证0结尾，因为有些地方需要打印stmt
     }
 
+    /* 执行预处理语句，参数由上层通过_params设置 */
+    explicit sql_query( int32 id,const struct sql_stmt *prepare )
+    {
+        _id   = id;
+        _size = prepare->_size;
+        _stmt = NULL;
+        _prepare = prepare;
+    }
+
     ~sql_query()
     {
         if ( _stmt ) delete []_stmt;
@@ -115,11 +218,21 @@ struct sql_query
         _id       = 0;
         _size     = 0;
         _stmt     = NULL;
+        _prepare  = NULL;
+    }
+
+    inline const char *get_stmt() const
+    {
+        return _prepare ? _prepare->_stmt : _stmt;
     }
 
     int32  _id;
     size_t _size;
     char  *_stmt;
+
+    const struct sql_stmt *_prepare;
+    std::vector<sql_col> _params; // 预处理语句的参数
+    class sql_arena _arena; // 参数中的字符串
 };
 
 #endif /* __SQL_RESULT_H__ */
@@ -1,6 +1,24 @@
 #include "buffer.h"
 
 class ordered_pool<BUFFER_CHUNK> buffer::allocator;
+class object_pool<struct buffer::segment> buffer::seg_pool;
+__thread class ordered_pool<BUFFER_CHUNK> *buffer::local_allocator = NULL;
+__thread class object_pool<struct buffer::segment> *buffer::local_seg_pool = NULL;
+
+/* 设置当前线程使用的内存池，NULL表示使用默认的内存池 */
+void buffer::set_thread_allocator( class ordered_pool<BUFFER_CHUNK> *pool )
+{
+    local_allocator = pool;
+    if ( pool )
+    {
+        if ( !local_seg_pool ) local_seg_pool = new object_pool<struct segment>();
+    }
+    else
+    {
+        delete local_seg_pool;
+        local_seg_pool = NULL;
+    }
+}
 
 buffer::buffer()
 {
@@ -12,13 +30,21 @@ buffer::buffer()
     /* 与客户端通信的默认设定 */
     _max_buff = BUFFER_LARGE;
     _min_buff = BUFFER_CHUNK;
+
+    _segment = false;
+    _head = NULL;
+    _tail = NULL;
 }
 
 buffer::~buffer()
 {
-    if ( _len )
+    if ( _segment )
+    {
+        seg_clear();
+    }
+    else if ( _len )
     {
-        allocator.ordered_free( _buff,_len/BUFFER_CHUNK );
+        get_allocator().ordered_free( _buff,_len/BUFFER_CHUNK );
     }
 
     _buff = NULL;
@@ -26,3 +52,227 @@ buffer::~buffer()
     _len  = 0;
     _pos  = 0;
 }
+
+/* 设置分段模式，只能在缓冲区无数据时设置 */
+void buffer::set_segment( bool segment )
+{
+    assert( "buffer set segment with data",0 == data_size() );
+    if ( segment == _segment ) return;
+
+    /* 两种模式的内存结构不一样，切换时把旧内存还给allocator */
+    if ( _segment )
+    {
+        seg_clear();
+    }
+    else if ( _len )
+    {
+        get_allocator().ordered_free( _buff,_len/BUFFER_CHUNK );
+    }
+
+    _buff = NULL;
+    _size = 0;
+    _len  = 0;
+    _pos  = 0;
+
+    _segment = segment;
+}
+
+/* 把数据区填充到iovec数组，用于writev */
+int32 buffer::data_vector( struct iovec *iov,int32 max ) const
+{
+    assert( "buffer data vector",max > 0 );
+    if ( !_segment )
+    {
+        iov[0].iov_base = data_pointer();
+        iov[0].iov_len  = data_size();
+
+        return 1;
+    }
+
+    int32 cnt = 0;
+    for ( struct segment *seg = _head;seg && cnt < max;seg = seg->_next )
+    {
+        uint32 used = seg->_size - seg->_pos;
+        if ( 0 == used ) continue;
+
+        iov[cnt].iov_base = seg->data() + seg->_pos;
+        iov[cnt].iov_len  = used;
+        ++cnt;
+    }
+
+    return cnt;
+}
+
+/* 写入共享数据帧，分段模式下直接引用，否则拷贝 */
+int32 buffer::append_frame( class shared_frame *frame )
+{
+    uint32 size = frame->size();
+
+    /* 帧太小时，多一个segment、多一个iovec还不如直接拷贝 */
+    if ( !_segment || size < BUFFER_SHARE_MIN )
+    {
+        return append( frame->data(),size ) ? 0 : -1;
+    }
+
+    if ( _size + size > _max_buff ) return -1;
+
+    /* 最后一个segment没有数据(只可能是_head == _tail)，直接归还 */
+    if ( _tail && 0 == _tail->_size && _head == _tail )
+    {
+        seg_free( _tail );
+        _head = _tail = NULL;
+    }
+
+    struct segment *seg = get_seg_pool().construct();
+    seg->_next  = NULL;
+    seg->_frame = frame;
+    seg->_n     = 0;
+    seg->_pos   = 0;
+    seg->_size  = size;
+    seg->_len   = size;
+    frame->grab();
+
+    if ( _tail )
+    {
+        _tail->_next = seg;
+    }
+    else
+    {
+        _head = seg;
+    }
+    _tail = seg;
+    _len  += size;
+    _size += size;
+
+    return 1;
+}
+
+/* 归还一个segment */
+void buffer::seg_free( struct segment *seg )
+{
+    if ( seg->_frame )
+    {
+        assert( "buffer segment free",_len >= seg->_len );
+
+        _len -= seg->_len;
+        seg->_frame->release();
+        seg->_frame = NULL;
+        get_seg_pool().destroy( seg );
+        return;
+    }
+
+    assert( "buffer segment free",_len >= seg->_n*BUFFER_CHUNK );
+
+    _len -= seg->_n*BUFFER_CHUNK;
+    get_allocator().ordered_free( reinterpret_cast<char *>(seg),seg->_n );
+}
+
+/* 分段模式下，释放所有segment */
+void buffer::seg_clear()
+{
+    while ( _head )
+    {
+        struct segment *seg = _head;
+        _head = seg->_next;
+
+        seg_free( seg );
+    }
+
+    _tail = NULL;
+    _size = 0;
+    _pos  = 0;
+    assert( "buffer segment clear",0 == _len );
+}
+
+/* 分段模式下，减去缓冲区数据。发送完的segment直接归还，最后一个则保留复用 */
+void buffer::seg_subtract( uint32 len )
+{
+    assert( "buffer subtract",_size >= len );
+
+    _size -= len;
+    while ( len > 0 )
+    {
+        struct segment *seg = _head;
+        uint32 used = seg->_size - seg->_pos;
+        if ( len < used )
+        {
+            seg->_pos += len;
+            return;
+        }
+
+        len -= used;
+        if ( seg == _tail )
+        {
+            assert( "buffer subtract",0 == len );
+            /* 引用的segment是只读的，不能复用 */
+            if ( seg->_frame )
+            {
+                seg_free( seg );
+                _head = _tail = NULL;
+                return;
+            }
+            seg->_pos = seg->_size = 0;
+            return;
+        }
+
+        _head = seg->_next;
+        seg_free( seg );
+    }
+
+    /* 刚好发送完一个segment，而下一个是空的_tail */
+    if ( _head == _tail && _head->_pos == _head->_size )
+    {
+        _head->_pos = _head->_size = 0;
+    }
+}
+
+/* 分段模式下的内存预分配，保证_tail中有连续bytes字节可写
+ * 与连续模式一样，刚好用完也申请，因此reserved(0)保证至少有1字节可写
+ */
+bool buffer::seg_reserved( uint32 bytes,uint32 vsz )
+{
+    /* 自定义写入缓存时，数据在旧的segment里，无法挂到新的segment */
+    assert( "segment buffer not support vsz",0 == vsz );
+
+    if ( _tail && _tail->_len - _tail->_size > bytes ) return true;
+
+    /* 按实际写入的数据量限制，不按分配的内存。引用的segment后面没有空闲空间，
+     * 广播和单发交替时每次都要分配新segment，按内存算很快就会超出限制
+     */
+    if ( _size + bytes > _max_buff ) return false;
+
+    uint32 n = (sizeof(struct segment) + bytes)/BUFFER_CHUNK + 1;
+
+    /* 最后一个segment没有数据(只可能是_head == _tail)，但空间不够，直接归还 */
+    if ( _tail && 0 == _tail->_size )
+    {
+        assert( "buffer segment empty tail",_head == _tail );
+        seg_free( _tail );
+        _head = _tail = NULL;
+    }
+
+    uint32 chunk_size =
+        n*BUFFER_CHUNK >= BUFFER_LARGE ? 1 : BUFFER_CHUNK_SIZE;
+    struct segment *seg = reinterpret_cast<struct segment *>(
+        get_allocator().ordered_malloc( n,chunk_size ) );
+
+    seg->_next  = NULL;
+    seg->_frame = NULL;
+    seg->_n     = n;
+    seg->_pos   = 0;
+    seg->_size  = 0;
+    seg->_len   = n*BUFFER_CHUNK - sizeof(struct segment);
+
+    if ( _tail )
+    {
+        _tail->_next = seg;
+    }
+    else
+    {
+        _head = seg;
+    }
+    _tail = seg;
+    _len += n*BUFFER_CHUNK;
+
+    return true;
+}
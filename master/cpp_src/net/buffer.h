@@ -1,8 +1,12 @@
 #ifndef __BUFFER_H__
 #define __BUFFER_H__
 
+#include <sys/uio.h>    /* struct iovec */
+
 #include "../global/global.h"
+#include "../pool/object_pool.h"
 #include "../pool/ordered_pool.h"
+#include "shared_frame.h"
 
 /*
  *    +---------------------------------------------------------------+
@@ -17,6 +21,20 @@
  *   的办法是每读取完或发送完一轮数据包，就用memmove把后面的数据往前面移动，这在粘包频繁出现
  *   并且包不完整的情况下效率很低(进程间的socket粘包很严重)。因此，我们忽略前面的悬空缓冲区，
  *   直到我们需要调整内存时，才用memmove移动内存。
+ *
+ * 分段模式(只用于发送缓冲区)：
+ *    +-----------+     +-----------+     +-----------+
+ *    |  segment  | --> |  segment  | --> |  segment  |
+ *    +-----------+     +-----------+     +-----------+
+ *  _head                                _tail
+ * 1.每个segment都从allocator分配，首部存放segment信息，后面是数据区
+ * 2.写入只在_tail追加，空间不够时在链表尾部挂一个新的segment，不会memmove悬空区，也不会
+ *   按指数扩容后拷贝旧数据。广播、大量小包时可以避免拷贝
+ * 3.发送时用writev把所有segment一次发出去。接收缓冲区解析协议需要连续内存，不能用此模式
+ * 4.此模式下_size为所有segment数据总大小，_len为所有segment内存总大小，_pos恒为0。
+ *   _max_buff限制的是_size，即实际待发送的数据量
+ * 5.广播时可以挂一个引用shared_frame的segment，数据不拷贝，发送完后释放引用。引用的
+ *   segment是只读的，后续写入会在它后面挂新的segment
  */
 
 class buffer
@@ -25,7 +43,13 @@ public:
     buffer();
     ~buffer();
 
-    static void purge() { allocator.purge(); }
+    static void purge() { allocator.purge(); seg_pool.purge(); }
+
+    /* 设置当前线程使用的内存池，NULL表示使用默认的内存池
+     * 内存池不是线程安全的，io线程中的缓冲区需要使用自己的内存池，并且只能在该线程中
+     * 分配、释放。引用共享帧的segment也同时切换到该线程自己的对象池
+     */
+    static void set_thread_allocator( class ordered_pool<BUFFER_CHUNK> *pool );
 
     bool append( const void *data,uint32 len )
         __attribute__ ((warn_unused_result))
@@ -38,6 +62,8 @@ public:
     /* 减去缓冲区数据，此函数不处理缓冲区的数据 */
     inline void subtract( uint32 len )
     {
+        if ( expect_false(_segment) ) return seg_subtract( len );
+
         _pos += len;
         assert( "buffer subtract",_size >= _pos && _len >= _pos );
 
@@ -47,32 +73,100 @@ public:
     /* 增加数据区 */
     inline void increase( uint32 len )
     {
+        if ( expect_false(_segment) )
+        {
+            _tail->_size += len;
+            assert( "buffer increase",_tail->_size <= _tail->_len );
+        }
+
         _size += len;
         assert( "buffer increase",_size <= _len );
     }
 
     /* 重置 */
-    inline void clear() { _pos = _size = 0; }
+    inline void clear()
+    {
+        if ( expect_false(_segment) ) return seg_clear();
+
+        _pos = _size = 0;
+    }
     /* 总大小 */
     inline uint32 length() const { return _len; }
 
     /* 数据区大小 */
     inline uint32 data_size() const { return _size - _pos; }
-    /* 数据区指针 */
-    inline char *data_pointer() const { return _buff + _pos; }
+    /* 数据区指针，分段模式下为第一个segment的数据区 */
+    inline char *data_pointer() const
+    {
+        if ( expect_false(_segment) )
+        {
+            return _head ? _head->data() + _head->_pos : NULL;
+        }
+
+        return _buff + _pos;
+    }
+    /* 数据区指针开始的连续数据大小，分段模式下为第一个segment的数据大小 */
+    inline uint32 seg_data_size() const
+    {
+        if ( expect_false(_segment) )
+        {
+            return _head ? _head->_size - _head->_pos : 0;
+        }
+
+        return _size - _pos;
+    }
 
     /* 缓冲区大小 */
-    inline uint32 buff_size() const { return _len - _size; }
+    inline uint32 buff_size() const
+    {
+        if ( expect_false(_segment) )
+        {
+            return _tail ? _tail->_len - _tail->_size : 0;
+        }
+
+        return _len - _size;
+    }
     /* 缓冲区指针 */
-    inline char *buff_pointer() const { return _buff + _size; }
+    inline char *buff_pointer() const
+    {
+        if ( expect_false(_segment) )
+        {
+            return _tail ? _tail->data() + _tail->_size : NULL;
+        }
+
+        return _buff + _size;
+    }
 
     /* raw append data,but won't reserved */
     void __append( const void *data,const uint32 len )
     {
-        assert( "buffer not reserved!",_len - _size >= len );
-        memcpy( _buff + _size,data,len );       _size += len;
+        assert( "buffer not reserved!",buff_size() >= len );
+        memcpy( buff_pointer(),data,len );       increase( len );
     }
 
+    /* 分段模式下，第一个segment引用的共享帧，该segment已发送过一部分则返回NULL */
+    inline class shared_frame *data_frame() const
+    {
+        if ( !_segment || !_head || _head->_pos ) return NULL;
+
+        return _head->_frame;
+    }
+
+    /* 是否为分段模式 */
+    inline bool is_segment() const { return _segment; }
+    /* 设置分段模式，只能在缓冲区无数据时设置 */
+    void set_segment( bool segment );
+    /* 把数据区填充到iovec数组，用于writev
+     * @iov : iovec数组
+     * @max : iovec数组最大长度
+     * 返回填充的数量
+     */
+    int32 data_vector( struct iovec *iov,int32 max ) const;
+    /* 写入共享数据帧，分段模式下直接引用，否则拷贝
+     * return: <0 error;0 拷贝;>0 引用
+     */
+    int32 append_frame( class shared_frame *frame );
+
     /* 设置缓冲区最大最小值 */
     void set_buffer_size( uint32 max,uint32 min )
     {
@@ -87,6 +181,8 @@ public:
     inline bool reserved( uint32 bytes = 0,uint32 vsz = 0 )
         __attribute__ ((warn_unused_result))
     {
+        if ( expect_false(_segment) ) return seg_reserved( bytes,vsz );
+
         uint32 size = _size + vsz;
         if ( _len - size > bytes ) return true;/* 不能等于0,刚好用完也申请 */
 
@@ -116,21 +212,53 @@ public:
 
         uint32 chunk_size = new_len >= BUFFER_LARGE ? 1 : BUFFER_CHUNK_SIZE;
         char *new_buff =
-            allocator.ordered_malloc( new_len/BUFFER_CHUNK,chunk_size );
+            get_allocator().ordered_malloc( new_len/BUFFER_CHUNK,chunk_size );
 
         /* 像STL一样把旧内存拷到新内存 */
         if ( size ) memcpy( new_buff,_buff,size );
 
-        if ( _len ) allocator.ordered_free( _buff,_len/BUFFER_CHUNK );
+        if ( _len ) get_allocator().ordered_free( _buff,_len/BUFFER_CHUNK );
 
         _buff = new_buff;
         _len  = new_len ;
 
         return      true;
     }
+private:
+    /* 分段模式下的内存块，数据区紧跟在结构体后面 */
+    struct segment
+    {
+        struct segment *_next;
+        class shared_frame *_frame; /* 引用的共享帧，NULL表示数据紧跟在结构体后面 */
+        uint32 _n;    /* 内存大小为BUFFER_CHUNK的_n倍(包含segment本身)，引用时为0 */
+        uint32 _pos;  /* 悬空区大小 */
+        uint32 _size; /* 已使用大小(包含悬空区) */
+        uint32 _len;  /* 数据区总大小 */
+
+        inline char *data() const
+        {
+            if ( _frame ) return _frame->data();
+
+            return reinterpret_cast<char *>( const_cast<segment *>(this) + 1 );
+        }
+    };
 private:
     buffer( const buffer & );
     buffer &operator=( const buffer &);
+
+    void seg_clear();
+    void seg_subtract( uint32 len );
+    bool seg_reserved( uint32 bytes,uint32 vsz );
+    void seg_free( struct segment *seg );
+
+    static inline class ordered_pool<BUFFER_CHUNK> &get_allocator()
+    {
+        return expect_false(local_allocator) ? *local_allocator : allocator;
+    }
+    static inline class object_pool<struct segment> &get_seg_pool()
+    {
+        return expect_false(local_seg_pool) ? *local_seg_pool : seg_pool;
+    }
 private:
     char  *_buff;    /* 缓冲区指针 */
     uint32 _size;    /* 缓冲区已使用大小 */
@@ -139,8 +267,15 @@ private:
 
     uint32 _max_buff; /* 缓冲区最小值 */
     uint32 _min_buff; /* 缓冲区最大值 */
+
+    bool _segment;           /* 是否为分段模式 */
+    struct segment *_head;   /* 分段模式下，第一个segment */
+    struct segment *_tail;   /* 分段模式下，最后一个segment */
 private:
     static class ordered_pool<BUFFER_CHUNK> allocator;
+    static class object_pool<struct segment> seg_pool; /* 引用共享帧的segment */
+    static __thread class ordered_pool<BUFFER_CHUNK> *local_allocator;
+    static __thread class object_pool<struct segment> *local_seg_pool;
 };
 
 #endif /* __BUFFER_H__ */
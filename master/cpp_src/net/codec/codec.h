@@ -17,7 +17,8 @@ public:
         CDC_BSON     = 1, // bson
         CDC_STREAM   = 2, // 自定义二进制流
         CDC_FLATBUF  = 3, // google FlatBuffers
-        CDC_PROTOBUF = 4, // google protocol buffers
+        CDC_PROTOBUF = 4, // google protocol buffers(pbc)
+        CDC_UPB      = 5, // google protocol buffers(upb)，编译时USE_UPB=1才有
 
         CDC_MAX
     }codec_t;
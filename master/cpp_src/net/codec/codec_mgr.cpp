@@ -1,16 +1,25 @@
 #include "codec_mgr.h"
 
 #include "bson_codec.h"
+#include "stream_codec.h"
 #include "protobuf_codec.h"
 #include "flatbuffers_codec.h"
 
+#ifdef USE_UPB
+    #include "upb_codec.h"
+#endif
+
 codec_mgr::codec_mgr()
 {
     memset( _codecs,0,sizeof(_codecs) );
 
     _codecs[codec::CDC_BSON] = new class bson_codec();
+    _codecs[codec::CDC_STREAM] = new class stream_codec();
     _codecs[codec::CDC_FLATBUF] = new class flatbuffers_codec();
     _codecs[codec::CDC_PROTOBUF] = new class protobuf_codec();
+#ifdef USE_UPB
+    _codecs[codec::CDC_UPB] = new class upb_codec();
+#endif
 }
 
 codec_mgr::~codec_mgr()
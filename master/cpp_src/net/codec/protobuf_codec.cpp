@@ -1,5 +1,6 @@
 #include "protobuf_codec.h"
 #include "../net_include.h"
+#include "../../system/static_global.h"
 
 #include <pbc.h>
 #include <lua.hpp>
@@ -55,18 +56,36 @@ private:
     int32 raw_encode_field( lua_State *L,struct pbc_wmessage *wmsg,
         int32 type,int32 index,const char *key,const char *object );
 
-    int32 raw_decode( lua_State *L,struct pbc_rmessage *msg );
-    int32 decode_field( lua_State *L,
-        struct pbc_rmessage *msg,const char *key,int32 type,int32 idx );
+    int32 raw_decode( lua_State *L,
+        struct pbc_rmessage *msg,int32 key_tbl,int32 &field_cnt );
+    int32 decode_field( lua_State *L,struct pbc_rmessage *msg,
+        const char *key,int32 type,int32 idx,int32 key_tbl );
+    int32 push_key( lua_State *L,const char *key,int32 key_tbl );
 private:
+    /* 字段名缓存。pbc返回的字段名是它内部的固定指针，第一次遇到时内化到registry
+     * 中的一个table，以后按下标直接取，不需要每个数据包都重新计算hash、内化字段名
+     * _field_cnt是以该字段为子消息时，子消息上一次解码的字段数量，用于预分配table
+     */
+    struct key_cache
+    {
+        int32 _index;
+        int32 _field_cnt;
+    };
+
     struct pbc_env *_env;
     struct pbc_wmessage *_write_msg;
+
+    int32 _key_ref;
+    map_t< const char *,struct key_cache > _key_cache;
+    const_char_map_t(int32) _root_cnt; // 各消息上一次解码的字段数量
 };
 
 lprotobuf::lprotobuf()
 {
     _env = pbc_new();
     _write_msg = NULL;
+
+    _key_ref = LUA_NOREF;
 }
 
 lprotobuf::~lprotobuf()
@@ -76,6 +95,14 @@ lprotobuf::~lprotobuf()
 
     if ( _env ) pbc_delete( _env );
     _env = NULL;
+
+    /* codec_mgr在lstate之后定义，先于lua_close析构 */
+    luaL_unref( static_global::state(),LUA_REGISTRYINDEX,_key_ref );
+    _key_ref = LUA_NOREF;
+
+    const_char_map_t(int32)::iterator itr = _root_cnt.begin();
+    for ( ;itr != _root_cnt.end();itr ++ ) delete []itr->first._raw_ctx;
+    _root_cnt.clear();
 }
 
 void lprotobuf::del_message()
@@ -203,13 +230,71 @@ int32 lprotobuf::decode(
         return -1;
     }
 
-    int32 ecode = raw_decode( L,msg );
+    if ( !lua_checkstack( L,1 ) )
+    {
+        pbc_rmessage_delete( msg );
+        ERROR( "protobuf decode stack overflow" );
+        return -1;
+    }
+
+    // 字段名缓存table放在结果下面，解码完移除
+    int32 top = lua_gettop( L );
+    if ( expect_false( LUA_NOREF == _key_ref ) )
+    {
+        lua_newtable( L );
+        _key_ref = luaL_ref( L,LUA_REGISTRYINDEX );
+    }
+    lua_rawgeti( L,LUA_REGISTRYINDEX,_key_ref );
+
+    // object可能是临时的字符串，第一次解码时复制一份作为key
+    const_char_map_t(int32)::iterator itr = _root_cnt.find( object );
+    if ( expect_false( itr == _root_cnt.end() ) )
+    {
+        size_t len = strlen( object );
+        char *name = new char[len + 1];
+        memcpy( name,object,len + 1 );
+
+        itr = _root_cnt.insert( std::make_pair( name,0 ) ).first;
+    }
+
+    int32 ecode = raw_decode( L,msg,top + 1,itr->second );
     pbc_rmessage_delete( msg );
 
+    if ( ecode < 0 )
+    {
+        lua_settop( L,top );
+        return -1;
+    }
+    lua_remove( L,top + 1 );
+
     return ecode;
 }
 
-int32 lprotobuf::raw_decode( lua_State *L,struct pbc_rmessage *msg )
+/* 把字段名push到栈上，优先从缓存中取 */
+int32 lprotobuf::push_key( lua_State *L,const char *key,int32 key_tbl )
+{
+    map_t< const char *,struct key_cache >::const_iterator itr =
+        _key_cache.find( key );
+    if ( expect_true( itr != _key_cache.end() ) )
+    {
+        lua_rawgeti( L,key_tbl,itr->second._index );
+        return 0;
+    }
+
+    struct key_cache &cache = _key_cache[key];
+    cache._index = static_cast<int32>( _key_cache.size() );
+    cache._field_cnt = 0;
+
+    lua_pushstring( L,key );
+    lua_pushvalue( L,-1 );
+    lua_rawseti( L,key_tbl,cache._index );
+
+    return 0;
+}
+
+/* field_cnt:传入上一次解码的字段数量用于预分配table，返回本次的数量 */
+int32 lprotobuf::raw_decode( lua_State *L,
+    struct pbc_rmessage *msg,int32 key_tbl,int32 &field_cnt )
 {
     int type = 0;
     const char *key = NULL;
@@ -221,22 +306,23 @@ int32 lprotobuf::raw_decode( lua_State *L,struct pbc_rmessage *msg )
     }
     int32 top = lua_gettop( L );
 
-    lua_newtable( L );
+    lua_createtable( L,0,field_cnt );
 
+    int32 cnt = 0;
     while( true )
     {
         type = pbc_rmessage_next( msg, &key );
         if ( key == NULL ) break;
 
-        lua_pushstring( L,key );
+        push_key( L,key,key_tbl );
         if ( type & PBC_REPEATED )
         {
-            lua_newtable( L );
             int32 raw_type = (type & ~PBC_REPEATED);
             int size = pbc_rmessage_size( msg, key );
+            lua_createtable( L,size,0 );
             for ( int idx = 0;idx < size;idx ++ )
             {
-                if ( decode_field( L,msg,key,raw_type,idx ) < 0 )
+                if ( decode_field( L,msg,key,raw_type,idx,key_tbl ) < 0 )
                 {
                     lua_settop( L,top );
                     return           -1;
@@ -246,20 +332,22 @@ int32 lprotobuf::raw_decode( lua_State *L,struct pbc_rmessage *msg )
         }
         else
         {
-            if ( decode_field( L,msg,key,type,0 ) < 0 )
+            if ( decode_field( L,msg,key,type,0,key_tbl ) < 0 )
             {
                 lua_settop( L,top );
                 return           -1;
             }
         }
         lua_rawset( L,top + 1 );
+        cnt ++;
     }
 
+    field_cnt = cnt;
     return 0;
 }
 
-int32 lprotobuf::decode_field( lua_State *L,
-    struct pbc_rmessage *msg,const char *key,int32 type,int32 idx )
+int32 lprotobuf::decode_field( lua_State *L,struct pbc_rmessage *msg,
+    const char *key,int32 type,int32 idx,int32 key_tbl )
 {
     switch( type )
     {
@@ -300,7 +388,8 @@ int32 lprotobuf::decode_field( lua_State *L,
             ERROR( "protobuf decode sub message not found:%s",key );
             return -1;
         }
-        return raw_decode( L,submsg );
+        // 同一个字段的子消息类型相同，字段数量也记录在字段名缓存中
+        return raw_decode( L,submsg,key_tbl,_key_cache[key]._field_cnt );
     }break;
     default :
         ERROR( "protobuf decode unknow type" ); return -1;
@@ -0,0 +1,447 @@
+#include <lua.hpp>
+#include <fstream>
+
+#include "stream_codec.h"
+#include "../../system/static_global.h"
+
+#define STREAM_MAX_DEPTH   32   // table最大嵌套层数，超过认为是循环引用
+#define STREAM_BUFFER_SIZE 4096 // 编码缓冲区初始大小
+
+/* 每个值以一个字节的类型开始
+ * 0x80~0xFF为0~127的整数，0x40~0x7F为0~63的字段id，其他的见下面
+ */
+typedef enum
+{
+    ST_NIL    = 0x00,
+    ST_FALSE  = 0x01,
+    ST_TRUE   = 0x02,
+    ST_INT    = 0x03, // zigzag varint
+    ST_DOUBLE = 0x04, // 8字节
+    ST_STRING = 0x05, // varint长度 + 内容
+    ST_TABLE  = 0x06, // varint数组长度 + 数组元素 + 其他key、value + ST_END
+    ST_END    = 0x07, // table结束
+    ST_FIELD  = 0x08, // varint字段id
+
+    ST_SMALL_FIELD = 0x40,
+    ST_SMALL_INT   = 0x80
+}stream_tag_t;
+
+stream_codec::stream_codec()
+{
+    _len = 0;
+    _size = STREAM_BUFFER_SIZE;
+    _buffer = new char[_size];
+
+    _field_ref = LUA_NOREF;
+    _field_tbl = 0;
+    _field_cnt = 0;
+}
+
+stream_codec::~stream_codec()
+{
+    delete []_buffer;
+    _buffer = NULL;
+
+    /* codec_mgr在lstate之后定义，先于lua_close析构 */
+    if ( LUA_NOREF != _field_ref )
+    {
+        luaL_unref( static_global::state(),LUA_REGISTRYINDEX,_field_ref );
+        _field_ref = LUA_NOREF;
+    }
+}
+
+/* 加载字段名列表
+ * @path:字段名文件，每行一个，按顺序从0开始为字段id，空行及#开头的注释行不算
+ * return:字段数量，<0 error
+ */
+int32 stream_codec::load_path( const char *path )
+{
+    std::ifstream ifs( path );
+    if ( !ifs.good() )
+    {
+        ERROR( "stream codec can not open schema:%s",path );
+        return -1;
+    }
+
+    lua_State *L = static_global::state();
+
+    luaL_unref( L,LUA_REGISTRYINDEX,_field_ref );
+    _field_id.clear();
+    _field_cnt = 0;
+
+    lua_newtable( L );
+
+    std::string line;
+    while ( std::getline( ifs,line ) )
+    {
+        if ( !line.empty() && '\r' == line[line.size() - 1] )
+        {
+            line.erase( line.size() - 1 );
+        }
+        if ( line.empty() || '#' == line[0] ) continue;
+
+        int32 id = _field_cnt ++;
+
+        // 字符串放到table中，保证不会被gc，指针一直有效。解码时也直接从table中取
+        lua_pushlstring( L,line.c_str(),line.size() );
+        const char *name = lua_tostring( L,-1 );
+        lua_rawseti( L,-2,id + 1 );
+
+        if ( !_field_id.insert( std::make_pair( name,id ) ).second )
+        {
+            ERROR( "stream codec duplicate field:%s",name );
+        }
+    }
+
+    _field_ref = luaL_ref( L,LUA_REGISTRYINDEX );
+
+    return _field_cnt;
+}
+
+bool stream_codec::reserved( size_t bytes )
+{
+    if ( expect_true( _len + bytes <= _size ) ) return true;
+
+    if ( _len + bytes > MAX_PACKET_LEN )
+    {
+        ERROR( "stream encode buffer over MAX_PACKET_LEN" );
+        return false;
+    }
+
+    size_t new_size = _size;
+    while ( new_size < _len + bytes ) new_size *= 2;
+
+    char *new_buffer = new char[new_size];
+    memcpy( new_buffer,_buffer,_len );
+
+    delete []_buffer;
+    _buffer = new_buffer;
+    _size = new_size;
+
+    return true;
+}
+
+void stream_codec::append_varint( uint64 val )
+{
+    while ( val >= 0x80 )
+    {
+        append_byte( static_cast<uint8>( val | 0x80 ) );
+        val >>= 7;
+    }
+    append_byte( static_cast<uint8>( val ) );
+}
+
+bool stream_codec::read_varint( struct reader &rd,uint64 &val )
+{
+    val = 0;
+    for ( int32 shift = 0;shift < 64 && rd.pos < rd.end;shift += 7 )
+    {
+        uint8 byte = *rd.pos++;
+        val |= static_cast<uint64>( byte & 0x7F ) << shift;
+
+        if ( !(byte & 0x80) ) return true;
+    }
+
+    return false;
+}
+
+int32 stream_codec::encode_string( const char *str,size_t len )
+{
+    /* 短字符串是内化的，在字段列表中的字符串指针一定相同 */
+    map_t< const char *,int32 >::const_iterator itr = _field_id.find( str );
+    if ( itr != _field_id.end() )
+    {
+        int32 id = itr->second;
+        if ( !reserved( 11 ) ) return -1;
+
+        if ( id < 0x40 )
+        {
+            append_byte( static_cast<uint8>( ST_SMALL_FIELD | id ) );
+        }
+        else
+        {
+            append_byte( ST_FIELD );
+            append_varint( id );
+        }
+        return 0;
+    }
+
+    if ( !reserved( 11 + len ) ) return -1;
+
+    append_byte( ST_STRING );
+    append_varint( len );
+    memcpy( _buffer + _len,str,len );
+    _len += len;
+
+    return 0;
+}
+
+int32 stream_codec::encode_table( lua_State *L,int32 index,int32 depth )
+{
+    if ( depth >= STREAM_MAX_DEPTH )
+    {
+        ERROR( "stream encode table too deep,maybe loop reference" );
+        return -1;
+    }
+
+    if ( !lua_checkstack( L,3 ) || !reserved( 11 ) ) return -1;
+
+    // 先写数组部分，不需要写key
+    size_t array_len = lua_rawlen( L,index );
+    append_byte( ST_TABLE );
+    append_varint( array_len );
+
+    for ( size_t idx = 1;idx <= array_len;idx ++ )
+    {
+        lua_rawgeti( L,index,idx );
+        if ( encode_value( L,lua_gettop( L ),depth + 1 ) < 0 ) return -1;
+        lua_pop( L,1 );
+    }
+
+    lua_pushnil( L );
+    while ( lua_next( L,index ) )
+    {
+        // 数组部分已经写入了
+        if ( lua_isinteger( L,-2 ) )
+        {
+            lua_Integer key = lua_tointeger( L,-2 );
+            if ( key >= 1 && key <= static_cast<lua_Integer>( array_len ) )
+            {
+                lua_pop( L,1 );
+                continue;
+            }
+        }
+
+        int32 top = lua_gettop( L );
+        if ( encode_value( L,top - 1,depth + 1 ) < 0
+            || encode_value( L,top,depth + 1 ) < 0 )
+        {
+            return -1;
+        }
+        lua_pop( L,1 );
+    }
+
+    if ( !reserved( 1 ) ) return -1;
+    append_byte( ST_END );
+
+    return 0;
+}
+
+int32 stream_codec::encode_value( lua_State *L,int32 index,int32 depth )
+{
+    switch ( lua_type( L,index ) )
+    {
+    case LUA_TNIL :
+        if ( !reserved( 1 ) ) return -1;
+        append_byte( ST_NIL );
+        break;
+    case LUA_TBOOLEAN :
+        if ( !reserved( 1 ) ) return -1;
+        append_byte( lua_toboolean( L,index ) ? ST_TRUE : ST_FALSE );
+        break;
+    case LUA_TNUMBER :
+        if ( !reserved( 11 ) ) return -1;
+        if ( lua_isinteger( L,index ) )
+        {
+            int64 val = lua_tointeger( L,index );
+            if ( val >= 0 && val < 0x80 )
+            {
+                append_byte( static_cast<uint8>( ST_SMALL_INT | val ) );
+            }
+            else
+            {
+                // zigzag，绝对值小的负数也只占几个字节
+                append_byte( ST_INT );
+                append_varint( (static_cast<uint64>( val ) << 1) ^
+                    static_cast<uint64>( val >> 63 ) );
+            }
+        }
+        else
+        {
+            double val = lua_tonumber( L,index );
+            append_byte( ST_DOUBLE );
+            memcpy( _buffer + _len,&val,sizeof(val) );
+            _len += sizeof(val);
+        }
+        break;
+    case LUA_TSTRING :
+    {
+        size_t len = 0;
+        const char *str = lua_tolstring( L,index,&len );
+        return encode_string( str,len );
+    }
+    case LUA_TTABLE :
+        return encode_table( L,index,depth );
+    default :
+        ERROR( "stream encode unsupport type:%s",luaL_typename( L,index ) );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* 编码数据包，index到栈顶的所有值依次编码
+ * return: <0 error,otherwise the length of buffer
+ */
+int32 stream_codec::encode(
+    lua_State *L,int32 index,const char **buffer,const cmd_cfg_t *cfg )
+{
+    UNUSED( cfg );
+
+    _len = 0;
+    int32 top = lua_gettop( L );
+    for ( int32 idx = index;idx <= top;idx ++ )
+    {
+        if ( encode_value( L,idx,0 ) < 0 )
+        {
+            lua_settop( L,top );
+            return -1;
+        }
+    }
+
+    *buffer = _buffer;
+    return static_cast<int32>( _len );
+}
+
+int32 stream_codec::decode_table( lua_State *L,struct reader &rd,int32 depth )
+{
+    if ( depth >= STREAM_MAX_DEPTH ) return -1;
+
+    uint64 array_len = 0;
+    if ( !read_varint( rd,array_len ) ) return -1;
+
+    // 每个元素至少一个字节，防止错误的数据分配过大的table
+    if ( array_len > static_cast<uint64>( rd.end - rd.pos ) ) return -1;
+    if ( !lua_checkstack( L,3 ) ) return -1;
+
+    lua_createtable( L,static_cast<int32>( array_len ),0 );
+    int32 tbl = lua_gettop( L );
+
+    for ( uint64 idx = 1;idx <= array_len;idx ++ )
+    {
+        if ( decode_value( L,rd,depth + 1 ) < 0 ) return -1;
+        lua_rawseti( L,tbl,static_cast<lua_Integer>( idx ) );
+    }
+
+    while ( true )
+    {
+        if ( rd.pos >= rd.end ) return -1;
+        if ( ST_END == *rd.pos )
+        {
+            rd.pos ++;
+            break;
+        }
+
+        if ( decode_value( L,rd,depth + 1 ) < 0
+            || decode_value( L,rd,depth + 1 ) < 0 )
+        {
+            return -1;
+        }
+
+        // nil、NaN不能作为key，lua_rawset会抛异常
+        if ( lua_isnil( L,-2 ) ) return -1;
+        if ( lua_type( L,-2 ) == LUA_TNUMBER && !lua_isinteger( L,-2 ) )
+        {
+            lua_Number key = lua_tonumber( L,-2 );
+            if ( key != key ) return -1;
+        }
+        lua_rawset( L,tbl );
+    }
+
+    return 0;
+}
+
+int32 stream_codec::decode_value( lua_State *L,struct reader &rd,int32 depth )
+{
+    if ( rd.pos >= rd.end ) return -1;
+
+    uint8 tag = *rd.pos++;
+    if ( tag & ST_SMALL_INT )
+    {
+        lua_pushinteger( L,tag & 0x7F );
+        return 0;
+    }
+    if ( tag & ST_SMALL_FIELD )
+    {
+        size_t id = tag & 0x3F;
+        if ( id >= static_cast<size_t>( _field_cnt ) ) return -1;
+
+        lua_rawgeti( L,_field_tbl,static_cast<lua_Integer>( id + 1 ) );
+        return 0;
+    }
+
+    uint64 val = 0;
+    switch ( tag )
+    {
+    case ST_NIL   : lua_pushnil( L );break;
+    case ST_FALSE : lua_pushboolean( L,0 );break;
+    case ST_TRUE  : lua_pushboolean( L,1 );break;
+    case ST_INT   :
+        if ( !read_varint( rd,val ) ) return -1;
+        lua_pushinteger( L,
+            static_cast<int64>( val >> 1 ) ^ -static_cast<int64>( val & 1 ) );
+        break;
+    case ST_DOUBLE :
+    {
+        double dval = 0;
+        if ( rd.end - rd.pos < static_cast<int32>( sizeof(dval) ) ) return -1;
+
+        memcpy( &dval,rd.pos,sizeof(dval) );
+        rd.pos += sizeof(dval);
+        lua_pushnumber( L,dval );
+        break;
+    }
+    case ST_STRING :
+        if ( !read_varint( rd,val ) ) return -1;
+        if ( val > static_cast<uint64>( rd.end - rd.pos ) ) return -1;
+
+        lua_pushlstring( L,reinterpret_cast<const char *>( rd.pos ),val );
+        rd.pos += val;
+        break;
+    case ST_TABLE :
+        return decode_table( L,rd,depth );
+    case ST_FIELD :
+        if ( !read_varint( rd,val ) ) return -1;
+        if ( val >= static_cast<uint64>( _field_cnt ) ) return -1;
+
+        lua_rawgeti( L,_field_tbl,static_cast<lua_Integer>( val + 1 ) );
+        break;
+    default : return -1;
+    }
+
+    return 0;
+}
+
+/* 解码数据包
+ * return: <0 error,otherwise the number of parameter push to stack
+ */
+int32 stream_codec::decode(
+    lua_State *L,const char *buffer,int32 len,const cmd_cfg_t *cfg )
+{
+    UNUSED( cfg );
+
+    struct reader rd;
+    rd.pos = reinterpret_cast<const uint8 *>( buffer );
+    rd.end = rd.pos + len;
+
+    int32 cnt = 0;
+    int32 top = lua_gettop( L );
+    if ( !lua_checkstack( L,1 ) ) return -1;
+
+    // 字段名直接从引用的table中取，不需要重新内化。table放在结果下面，解码完移除
+    lua_rawgeti( L,LUA_REGISTRYINDEX,_field_ref );
+    _field_tbl = top + 1;
+    while ( rd.pos < rd.end )
+    {
+        if ( !lua_checkstack( L,1 ) || decode_value( L,rd,0 ) < 0 )
+        {
+            lua_settop( L,top );
+            ERROR( "invalid stream buffer" );
+            return -1;
+        }
+        cnt ++;
+    }
+    lua_remove( L,top + 1 );
+
+    return cnt;
+}
@@ -0,0 +1,65 @@
+#ifndef __STREAM_CODEC_H__
+#define __STREAM_CODEC_H__
+
+#include "codec.h"
+
+/* 自定义二进制流，用于服务器之间通信及rpc
+ * 1. 直接把lua的值(nil、boolean、number、string、table)按类型写入，不需要描述文件
+ * 2. 整数用zigzag + varint，0~127的非负整数只占一个字节
+ * 3. schema为一个字段名列表文件，每行一个，按顺序从0开始为字段id。在列表中的字符串
+ *    (通常是table的key)只写入字段id，不在列表中的照常写入字符串。通信双方必须加载同一个
+ *    文件，文件只能在末尾追加
+ * 4. lua的短字符串是内化的，内容相同的字符串指针相同。加载时把字段名字符串引用住，编码
+ *    时直接用字符串指针查找字段id，不需要计算hash、比较字符串
+ * 5. 编码的缓冲区复用，只在不够时扩大，编码、解码过程中不分配内存(lua对象除外)
+ */
+class stream_codec : public codec
+{
+public:
+    stream_codec();
+    ~stream_codec();
+
+    // 缓冲区复用，不需要释放
+    void finalize() {}
+    int32 load_path( const char *path );
+
+    /* 解码数据包
+     * return: <0 error,otherwise the number of parameter push to stack
+     */
+    int32 decode(
+         lua_State *L,const char *buffer,int32 len,const cmd_cfg_t *cfg );
+    /* 编码数据包，index到栈顶的所有值依次编码
+     * return: <0 error,otherwise the length of buffer
+     */
+    int32 encode(
+        lua_State *L,int32 index,const char **buffer,const cmd_cfg_t *cfg );
+private:
+    struct reader
+    {
+        const uint8 *pos;
+        const uint8 *end;
+    };
+private:
+    bool reserved( size_t bytes );
+    void append_byte( uint8 val ) { _buffer[_len++] = static_cast<char>(val); }
+    void append_varint( uint64 val );
+
+    int32 encode_value( lua_State *L,int32 index,int32 depth );
+    int32 encode_table( lua_State *L,int32 index,int32 depth );
+    int32 encode_string( const char *str,size_t len );
+
+    int32 decode_value( lua_State *L,struct reader &rd,int32 depth );
+    int32 decode_table( lua_State *L,struct reader &rd,int32 depth );
+    static bool read_varint( struct reader &rd,uint64 &val );
+private:
+    char *_buffer;
+    size_t _size; // 缓冲区大小
+    size_t _len;  // 已编码的长度
+
+    int32 _field_ref; // 字段名在registry中的引用，防止被gc后指针失效
+    int32 _field_tbl; // 解码时字段名table在栈上的位置
+    int32 _field_cnt;
+    map_t< const char *,int32 > _field_id;
+};
+
+#endif /* __STREAM_CODEC_H__ */
@@ -0,0 +1,609 @@
+#include "upb_codec.h"
+#include "../net_include.h"
+#include "../../system/static_global.h"
+
+#include <lua.hpp>
+#include <upb/mem/arena.h>
+#include <upb/reflection/def.h>
+#include <upb/reflection/message.h>
+#include <upb/wire/decode.h>
+#include <upb/wire/encode.h>
+#include <google/protobuf/descriptor.upb.h>
+
+/* linux open dir */
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <vector>
+#include <fstream>
+
+#define PB_ARENA_BLOCK 65536 // arena首个内存块大小，一般的数据包都不会超过
+#define PB_MAX_DEPTH   32    // 消息最大嵌套层数
+
+typedef const google_protobuf_FileDescriptorProto *file_proto_t;
+
+/* check if suffix match */
+static int is_suffix_file( const char *path,const char *suffix )
+{
+    /* simply check,not consider file like ./subdir/.bfbs */
+    size_t sz = strlen( suffix );
+    size_t ps = strlen( path );
+
+    /* file like .pb will be ignore */
+    if ( ps <= sz + 2 ) return 0;
+
+    if ( '.' == path[ps-sz-1] && 0 == strcmp( path + ps - sz,suffix ) )
+    {
+        return true;
+    }
+
+    return false;
+}
+
+/* 读取一个.pb文件(FileDescriptorSet)，解析出其中的文件描述 */
+static int32 read_file( const char *path,
+    upb_Arena *arena,std::vector<file_proto_t> &files )
+{
+    std::ifstream ifs( path,std::ifstream::binary|std::ifstream::in );
+    if ( !ifs.good() )
+    {
+        ERROR( "can NOT open file(%s):%s",path,strerror(errno) );
+        return -1;
+    }
+
+    std::string content( (std::istreambuf_iterator<char>( ifs )),
+        std::istreambuf_iterator<char>() );
+    ifs.close();
+
+    // 解析时字符串会拷贝到arena中，content可以直接释放
+    const google_protobuf_FileDescriptorSet *set =
+        google_protobuf_FileDescriptorSet_parse(
+            content.c_str(),content.size(),arena );
+    if ( !set )
+    {
+        ERROR( "upb parse descriptor error:%s",path );
+        return -1;
+    }
+
+    size_t count = 0;
+    file_proto_t const *file =
+        google_protobuf_FileDescriptorSet_file( set,&count );
+    for ( size_t idx = 0;idx < count;idx ++ ) files.push_back( file[idx] );
+
+    return 0;
+}
+
+/* 检查一个文件描述依赖的文件是否都已加载 */
+static bool is_dependency_loaded( const upb_DefPool *pool,file_proto_t file )
+{
+    size_t count = 0;
+    const upb_StringView *dep =
+        google_protobuf_FileDescriptorProto_dependency( file,&count );
+    for ( size_t idx = 0;idx < count;idx ++ )
+    {
+        if ( !upb_DefPool_FindFileByNameWithSize(
+            pool,dep[idx].data,dep[idx].size ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int32 encode_message( lua_State *L,upb_Message *msg,
+    const upb_MessageDef *msg_def,int32 index,upb_Arena *arena,int32 depth );
+
+/* 把lua的值转换为upb的值，字符串直接引用lua的内存，编码完成前不会被gc */
+static int32 to_value( lua_State *L,const upb_FieldDef *field,int32 index,
+    upb_Arena *arena,int32 depth,upb_MessageValue &val )
+{
+#define LUAL_CHECK( TYPE )    \
+    if ( !lua_is##TYPE( L,index ) ){    \
+        ERROR( "upb encode field(%s) expect "#TYPE",got %s",    \
+            upb_FieldDef_Name( field ),luaL_typename( L,index ) );    \
+        return -1;    \
+    }
+
+    switch ( upb_FieldDef_CType( field ) )
+    {
+    case kUpb_CType_Bool :
+        val.bool_val = lua_toboolean( L,index );
+        break;
+    case kUpb_CType_Float :
+        LUAL_CHECK( number )
+        val.float_val = static_cast<float>( lua_tonumber( L,index ) );
+        break;
+    case kUpb_CType_Double :
+        LUAL_CHECK( number )
+        val.double_val = lua_tonumber( L,index );
+        break;
+    case kUpb_CType_Int32 : case kUpb_CType_Enum :
+        LUAL_CHECK( integer )
+        val.int32_val = static_cast<int32>( lua_tointeger( L,index ) );
+        break;
+    case kUpb_CType_UInt32 :
+        LUAL_CHECK( integer )
+        val.uint32_val = static_cast<uint32>( lua_tointeger( L,index ) );
+        break;
+    case kUpb_CType_Int64 :
+        LUAL_CHECK( integer )
+        val.int64_val = static_cast<int64>( lua_tointeger( L,index ) );
+        break;
+    case kUpb_CType_UInt64 :
+        LUAL_CHECK( integer )
+        val.uint64_val = static_cast<uint64>( lua_tointeger( L,index ) );
+        break;
+    case kUpb_CType_String : case kUpb_CType_Bytes :
+    {
+        LUAL_CHECK( string )
+        size_t len = 0;
+        const char *str = lua_tolstring( L,index,&len );
+        val.str_val = upb_StringView_FromDataAndSize( str,len );
+    }break;
+    case kUpb_CType_Message :
+    {
+        const upb_MessageDef *sub_def = upb_FieldDef_MessageSubDef( field );
+        upb_Message *sub_msg =
+            upb_Message_New( upb_MessageDef_MiniTable( sub_def ),arena );
+        if ( !sub_msg
+            || encode_message( L,sub_msg,sub_def,index,arena,depth + 1 ) < 0 )
+        {
+            return -1;
+        }
+        val.msg_val = sub_msg;
+    }break;
+    default :
+        ERROR( "upb encode unknow type:%s",upb_FieldDef_Name( field ) );
+        return -1;
+    }
+
+    return 0;
+
+#undef LUAL_CHECK
+}
+
+static int32 encode_message( lua_State *L,upb_Message *msg,
+    const upb_MessageDef *msg_def,int32 index,upb_Arena *arena,int32 depth )
+{
+    if ( !lua_istable( L,index ) )
+    {
+        ERROR( "upb encode expect a table" );
+        return -1;
+    }
+
+    if ( depth >= PB_MAX_DEPTH || !lua_checkstack( L,3 ) )
+    {
+        ERROR( "upb encode too deep" );
+        return -1;
+    }
+
+    int32 top = lua_gettop( L );
+    int32 field_cnt = upb_MessageDef_FieldCount( msg_def );
+    for ( int32 field_idx = 0;field_idx < field_cnt;field_idx ++ )
+    {
+        const upb_FieldDef *field = upb_MessageDef_Field( msg_def,field_idx );
+
+        lua_pushstring( L,upb_FieldDef_Name( field ) );
+        if ( LUA_TNIL == lua_rawget( L,index ) )
+        {
+            lua_pop( L,1 );
+            continue;
+        }
+
+        upb_MessageValue val;
+        if ( upb_FieldDef_IsMap( field ) )
+        {
+            ERROR( "upb encode map field not support:%s",
+                upb_FieldDef_Name( field ) );
+            return -1;
+        }
+        else if ( upb_FieldDef_IsRepeated( field ) )
+        {
+            if ( !lua_istable( L,top + 1 ) )
+            {
+                ERROR( "field(%s) expect a table",upb_FieldDef_Name( field ) );
+                return -1;
+            }
+
+            upb_Array *array = upb_Message_Mutable( msg,field,arena ).array;
+            size_t len = lua_rawlen( L,top + 1 );
+            for ( size_t idx = 1;idx <= len;idx ++ )
+            {
+                lua_rawgeti( L,top + 1,idx );
+                if ( to_value( L,field,top + 2,arena,depth,val ) < 0
+                    || !upb_Array_Append( array,val,arena ) )
+                {
+                    return -1;
+                }
+                lua_pop( L,1 );
+            }
+        }
+        else if ( upb_FieldDef_IsSubMessage( field ) )
+        {
+            upb_Message *sub_msg = upb_Message_Mutable( msg,field,arena ).msg;
+            if ( encode_message( L,sub_msg,upb_FieldDef_MessageSubDef( field ),
+                top + 1,arena,depth + 1 ) < 0 )
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            if ( to_value( L,field,top + 1,arena,depth,val ) < 0
+                || !upb_Message_SetFieldByDef( msg,field,val,arena ) )
+            {
+                return -1;
+            }
+        }
+
+        lua_pop( L,1 );
+    }
+
+    return 0;
+}
+
+/* 把标量字段的值push到lua，子消息由decode_message处理 */
+static int32 push_value(
+    lua_State *L,const upb_FieldDef *field,upb_MessageValue val )
+{
+    switch ( upb_FieldDef_CType( field ) )
+    {
+    case kUpb_CType_Bool   : lua_pushboolean( L,val.bool_val );break;
+    case kUpb_CType_Float  : lua_pushnumber( L,val.float_val );break;
+    case kUpb_CType_Double : lua_pushnumber( L,val.double_val );break;
+    case kUpb_CType_Int32  :
+    case kUpb_CType_Enum   : lua_pushinteger( L,val.int32_val );break;
+    case kUpb_CType_UInt32 : lua_pushinteger( L,val.uint32_val );break;
+    case kUpb_CType_Int64  : lua_pushinteger( L,val.int64_val );break;
+    case kUpb_CType_UInt64 :
+        lua_pushinteger( L,static_cast<int64>( val.uint64_val ) );break;
+    case kUpb_CType_String :
+    case kUpb_CType_Bytes  :
+        lua_pushlstring( L,val.str_val.data,val.str_val.size );break;
+    default :
+        ERROR( "upb decode unknow type:%s",upb_FieldDef_Name( field ) );
+        return -1;
+    }
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+upb_codec::upb_codec()
+{
+    _block = new char[PB_ARENA_BLOCK];
+    _arena = NULL;
+    _pool = NULL;
+
+    _key_cnt = 0;
+    _key_ref = LUA_NOREF;
+}
+
+upb_codec::~upb_codec()
+{
+    finalize();
+
+    if ( _pool ) upb_DefPool_Free( _pool );
+    _pool = NULL;
+
+    delete []_block;
+    _block = NULL;
+
+    /* codec_mgr在lstate之后定义，先于lua_close析构 */
+    luaL_unref( static_global::state(),LUA_REGISTRYINDEX,_key_ref );
+    _key_ref = LUA_NOREF;
+}
+
+/* 编码后的数据在arena中，发送完才能释放 */
+void upb_codec::finalize()
+{
+    if ( _arena ) upb_Arena_Free( _arena );
+    _arena = NULL;
+}
+
+/* 用预分配的内存块创建arena，不够时upb会再从全局分配 */
+upb_Arena *upb_codec::new_arena()
+{
+    assert( "upb arena not clear",NULL == _arena );
+
+    _arena = upb_Arena_Init( _block,PB_ARENA_BLOCK,&upb_alloc_global );
+    return _arena;
+}
+
+/* 获取消息字段名在缓存table中的起始位置，第idx个字段名的位置为base + idx + 1
+ * 每种消息只在第一次解码时把所有字段名放到缓存table中
+ */
+int32 upb_codec::get_key_base(
+    lua_State *L,const upb_MessageDef *msg_def,int32 key_tbl )
+{
+    map_t< const upb_MessageDef *,int32 >::const_iterator itr =
+        _key_base.find( msg_def );
+    if ( expect_true( itr != _key_base.end() ) ) return itr->second;
+
+    int32 base = _key_cnt;
+    int32 field_cnt = upb_MessageDef_FieldCount( msg_def );
+    for ( int32 field_idx = 0;field_idx < field_cnt;field_idx ++ )
+    {
+        const upb_FieldDef *field = upb_MessageDef_Field( msg_def,field_idx );
+
+        lua_pushstring( L,upb_FieldDef_Name( field ) );
+        lua_rawseti( L,key_tbl,++ _key_cnt );
+    }
+
+    _key_base[msg_def] = base;
+    return base;
+}
+
+/* 和pbc一致，标量字段没有值时也解析出默认值，未设置的子消息则忽略 */
+int32 upb_codec::decode_message( lua_State *L,const upb_Message *msg,
+    const upb_MessageDef *msg_def,int32 key_tbl,int32 depth )
+{
+    if ( depth >= PB_MAX_DEPTH || !lua_checkstack( L,4 ) )
+    {
+        ERROR( "upb decode too deep" );
+        return -1;
+    }
+
+    int32 base = get_key_base( L,msg_def,key_tbl );
+    int32 field_cnt = upb_MessageDef_FieldCount( msg_def );
+    lua_createtable( L,0,field_cnt );
+    int32 top = lua_gettop( L );
+
+    for ( int32 field_idx = 0;field_idx < field_cnt;field_idx ++ )
+    {
+        const upb_FieldDef *field = upb_MessageDef_Field( msg_def,field_idx );
+        if ( upb_FieldDef_IsMap( field ) )
+        {
+            ERROR( "upb decode map field not support:%s",
+                upb_FieldDef_Name( field ) );
+            return -1;
+        }
+
+        const upb_MessageDef *sub_def = upb_FieldDef_IsSubMessage( field )
+            ? upb_FieldDef_MessageSubDef( field ) : NULL;
+        if ( upb_FieldDef_IsRepeated( field ) )
+        {
+            const upb_Array *array =
+                upb_Message_GetFieldByDef( msg,field ).array_val;
+            size_t size = array ? upb_Array_Size( array ) : 0;
+
+            lua_rawgeti( L,key_tbl,base + field_idx + 1 );
+            lua_createtable( L,static_cast<int32>( size ),0 );
+            for ( size_t idx = 0;idx < size;idx ++ )
+            {
+                upb_MessageValue val = upb_Array_Get( array,idx );
+                int32 ecode = sub_def
+                    ? decode_message( L,val.msg_val,sub_def,key_tbl,depth + 1 )
+                    : push_value( L,field,val );
+                if ( ecode < 0 ) return -1;
+
+                lua_rawseti( L,top + 2,idx + 1 );
+            }
+        }
+        else if ( sub_def )
+        {
+            if ( !upb_Message_HasFieldByDef( msg,field ) ) continue;
+
+            lua_rawgeti( L,key_tbl,base + field_idx + 1 );
+            const upb_Message *sub_msg =
+                upb_Message_GetFieldByDef( msg,field ).msg_val;
+            if ( decode_message( L,sub_msg,sub_def,key_tbl,depth + 1 ) < 0 )
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            lua_rawgeti( L,key_tbl,base + field_idx + 1 );
+            if ( push_value(
+                L,field,upb_Message_GetFieldByDef( msg,field ) ) < 0 )
+            {
+                return -1;
+            }
+        }
+        lua_rawset( L,top );
+    }
+
+    return 0;
+}
+
+int32 upb_codec::load_path( const char *path )
+{
+    char file_path[PATH_MAX];
+    int sz = snprintf( file_path,PATH_MAX,"%s/",path );
+    if ( sz <= 0 )
+    {
+        ERROR( "path too long:%s",path );
+
+        return -1;
+    }
+
+    DIR *dir = opendir( path );
+    if ( !dir )
+    {
+        ERROR( "can not open directory(%s):%s",path,strerror(errno) );
+
+        return -1;
+    }
+
+    // 描述文件只在加载时用，加载完就释放
+    upb_Arena *arena = upb_Arena_New();
+    std::vector<file_proto_t> files;
+
+    int32 count = 0;
+    struct dirent *dt = NULL;
+    while ( (dt = readdir( dir )) )
+    {
+        snprintf( file_path + sz,PATH_MAX - sz,"%s",dt->d_name );
+
+        struct stat path_stat;
+        stat( file_path, &path_stat );
+
+        if ( S_ISREG( path_stat.st_mode )
+            && is_suffix_file( dt->d_name,"pb" ) )
+        {
+            if ( read_file( file_path,arena,files ) < 0 )
+            {
+                closedir( dir );
+                upb_Arena_Free( arena );
+                return -1;
+            }
+            ++ count;
+        }
+    }
+    closedir( dir );
+
+    // upb没有unregister之类的函数，重新加载时整个DefPool重建
+    finalize();
+    if ( _pool ) upb_DefPool_Free( _pool );
+    _pool = upb_DefPool_New();
+
+    // 字段名缓存是按消息描述的指针索引的，DefPool重建后需要清空
+    lua_State *L = static_global::state();
+    luaL_unref( L,LUA_REGISTRYINDEX,_key_ref );
+    lua_newtable( L );
+    _key_ref = luaL_ref( L,LUA_REGISTRYINDEX );
+    _key_cnt = 0;
+    _key_base.clear();
+
+    /* 目录是无序的，而一个文件要在它import的文件之后加载。protoc -o默认不包含
+     * import的文件，因此每一轮只加载依赖已满足的，直到没有可加载的为止
+     */
+    size_t last = 0;
+    size_t loaded = 0;
+    std::vector<bool> done( files.size(),false );
+    do
+    {
+        last = loaded;
+        for ( size_t idx = 0;idx < files.size();idx ++ )
+        {
+            if ( done[idx] || !is_dependency_loaded( _pool,files[idx] ) )
+            {
+                continue;
+            }
+
+            done[idx] = true;
+            loaded ++;
+
+            // protoc --include_imports 时，同一个文件可能出现多次
+            upb_StringView name =
+                google_protobuf_FileDescriptorProto_name( files[idx] );
+            if ( upb_DefPool_FindFileByNameWithSize(
+                _pool,name.data,name.size ) )
+            {
+                continue;
+            }
+
+            upb_Status status;
+            upb_Status_Clear( &status );
+            if ( !upb_DefPool_AddFile( _pool,files[idx],&status ) )
+            {
+                ERROR( "upb add file(%.*s) error:%s",static_cast<int32>(
+                    name.size ),name.data,upb_Status_ErrorMessage( &status ) );
+                upb_Arena_Free( arena );
+                return -1;
+            }
+        }
+    } while ( last != loaded );
+    upb_Arena_Free( arena );
+
+    if ( loaded != files.size() )
+    {
+        ERROR( "upb load path(%s) error:missing dependency",path );
+        return -1;
+    }
+
+    return count;
+}
+
+/* 解码数据包
+ * return: <0 error,otherwise the number of parameter push to stack
+ */
+int32 upb_codec::decode(
+    lua_State *L,const char *buffer,int32 len,const cmd_cfg_t *cfg )
+{
+    const upb_MessageDef *msg_def = _pool
+        ? upb_DefPool_FindMessageByName( _pool,cfg->_object ) : NULL;
+    if ( !msg_def )
+    {
+        ERROR( "no such protobuf message(%s)",cfg->_object );
+        return -1;
+    }
+
+    upb_Arena *arena = new_arena();
+    const upb_MiniTable *layout = upb_MessageDef_MiniTable( msg_def );
+
+    upb_Message *msg = upb_Message_New( layout,arena );
+    if ( !msg || kUpb_DecodeStatus_Ok != upb_Decode( buffer,len,msg,layout,
+        upb_DefPool_ExtensionRegistry( _pool ),0,arena ) )
+    {
+        finalize();
+        ERROR( "upb decode %s error",cfg->_object );
+        return -1;
+    }
+
+    int32 top = lua_gettop( L );
+    if ( !lua_checkstack( L,1 ) )
+    {
+        finalize();
+        ERROR( "upb decode stack overflow" );
+        return -1;
+    }
+
+    // 字段名缓存table放在结果下面，解码完移除
+    lua_rawgeti( L,LUA_REGISTRYINDEX,_key_ref );
+    int32 ecode = decode_message( L,msg,msg_def,top + 1,0 );
+    finalize();
+
+    if ( ecode < 0 )
+    {
+        lua_settop( L,top );
+        return -1;
+    }
+    lua_remove( L,top + 1 );
+
+    // 默认情况下，所有内容解析到一个table
+    return 1;
+}
+
+/* 编码数据包
+ * return: <0 error,otherwise the length of buffer
+ */
+int32 upb_codec::encode(
+    lua_State *L,int32 index,const char **buffer,const cmd_cfg_t *cfg )
+{
+    const upb_MessageDef *msg_def = _pool
+        ? upb_DefPool_FindMessageByName( _pool,cfg->_object ) : NULL;
+    if ( !msg_def )
+    {
+        ERROR( "no such protobuf message(%s)",cfg->_object );
+        return -1;
+    }
+
+    upb_Arena *arena = new_arena();
+    const upb_MiniTable *layout = upb_MessageDef_MiniTable( msg_def );
+
+    int32 top = lua_gettop( L );
+    upb_Message *msg = upb_Message_New( layout,arena );
+    if ( !msg || encode_message( L,msg,msg_def,index,arena,0 ) < 0 )
+    {
+        lua_settop( L,top );
+        finalize();
+        ERROR( "upb encode %s error",cfg->_object );
+        return -1;
+    }
+
+    char *data = NULL;
+    size_t size = 0;
+    if ( kUpb_EncodeStatus_Ok != upb_Encode( msg,layout,0,arena,&data,&size ) )
+    {
+        finalize();
+        ERROR( "upb encode %s error",cfg->_object );
+        return -1;
+    }
+
+    *buffer = data;
+    return static_cast<int32>( size );
+}
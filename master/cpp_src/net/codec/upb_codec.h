@@ -0,0 +1,59 @@
+#ifndef __UPB_CODEC_H__
+#define __UPB_CODEC_H__
+
+#include "codec.h"
+
+/* 基于upb的protobuf编码，加载的仍是master/pb下protoc -o生成的.pb文件
+ * 1. pbc只能遍历lua table，再按字段名逐个查找描述。这里反过来按描述遍历字段，
+ *    字段名是描述里的固定指针，lua_pushstring有按指针的字符串缓存，不用每次都计算hash
+ * 2. 编码、解码用upb的table-driven序列化，内存从arena分配，arena首个内存块预分配并
+ *    复用，一般的数据包不需要再分配内存
+ * 3. 解码时字段名从预先内化的缓存中取，table按字段数量预分配
+ * 4. repeated字段只处理table的数组部分，map字段暂不支持
+ */
+
+struct upb_Arena;
+struct upb_DefPool;
+struct upb_Message;
+struct upb_MessageDef;
+
+class upb_codec : public codec
+{
+public:
+    upb_codec();
+    ~upb_codec();
+
+    void finalize();
+    int32 load_path( const char *path );
+
+    /* 解码数据包
+     * return: <0 error,otherwise the number of parameter push to stack
+     */
+    int32 decode(
+         lua_State *L,const char *buffer,int32 len,const cmd_cfg_t *cfg );
+    /* 编码数据包
+     * return: <0 error,otherwise the length of buffer
+     */
+    int32 encode(
+        lua_State *L,int32 index,const char **buffer,const cmd_cfg_t *cfg );
+private:
+    struct upb_Arena *new_arena();
+
+    int32 get_key_base(
+        lua_State *L,const struct upb_MessageDef *msg_def,int32 key_tbl );
+    int32 decode_message( lua_State *L,const struct upb_Message *msg,
+        const struct upb_MessageDef *msg_def,int32 key_tbl,int32 depth );
+private:
+    char *_block; // arena的首个内存块
+    struct upb_Arena *_arena;
+    struct upb_DefPool *_pool;
+
+    /* 字段名缓存。每种消息的字段名按顺序放到registry中的一个table，解码时按下标
+     * 直接取，不需要每个数据包都重新计算hash、内化字段名
+     */
+    int32 _key_ref;
+    int32 _key_cnt;
+    map_t< const struct upb_MessageDef *,int32 > _key_base;
+};
+
+#endif /* __UPB_CODEC_H__ */
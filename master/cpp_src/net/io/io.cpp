@@ -31,10 +31,10 @@ int32 io::recv()
 
     if ( 0 == len ) return -1; // 对方主动断开
 
-    /* error happen */
+    /* error happen，多线程io时在io线程中运行，日志用ERROR_R */
     if ( errno != EAGAIN && errno != EWOULDBLOCK )
     {
-        ERROR( "io send:%s",strerror(errno) );
+        ERROR_R( "io recv:%s",strerror(errno) );
         return -1;
     }
 
@@ -49,7 +49,18 @@ int32 io::send()
     size_t bytes = _send->data_size();
     assert( "io send without data",bytes > 0 );
 
-    int32 len = ::write( _fd,_send->data_pointer(),bytes );
+    int32 len = 0;
+    if ( _send->is_segment() )
+    {
+        /* 分段缓冲区，多个segment一次发送 */
+        struct iovec iov[BUFFER_MAX_IOV];
+        int32 cnt = _send->data_vector( iov,BUFFER_MAX_IOV );
+        len = ::writev( _fd,iov,cnt );
+    }
+    else
+    {
+        len = ::write( _fd,_send->data_pointer(),bytes );
+    }
 
     if ( expect_true(len > 0) )
     {
@@ -62,7 +73,7 @@ int32 io::send()
     /* error happen */
     if ( errno != EAGAIN && errno != EWOULDBLOCK )
     {
-        ERROR( "io send:%s",strerror(errno) );
+        ERROR_R( "io send:%s",strerror(errno) );
         return -1;
     }
 
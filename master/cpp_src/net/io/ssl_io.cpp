@@ -9,13 +9,16 @@
 
 // SSL的错误码是按队列存放的，一次错误可以产生多个错误码
 // 因此出错时，需要循环用ERR_get_error来清空错误码或者调用ERR_clear_error
+// 多线程io时ssl_io在io线程中运行，日志用ERROR_R，不读主线程事件循环的时间
 #define SSL_ERROR(x)    \
-    do{                                                     \
-        ERROR(x " errno(%d:%s)",errno,strerror(errno));     \
-        int32 eno = 0;                                      \
-        while ( 0 != (eno = ERR_get_error()) ) {            \
-            ERROR( "    %s",ERR_error_string(eno,NULL) );   \
-        }                                                   \
+    do{                                                      \
+        ERROR_R(x " errno(%d:%s)",errno,strerror(errno));    \
+        char ebuf[256];                                      \
+        unsigned long eno = 0;                               \
+        while ( 0 != (eno = ERR_get_error()) ) {             \
+            ERR_error_string_n( eno,ebuf,sizeof(ebuf) );     \
+            ERROR_R( "    %s",ebuf );                        \
+        }                                                    \
     }while(0)
 
 ssl_io::~ssl_io()
@@ -88,14 +91,20 @@ int32 ssl_io::send()
 
     if ( !_handshake ) return do_handshake();
 
-    size_t bytes = _send->data_size();
-    assert( "io send without data",bytes > 0 );
-    int32 len = SSL_write( X_SSL( _ssl_ctx ),_send->data_pointer(),bytes );
-    if ( expect_true(len > 0) )
+    assert( "io send without data",_send->data_size() > 0 );
+
+    /* SSL没有writev，分段缓冲区只能逐个segment发送 */
+    int32 len = 0;
+    do
     {
+        len = SSL_write( X_SSL( _ssl_ctx ),
+            _send->data_pointer(),_send->seg_data_size() );
+        if ( expect_false(len <= 0) ) break;
+
         _send->subtract( len );
-        return ((size_t)len) == bytes ? 0 : 2;
-    }
+    } while ( _send->data_size() > 0 );
+
+    if ( expect_true(len > 0) ) return 0;
 
     int32 ecode = SSL_get_error( X_SSL( _ssl_ctx ),len );
     if ( SSL_ERROR_WANT_WRITE == ecode ) return 2;
@@ -142,20 +151,20 @@ int32 ssl_io::init_ssl_ctx( int32 fd )
     void *base_ctx = ctx_mgr->get_ssl_ctx( _ctx_idx );
     if ( !base_ctx )
     {
-        ERROR( "ssl io init ssl ctx no base ctx found" );
+        ERROR_R( "ssl io init ssl ctx no base ctx found" );
         return -1;
     }
 
     _ssl_ctx = SSL_new( X_SSL_CTX( base_ctx ) );
     if ( !_ssl_ctx )
     {
-        ERROR( "ssl io init ssl SSL_new fail" );
+        ERROR_R( "ssl io init ssl SSL_new fail" );
         return -1;
     }
 
     if ( !SSL_set_fd( X_SSL( _ssl_ctx ),fd ) )
     {
-        ERROR( "ssl io init ssl SSL_set_fd fail" );
+        ERROR_R( "ssl io init ssl SSL_set_fd fail" );
         return -1;
     }
 
@@ -0,0 +1,674 @@
+#include <sys/eventfd.h>
+
+#include "io_reactor.h"
+
+#include "socket.h"
+#include "io/ssl_io.h"
+#include "header_include.h"
+#include "../ev/ev_def.h"
+#include "../thread/thread.h"
+#include "../system/static_global.h"
+
+/* io线程中的连接，只在io线程中创建、使用、销毁 */
+class io_reactor::conn
+{
+public:
+    conn( class io_reactor *reactor,uint32 conn_id,int32 packet_type )
+        : _w( reactor )
+    {
+        _io = NULL;
+        _closed = false;
+        _upgraded = false;
+        _conn_id = conn_id;
+        _reactor = reactor;
+        _packet_type = packet_type;
+    }
+
+    ~conn()
+    {
+        delete _io;
+        _io = NULL;
+    }
+
+    void io_cb( ev_io &w,int32 revents )
+    {
+        if ( revents & EV_READ ) _reactor->conn_recv( this );
+        if ( revents & EV_WRITE ) _reactor->conn_send( this );
+    }
+
+    uint32 frame_size( const char *data,uint32 size );
+    uint32 stream_frame_size( const char *data,uint32 size );
+    uint32 websocket_frame_size( const char *data,uint32 size );
+public:
+    ev_io _w;
+    class io *_io;
+    class buffer _recv;
+    class buffer _send;
+
+    bool _closed; /* 已出错并通知了主线程，等待主线程删除 */
+    bool _upgraded; /* websocket是否已收到http升级请求 */
+    uint32 _conn_id;
+    int32 _packet_type;
+    class io_reactor *_reactor;
+};
+
+/* 接收缓冲区前面完整的数据包大小，只有完整的数据包才交给主线程 */
+uint32 io_reactor::conn::frame_size( const char *data,uint32 size )
+{
+    switch ( _packet_type )
+    {
+        case packet::PKT_STREAM    : return stream_frame_size( data,size );
+        case packet::PKT_WEBSOCKET :
+        case packet::PKT_WSSTREAM  : return websocket_frame_size( data,size );
+        default : break;
+    }
+
+    /* http等其他协议由主线程自己处理不完整的数据 */
+    return size;
+}
+
+uint32 io_reactor::conn::stream_frame_size( const char *data,uint32 size )
+{
+    uint32 len = 0;
+    while ( size - len >= sizeof(struct base_header) )
+    {
+        const struct base_header *header =
+            reinterpret_cast<const struct base_header *>( data + len );
+
+        uint32 pkt_len = PACKET_LENGTH( header );
+        if ( size - len < pkt_len ) break;
+
+        len += pkt_len;
+    }
+
+    return len;
+}
+
+/* websocket先是一个http升级请求，之后才是websocket帧
+ * 帧头：2字节，payload长度为126时后面2字节为长度，127时后面8字节为长度，有mask时再加4字节
+ */
+uint32 io_reactor::conn::websocket_frame_size( const char *data,uint32 size )
+{
+    uint32 len = 0;
+    if ( expect_false(!_upgraded) )
+    {
+        const char *end = static_cast<const char *>(
+            memmem( data,size,"\r\n\r\n",4 ) );
+        if ( !end ) return 0;
+
+        _upgraded = true;
+        len = static_cast<uint32>( end - data ) + 4;
+    }
+
+    while ( size - len >= 2 )
+    {
+        const uint8 *frame = reinterpret_cast<const uint8 *>( data + len );
+
+        uint32 head_len = 2;
+        uint64 body_len = frame[1] & 0x7F;
+        if ( 126 == body_len )
+        {
+            head_len += 2;
+            if ( size - len < head_len ) break;
+
+            body_len = (uint64(frame[2]) << 8) | frame[3];
+        }
+        else if ( 127 == body_len )
+        {
+            head_len += 8;
+            if ( size - len < head_len ) break;
+
+            body_len = 0;
+            for ( int32 idx = 2;idx < 10;idx ++ )
+            {
+                body_len = (body_len << 8) | frame[idx];
+            }
+        }
+        if ( frame[1] & 0x80 ) head_len += 4; /* mask */
+
+        if ( size - len < head_len + body_len ) break;
+
+        len += head_len + static_cast<uint32>( body_len );
+    }
+
+    return len;
+}
+
+io_reactor::io_reactor( int32 index )
+    : _main_queue( REACTOR_QUEUE ),_reactor_queue( REACTOR_QUEUE )
+{
+    _id = 0;
+    _run = false;
+    _index = index;
+
+    _main_fd = -1;
+    _reactor_fd = -1;
+
+    _main_notify = false;
+    _reactor_notify = false;
+    _conn_count = 0;
+    _main_full = false;
+    _quit = false;
+
+    _main_watcher.set( static_global::ev() );
+    _reactor_watcher.set( this );
+}
+
+io_reactor::~io_reactor()
+{
+    assert( "io reactor still running",!_run );
+    assert( "io reactor eventfd not close",
+        -1 == _main_fd && -1 == _reactor_fd );
+}
+
+struct io_reactor::message *io_reactor::new_message(
+    int32 type,uint32 conn_id,uint32 size )
+{
+    char *mem = new char[sizeof(struct message) + size];
+
+    struct message *msg = reinterpret_cast<struct message *>( mem );
+    memset( msg,0,sizeof(struct message) );
+
+    msg->_type = type;
+    msg->_size = size;
+    msg->_conn_id = conn_id;
+
+    return msg;
+}
+
+void io_reactor::del_message( struct message *msg )
+{
+    /* 共享帧的引用计数是原子的，主线程、io线程都可以释放 */
+    if ( msg->_frame ) msg->_frame->release();
+
+    delete []reinterpret_cast<char *>( msg );
+}
+
+/* 写eventfd唤醒另一个线程，多次写入只会唤醒一次 */
+void io_reactor::wake( int32 fd )
+{
+    uint64 val = 1;
+    if ( ::write( fd,&val,sizeof(val) ) < 0 && EAGAIN != errno )
+    {
+        ERROR_R( "io reactor wake error:%s",strerror(errno) );
+    }
+}
+
+void io_reactor::drain( int32 fd )
+{
+    uint64 val = 0;
+    if ( ::read( fd,&val,sizeof(val) ) < 0 && EAGAIN != errno )
+    {
+        ERROR_R( "io reactor drain error:%s",strerror(errno) );
+    }
+}
+
+bool io_reactor::start()
+{
+    _main_fd = eventfd( 0,EFD_NONBLOCK | EFD_CLOEXEC );
+    _reactor_fd = eventfd( 0,EFD_NONBLOCK | EFD_CLOEXEC );
+    if ( _main_fd < 0 || _reactor_fd < 0 )
+    {
+        ERROR( "io reactor eventfd fail:%s",strerror(errno) );
+
+        if ( _main_fd >= 0 ) { ::close( _main_fd );_main_fd = -1; }
+        if ( _reactor_fd >= 0 ) { ::close( _reactor_fd );_reactor_fd = -1; }
+        return false;
+    }
+
+    /* io线程的watcher必须在线程创建前设置好，之后只能由io线程操作 */
+    _reactor_watcher.set<io_reactor,&io_reactor::reactor_io_cb>( this );
+    _reactor_watcher.start( _reactor_fd,EV_READ );
+
+    _run = true;
+    if ( pthread_create( &_id,NULL,io_reactor::start_routine,(void *)this ) )
+    {
+        _run = false;
+        _reactor_watcher.stop();
+        ::close( _main_fd );
+        ::close( _reactor_fd );
+        _main_fd = _reactor_fd = -1;
+
+        ERROR( "io reactor start,create fail:%s",strerror(errno) );
+        return false;
+    }
+
+    _main_watcher.set<io_reactor,&io_reactor::main_io_cb>( this );
+    _main_watcher.start( _main_fd,EV_READ );
+
+    return true;
+}
+
+void io_reactor::stop()
+{
+    if ( !_run )
+    {
+        ERROR( "io_reactor::stop:thread not running" );
+        return;
+    }
+
+    _run = false;
+    _quit = true; /* io线程的事件循环只能由io线程自己退出 */
+    wake( _reactor_fd );
+
+    int32 ecode = pthread_join( _id,NULL );
+    if ( ecode )
+    {
+        FATAL( "io reactor join fail:%s",strerror( ecode ) );
+        return;
+    }
+
+    /* io线程已退出，剩下的消息直接丢弃，还没交给io线程的连接在这里关闭 */
+    struct message *msg = NULL;
+    while ( _main_queue.pop( msg ) )
+    {
+        if ( MSG_ADD == msg->_type ) ::close( msg->_fd );
+        del_message( msg );
+    }
+    while ( _reactor_queue.pop( msg ) ) del_message( msg );
+
+    std::vector<struct message *>::iterator itr = _main_overflow.begin();
+    for ( ;itr != _main_overflow.end();itr ++ )
+    {
+        if ( MSG_ADD == (*itr)->_type ) ::close( (*itr)->_fd );
+        del_message( *itr );
+    }
+    _main_overflow.clear();
+
+    itr = _reactor_overflow.begin();
+    for ( ;itr != _reactor_overflow.end();itr ++ ) del_message( *itr );
+    _reactor_overflow.clear();
+
+    if ( _main_watcher.is_active() ) _main_watcher.stop();
+    if ( _reactor_watcher.is_active() ) _reactor_watcher.stop();
+
+    ::close( _main_fd );
+    ::close( _reactor_fd );
+    _main_fd = _reactor_fd = -1;
+}
+
+void *io_reactor::start_routine( void *arg )
+{
+    class io_reactor *reactor = static_cast<class io_reactor *>( arg );
+    assert( "io reactor start routine got NULL argument",reactor );
+
+    thread::signal_block();  /* 子线程不处理外部信号 */
+
+    reactor->routine();
+
+    return NULL;
+}
+
+void io_reactor::routine()
+{
+    /* 缓冲区的内存池不是线程安全的，io线程使用独立的内存池 */
+    class ordered_pool<BUFFER_CHUNK> *pool = new ordered_pool<BUFFER_CHUNK>();
+    buffer::set_thread_allocator( pool );
+
+    run();
+
+    /* 主线程已经不再处理网络，直接关闭所有连接 */
+    conn_map_t::iterator itr = _conn_map.begin();
+    for ( ;itr != _conn_map.end();itr ++ )
+    {
+        class conn *cn = itr->second;
+
+        cn->_w.stop();
+        ::close( cn->_w.fd );
+        delete cn;
+    }
+    _conn_map.clear();
+
+    buffer::set_thread_allocator( NULL );
+    delete pool;
+}
+
+/* io线程每一轮事件循环结束时调用 */
+void io_reactor::running( int64 ms_now )
+{
+    if ( expect_false(!_reactor_overflow.empty()) )
+    {
+        size_t idx = 0;
+        size_t size = _reactor_overflow.size();
+        for ( ;idx < size;idx ++ )
+        {
+            if ( !_reactor_queue.push( _reactor_overflow[idx] ) ) break;
+        }
+
+        if ( idx > 0 )
+        {
+            _reactor_notify = true;
+            _reactor_overflow.erase(
+                _reactor_overflow.begin(),_reactor_overflow.begin() + idx );
+        }
+    }
+
+    if ( _reactor_notify )
+    {
+        _reactor_notify = false;
+        wake( _main_fd );
+    }
+}
+
+/* 队列中的消息还没写完，尽快再写 */
+ev_tstamp io_reactor::wait_time()
+{
+    if ( expect_false(!_reactor_overflow.empty()) ) return EPOLL_MIN_TM;
+
+    return ev::wait_time();
+}
+
+/* 主线程发往io线程的消息 */
+void io_reactor::push_main( struct message *msg )
+{
+    if ( expect_true(_main_overflow.empty()) && _main_queue.push( msg ) )
+    {
+        _main_notify = true;
+        return;
+    }
+
+    /* 队列满了，先缓存起来，由io线程处理完后唤醒主线程继续写入 */
+    _main_overflow.push_back( msg );
+    _main_full = true;
+}
+
+/* io线程发往主线程的消息 */
+void io_reactor::push_reactor( struct message *msg )
+{
+    if ( expect_true(_reactor_overflow.empty()) && _reactor_queue.push( msg ) )
+    {
+        _reactor_notify = true;
+        return;
+    }
+
+    _reactor_overflow.push_back( msg );
+}
+
+void io_reactor::add_conn( uint32 conn_id,int32 fd,
+    int32 io_type,int32 io_ctx,int32 packet_type )
+{
+    struct message *msg = new_message( MSG_ADD,conn_id,0 );
+
+    msg->_fd = fd;
+    msg->_io_type = io_type;
+    msg->_io_ctx = io_ctx;
+    msg->_packet_type = packet_type;
+
+    ++ _conn_count;
+    push_main( msg );
+}
+
+void io_reactor::del_conn( uint32 conn_id )
+{
+    assert( "io reactor conn count error",_conn_count > 0 );
+
+    -- _conn_count;
+    push_main( new_message( MSG_DEL,conn_id,0 ) );
+}
+
+void io_reactor::send( uint32 conn_id,class buffer &send )
+{
+    uint32 size = send.data_size();
+    if ( 0 == size ) return;
+
+    if ( !send.is_segment() )
+    {
+        struct message *msg = new_message( MSG_DATA,conn_id,size );
+        memcpy( msg->data(),send.data_pointer(),size );
+        send.clear();
+
+        push_main( msg );
+        return;
+    }
+
+    /* 分段缓冲区逐个segment处理，引用共享帧的segment把引用交给io线程，不拷贝数据
+     * 其他segment的内存来自主线程的内存池，只能拷贝
+     */
+    while ( send.data_size() > 0 )
+    {
+        class shared_frame *frame = send.data_frame();
+        if ( frame )
+        {
+            struct message *msg = new_message( MSG_FRAME,conn_id,0 );
+
+            frame->grab();
+            msg->_frame = frame;
+            msg->_size = frame->size();
+            send.subtract( frame->size() );
+
+            push_main( msg );
+            continue;
+        }
+
+        uint32 seg_size = send.seg_data_size();
+        struct message *msg = new_message( MSG_DATA,conn_id,seg_size );
+        memcpy( msg->data(),send.data_pointer(),seg_size );
+        send.subtract( seg_size );
+
+        push_main( msg );
+    }
+}
+
+void io_reactor::invoke_notify()
+{
+    if ( expect_false(!_main_overflow.empty()) )
+    {
+        size_t idx = 0;
+        size_t size = _main_overflow.size();
+        for ( ;idx < size;idx ++ )
+        {
+            if ( !_main_queue.push( _main_overflow[idx] ) ) break;
+        }
+
+        if ( idx > 0 )
+        {
+            _main_notify = true;
+            _main_overflow.erase(
+                _main_overflow.begin(),_main_overflow.begin() + idx );
+        }
+        if ( !_main_overflow.empty() ) _main_full = true;
+    }
+
+    if ( _main_notify )
+    {
+        _main_notify = false;
+        wake( _reactor_fd );
+    }
+}
+
+/* 主线程收到io线程的消息 */
+void io_reactor::main_io_cb( ev_io &w,int32 revents )
+{
+    static class lnetwork_mgr *network_mgr = static_global::network_mgr();
+
+    drain( _main_fd );
+
+    struct message *msg = NULL;
+    while ( _reactor_queue.pop( msg ) )
+    {
+        /* 主线程可能已经关闭了该连接，剩下的消息直接丢弃 */
+        class socket *sk = network_mgr->get_conn_by_conn_id( msg->_conn_id );
+        if ( sk && sk->fd() > 0 && this == sk->get_reactor() )
+        {
+            if ( MSG_DATA == msg->_type )
+            {
+                sk->reactor_recv( msg->data(),msg->_size );
+            }
+            else if ( MSG_CLOSE == msg->_type )
+            {
+                sk->reactor_close();
+            }
+        }
+
+        del_message( msg );
+    }
+}
+
+/* io线程收到主线程的消息 */
+void io_reactor::reactor_io_cb( ev_io &w,int32 revents )
+{
+    drain( _reactor_fd );
+
+    struct message *msg = NULL;
+    while ( _main_queue.pop( msg ) )
+    {
+        do_message( msg );
+        del_message( msg );
+    }
+
+    /* 主线程有消息缓存在溢出数组，唤醒主线程继续写入 */
+    if ( _main_full.exchange( false ) ) wake( _main_fd );
+
+    if ( expect_false(_quit.load()) ) quit();
+}
+
+void io_reactor::do_message( struct message *msg )
+{
+    switch ( msg->_type )
+    {
+        case MSG_ADD  : do_add( msg );break;
+        case MSG_DEL  : do_del( msg->_conn_id );break;
+        case MSG_DATA :
+        case MSG_FRAME: do_send( msg );break;
+        default :
+            ERROR_R( "io reactor unknow message:%d",msg->_type );
+            break;
+    }
+}
+
+void io_reactor::do_add( struct message *msg )
+{
+    class conn *cn = new class conn( this,msg->_conn_id,msg->_packet_type );
+
+    /* 发送缓冲区用分段模式，主线程转交的共享帧可以直接引用 */
+    cn->_send.set_segment( true );
+
+    switch ( msg->_io_type )
+    {
+        case io::IOT_NONE :
+            cn->_io = new io( &cn->_recv,&cn->_send );
+            break;
+        case io::IOT_SSL :
+            cn->_io = new ssl_io( msg->_io_ctx,&cn->_recv,&cn->_send );
+            break;
+        default :
+            ERROR_R( "io reactor unknow io type:%d",msg->_io_type );
+            cn->_io = new io( &cn->_recv,&cn->_send );
+            break;
+    }
+
+    _conn_map[cn->_conn_id] = cn;
+
+    cn->_w.set<io_reactor::conn,&io_reactor::conn::io_cb>( cn );
+    cn->_w.start( msg->_fd,EV_READ );
+
+    // 返回值: < 0 错误，0 成功，1 需要重读，2 需要重写
+    int32 ecode = cn->_io->init_accept( msg->_fd );
+    if ( expect_false(ecode < 0) )
+    {
+        conn_error( cn );
+    }
+    else if ( 2 == ecode )
+    {
+        conn_send( cn );
+    }
+}
+
+void io_reactor::do_del( uint32 conn_id )
+{
+    conn_map_t::iterator itr = _conn_map.find( conn_id );
+    if ( itr == _conn_map.end() )
+    {
+        ERROR_R( "io reactor del conn not found:%d",conn_id );
+        return;
+    }
+
+    class conn *cn = itr->second;
+    _conn_map.erase( itr );
+
+    /* 主线程关闭前要求发送的数据，尽量发送 */
+    if ( !cn->_closed && cn->_send.data_size() > 0 ) cn->_io->send();
+
+    cn->_w.stop();
+    ::close( cn->_w.fd );
+    delete cn;
+}
+
+void io_reactor::do_send( struct message *msg )
+{
+    conn_map_t::iterator itr = _conn_map.find( msg->_conn_id );
+    if ( itr == _conn_map.end() )
+    {
+        ERROR_R( "io reactor send conn not found:%d",msg->_conn_id );
+        return;
+    }
+
+    class conn *cn = itr->second;
+    if ( cn->_closed ) return;
+
+    bool ok = msg->_frame ? cn->_send.append_frame( msg->_frame ) >= 0
+        : cn->_send.append( msg->data(),msg->_size );
+    if ( !ok )
+    {
+        ERROR_R( "io reactor send buffer overflow:%d",msg->_conn_id );
+        conn_error( cn );
+        return;
+    }
+
+    /* 已经在等待可写事件，等可写时再一起发送 */
+    if ( cn->_w.events & EV_WRITE ) return;
+
+    conn_send( cn );
+}
+
+void io_reactor::conn_recv( class conn *cn )
+{
+    if ( cn->_closed ) return;
+
+    // 返回值: < 0 错误，0 成功，1 需要重读，2 需要重写
+    int32 ret = cn->_io->recv();
+    if ( expect_false(ret < 0) ) return conn_error( cn );
+
+    // SSL握手成功，有数据待发送则会出现这种情况
+    if ( expect_false(2 == ret) ) conn_send( cn );
+
+    class buffer &recv = cn->_recv;
+    uint32 size = recv.data_size();
+    if ( 0 == size ) return;
+
+    /* 在io线程拆分数据包，主线程只处理完整的数据包 */
+    uint32 len = cn->frame_size( recv.data_pointer(),size );
+    if ( 0 == len ) return;
+
+    struct message *msg = new_message( MSG_DATA,cn->_conn_id,len );
+    memcpy( msg->data(),recv.data_pointer(),len );
+    recv.subtract( len );
+
+    push_reactor( msg );
+}
+
+void io_reactor::conn_send( class conn *cn )
+{
+    if ( cn->_closed ) return;
+
+    // 返回值: < 0 错误，0 成功，1 需要重读，2 需要重写
+    int32 ret = cn->_io->send();
+    if ( expect_false(ret < 0) ) return conn_error( cn );
+
+    /* 数据未发送完或者ssl需要重写，监听可写事件 */
+    int32 events = 2 == ret ? EV_READ | EV_WRITE : EV_READ;
+    if ( events != cn->_w.events ) cn->_w.set( events );
+}
+
+/* 连接出错或者对方断开，通知主线程。fd由主线程通知删除时再关闭 */
+void io_reactor::conn_error( class conn *cn )
+{
+    if ( cn->_closed ) return;
+
+    cn->_closed = true;
+    cn->_w.stop();
+    cn->_recv.clear();
+    cn->_send.clear();
+
+    push_reactor( new_message( MSG_CLOSE,cn->_conn_id,0 ) );
+}
@@ -0,0 +1,137 @@
+#ifndef __IO_REACTOR_H__
+#define __IO_REACTOR_H__
+
+#include <pthread.h>
+#include <vector>
+
+#include "../global/global.h"
+#include "../ev/ev_watcher.h"
+#include "../thread/spsc_queue.h"
+
+#include "buffer.h"
+
+/* 多线程io(multi-reactor)
+ * 1.每个io线程有自己的事件循环，负责一部分客户端连接的recv、ssl、数据包拆分及发送
+ * 2.主线程(lua线程)仍保留一个socket对象作为代理，负责解码、回调脚本及打包。打包后的数据
+ *   通过队列交给io线程发送，io线程收到的完整数据包通过队列交给主线程解码
+ * 3.主线程和io线程之间各用一个单生产者单消费者的无锁队列，用eventfd唤醒。主线程每一轮
+ *   主循环只唤醒一次io线程，io线程每一轮事件循环也只唤醒一次主线程
+ * 4.fd只由io线程关闭，并且只在主线程通知删除后才关闭，避免fd被重用时主线程误操作
+ * 5.队列满时先缓存到各自线程的溢出数组，不会丢弃数据，也不会阻塞
+ * 6.广播的共享帧(shared_frame)不拷贝，把引用交给io线程，io线程的发送缓冲区用分段模式
+ *   直接引用该帧
+ */
+class io_reactor : public ev
+{
+public:
+    typedef enum
+    {
+        MSG_NONE  = 0,
+        MSG_ADD   = 1, // 主线程->io线程，新增连接
+        MSG_DEL   = 2, // 主线程->io线程，删除连接(关闭fd)
+        MSG_DATA  = 3, // 双向，发送或者收到的数据
+        MSG_CLOSE = 4, // io线程->主线程，连接出错或者对方断开
+        MSG_FRAME = 5, // 主线程->io线程，发送共享帧，消息持有帧的一个引用
+
+        MSG_MAX
+    }msg_t;
+
+    /* 线程之间传递的消息，数据紧跟在结构体后面 */
+    struct message
+    {
+        int32 _type;
+        uint32 _conn_id;
+        uint32 _size; /* 数据大小 */
+
+        /* MSG_ADD时连接的参数 */
+        int32 _fd;
+        int32 _io_type;
+        int32 _io_ctx;
+        int32 _packet_type;
+
+        /* MSG_FRAME时引用的共享帧 */
+        class shared_frame *_frame;
+
+        inline char *data() const
+        {
+            return reinterpret_cast<char *>(
+                const_cast<struct message *>(this) + 1 );
+        }
+    };
+public:
+    ~io_reactor();
+    explicit io_reactor( int32 index );
+
+    bool start();
+    void stop ();
+
+    /* 以下函数只能在主线程调用 */
+    void add_conn( uint32 conn_id,int32 fd,
+        int32 io_type,int32 io_ctx,int32 packet_type );
+    void del_conn( uint32 conn_id );
+    /* 把发送缓冲区的数据交给io线程发送，并清空发送缓冲区
+     * 分段缓冲区中引用的共享帧只转交引用，其他数据拷贝
+     */
+    void send( uint32 conn_id,class buffer &send );
+    /* 主循环每一轮调用一次，唤醒io线程处理本轮的消息 */
+    void invoke_notify();
+
+    inline int32 get_index() const { return _index; }
+    inline uint32 get_conn_count() const { return _conn_count; }
+private:
+    class conn;
+    typedef map_t<uint32,class conn *> conn_map_t;
+
+    static struct message *new_message( int32 type,uint32 conn_id,uint32 size );
+    static void del_message( struct message *msg );
+
+    static void *start_routine( void *arg );
+    static void wake( int32 fd );
+    static void drain( int32 fd );
+
+    void routine();
+    void running( int64 ms_now );
+    ev_tstamp wait_time();
+
+    /* 主线程 */
+    void push_main( struct message *msg );
+    void main_io_cb( ev_io &w,int32 revents );
+
+    /* io线程 */
+    void push_reactor( struct message *msg );
+    void reactor_io_cb( ev_io &w,int32 revents );
+    void do_message( struct message *msg );
+    void do_add( struct message *msg );
+    void do_del( uint32 conn_id );
+    void do_send( struct message *msg );
+    void conn_recv( class conn *cn );
+    void conn_send( class conn *cn );
+    void conn_error( class conn *cn );
+private:
+    int32 _index;
+    pthread_t _id;
+    volatile bool _run;
+
+    int32 _main_fd;    /* 主线程监听，io线程写入 */
+    int32 _reactor_fd; /* io线程监听，主线程写入 */
+    ev_io _main_watcher;
+    ev_io _reactor_watcher;
+
+    /* 主线程->io线程 */
+    bool _main_notify;
+    spsc_queue<struct message *> _main_queue;
+    std::vector<struct message *> _main_overflow;
+    uint32 _conn_count;
+
+    /* io线程->主线程 */
+    bool _reactor_notify;
+    spsc_queue<struct message *> _reactor_queue;
+    std::vector<struct message *> _reactor_overflow;
+    conn_map_t _conn_map;
+
+    /* 主线程的消息溢出时，由io线程处理完队列后唤醒主线程继续写入 */
+    std::atomic<bool> _main_full;
+    std::atomic<bool> _quit; /* 通知io线程退出 */
+};
+
+#endif /* __IO_REACTOR_H__ */
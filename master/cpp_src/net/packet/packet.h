@@ -6,6 +6,7 @@
 /* socket packet parser and deparser */
 
 class socket;
+class shared_frame;
 struct lua_State;
 
 class packet
@@ -57,6 +58,22 @@ public:
         assert( "should never call base function",false );
         return -1;
     }
+
+    /* 构造服务器发往客户端的共享数据帧，用于广播。同一packet类型的socket共用一个帧
+     * return: 引用计数为1的帧，由调用者release。不支持共享帧的packet返回NULL，调用者
+     *         改用raw_pack_clt逐个打包
+     */
+    virtual class shared_frame *make_clt_frame(
+        int32 cmd,uint16 ecode,const char *ctx,size_t size )
+    {
+        return NULL;
+    }
+    /* 构造服务器发往服务器的共享数据帧，用于广播，不支持时返回NULL */
+    virtual class shared_frame *make_ss_frame(
+        int32 cmd,uint16 ecode,int32 session,const char *ctx,size_t size )
+    {
+        return NULL;
+    }
 protected:
     class socket *_socket;
 };
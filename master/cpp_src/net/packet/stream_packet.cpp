@@ -363,8 +363,8 @@ void stream_packet::rpc_command( const s2s_header *header )
     lua_pushinteger  ( L,_socket->conn_id() );
     lua_pushinteger  ( L,header->_owner     );
 
-    // rpc解析方式目前固定为bson
-    codec *decoder = static_global::codec_mgr()->get_codec( codec::CDC_BSON );
+    // rpc解析方式由RPC_CODEC指定
+    codec *decoder = static_global::codec_mgr()->get_codec( RPC_CODEC );
     int32 cnt = decoder->decode( L,buffer,size,NULL );
     if ( cnt < 1 ) // rpc调用至少要带参数名
     {
@@ -410,8 +410,8 @@ void stream_packet::rpc_return( const s2s_header *header )
     int32 cnt = 0;
     if ( size > 0 )
     {
-        // rpc解析方式目前固定为bson
-        codec *decoder = static_global::codec_mgr()->get_codec( codec::CDC_BSON );
+        // rpc解析方式由RPC_CODEC指定
+        codec *decoder = static_global::codec_mgr()->get_codec( RPC_CODEC );
         cnt = decoder->decode( L,buffer,size,NULL );
     }
     if ( LUA_OK != lua_pcall( L,3 + cnt,0,1 ) )
@@ -432,7 +432,7 @@ int32 stream_packet::rpc_pack(
 {
     int32 len = 0;
     const char *buffer = NULL;
-    codec *encoder = static_global::codec_mgr()->get_codec( codec::CDC_BSON );
+    codec *encoder = static_global::codec_mgr()->get_codec( RPC_CODEC );
 
     if ( LUA_OK == ecode )
     {
@@ -453,6 +453,13 @@ int32 stream_packet::rpc_pack(
     s2sh._packet = pkt;
 
     class buffer &send = _socket->send_buffer();
+    if ( !send.reserved( len + sizeof(struct s2s_header) ) )
+    {
+        encoder->finalize();
+        ERROR( "rpc_pack can not reserved buffer" );
+        return -1;
+    }
+
     send.__append( &s2sh,sizeof(struct s2s_header) );
     if ( len > 0)
     {
@@ -733,6 +740,41 @@ int32 stream_packet::raw_pack_ss(
     return 0;
 }
 
+class shared_frame *stream_packet::make_clt_frame(
+    int32 cmd,uint16 ecode,const char *ctx,size_t size )
+{
+    struct s2c_header header;
+    header._length = PACKET_MAKE_LENGTH( struct s2c_header,size );
+    header._cmd    = static_cast<uint16>  ( cmd );
+    header._errno  = ecode;
+
+    class shared_frame *frame =
+        shared_frame::create( sizeof(header) + size );
+    frame->append( &header,sizeof(header) );
+    if ( size > 0 ) frame->append( ctx,size );
+
+    return frame;
+}
+
+class shared_frame *stream_packet::make_ss_frame(
+    int32 cmd,uint16 ecode,int32 session,const char *ctx,size_t size )
+{
+    struct s2s_header header;
+    header._length = PACKET_MAKE_LENGTH( struct s2s_header,size );
+    header._cmd    = static_cast<uint16> ( cmd );
+    header._errno  = ecode;
+    header._owner  = session;
+    header._packet = SPKT_SSPK;
+    header._codec  = codec::CDC_NONE;// 这个这里用不着，但不初始化valgrind就会警告
+
+    class shared_frame *frame =
+        shared_frame::create( sizeof(header) + size );
+    frame->append( &header,sizeof(header) );
+    if ( size > 0 ) frame->append( ctx,size );
+
+    return frame;
+}
+
 // 打包客户端广播数据
 // ssc_multicast( conn_id,mask,args_list,codec_type,cmd,errno,pkt )
 int32 stream_packet::pack_ssc_multicast( lua_State *L,int32 index )
@@ -829,8 +871,8 @@ int32 stream_packet::pack_ssc_multicast( lua_State *L,int32 index )
     return 0;
 }
 
-// 转发到一个客户端
-void stream_packet::ssc_one_multicast(
+// 转发到一个客户端，同一packet类型的客户端共用frames中的数据帧
+void stream_packet::ssc_one_multicast( class shared_frame **frames,
     owner_t owner,int32 cmd,uint16 ecode,const char *ctx,int32 size )
 {
     static const class lnetwork_mgr *network_mgr = static_global::network_mgr();
@@ -852,7 +894,20 @@ void stream_packet::ssc_one_multicast(
         ERROR( "ssc_one_multicast no packet found" );
         return;
     }
-    sk_packet->raw_pack_clt( cmd,ecode,ctx,size );
+
+    packet::packet_t pkt_ty = sk_packet->type();
+    if ( !frames[pkt_ty] )
+    {
+        frames[pkt_ty] = sk_packet->make_clt_frame( cmd,ecode,ctx,size );
+    }
+
+    // 该packet类型不支持共享帧，单独打包
+    if ( !frames[pkt_ty] )
+    {
+        sk_packet->raw_pack_clt( cmd,ecode,ctx,size );
+        return;
+    }
+    sk->append_frame( frames[pkt_ty] );
 }
 
 // 处理其他进程发过来的客户端广播
@@ -883,11 +938,13 @@ void stream_packet::ssc_multicast( const s2s_header *header )
     // 根据玩家pid广播，底层直接处理 
     if ( CLT_MC_OWNER == mask )
     {
+        class shared_frame *frames[PKT_MAX] = { NULL };
         for ( int32 idx = 0;idx < count;idx ++ )
         {
-            ssc_one_multicast(
+            ssc_one_multicast( frames,
                 *(raw_list + idx + 2),header->_cmd,header->_errno,ctx,size );
         }
+        shared_frame::release( frames,PKT_MAX );
         return;
     }
 
@@ -922,19 +979,23 @@ void stream_packet::ssc_multicast( const s2s_header *header )
         lua_settop( L,0 );
         return;
     }
+    class shared_frame *frames[PKT_MAX] = { NULL };
     lua_pushnil(L);  /* first key */
     while ( lua_next(L, -2) != 0 )
     {
         if ( !lua_isinteger( L,-1 ) )
         {
             lua_settop( L,0 );
+            shared_frame::release( frames,PKT_MAX );
             ERROR( "ssc_multicast list expect integer" );
             return;
         }
         owner_t owner = static_cast<owner_t>( lua_tointeger( L,-1 ) );
-        ssc_one_multicast( owner,header->_cmd,header->_errno,ctx,size );
+        ssc_one_multicast( frames,
+            owner,header->_cmd,header->_errno,ctx,size );
 
         lua_pop( L,1 );
     }
+    shared_frame::release( frames,PKT_MAX );
     lua_settop( L,0 ); /* remove traceback */
 }
\ No newline at end of file
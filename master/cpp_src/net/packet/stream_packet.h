@@ -33,6 +33,10 @@ public:
         int32 cmd,uint16 ecode,const char *ctx,size_t size );
     int32 raw_pack_ss( 
         int32 cmd,uint16 ecode,int32 session,const char *ctx,size_t size );
+    class shared_frame *make_clt_frame(
+        int32 cmd,uint16 ecode,const char *ctx,size_t size );
+    class shared_frame *make_ss_frame(
+        int32 cmd,uint16 ecode,int32 session,const char *ctx,size_t size );
     int32 unpack();
 private:
     void dispatch( const struct base_header *header );
@@ -49,7 +53,7 @@ private:
     void ssc_multicast( const s2s_header *header );
     int32 rpc_pack(
         lua_State *L,int32 unique_id,int32 ecode,uint16 pkt,int32 index );
-    void ssc_one_multicast( 
+    void ssc_one_multicast( class shared_frame **frames,
         owner_t owner,int32 cmd,uint16 ecode,const char *ctx,int32 size );
 };
 
@@ -296,3 +296,31 @@ int32 ws_stream_packet::do_pack_clt(
 
     return 0;
 }
+
+class shared_frame *ws_stream_packet::make_clt_frame(
+    int32 cmd,uint16 ecode,const char *ctx,size_t size )
+{
+    // 同raw_pack_clt，服务器发往客户端的帧不需要mask，所有客户端的帧都是一样的
+    websocket_flags flags =
+        static_cast<websocket_flags>(WS_OP_BINARY | WS_FINAL_FRAME);
+
+    struct clt_header header;
+    header._cmd = cmd;
+    header._errno = ecode;
+    size_t frame_size = size + sizeof(header);
+    size_t len = websocket_calc_frame_size( flags,frame_size );
+
+    const char *header_ctx = reinterpret_cast<const char*>(&header);
+    class shared_frame *frame = shared_frame::create( len );
+
+    char mask[4] = { 0 };
+    uint8 mask_offset = 0;
+    char *buff = frame->data_end();
+    size_t offset = websocket_build_frame_header( buff,flags,mask,frame_size );
+    offset += websocket_append_frame( 
+        buff + offset,flags,mask,header_ctx,sizeof(header),&mask_offset );
+    websocket_append_frame( buff + offset,flags,mask,ctx,size,&mask_offset );
+    frame->increase( len );
+
+    return frame;
+}
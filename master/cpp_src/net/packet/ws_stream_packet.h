@@ -25,6 +25,8 @@ public:
 
     int32 raw_pack_clt( 
         int32 cmd,uint16 ecode,const char *ctx,size_t size );
+    class shared_frame *make_clt_frame(
+        int32 cmd,uint16 ecode,const char *ctx,size_t size );
 private:
     int32 sc_command();
     int32 cs_command( int32 cmd,const char *ctx,size_t size );
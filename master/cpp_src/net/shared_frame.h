@@ -0,0 +1,84 @@
+#ifndef __SHARED_FRAME_H__
+#define __SHARED_FRAME_H__
+
+#include <new>    /* placement new */
+#include <atomic>
+
+#include "../global/global.h"
+
+/* 共享数据帧(只读，引用计数)
+ * 1.广播时同一个数据包要发往大量socket，包头+包体只构造一次，分段模式的发送缓冲区直接
+ *   引用该帧而不是拷贝，非分段模式的缓冲区仍然拷贝
+ * 2.创建者持有一个引用，每个引用该帧的segment持有一个引用，最后一个release时释放内存
+ * 3.帧构造完成后不能再修改。多线程io时引用会交给io线程，在io线程中释放，因此引用计数
+ *   用原子操作
+ */
+class shared_frame
+{
+public:
+    /* 创建一个共享帧，内存大小为len，引用计数为1 */
+    static class shared_frame *create( uint32 len )
+    {
+        char *mem = new char[sizeof(class shared_frame) + len];
+        return new ( mem ) shared_frame( len );
+    }
+
+    /* 释放广播时按packet类型缓存的共享帧 */
+    static void release( class shared_frame **frames,int32 count )
+    {
+        for ( int32 idx = 0;idx < count;idx ++ )
+        {
+            if ( frames[idx] ) frames[idx]->release();
+            frames[idx] = NULL;
+        }
+    }
+
+    inline void grab() { _ref.fetch_add( 1,std::memory_order_relaxed ); }
+    inline void release()
+    {
+        /* 最后一个引用释放时，其他线程对帧的读取都要已完成 */
+        uint32 ref = _ref.fetch_sub( 1,std::memory_order_acq_rel );
+        assert( "shared frame release",ref > 0 );
+        if ( 1 != ref ) return;
+
+        this->~shared_frame();
+        delete []reinterpret_cast<char *>( this );
+    }
+
+    /* 数据大小 */
+    inline uint32 size() const { return _size; }
+    /* 数据指针 */
+    inline char *data() const
+    {
+        return reinterpret_cast<char *>(
+            const_cast<class shared_frame *>(this) + 1 );
+    }
+
+    /* 构造帧时写入数据 */
+    inline void append( const void *data,uint32 len )
+    {
+        assert( "shared frame overflow",_size + len <= _len );
+        memcpy( data_end(),data,len );
+        _size += len;
+    }
+    /* 构造帧时，数据区末尾指针，用于自定义写入(如websocket帧) */
+    inline char *data_end() const { return data() + _size; }
+    /* 自定义写入后增加数据大小 */
+    inline void increase( uint32 len )
+    {
+        _size += len;
+        assert( "shared frame increase",_size <= _len );
+    }
+private:
+    explicit shared_frame( uint32 len ) : _ref( 1 ),_size( 0 ),_len( len ) {}
+    ~shared_frame() {}
+
+    shared_frame( const shared_frame & );
+    shared_frame &operator=( const shared_frame & );
+private:
+    std::atomic<uint32> _ref; /* 引用计数 */
+    uint32 _size; /* 数据大小 */
+    uint32 _len ; /* 内存大小 */
+};
+
+#endif /* __SHARED_FRAME_H__ */
@@ -5,6 +5,7 @@
 #include <arpa/inet.h>  /* htons */
 
 #include "socket.h"
+#include "io_reactor.h"
 #include "io/ssl_io.h"
 #include "../ev/ev_def.h"
 #include "packet/http_packet.h"
@@ -19,6 +20,10 @@ socket::socket( uint32 conn_id,conn_t conn_ty )
     _packet = NULL;
     _object_id = 0;
 
+    _io_ctx = 0;
+    _io_ty = io::IOT_NONE;
+    _reactor = NULL;
+
     _pending  = 0;
     _conn_id  = conn_id;
     _conn_ty  = conn_ty;
@@ -47,12 +52,16 @@ void socket::stop( bool flush )
         _pending = 0;
 
         // 如果是出错，则不发送剩余数据，如果是脚本上层正常关闭，则发送
-        if ( flush ) _io->send();  /* flush data before close */
+        if ( flush )  /* flush data before close */
+        {
+            if ( _reactor ) _reactor->send( _conn_id,_send ); else _io->send();
+        }
     }
 
     if ( _w.fd > 0 )
     {
-        ::close( _w.fd );
+        /* 多线程io模式下，fd由io线程关闭 */
+        if ( _reactor ) _reactor->del_conn( _conn_id ); else ::close( _w.fd );
         _w.stop ();
         _w.fd = -1; /* must after stop */
     }
@@ -95,6 +104,13 @@ int32 socket::send()
      */
      _pending = 0;
 
+    /* 多线程io模式下，数据交给io线程发送 */
+    if ( _reactor )
+    {
+        _reactor->send( _conn_id,_send );
+        return 0;
+    }
+
      // 返回值: < 0 错误，0 成功，1 需要重读，2 需要重写
     int32 ret = _io->send();
     if ( expect_false(ret < 0) )
@@ -361,6 +377,22 @@ void socket::pending_send()
     _pending = static_global::lua_ev()->pending_send( this );
 }
 
+/* 写入共享数据帧，分段模式下直接引用，否则拷贝 */
+int32 socket::append_frame( class shared_frame *frame )
+{
+    int32 refer = _send.append_frame( frame );
+    if ( refer < 0 )
+    {
+        ERROR( "socket append frame can not reserved buffer" );
+        return -1;
+    }
+
+    static_global::statistic()->add_multicast( refer > 0,frame->size() );
+
+    pending_send();
+    return 0;
+}
+
 
 void socket::listen_cb()
 {
@@ -391,6 +423,11 @@ void socket::listen_cb()
         bool is_ok = network_mgr->accept_new( _conn_id,new_sk );
         if ( expect_true( is_ok ) )
         {
+            /* 多线程io模式下，客户端连接交给io线程处理(脚本可能已关闭该连接) */
+            if ( new_sk->fd() > 0 )
+            {
+                new_sk->set_reactor( network_mgr->select_reactor( _conn_ty ) );
+            }
             new_sk->init_accept();
         }
         else
@@ -454,6 +491,39 @@ void socket::command_cb()
     int32 ret = socket::recv();
     if ( expect_false(0 != ret) ) return;  /* 出错,包括对方主动断开或者需要重试 */
 
+    command_unpack();
+}
+
+/* 多线程io模式下，io线程收到的完整数据包 */
+void socket::reactor_recv( const char *data,uint32 size )
+{
+    static class lnetwork_mgr *network_mgr = static_global::network_mgr();
+
+    if ( !_packet || !_recv.append( data,size ) )
+    {
+        socket::stop();
+        network_mgr->connect_del( _conn_id );
+        ERROR( "socket reactor recv no packet set or buffer overflow" );
+        return;
+    }
+
+    command_unpack();
+}
+
+/* 多线程io模式下，io线程发现连接出错或者对方断开 */
+void socket::reactor_close()
+{
+    static class lnetwork_mgr *network_mgr = static_global::network_mgr();
+
+    socket::stop();
+    network_mgr->connect_del( _conn_id );
+}
+
+void socket::command_unpack()
+{
+    static class lnetwork_mgr *network_mgr = static_global::network_mgr();
+
+    int32 ret = 0;
     /* 在回调脚本时，可能被脚本关闭当前socket(fd < 0)，这时就不要再处理数据了 */
     do
     {
@@ -475,6 +545,9 @@ int32 socket::set_io( io::io_t io_type,int32 io_ctx )
     delete _io;
     _io = NULL;
 
+    _io_ty = io_type;
+    _io_ctx = io_ctx;
+
     switch( io_type )
     {
         case io::IOT_NONE :
@@ -541,6 +614,15 @@ int32 socket::io_status_check( int32 ecode )
 int32 socket::init_accept()
 {
     assert( "socket init accept no io set",_io );
+
+    /* 多线程io模式下，主线程不再监听该fd，ssl握手等都在io线程处理 */
+    if ( _reactor )
+    {
+        _w.stop();
+        _reactor->add_conn( _conn_id,_w.fd,_io_ty,_io_ctx,
+            _packet ? _packet->type() : packet::PKT_NONE );
+        return 0;
+    }
     int32 ecode = _io->init_accept( _w.fd );
 
     io_status_check( ecode );
@@ -22,6 +22,7 @@
 #endif
 
 class lev;
+class io_reactor;
 
 /* 网络socket连接类
  * 这里封装了基本的网络操作
@@ -52,6 +53,10 @@ public:
     void command_cb();
     void connect_cb();
 
+    /* 多线程io模式下，io线程收到的数据及连接断开 */
+    void reactor_recv( const char *data,uint32 size );
+    void reactor_close();
+
     int32 recv();
     int32 send();
 
@@ -59,6 +64,8 @@ public:
     void stop ( bool flush = false );
     int32 validate();
     void pending_send();
+    /* 写入共享数据帧，用于广播 */
+    int32 append_frame( class shared_frame *frame );
 
     const char *address();
     int32 listen( const char *host,int32 port );
@@ -103,10 +110,20 @@ public:
     {
         _send.set_buffer_size( max,min );
     }
+    /* 发送缓冲区使用分段模式 */
+    inline void set_send_segment( bool segment )
+    {
+        _send.set_segment( segment );
+    }
 
     inline int64 get_object_id() const { return _object_id; }
     inline void set_object_id( int64 oid ) { _object_id = oid; }
+
+    /* 设置由哪个io线程处理，NULL为主线程处理 */
+    inline void set_reactor( class io_reactor *reactor ) { _reactor = reactor; }
+    inline class io_reactor *get_reactor() const { return _reactor; }
 private:
+    void command_unpack();
     int32 io_status_check( int32 ecode );
 protected:
     buffer _recv;
@@ -122,6 +139,10 @@ private:
     class packet *_packet;
     codec::codec_t _codec_ty;
 
+    io::io_t _io_ty;
+    int32 _io_ctx;
+    class io_reactor *_reactor; /* 多线程io模式下，负责该连接的io线程 */
+
     /* 采用模板类这里就可以直接保存对应类型的对象指针及成员函数，模板函数只能用void类型 */
     void *_this;
     void (socket::*_method)();
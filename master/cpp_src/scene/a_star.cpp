@@ -1,12 +1,14 @@
 #include <cmath> // for sqrt
+#include <algorithm> // for reverse
 
 #include "a_star.h"
 #include "grid_map.h"
+#include "hpa_graph.h"
 
 // 默认格子集合大小，128*128有点大，占128k内存了
 // 如果有超级大地图，那么可能要考虑用hash_map，虽然慢一点，至少不会爆内存
 #define DEFAULT_SET 128*128
-#define DEFAULT_POOL 1024  // 默认分配格子内存池数量
+#define DEFAULT_POOL 1024  // 格子内存池每次分配的格子数量
 
 /* 定义一个格子的距离,整数计算效率比浮点高，
  * 根据勾股定理，要定一个误差较小的整数对角距离,边长为10，那边沿对角走则为14
@@ -19,23 +21,30 @@
 a_star::a_star()
 {
     _node_set = NULL;  // 记录当前寻路格子数据
-    _node_pool = NULL; // 格子对象内存池
+    _node_gen = NULL;
+    _search_gen = 0;
 
     _set_max  = 0;
-    _pool_max = 0; // 内存池格子数量
     _pool_idx = 0; // 内存池当前已用数量
+    _base_x   = 0;
+    _base_y   = 0;
+    _width    = 0;
+    _height   = 0;
 }
 
 a_star::~a_star()
 {
     delete []_node_set;
-    delete []_node_pool;
+    delete []_node_gen;
+
+    std::vector<struct node*>::iterator iter = _node_pool.begin();
+    for (;iter != _node_pool.end();iter ++) delete [](*iter);
 
     _node_set = NULL;
-    _node_pool = NULL;
+    _node_gen = NULL;
+    _node_pool.clear();
 
     _set_max  = 0;
-    _pool_max = 0; // 内存池格子数量
     _pool_idx = 0; // 内存池当前已用数量
 }
 
@@ -44,7 +53,8 @@ a_star::~a_star()
  * @x,y：起点坐标
  * @dx,dy：dest，终点坐标
  */
-bool a_star::search(const grid_map *map,int32 x,int32 y,int32 dx,int32 dy)
+bool a_star::search(
+    const grid_map *map,int32 x,int32 y,int32 dx,int32 dy,int32 mode)
 {
     // 起点和终点必须是可行走的
     if ( map->get_pass_cost(x,y) < 0 || map->get_pass_cost(dx,dy) < 0 )
@@ -52,40 +62,51 @@ bool a_star::search(const grid_map *map,int32 x,int32 y,int32 dx,int32 dy)
         return false;
     }
 
-    uint16 width = map->get_width();
-    uint16 height = map->get_height();
-    // 分配格子集合，每次寻路时只根据当前地图只增不减
+    prepare( 0,0,map->get_width(),map->get_height() );
+
+    if ( SM_JPS == mode ) return do_jps_search( map,x,y,dx,dy );
+    if ( SM_HPA == mode ) return do_hpa_search( map,x,y,dx,dy );
+
+    return do_search( map,x,y,dx,dy );
+}
+
+/* 分配格子集合并清空寻路缓存
+ * @x0,y0：格子集合对应范围的左上角，整个地图寻路时为(0,0)
+ * @width,height：范围的宽高
+ */
+void a_star::prepare( int32 x0,int32 y0,int32 width,int32 height )
+{
+    // 分配格子集合，只根据寻路范围只增不减。hpa*构建时只在簇内寻路，不需要整个地图大小
     if ( _set_max < width*height )
     {
         delete []_node_set;
+        delete []_node_gen;
 
         _set_max = width*height;
         _set_max = _set_max > DEFAULT_SET ? _set_max : DEFAULT_SET;
 
-        _node_set = new node*[DEFAULT_SET];
+        _node_set = new node*[_set_max];
+        _node_gen = new uint32[_set_max];
+        memset( _node_gen,0,sizeof(uint32)*_set_max );
+        _search_gen = 0;
     }
 
-    /* 格子内存池
-     * 现在内存池默认分配1024个，如果用完了那就算找不到路径
-     * 如果以后确实有更高的需求，加个参数，用完后传入一个更大的数量在这里重新分配重新
-     * 查找。
-     * 注意内存池的对象是引用到node_set里的，必须要重新调用search函数
+    /* 清空寻路缓存
+     * 不需要清空_node_set，序号加1后之前的格子都视为没访问过。序号用完一轮才清空一次
      */
-    if ( _pool_max < DEFAULT_POOL )
+    if ( expect_false(0 == ++_search_gen) )
     {
-        delete []_node_pool;
-
-        _pool_max = DEFAULT_POOL;
-        _node_pool = new struct node[DEFAULT_POOL];
+        _search_gen = 1;
+        memset( _node_gen,0,sizeof(uint32)*_set_max );
     }
 
-    // 清空寻路缓存
     _pool_idx = 0;
+    _base_x = x0;
+    _base_y = y0;
+    _width  = width;
+    _height = height;
     _path.clear();
     _open_set.clear();
-    memset( _node_set,0,sizeof(struct node *)*width*height );
-
-    return do_search( map,x,y,dx,dy );
 }
 
 // a*算法逻辑
@@ -101,7 +122,7 @@ bool a_star::do_search(
 
     uint16 height = map->get_height();
     struct node *parent = new_node(x,y);
-    _node_set[x *height + y] = parent;
+    set_node(x *height + y,parent);
     while ( parent )
     {
         uint16 px = parent->x;
@@ -127,12 +148,6 @@ bool a_star::do_search(
             // 不可行走的格子，忽略
             if ( map->get_pass_cost(cx,cy) < 0 ) continue;
 
-            int32 idx = cx * height + cy;
-            struct node *child = _node_set[idx];
-
-            // 已经close的格子，忽略
-            if ( child && child->mask ) continue;
-
             /* 计算起点到当前点的消耗
              * 前4个方向(北-东-南-西)都是直走，假设边长为10，那边沿对角走则为14
              * 复杂的游戏，可能每个格子的速度不一样(即get_pass_cost值不一样)，有的
@@ -141,63 +156,578 @@ bool a_star::do_search(
             int32 g = parent->g + (dir < 4 ? D : DD);
             int32 h = diagonal( cx,cy,dx,dy );
 
-            if ( child )
+            open_node( parent,cx,cy,g,h,height );
+        }
+
+        parent = pop_open_set(); // 从open_set取出最优格子
+    }
+
+    return false;
+}
+
+// 把格子加入open set，已在open set中的则判断是否有更优路径
+void a_star::open_node(const struct node *parent,
+    int32 cx,int32 cy,int32 g,int32 h,uint16 height)
+{
+    int32 idx = (cx - _base_x) * height + (cy - _base_y);
+    struct node *child = get_node(idx);
+
+    // 已经close的格子，忽略
+    if ( child && child->mask ) return;
+
+    if ( child )
+    {
+        // 发现更优路径，更新路径并调整在open set中的位置
+        if ( g + h < child->g + child->h )
+        {
+            child->g = g;
+            child->h = h;
+            child->px = parent->x;
+            child->py = parent->y;
+            shift_up(child->open_idx);
+        }
+    }
+    else
+    {
+        child = new_node(cx,cy,parent->x,parent->y);
+
+        child->g = g;
+        child->h = h;
+        set_node(idx,child);
+        push_open_set(child); // 加入到open set
+    }
+}
+
+#define IS_PASS(x,y) (map->get_pass_cost(x,y) >= 0)
+
+/* jump point search，使用预先计算的跳跃距离(jps+)
+ * http://users.cecs.anu.edu.au/~dharabor/data/papers/harabor-grastien-aaai11.pdf
+ * 和do_search一样允许沿对角行走，并且不要求相邻的两个格子可行走，因此强制邻居的
+ * 判断和论文中的略有不同。open set中只有跳点，跳点之间的格子在回溯路径时补上
+ * 不预先计算的话，空旷的地图上每次对角跳跃都要直线扫描到地图边缘，比a*还慢
+ */
+bool a_star::do_jps_search(
+    const grid_map *map,int32 x,int32 y,int32 dx,int32 dy)
+{
+    // 地图修改过还没重新计算跳跃距离，用普通a*，结果是一样的
+    const int16 *jump_dist = map->get_jump_dist();
+    if ( !jump_dist ) return do_search( map,x,y,dx,dy );
+
+    int32 dirs[8][2];
+    uint16 height = map->get_height();
+
+    struct node *parent = new_node(x,y,x,y);
+    set_node(x *height + y,parent);
+    while ( parent )
+    {
+        uint16 px = parent->x;
+        uint16 py = parent->y;
+        // 到达目标
+        if ( px == dx && py == dy )
+        {
+            return backtrace_path( parent,x,y,height );
+        }
+
+        parent->mask = 1; // 标识为close
+
+        bool is_start = (px == x && py == y);
+        int32 dir_cnt = jps_neighbours( map,parent,is_start,dirs );
+        for ( int32 dir = 0;dir < dir_cnt;dir ++ )
+        {
+            int32 cx = px;
+            int32 cy = py;
+            if ( !jump(map,jump_dist,cx,cy,dirs[dir][0],dirs[dir][1],dx,dy) )
             {
-                // 发现更优路径，更新路径
-                if ( g + h < child->g + child->h )
-                {
-                    child->g = g;
-                    child->h = h;
-                    child->px = px;
-                    child->py = py;
-                }
+                continue;
             }
-            else
+
+            // 跳点和父格子在同一条直线或者对角线上，对角距离即为实际距离
+            int32 g = parent->g + diagonal( px,py,cx,cy );
+            int32 h = diagonal( cx,cy,dx,dy );
+
+            open_node( parent,cx,cy,g,h,height );
+        }
+
+        parent = pop_open_set(); // 从open_set取出最优格子
+    }
+
+    return false;
+}
+
+// 跳点需要展开的方向(自然邻居和强制邻居)，返回方向数量
+int32 a_star::jps_neighbours(const grid_map *map,
+    const struct node *nd,bool is_start,int32 dirs[][2])
+{
+    int32 cnt = 0;
+    int32 x = nd->x;
+    int32 y = nd->y;
+
+#define ADD_DIR(dir_x,dir_y) \
+    do{ \
+        if ( IS_PASS(x + (dir_x),y + (dir_y)) ) \
+        { \
+            dirs[cnt][0] = dir_x;dirs[cnt][1] = dir_y;cnt ++; \
+        } \
+    }while(0)
+
+    // 起点没有父格子，8个方向都要展开
+    if ( is_start )
+    {
+        for ( int32 dir_x = -1;dir_x <= 1;dir_x ++ )
+        {
+            for ( int32 dir_y = -1;dir_y <= 1;dir_y ++ )
             {
-                child = new_node(cx,cy,px,py);
-                if ( expect_false(!child) ) return false;
+                if ( dir_x || dir_y ) ADD_DIR(dir_x,dir_y);
+            }
+        }
+        return cnt;
+    }
+
+    // 从父格子过来的方向
+    int32 dir_x = x > nd->px ? 1 : (x < nd->px ? -1 : 0);
+    int32 dir_y = y > nd->py ? 1 : (y < nd->py ? -1 : 0);
+
+    if ( dir_x && dir_y )
+    {
+        ADD_DIR(0,dir_y);
+        ADD_DIR(dir_x,0);
+        ADD_DIR(dir_x,dir_y);
+
+        if ( !IS_PASS(x - dir_x,y) ) ADD_DIR(-dir_x,dir_y);
+        if ( !IS_PASS(x,y - dir_y) ) ADD_DIR(dir_x,-dir_y);
+    }
+    else if ( dir_x )
+    {
+        ADD_DIR(dir_x,0);
+
+        if ( !IS_PASS(x,y + 1) ) ADD_DIR(dir_x,1);
+        if ( !IS_PASS(x,y - 1) ) ADD_DIR(dir_x,-1);
+    }
+    else
+    {
+        ADD_DIR(0,dir_y);
+
+        if ( !IS_PASS(x + 1,y) ) ADD_DIR(1,dir_y);
+        if ( !IS_PASS(x - 1,y) ) ADD_DIR(-1,dir_y);
+    }
+
+#undef ADD_DIR
+
+    return cnt;
+}
+
+/* 从(x,y)沿(dir_x,dir_y)方向跳跃，找到下一个需要展开的格子返回true，坐标通过x,y返回
+ * 跳跃距离是预先计算好的(见grid_map::build_jump_dist)，这里只需要额外处理终点:
+ * 直线方向上终点在跳点之前则直接跳到终点；对角方向上先到达终点所在的行或列，则在
+ * 该格子停下，下次从该格子直线跳到终点
+ */
+bool a_star::jump(const grid_map *map,const int16 *jump_dist,int32 &x,int32 &y,
+    int32 dir_x,int32 dir_y,int32 dx,int32 dy)
+{
+    int32 height = map->get_height();
+    int32 dist = jump_dist[(x*height + y)*8 + grid_map::dir_index(dir_x,dir_y)];
+    int32 pass = dist > 0 ? dist : -dist; // 该方向上可以走的格子数
+
+    // 终点在该方向上的距离
+    int32 goal_x = (dx - x)*dir_x;
+    int32 goal_y = (dy - y)*dir_y;
+
+    int32 step = 0;
+    if ( !dir_x || !dir_y )
+    {
+        bool on_line = dir_x ? dy == y : dx == x;
+        int32 goal = dir_x ? goal_x : goal_y;
+        if ( on_line && goal > 0 && goal <= pass )
+        {
+            step = goal;
+        }
+    }
+    else if ( goal_x > 0 && goal_y > 0 )
+    {
+        int32 goal = goal_x < goal_y ? goal_x : goal_y;
+        if ( goal <= pass ) step = goal;
+    }
+
+    if ( 0 == step )
+    {
+        if ( dist <= 0 ) return false;
+
+        step = dist;
+    }
+    else if ( dist > 0 && dist < step )
+    {
+        step = dist; // 跳点在终点(或终点所在行列)之前
+    }
+
+    x += dir_x * step;
+    y += dir_y * step;
+
+    return true;
+}
+
+#undef IS_PASS
+
+/* 在矩形范围内从(x,y)开始做dijkstra，不出范围，用于hpa*的簇内寻路
+ * 范围内可达的格子都会close，之后用get_dist、get_steps取距离和路径
+ */
+bool a_star::search_rect( const grid_map *map,
+    int32 x,int32 y,int32 x0,int32 y0,int32 x1,int32 y1 )
+{
+    if ( map->get_pass_cost(x,y) < 0 ) return false;
+
+    // 格子集合只需要覆盖矩形范围
+    prepare( x0,y0,x1 - x0 + 1,y1 - y0 + 1 );
+
+    // 起点的父格子为自己，get_steps回溯时用来判断是否到达起点
+    struct node *parent = new_node(x,y,x,y);
+    set_node(node_idx(x,y),parent);
+    while ( parent )
+    {
+        parent->mask = 1; // 标识为close
+
+        for ( int32 dir = 0;dir < 8;dir ++ )
+        {
+            int32 ox = grid_map::dir_offset[dir][0];
+            int32 oy = grid_map::dir_offset[dir][1];
+            int32 cx = parent->x + ox;
+            int32 cy = parent->y + oy;
+
+            if ( cx < x0 || cx > x1 || cy < y0 || cy > y1 ) continue;
+            if ( map->get_pass_cost(cx,cy) < 0 ) continue;
+
+            open_node( parent,cx,cy,parent->g + move_cost(ox,oy),0,_height );
+        }
+
+        parent = pop_open_set();
+    }
 
-                child->g = g;
-                child->h = h;
-                _node_set[idx] = child;
-                _open_set.push_back(child); // 加入到open set
+    return true;
+}
+
+// search_rect之后，起点到(x,y)的距离，不可达返回-1
+int32 a_star::get_dist( int32 x,int32 y ) const
+{
+    if ( !in_range(x,y) ) return -1;
+
+    const struct node *nd = get_node(node_idx(x,y));
+
+    return (nd && nd->mask) ? nd->g : -1;
+}
+
+// search_rect之后，起点到(x,y)的路径，每一步为一个方向
+bool a_star::get_steps( int32 x,int32 y,std::vector<uint8> &steps ) const
+{
+    steps.clear();
+    if ( !in_range(x,y) ) return false;
+
+    const struct node *nd = get_node(node_idx(x,y));
+    if ( !nd || !nd->mask ) return false;
+
+    while ( nd->x != nd->px || nd->y != nd->py )
+    {
+        steps.push_back(
+            (uint8)grid_map::dir_index(nd->x - nd->px,nd->y - nd->py) );
+        nd = get_node(node_idx(nd->px,nd->py));
+    }
+    std::reverse( steps.begin(),steps.end() );
+
+    return true;
+}
+
+/* 分层寻路(hpa*)
+ * 1. 起点、终点在同一个簇内，直接在簇内寻路，找不到的(需要绕出簇)再走抽象图
+ * 2. 起点、终点分别在所在簇内寻路，连接到簇的抽象节点
+ * 3. 在抽象图上做a*，格子对象、open set和普通a*共用，格子只有抽象节点和终点
+ * 4. 抽象路径上相邻两个节点之间用缓存的簇内路径细化
+ */
+bool a_star::do_hpa_search(
+    const grid_map *map,int32 x,int32 y,int32 dx,int32 dy)
+{
+    // 没有构建抽象图或者地图修改过还没重新构建，用普通a*
+    const hpa_graph *hpa = map->get_hpa();
+    if ( !hpa ) return do_search( map,x,y,dx,dy );
+
+    if ( hpa->is_same_cluster(x,y,dx,dy) )
+    {
+        int32 x0,y0,x1,y1;
+        hpa->get_cluster_rect( x,y,x0,y0,x1,y1 );
+
+        search_rect( map,x,y,x0,y0,x1,y1 );
+        const struct node *dest = get_node(node_idx(dx,dy));
+        if ( dest && dest->mask ) return backtrace_path( dest,x,y,_height );
+    }
+
+    if ( !hpa_connect(map,hpa,x,y,_start_link)
+        || !hpa_connect(map,hpa,dx,dy,_dest_link) )
+    {
+        return false;
+    }
+
+    prepare( 0,0,map->get_width(),map->get_height() );
+
+    int32 start_idx = x *_height + y;
+    int32 dest_idx = dx *_height + dy;
+
+    struct node *parent = new_node(x,y,x,y);
+    set_node(start_idx,parent);
+    while ( parent )
+    {
+        int32 idx = parent->x *_height + parent->y;
+        // 到达目标
+        if ( idx == dest_idx ) return hpa_path( map,hpa,parent,x,y,dx,dy );
+
+        parent->mask = 1; // 标识为close
+
+        // 起点连接到所在簇的抽象节点
+        if ( idx == start_idx )
+        {
+            std::vector<struct hpa_link>::const_iterator iter =
+                _start_link.begin();
+            for ( ;iter != _start_link.end();iter ++ )
+            {
+                if ( start_idx == iter->idx ) continue;
+
+                int32 cx = iter->idx / _height;
+                int32 cy = iter->idx % _height;
+                open_node( parent,cx,cy,
+                    iter->cost,diagonal(cx,cy,dx,dy),_height );
             }
         }
 
+        // 抽象图上的边，起点本身也可能是抽象节点
+        const struct hpa_graph::node *hnd = hpa->get_node(idx);
+        if ( hnd )
+        {
+            std::vector<struct hpa_graph::edge>::const_iterator iter =
+                hnd->edges.begin();
+            for ( ;iter != hnd->edges.end();iter ++ )
+            {
+                int32 cx = iter->to / _height;
+                int32 cy = iter->to % _height;
+                open_node( parent,cx,cy,
+                    parent->g + iter->cost,diagonal(cx,cy,dx,dy),_height );
+            }
+        }
+
+        // 终点所在簇的抽象节点连接到终点
+        const struct hpa_link *link = find_link(_dest_link,idx);
+        if ( link ) open_node( parent,dx,dy,parent->g + link->cost,0,_height );
+
         parent = pop_open_set(); // 从open_set取出最优格子
     }
 
     return false;
 }
 
-/* 查找open set里最优的点
- * 有些项目使用priority_queue来做的，但我觉得用vector反而更快些，毕竟在更新
- * 路径时不需要维护，删除时，把最后一个元素调到当前点即可
+// 在(x,y)所在的簇内寻路，连接到簇的抽象节点
+bool a_star::hpa_connect( const grid_map *map,const hpa_graph *hpa,
+    int32 x,int32 y,std::vector<struct hpa_link> &links )
+{
+    links.clear();
+
+    int32 x0,y0,x1,y1;
+    hpa->get_cluster_rect( x,y,x0,y0,x1,y1 );
+    search_rect( map,x,y,x0,y0,x1,y1 );
+
+    // 抽象节点是按整个地图排列的下标，search_rect之后_height只是簇的高度
+    int32 height = map->get_height();
+    const std::vector<int32> &nodes = hpa->get_cluster_node(x,y);
+    std::vector<int32>::const_iterator iter = nodes.begin();
+    for ( ;iter != nodes.end();iter ++ )
+    {
+        int32 nx = *iter / height;
+        int32 ny = *iter % height;
+
+        int32 dist = get_dist( nx,ny );
+        if ( dist < 0 ) continue;
+
+        links.push_back( hpa_link() );
+        struct hpa_link &link = links.back();
+        link.idx = *iter;
+        link.cost = dist;
+        get_steps( nx,ny,link.steps );
+    }
+
+    return !links.empty();
+}
+
+const struct a_star::hpa_link *a_star::find_link(
+    const std::vector<struct hpa_link> &links,int32 idx ) const
+{
+    std::vector<struct hpa_link>::const_iterator iter = links.begin();
+    for ( ;iter != links.end();iter ++ )
+    {
+        if ( idx == iter->idx ) return &(*iter);
+    }
+
+    return NULL;
+}
+
+#define PUSH_STEP(dir) \
+    do{ \
+        cx += grid_map::dir_offset[dir][0]; \
+        cy += grid_map::dir_offset[dir][1]; \
+        _path.push_back( cx ); \
+        _path.push_back( cy ); \
+    }while(0)
+
+/* 把抽象路径细化为格子路径
+ * 抽象路径上相邻的两个节点，要么是起点(终点)的连接，要么是抽象图上的边
+ */
+bool a_star::hpa_path( const grid_map *map,const hpa_graph *hpa,
+    const struct node *dest,int32 x,int32 y,int32 dx,int32 dy )
+{
+    int32 start_idx = x *_height + y;
+    int32 dest_idx = dx *_height + dy;
+
+    // 回溯抽象路径，_hpa_chain里是反向的
+    _hpa_chain.clear();
+    while ( dest )
+    {
+        _hpa_chain.push_back( dest->x *_height + dest->y );
+        if ( dest->x == x && dest->y == y ) break;
+
+        dest = get_node(dest->px *_height + dest->py);
+    }
+    if ( !dest ) return false;
+
+    // 先按正向生成路径
+    int32 cx = x;
+    int32 cy = y;
+    _path.push_back( cx );
+    _path.push_back( cy );
+    for ( size_t idx = _hpa_chain.size() - 1;idx > 0;idx -- )
+    {
+        int32 from = _hpa_chain[idx];
+        int32 to = _hpa_chain[idx - 1];
+
+        const struct hpa_link *link = NULL;
+        if ( from == start_idx && (link = find_link(_start_link,to)) )
+        {
+            std::vector<uint8>::const_iterator iter = link->steps.begin();
+            for ( ;iter != link->steps.end();iter ++ ) PUSH_STEP(*iter);
+            continue;
+        }
+
+        // 终点的连接是从终点到抽象节点的，要反过来走
+        if ( to == dest_idx && (link = find_link(_dest_link,from)) )
+        {
+            std::vector<uint8>::const_reverse_iterator iter =
+                link->steps.rbegin();
+            for ( ;iter != link->steps.rend();iter ++ )
+            {
+                const int32 *offset = grid_map::dir_offset[*iter];
+                PUSH_STEP( grid_map::dir_index(-offset[0],-offset[1]) );
+            }
+            continue;
+        }
+
+        const struct hpa_graph::edge *edge = hpa->get_edge(from,to);
+        if ( expect_false(!edge) )
+        {
+            ERROR( "hpa path edge not found:%d - %d",from,to );
+            _path.clear();
+            return false;
+        }
+
+        // 簇间的边，两个格子相邻
+        if ( edge->steps.empty() )
+        {
+            PUSH_STEP( grid_map::dir_index(
+                to / _height - from / _height,to % _height - from % _height) );
+            continue;
+        }
+
+        std::vector<uint8>::const_iterator iter = edge->steps.begin();
+        for ( ;iter != edge->steps.end();iter ++ ) PUSH_STEP(*iter);
+    }
+
+    // 和backtrace_path一样，路径是从终点到起点的
+    std::reverse( _path.begin(),_path.end() );
+    for ( size_t idx = 0;idx < _path.size();idx += 2 )
+    {
+        std::swap( _path[idx],_path[idx + 1] );
+    }
+
+    return true;
+}
+
+#undef PUSH_STEP
+
+// 加入到open set
+void a_star::push_open_set(struct node *nd)
+{
+    nd->open_idx = (uint32)_open_set.size();
+    _open_set.push_back(nd);
+
+    shift_up(nd->open_idx);
+}
+
+/* 取出open set里最优的点
+ * 原来是遍历整个vector，open set大的时候(长路径)太慢，现在用二叉堆，堆顶即为最优
  */
 struct a_star::node *a_star::pop_open_set()
 {
     size_t open_sz = _open_set.size();
     if ( 0 == open_sz ) return NULL;
 
-    int32 parent_f = -1;
-    size_t parent_idx = -1;
-    struct node *parent = NULL;
-    for ( size_t idx = 0;idx < open_sz;idx ++ )
+    struct node *parent = _open_set[0];
+
+    // 把最后一个元素移动到堆顶再往下调整
+    _open_set[0] = _open_set.back();
+    _open_set[0]->open_idx = 0;
+    _open_set.pop_back();
+    if ( open_sz > 1 ) shift_down(0);
+
+    return parent;
+}
+
+// 往堆顶调整
+void a_star::shift_up(size_t idx)
+{
+    struct node *nd = _open_set[idx];
+    while ( idx > 0 )
+    {
+        size_t parent_idx = (idx - 1) >> 1;
+        struct node *parent = _open_set[parent_idx];
+        if ( !is_better(nd,parent) ) break;
+
+        _open_set[idx] = parent;
+        parent->open_idx = (uint32)idx;
+        idx = parent_idx;
+    }
+
+    _open_set[idx] = nd;
+    nd->open_idx = (uint32)idx;
+}
+
+// 往堆底调整
+void a_star::shift_down(size_t idx)
+{
+    size_t open_sz = _open_set.size();
+    struct node *nd = _open_set[idx];
+    while ( true )
     {
-        struct node *nd = _open_set[idx];
-        if (!parent || parent_f > nd->g + nd->h )
+        size_t child_idx = (idx << 1) + 1;
+        if ( child_idx >= open_sz ) break;
+
+        // 取两个子节点中较优的
+        if ( child_idx + 1 < open_sz
+            && is_better(_open_set[child_idx + 1],_open_set[child_idx]) )
         {
-            parent = nd;
-            parent_idx = idx;
-            parent_f = nd->g + nd->h;
+            child_idx ++;
         }
-    }
 
-    // 不用移动整个数组，直接把最后一个元素移动到当前元素即可
-    _open_set[parent_idx] = _open_set.back();
-    _open_set.pop_back();
+        struct node *child = _open_set[child_idx];
+        if ( !is_better(child,nd) ) break;
 
-    return parent;
+        _open_set[idx] = child;
+        child->open_idx = (uint32)idx;
+        idx = child_idx;
+    }
+
+    _open_set[idx] = nd;
+    nd->open_idx = (uint32)idx;
 }
 
 // 从终点回溯到起点并得到路径
@@ -218,7 +748,23 @@ bool a_star::backtrace_path(
         // 注意由于坐标用的是uint16类型，起点父坐标为(0,0)有可能与真实坐标冲突
         if (x == dx && y == dy) return true;
 
-        dest = _node_set[dest->px * height + dest->py];
+        // jps的父格子是上一个跳点，不一定相邻，中间的格子在同一直线或对角线上，补上
+        int32 px = dest->px;
+        int32 py = dest->py;
+        int32 dir_x = px > x ? 1 : (px < x ? -1 : 0);
+        int32 dir_y = py > y ? 1 : (py < y ? -1 : 0);
+        int32 cx = x + dir_x;
+        int32 cy = y + dir_y;
+        while ( (cx != px || cy != py) && _path.size() < 1024000 )
+        {
+            _path.push_back( cx );
+            _path.push_back( cy );
+
+            cx += dir_x;
+            cy += dir_y;
+        }
+
+        dest = get_node((px - _base_x) * height + (py - _base_y));
     }
 
     return false;
@@ -227,10 +773,13 @@ bool a_star::backtrace_path(
 // 从内存池取一个格子对象
 struct a_star::node *a_star::new_node(uint16 x,uint16 y,uint16 px,uint16 py)
 {
-    // 如果预分配的都用完了，就不找了
-    // 继续再找对于服务器而言也太低效，建议上导航坐标或者针对玩法优化
-    if ( _pool_idx >= _pool_max ) return NULL;
-    struct node *nd = _node_pool + _pool_idx;
+    // 当前的块用完了，再分配一块。每个格子最多只有一个对象，不会无限增长
+    size_t chunk = _pool_idx / DEFAULT_POOL;
+    if ( expect_false(chunk >= _node_pool.size()) )
+    {
+        _node_pool.push_back( new struct node[DEFAULT_POOL] );
+    }
+    struct node *nd = _node_pool[chunk] + _pool_idx % DEFAULT_POOL;
 
     _pool_idx ++;
 
@@ -242,6 +791,7 @@ struct a_star::node *a_star::new_node(uint16 x,uint16 y,uint16 px,uint16 py)
     nd->g = 0;
     nd->h = 0;
     nd->mask = 0;
+    nd->open_idx = 0;
 
     return nd;
 }
@@ -11,6 +11,7 @@
 #include "../global/global.h"
 
 class grid_map;
+class hpa_graph;
 class a_star
 {
 public:
@@ -20,11 +21,28 @@ public:
         uint8 mask; // 是否close
         int32 g; // a*算法中f = g + h中的g，代表从起始位置到该格子的开销
         int32 h; // a*算法中f = g + h中的h，代表该格子到目标节点预估的开销
+        uint32 open_idx; // 在open set(二叉堆)中的下标
         uint16 x; // 该格子的x坐标
         uint16 y; // 该格子的y坐标
         uint16 px; // 该格子的父格子x坐标
         uint16 py; // 该格子的父格子y坐标
     };
+
+    // 寻路方式
+    enum search_mode
+    {
+        SM_ASTAR = 0, // 普通a*
+        /* jump point search，只展开跳点，适用于格子只区分可行走、不可行走的地图
+         * 目前的a*也不区分格子消耗，两者得到的路径长度是一样的
+         */
+        SM_JPS   = 1,
+        /* 分层寻路(hpa*)，在地图的抽象图上寻路后再细化，适用于有大块障碍的大地图
+         * 远距离寻路。得到的路径接近最短路径，但不保证最短。空旷的地图上不如a*
+         */
+        SM_HPA   = 2,
+
+        SM_MAX
+    };
 public:
     a_star();
     ~a_star();
@@ -32,16 +50,87 @@ public:
      * @map：对应地图的地形数据
      * @x,y：起点坐标
      * @dx,dy：dest，终点坐标
+     * @mode：寻路方式，见search_mode
      */
-    bool search( const grid_map *map,int32 x,int32 y,int32 dx,int32 dy);
+    bool search( const grid_map *map,
+        int32 x,int32 y,int32 dx,int32 dy,int32 mode = SM_ASTAR );
     // 获取路径
     const std::vector<uint16> &get_path() const { return _path; }
+
+    /* 在矩形范围内从(x,y)开始做dijkstra，不出范围，用于hpa*的簇内寻路
+     * 之后用get_dist、get_steps取范围内各个格子的距离和路径，直到下一次寻路
+     */
+    bool search_rect( const grid_map *map,
+        int32 x,int32 y,int32 x0,int32 y0,int32 x1,int32 y1 );
+    // search_rect之后，起点到(x,y)的距离，不可达返回-1
+    int32 get_dist( int32 x,int32 y ) const;
+    // search_rect之后，起点到(x,y)的路径，每一步为一个方向(见grid_map::dir_offset)
+    bool get_steps( int32 x,int32 y,std::vector<uint8> &steps ) const;
+
+    // 往某个方向走一格的消耗，同a_star.cpp中的D、DD
+    static inline int32 move_cost(int32 ox,int32 oy)
+    {
+        return (ox && oy) ? 14 : 10;
+    }
 private:
+    // 分配格子集合并清空寻路缓存
+    void prepare( int32 x0,int32 y0,int32 width,int32 height );
+    /* open set用二叉堆(最小堆)，f值最小的格子在堆顶 */
     struct node *pop_open_set();
+    void push_open_set(struct node *nd);
+    void shift_up(size_t idx); // 格子f值变小(发现更优路径)后往堆顶调整
+    void shift_down(size_t idx);
+    // 格子a是否比b更优
+    inline bool is_better(const struct node *a,const struct node *b) const
+    {
+        int32 fa = a->g + a->h;
+        int32 fb = b->g + b->h;
+        // f相同时优先离终点更近的，能少搜索一些格子
+        return fa < fb || (fa == fb && a->h < b->h);
+    }
+
+    // 取本次寻路中访问过的格子，之前寻路留下的视为没访问过
+    inline struct node *get_node(int32 idx) const
+    {
+        return _search_gen == _node_gen[idx] ? _node_set[idx] : NULL;
+    }
+    inline void set_node(int32 idx,struct node *nd)
+    {
+        _node_set[idx] = nd;
+        _node_gen[idx] = _search_gen;
+    }
+    // 格子在格子集合中的下标，集合只覆盖寻路范围
+    inline int32 node_idx(int32 x,int32 y) const
+    {
+        return (x - _base_x)*_height + (y - _base_y);
+    }
+    inline bool in_range(int32 x,int32 y) const
+    {
+        return x >= _base_x && x < _base_x + _width
+            && y >= _base_y && y < _base_y + _height;
+    }
+
     bool backtrace_path(
         const struct node *dest,int32 dx,int32 dy,uint16 height );
     bool do_search(
         const grid_map *map,int32 x,int32 y,int32 dx,int32 dy);
+    bool do_jps_search(
+        const grid_map *map,int32 x,int32 y,int32 dx,int32 dy);
+    bool do_hpa_search(
+        const grid_map *map,int32 x,int32 y,int32 dx,int32 dy);
+    // 把格子加入open set，已在open set中的则判断是否有更优路径
+    void open_node(const struct node *parent,
+        int32 cx,int32 cy,int32 g,int32 h,uint16 height);
+
+    /* 从(x,y)沿(dir_x,dir_y)方向跳跃，找到下一个需要展开的格子返回true
+     * @jump_dist：地图预先计算的跳跃距离
+     * @dx,dy：终点坐标
+     */
+    bool jump(const grid_map *map,const int16 *jump_dist,int32 &x,int32 &y,
+        int32 dir_x,int32 dir_y,int32 dx,int32 dy);
+    // 跳点需要展开的方向，返回方向数量
+    int32 jps_neighbours(const grid_map *map,
+        const struct node *nd,bool is_start,int32 dirs[][2]);
     struct node *new_node(uint16 x,uint16 y,uint16 px = 0,uint16 py = 0);
 
     /* 启发函数的选择，下面的连接说明各个算法的适用场景及效率
@@ -72,13 +161,41 @@ private:
     int32 euclidean(int32 x,int32 y,int32 gx,int32 gy);
 private:
     struct node **_node_set; // 记录当前寻路格子集合
-    struct node *_node_pool; // 格子对象内存池
+    /* 格子在第几次寻路时访问过，和_search_gen不一样的格子即为没访问过
+     * 这样每次寻路不用清空整个_node_set
+     */
+    uint32 *_node_gen;
+    uint32 _search_gen; // 当前寻路的序号
+
+    /* 格子对象内存池，按块分配，用完了再分配一块。块不会移动，因此格子指针一直有效 */
+    std::vector<struct node*> _node_pool;
     std::vector<uint16> _path; // 生成的路径，反向并且每两个元素表示一个格子
     std::vector<struct node*> _open_set; // 记录算法运行过程中待处理的格子
 
     int32 _set_max;  // 当前集合大小
-    int32 _pool_max; // 内存池格子数量
     int32 _pool_idx; // 内存池当前已用数量
+    uint16 _base_x;  // 当前寻路范围的左上角x，整个地图寻路时为0
+    uint16 _base_y;  // 当前寻路范围的左上角y
+    uint16 _width;   // 当前寻路范围的宽度
+    uint16 _height;  // 当前寻路范围的高度
+
+    /* hpa*寻路时起点、终点和所在簇抽象节点的连接 */
+    struct hpa_link
+    {
+        int32 idx; // 抽象节点的格子下标
+        int32 cost;
+        std::vector<uint8> steps; // 从起点(终点)到抽象节点的路径
+    };
+    bool hpa_connect( const grid_map *map,const hpa_graph *hpa,
+        int32 x,int32 y,std::vector<struct hpa_link> &links );
+    const struct hpa_link *find_link(
+        const std::vector<struct hpa_link> &links,int32 idx ) const;
+    bool hpa_path( const grid_map *map,const hpa_graph *hpa,
+        const struct node *dest,int32 x,int32 y,int32 dx,int32 dy );
+
+    std::vector<struct hpa_link> _start_link;
+    std::vector<struct hpa_link> _dest_link;
+    std::vector<int32> _hpa_chain; // 抽象路径上的格子
 };
 
 #endif /* __A_STAR_H__ */
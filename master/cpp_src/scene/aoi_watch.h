@@ -0,0 +1,80 @@
+/* AOI中实体之间的关注关系
+ * 1. 关系是双向记录的：target的_watch_me中记录watcher，watcher的_watching中记录
+ *    target，两边都记录了这条关系在对方列表中的下标
+ * 2. 删除关系时用最后一个元素替换，并修正被移动的关系在对方列表中的下标，不需要遍历
+ * 3. 不同的AOI算法实体结构不一样，只要有_watch_me、_watching两个列表即可
+ */
+
+#ifndef __AOI_WATCH_H__
+#define __AOI_WATCH_H__
+
+#include <vector>
+#include "../global/global.h"
+
+// 一条关注关系，_rev为这条关系在对方列表中的下标
+template< class CTX >
+struct aoi_link
+{
+    CTX *_ctx;
+    uint32 _rev;
+};
+
+// watcher关注target，即把watcher加到target的_watch_me
+template< class CTX >
+void aoi_add_watch(CTX *watcher,CTX *target)
+{
+    struct aoi_link< CTX > link;
+
+    link._ctx = watcher;
+    link._rev = (uint32)watcher->_watching.size();
+    target->_watch_me.push_back(link);
+
+    link._ctx = target;
+    link._rev = (uint32)target->_watch_me.size() - 1;
+    watcher->_watching.push_back(link);
+}
+
+// 删除target的_watch_me中下标为idx的关系，同时删除watcher中对应的关系
+template< class CTX >
+void aoi_del_watch(CTX *target,uint32 idx)
+{
+    std::vector< struct aoi_link< CTX > > &watch_me = target->_watch_me;
+    CTX *watcher = watch_me[idx]._ctx;
+    uint32 rev = watch_me[idx]._rev;
+
+    watch_me[idx] = watch_me.back();
+    watch_me.pop_back();
+    if (idx < watch_me.size())
+    {
+        const struct aoi_link< CTX > &moved = watch_me[idx];
+        moved._ctx->_watching[moved._rev]._rev = idx;
+    }
+
+    std::vector< struct aoi_link< CTX > > &watching = watcher->_watching;
+    watching[rev] = watching.back();
+    watching.pop_back();
+    if (rev < watching.size())
+    {
+        const struct aoi_link< CTX > &moved = watching[rev];
+        moved._ctx->_watch_me[moved._rev]._rev = rev;
+    }
+}
+
+// 删除实体所有的关注关系，list返回关注该实体的实体
+template< class CTX >
+void aoi_del_all_watch(CTX *ctx,std::vector< CTX* > *list)
+{
+    while (!ctx->_watch_me.empty())
+    {
+        if (list) list->push_back(ctx->_watch_me.back()._ctx);
+        aoi_del_watch(ctx,(uint32)ctx->_watch_me.size() - 1);
+    }
+
+    while (!ctx->_watching.empty())
+    {
+        const struct aoi_link< CTX > &link = ctx->_watching.back();
+        aoi_del_watch(link._ctx,link._rev);
+    }
+}
+
+#endif /* __AOI_WATCH_H__ */
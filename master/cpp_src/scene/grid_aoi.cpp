@@ -2,9 +2,8 @@
 #include "scene_include.h"
 #include "../system/static_global.h"
 
-// 暂定格子数最大为256，一个格子坐标x占高8位，y占低8位构成一个索引
-#define INDEX_BIT 8
-#define MAKE_INDEX(x,y) ((int32)x << INDEX_BIT) + y
+// 格子数最大和地图一样为MAX_MAP_GRID(4096)，格子坐标用uint16存放
+#define INDEX_BIT 12
 
 object_pool< grid_aoi::entity_ctx > grid_aoi::_ctx_pool(10240,1024);
 object_pool< grid_aoi::entity_vector_t > grid_aoi::_vector_pool(10240,1024);
@@ -17,6 +16,8 @@ grid_aoi::grid_aoi()
     _visual_width = 0; // 视野宽度格子数
     _visual_height = 0; // 视野高度格子数
 
+    _entity_grid.resize(1,NULL);
+
     C_OBJECT_ADD("grid_aoi");
 }
 
@@ -25,8 +26,11 @@ grid_aoi::~grid_aoi()
     entity_set_t::iterator iter = _entity_set.begin();
     for (;iter != _entity_set.end();iter ++) del_entity_ctx(iter->second);
 
-    map_t< uint32,entity_vector_t* >::iterator viter = _entity_grid.begin();
-    for (;viter != _entity_grid.end();viter ++) del_entity_vector(viter->second);
+    std::vector< entity_vector_t* >::iterator viter = _entity_grid.begin();
+    for (;viter != _entity_grid.end();viter ++)
+    {
+        if (*viter) del_entity_vector(*viter);
+    }
 
     _entity_set.clear();
     _entity_grid.clear();
@@ -50,16 +54,17 @@ grid_aoi::entity_vector_t *grid_aoi::new_entity_vector()
 
 void grid_aoi::del_entity_ctx(struct entity_ctx *ctx)
 {
-    del_entity_vector(ctx->_watch_me);
-
-    _ctx_pool.destroy(ctx);
+    // 列表太大的直接删除，不要占着内存在缓存里
+    _ctx_pool.destroy(ctx,
+        ctx->_watch_me.capacity() > 512 || ctx->_watching.capacity() > 512);
 }
 
 struct grid_aoi::entity_ctx *grid_aoi::new_entity_ctx()
 {
     struct entity_ctx *ctx = _ctx_pool.construct();
 
-    ctx->_watch_me = new_entity_vector();
+    ctx->_watch_me.clear();
+    ctx->_watching.clear();
 
     return ctx;
 }
@@ -76,17 +81,32 @@ void grid_aoi::set_visual_range(int32 width,int32 height)
 // @width,@height 像素
 int32 grid_aoi::set_size(int32 width,int32 height)
 {
-    _width = PIX_TO_GRID(width);
-    _height = PIX_TO_GRID(height);
+    // 先用int32判断，直接赋值给_width、_height超出范围会被截断
+    int32 grid_width = PIX_TO_GRID(width);
+    int32 grid_height = PIX_TO_GRID(height);
 
-    static const int max_grid = 0x01 << INDEX_BIT;
-    if (_width > max_grid || _height > max_grid)
+    static const int32 max_grid = 0x01 << INDEX_BIT;
+    if (grid_width < 0 || grid_height < 0
+        || grid_width > max_grid || grid_height > max_grid)
     {
         _width = 0;
         _height = 0;
         return -1;
     }
 
+    _width = grid_width;
+    _height = grid_height;
+
+    // 有实体时格子里存的是按旧宽高排列的数据，不能再修改
+    assert("aoi set size with entity",_entity_set.empty());
+
+    std::vector< entity_vector_t* >::iterator iter = _entity_grid.begin();
+    for (;iter != _entity_grid.end();iter ++)
+    {
+        if (*iter) del_entity_vector(*iter);
+    }
+    _entity_grid.assign((_width + 1)*(_height + 1),NULL);
+
     return 0;
 }
 
@@ -137,67 +157,39 @@ int32 grid_aoi::raw_get_entitys(
     return 0;
 }
 
-// 获取格子内的实体列表
-grid_aoi::entity_vector_t *grid_aoi::get_grid_entitys(int32 x,int32 y)
-{
-    int32 index = MAKE_INDEX(x,y);
-
-    map_t< uint32,entity_vector_t* >::iterator itr = _entity_grid.find(index);
-    if (itr == _entity_grid.end()) return NULL;
-
-    return itr->second;
-}
-
-bool grid_aoi::remove_entity_from_vector(
-    entity_vector_t *list,const struct entity_ctx *ctx)
-{
-    entity_vector_t::iterator iter = list->begin();
-    for (;iter != list->end();iter ++)
-    {
-        if (*iter == ctx)
-        {
-            // 用最后一个元素替换就好，不用移动其他元素
-            *iter = list->back();
-            list->pop_back();
-
-            return true;
-        }
-    }
-
-    return false;
-}
-
 // 删除格子内实体
 bool grid_aoi::remove_grid_entity(int32 x,int32 y,const struct entity_ctx *ctx)
 {
-    int32 index = MAKE_INDEX(x,y);
-    map_t< uint32,entity_vector_t* >::iterator iter = _entity_grid.find(index);
-    if (iter == _entity_grid.end() || !iter->second) return false;
+    entity_vector_t *&grid_list = _entity_grid[x*(_height + 1) + y];
+    if (!grid_list) return false;
+
+    uint32 idx = ctx->_grid_idx;
+    if (idx >= grid_list->size() || (*grid_list)[idx] != ctx) return false;
 
-    entity_vector_t *grid_list = iter->second;
-    bool isDel = remove_entity_from_vector(grid_list,ctx);
+    // 用最后一个元素替换就好，不用移动其他元素
+    struct entity_ctx *moved = grid_list->back();
+    (*grid_list)[idx] = moved;
+    moved->_grid_idx = idx;
+    grid_list->pop_back();
 
     // 这个格子不再有实体就清空
     if (grid_list->empty())
     {
         del_entity_vector(grid_list);
-        _entity_grid.erase(iter);
+        grid_list = NULL;
     }
 
-    return isDel;
+    return true;
 }
 
 // 插入实体到格子内
 void grid_aoi::insert_grid_entity(int32 x,int32 y,struct entity_ctx *ctx)
 {
-    int32 index = MAKE_INDEX(x,y);
-
-    // https://en.cppreference.com/w/cpp/language/value_initialization
-    // 没创建时，grid_list应该是NULL
-    entity_vector_t *&grid_list = _entity_grid[index];
-    // 注意上面用的是指针的引用
+    // 注意这里用的是指针的引用
+    entity_vector_t *&grid_list = _entity_grid[x*(_height + 1) + y];
     if (!grid_list) grid_list = new_entity_vector();
 
+    ctx->_grid_idx = (uint32)grid_list->size();
     grid_list->push_back(ctx);
 }
 
@@ -222,52 +214,46 @@ int32 grid_aoi::exit_entity(entity_id_t id,entity_vector_t *list)
     if (!ctx) return 2;
     bool isOk = remove_grid_entity(ctx->_pos_x,ctx->_pos_y,ctx);
 
-    // 是否需要返回关注自己离开场景的实体列表
-    entity_vector_t *watch_me= ctx->_watch_me;
-    if (list && watch_me && !watch_me->empty())
-    {
-        list->insert(list->end(),watch_me->begin(),watch_me->end());
-    }
-
-    // 从别人的watch_me列表删除
-    // 自己关注event才有可能出现在别人的watch列表中
-    if (ctx->_event)
-    {
-        int32 x = 0,y = 0,dx = 0,dy = 0;
-        get_visual_range(x,y,dx,dy,ctx->_pos_x,ctx->_pos_y);
-
-        // 把自己的列表清空，这样从自己列表中删除时就不用循环了
-        watch_me->clear();
-        entity_exit_range(ctx,x,y,dx,dy);
-    }
+    // 返回关注自己离开场景的实体列表，并从别人的watch_me列表删除自己
+    aoi_del_all_watch(ctx,list);
 
     del_entity_ctx(ctx);
 
     return isOk ? 0 : -1;
 }
 
-// 处理实体退出某个范围
+/* 删除不在某个矩形范围内的关注关系
+ * 只需要遍历实体自己的两个关注列表，不需要遍历格子，也不需要在别人的列表中查找
+ * @list:返回关注自己并且离开范围的实体
+ */
 void grid_aoi::entity_exit_range(struct entity_ctx *ctx,
     int32 x,int32 y,int32 dx,int32 dy,entity_vector_t *list)
 {
-     entity_vector_t *watch_list = new_entity_vector();
+#define IN_RANGE(other) \
+    (other->_pos_x >= x && other->_pos_x <= dx \
+        && other->_pos_y >= y && other->_pos_y <= dy)
 
-    raw_get_entitys(watch_list,x,y,dx,dy);
-    entity_vector_t::iterator iter = watch_list->begin();
-    for (;iter != watch_list->end();iter ++)
+    // 倒序遍历，删除时用来替换的最后一个元素已经检查过了
+    watch_vector_t &watch_me = ctx->_watch_me;
+    for (int32 idx = (int32)watch_me.size() - 1;idx >= 0;idx --)
     {
-        // 从别人的watch_me列表删除自己，并且从自己的watch_me列表中删除别人
-        struct entity_ctx *other = *iter;
-        // 自己关注event才有可能出现在别人的watch列表中
-        if (ctx->_event) remove_entity_from_vector(other->_watch_me,ctx);
-        if (other->_event)
-        {
-            remove_entity_from_vector(ctx->_watch_me,other);
-            if (list) list->push_back(other);
-        }
+        struct entity_ctx *other = watch_me[idx]._ctx;
+        if (IN_RANGE(other)) continue;
+
+        if (list) list->push_back(other);
+        aoi_del_watch(ctx,idx);
     }
 
-    del_entity_vector(watch_list);
+    watch_vector_t &watching = ctx->_watching;
+    for (int32 idx = (int32)watching.size() - 1;idx >= 0;idx --)
+    {
+        const watch_link &link = watching[idx];
+        if (IN_RANGE(link._ctx)) continue;
+
+        aoi_del_watch(link._ctx,link._rev);
+    }
+
+#undef IN_RANGE
 }
 
 // 处理实体进入场景
@@ -311,17 +297,16 @@ void grid_aoi::entity_enter_range(struct entity_ctx *ctx,
     entity_vector_t *watch_list = new_entity_vector();
     raw_get_entitys(watch_list,x,y,dx,dy);
 
-    entity_vector_t *watch_me = ctx->_watch_me;
     entity_vector_t::iterator iter = watch_list->begin();
     for (;iter != watch_list->end();iter ++)
     {
         struct entity_ctx *other = *iter;
         // 把自己加到别人的watch
-        if (ctx->_event) other->_watch_me->push_back(ctx);
+        if (ctx->_event) aoi_add_watch(ctx,other);
         // 把别人加到自己的watch
         if (other->_event)
         {
-            watch_me->push_back(other);
+            aoi_add_watch(other,ctx);
 
             // 返回需要触发aoi事件的实体
             if (list) list->push_back(other);
@@ -396,49 +381,20 @@ int32 grid_aoi::update_entity(entity_id_t id,
 
     // 由于事件列表不包含自己，退出格子后先取列表再进入新格子
 
+    // 不在新视野内的关注关系，直接从关注列表中删除，触发退出
+    entity_exit_range(ctx,new_x,new_y,new_dx,new_dy,list_out);
+
     // 交集区域内玩家，触发更新事件
-    // 旧视野区域，触发退出
     // 新视野区域，触发进入
     if (!intersection)
     {
-        ctx->_watch_me->clear(); // 把列表清空，退出时减少查找时间
-        entity_exit_range(ctx,old_x,old_y,old_dx,old_dy,list_out);
         entity_enter_range(ctx,new_x,new_y,new_dx,new_dy,list_in);
 
         goto INSETION;// 进入新格子
         return -1;
     }
 
-    raw_get_entitys(list,it_x,it_y,it_dx,it_dy);
-
-    for (int32 ix = old_x;ix <= old_dx;ix ++)
-    {
-        // 排除交集区域
-        // 因为视野这个矩形不可以旋转，所以交集区域总在矩形的4个角上
-        // 按x轴筛选，那y轴就有几种情况：1无效，2取上半段，3取下段
-        int32 iy = old_y;
-        int32 idy = old_dy;
-        if (ix >= it_x && ix <= it_dx)
-        {
-            if (old_dy > it_dy) // 下段
-            {
-                iy = it_dy + 1;
-                idy = old_dy;
-            }
-            else if (old_y < it_y) // 上段
-            {
-                iy = old_y;
-                idy = it_y - 1;
-            }
-            else
-            {
-                continue; // 无效
-            }
-        }
-
-        assert("rectangle difference fail",iy <= idy);
-        entity_exit_range(ctx,ix,iy,ix,idy,list_out);
-    }
+    if (list) raw_get_entitys(list,it_x,it_y,it_dx,it_dy);
 
     for (int32 ix = new_x;ix <= new_dx;ix ++)
     {
@@ -7,12 +7,15 @@
  * 4. 通过event来控制实体关注的事件。npc、怪物通常不关注任何事件，这样可以大幅提升
  *    效率，战斗ai另外做即可(攻击玩家在ai定时器定时取watch_me列表即可)。怪物攻击怪物或
  *    npc在玩家靠近时对话可以给这些实体加上事件，这样的实体不会太多
+ * 5. 格子用一个数组存放，实体记录自己在格子列表中的下标。watch_me关系是双向记录的
+ *    (见aoi_watch.h)，从格子或者watch_me列表删除都不需要遍历
  */
 
 #ifndef __GRID_AOI_H__
 #define __GRID_AOI_H__
 
 #include <vector>
+#include "aoi_watch.h"
 #include "../pool/object_pool.h"
 
 class grid_aoi
@@ -23,17 +26,23 @@ public:
     typedef int64 entity_id_t; // 用来标识实体的唯一id
     typedef std::vector< struct entity_ctx* > entity_vector_t; // 实体列表
 
+    typedef struct aoi_link< struct entity_ctx > watch_link; // 关注关系
+    typedef std::vector< watch_link > watch_vector_t;
+
     struct entity_ctx
     {
         uint8 _type; // 记录实体类型
         uint8 _event; // 关注的事件
-        uint8 _pos_x; // 格子坐标，x
-        uint8 _pos_y; // 格子坐标，y
+        uint16 _pos_x; // 格子坐标，x
+        uint16 _pos_y; // 格子坐标，y
+        uint32 _grid_idx; // 在所在格子实体列表中的下标
         entity_id_t _id;
         // 关注我的实体列表。比如我周围的玩家，需要看到我移动、放技能
         // 都需要频繁广播给他们。如果游戏并不是arpg，可能并不需要这个列表
         // 一般怪物、npc不要加入这个列表，如果有少部分npc需要aoi事件，另外定一个类型
-        entity_vector_t* _watch_me;
+        watch_vector_t _watch_me;
+        // 我关注的实体列表，即我在这些实体的_watch_me中，删除关系时用
+        watch_vector_t _watching;
     };
 
     typedef map_t< entity_id_t,struct entity_ctx* > entity_set_t;
@@ -66,9 +75,11 @@ protected:
     struct entity_ctx *new_entity_ctx();
     void del_entity_ctx(struct entity_ctx *ctx);
 private:
-    entity_vector_t *get_grid_entitys(int32 x,int32 y); // 获取格子内的实体列表
-    bool remove_entity_from_vector(
-        entity_vector_t *list,const struct entity_ctx *ctx);
+    // 获取格子内的实体列表
+    inline entity_vector_t *get_grid_entitys(int32 x,int32 y)
+    {
+        return _entity_grid[x*(_height + 1) + y];
+    }
     // 插入实体到格子内
     void insert_grid_entity(int32 x,int32 y,struct entity_ctx *ctx);
     // 删除格子内实体
@@ -82,21 +93,21 @@ private:
     // 处理实体进入某个范围
     void entity_enter_range(struct entity_ctx *ctx,
         int32 x,int32 y,int32 dx,int32 dy,entity_vector_t *list = NULL);
-    // 处理实体退出某个范围
+    // 删除不在某个范围内的关注关系
     void entity_exit_range(struct entity_ctx *ctx,
         int32 x,int32 y,int32 dx,int32 dy,entity_vector_t *list = NULL);
 protected:
-    uint8 _width; // 场景最大宽度(格子坐标)
-    uint8 _height; // 场景最大高度(格子坐标)
+    uint16 _width; // 场景最大宽度(格子坐标)
+    uint16 _height; // 场景最大高度(格子坐标)
 
     // 格子数指以实体为中心，不包含当前格子，上下或者左右的格子数
     uint8 _visual_width; // 视野宽度格子数
     uint8 _visual_height; // 视野高度格子数
 
-    /* 记录每个格子中的实体id列表
-     * 格子的x、y坐标为uint16，一起拼成一个uint32作为key
+    /* 记录每个格子中的实体列表，按x*(_height + 1) + y排列，同一列的格子是连续的
+     * 没有实体的格子为NULL
      */
-    map_t< uint32,entity_vector_t* > _entity_grid;
+    std::vector< entity_vector_t* > _entity_grid;
 
     /* 记录所有实体的数据 */
     entity_set_t _entity_set;
@@ -1,33 +1,152 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "grid_map.h"
+#include "hpa_graph.h"
 #include "../system/static_global.h"
 
+// 地图以左上角为坐标原点，分别向8个方向移动时的向量
+const int32 grid_map::dir_offset[8][2] =
+{
+    {0,-1},{1,0},{ 0,1},{-1, 0}, // 北-东-南-西
+    {1,-1},{1,1},{-1,1},{-1,-1}  // 东北-东南-西南-西北
+};
+
 grid_map::grid_map()
 {
     _id = 0;
     _width = 0;
     _height = 0;
     _grid_set = NULL;
+    _region_set = NULL;
+
+    _chunk = NULL;
+    _writable = NULL;
+    _chunk_cnt = 0;
+
+    _mmap = NULL;
+    _mmap_size = 0;
+
+    _jump_dist = NULL;
+    _jump_dirty = true;
+
+    _hpa = NULL;
+
+    _data_ver = 0;
+    _share_ver = 0;
+    _share = NULL;
 
     C_OBJECT_ADD("grid_map");
 }
 
 grid_map::~grid_map()
 {
-    delete []_grid_set;
+    if ( _mmap )
+    {
+        munmap( _mmap,_mmap_size );
+    }
+    else
+    {
+        delete []_grid_set;
+    }
+
+    std::vector<int8 *>::iterator itr = _alloc_chunk.begin();
+    for ( ;itr != _alloc_chunk.end();itr ++ ) delete [](*itr);
+
+    delete []_chunk;
+    delete []_writable;
+    delete []_jump_dist;
+    delete _hpa;
 
     C_OBJECT_DEC("grid_map");
 }
 
-// 加载单个地图文件
+/* 加载编译好的地图文件
+ * 地图文件是只读的，用MAP_SHARED映射，多个场景进程加载同一个地图时共用page cache
+ * 里的同一份内存，不需要每个进程都分配、填充一次
+ */
 bool grid_map::load_file(const char *path)
 {
+    assert("grid map already have data", NULL == _chunk);
+
+    int32 fd = ::open( path,O_RDONLY );
+    if ( fd < 0 )
+    {
+        ERROR( "map file open fail(%s):%s",path,strerror(errno) );
+        return false;
+    }
+
+    struct stat st;
+    if ( fstat( fd,&st ) < 0 || st.st_size < (off_t)sizeof(struct map_header) )
+    {
+        ::close( fd );
+        ERROR( "map file size error:%s",path );
+        return false;
+    }
+
+    size_t size = st.st_size;
+    void *addr = mmap( NULL,size,PROT_READ,MAP_SHARED,fd,0 );
+    ::close( fd ); // 映射后关闭文件不影响映射的内存
+    if ( MAP_FAILED == addr )
+    {
+        ERROR( "map file mmap fail(%s):%s",path,strerror(errno) );
+        return false;
+    }
+
+    const struct map_header *header =
+        reinterpret_cast<const struct map_header *>( addr );
+
+    /* 先检查宽高，再用size_t计算格子数，uint16相乘会提升为int，可能溢出 */
+    if ( MAP_FILE_MAGIC != header->_magic
+        || MAP_FILE_VERSION != header->_version
+        || header->_file_size != size
+        || 0 == header->_width || MAX_MAP_GRID < header->_width
+        || 0 == header->_height || MAX_MAP_GRID < header->_height )
+    {
+        munmap( addr,size );
+        ERROR( "map file header error:%s",path );
+        return false;
+    }
+
+    size_t grid = static_cast<size_t>( header->_width ) * header->_height;
+    if ( header->_cost_offset < sizeof(struct map_header)
+        || static_cast<size_t>( header->_cost_offset ) + grid > size
+        || 0 != header->_region_offset % sizeof(uint16)
+        || (header->_region_offset && static_cast<size_t>(
+            header->_region_offset ) + grid*sizeof(uint16) > size) )
+    {
+        munmap( addr,size );
+        ERROR( "map file format error:%s",path );
+        return false;
+    }
+
+    char *data = static_cast<char *>( addr );
+
+    _id = header->_id;
+    _width = header->_width;
+    _height = header->_height;
+    // 映射的内存是只读的，块都标记为不能直接修改
+    _grid_set = reinterpret_cast<int8 *>( data + header->_cost_offset );
+    if ( header->_region_offset )
+    {
+        _region_set = reinterpret_cast<const uint16 *>(
+            data + header->_region_offset );
+    }
+
+    _mmap = addr;
+    _mmap_size = size;
+    _jump_dirty = true;
+
+    init_chunk( false );
+
     return true;
 }
 
 // 设置地图信息
 bool grid_map::set( int32 id,uint16 width,uint16 height )
 {
-    assert("grid map already have data", NULL == _grid_set);
+    assert("grid map already have data", NULL == _chunk);
 
     if ( MAX_MAP_GRID < width || MAX_MAP_GRID < height ) return false;
 
@@ -39,6 +158,75 @@ bool grid_map::set( int32 id,uint16 width,uint16 height )
     // 全部初始化为不可行走
     memset(_grid_set,-1,sizeof(int8)*_width*height);
 
+    init_chunk( true );
+
+    return true;
+}
+
+// 根据_grid_set创建块索引
+void grid_map::init_chunk( bool writable )
+{
+    int32 size = _width*_height;
+
+    _chunk_cnt = (size + MAP_CHUNK_MASK) >> MAP_CHUNK_BITS;
+    _chunk = new int8*[_chunk_cnt];
+    _writable = new uint8[_chunk_cnt];
+    for ( int32 idx = 0;idx < _chunk_cnt;idx ++ )
+    {
+        _chunk[idx] = _grid_set + (idx << MAP_CHUNK_BITS);
+    }
+    memset( _writable,writable ? 1 : 0,sizeof(uint8)*_chunk_cnt );
+}
+
+/* 取可以修改的块
+ * 共享的块复制一份再修改，原来的内存仍由分配它的地图释放，不影响共享它的地图
+ */
+int8 *grid_map::write_chunk( int32 chunk )
+{
+    if ( expect_true(_writable[chunk]) ) return _chunk[chunk];
+
+    // 最后一块可能不满
+    int32 size = _width*_height - (chunk << MAP_CHUNK_BITS);
+    if ( size > MAP_CHUNK_SIZE ) size = MAP_CHUNK_SIZE;
+
+    int8 *copy = new int8[MAP_CHUNK_SIZE];
+    memcpy( copy,_chunk[chunk],sizeof(int8)*size );
+
+    _alloc_chunk.push_back( copy );
+    _chunk[chunk] = copy;
+    _writable[chunk] = 1;
+
+    return copy;
+}
+
+/* 复制一份地图
+ * 只复制块索引，格子数据和原地图共用。原地图的块也变为共享的，之后原地图修改也要
+ * 先复制，不会影响到复制出来的地图
+ * 跳跃距离(w*h*8)、抽象图只和格子数据有关，两边都没修改前直接用原地图的，不用每个
+ * 副本都构建一份
+ */
+bool grid_map::fork( grid_map *base )
+{
+    assert("grid map already have data", NULL == _chunk);
+
+    if ( !base->_chunk ) return false;
+
+    _id = base->_id;
+    _width = base->_width;
+    _height = base->_height;
+    _region_set = base->_region_set;
+
+    _chunk_cnt = base->_chunk_cnt;
+    _chunk = new int8*[_chunk_cnt];
+    _writable = new uint8[_chunk_cnt];
+    memcpy( _chunk,base->_chunk,sizeof(int8 *)*_chunk_cnt );
+    memset( _writable,0,sizeof(uint8)*_chunk_cnt );
+
+    memset( base->_writable,0,sizeof(uint8)*_chunk_cnt );
+
+    _share = base;
+    _share_ver = base->_data_ver;
+
     return true;
 }
 
@@ -47,7 +235,12 @@ bool grid_map::fill( uint16 x,uint16 y,int8 cost )
 {
     if ( x >= _width || y >= _height ) return false;
 
-    _grid_set[x*_height + y] = cost;
+    int32 idx = x*_height + y;
+    write_chunk( idx >> MAP_CHUNK_BITS )[idx & MAP_CHUNK_MASK] = cost;
+    ++_data_ver;
+    _share = NULL; // 和原地图不一样了，跳跃距离、抽象图要自己构建
+    _jump_dirty = true;
+    if ( _hpa ) _hpa->invalidate( x,y );
 
     return true;
 }
@@ -58,5 +251,142 @@ int8 grid_map::get_pass_cost(int32 x,int32 y) const
     if ( expect_false(x < 0 || x >= _width) ) return -1;
     if ( expect_false(y < 0 || y >= _height) ) return -1;
 
-    return _grid_set[x*_height + y];
+    int32 idx = x*_height + y;
+    return _chunk[idx >> MAP_CHUNK_BITS][idx & MAP_CHUNK_MASK];
+}
+
+// 获取格子所属的区域，没有区域层则为0
+uint16 grid_map::get_region(int32 x,int32 y) const
+{
+    if ( !_region_set ) return 0;
+    if ( expect_false(x < 0 || x >= _width) ) return 0;
+    if ( expect_false(y < 0 || y >= _height) ) return 0;
+
+    return _region_set[x*_height + y];
+}
+
+// 沿dir方向走到(x,y)时，该格子是否为跳点(有强制邻居)
+// 允许沿对角行走时不要求相邻的两个格子可行走，和a_star一致
+bool grid_map::is_jump_point(int32 x,int32 y,int32 dir) const
+{
+    int32 ox = dir_offset[dir][0];
+    int32 oy = dir_offset[dir][1];
+
+    if ( ox && oy )
+    {
+        if ( (is_pass(x - ox,y + oy) && !is_pass(x - ox,y))
+            || (is_pass(x + ox,y - oy) && !is_pass(x,y - oy)) )
+        {
+            return true;
+        }
+
+        // 沿两个分量方向直线跳跃能找到跳点，那当前格子也是跳点
+        int32 idx = (x*_height + y)*8;
+        return _jump_dist[idx + dir_index(ox,0)] > 0
+            || _jump_dist[idx + dir_index(0,oy)] > 0;
+    }
+
+    if ( ox )
+    {
+        return (is_pass(x + ox,y + 1) && !is_pass(x,y + 1))
+            || (is_pass(x + ox,y - 1) && !is_pass(x,y - 1));
+    }
+
+    return (is_pass(x + 1,y + oy) && !is_pass(x + 1,y))
+        || (is_pass(x - 1,y + oy) && !is_pass(x - 1,y));
+}
+
+/* 计算jps+的跳跃距离
+ * 每个方向从地图的另一边往回算，(x,y)的距离由下一个格子的距离推出，每个方向只需要
+ * 遍历一次地图。对角方向要用到直线方向的结果，因此先算直线方向
+ */
+void grid_map::build_jump_dist()
+{
+    if ( _share )
+    {
+        grid_map *share = get_share();
+        if ( share )
+        {
+            share->build_jump_dist();
+            return;
+        }
+
+        _share = NULL; // 原地图修改过，不能再共用
+    }
+
+    if ( !_jump_dirty || !_chunk ) return;
+
+    if ( !_jump_dist ) _jump_dist = new int16[_width*_height*8];
+
+    for ( int32 dir = 0;dir < 8;dir ++ )
+    {
+        int32 ox = dir_offset[dir][0];
+        int32 oy = dir_offset[dir][1];
+
+        // 和方向相反的顺序遍历，保证下一个格子先算
+        int32 bx = ox > 0 ? _width - 1 : 0;
+        int32 sx = ox > 0 ? -1 : 1;
+        int32 by = oy > 0 ? _height - 1 : 0;
+        int32 sy = oy > 0 ? -1 : 1;
+
+        for ( int32 ix = 0;ix < _width;ix ++ )
+        {
+            int32 x = bx + ix*sx;
+            for ( int32 iy = 0;iy < _height;iy ++ )
+            {
+                int32 y = by + iy*sy;
+                int32 nx = x + ox;
+                int32 ny = y + oy;
+
+                int32 dist = 0;
+                if ( !is_pass(nx,ny) )
+                {
+                    dist = 0;
+                }
+                else if ( is_jump_point(nx,ny,dir) )
+                {
+                    dist = 1;
+                }
+                else
+                {
+                    int32 next = _jump_dist[(nx*_height + ny)*8 + dir];
+                    dist = next > 0 ? next + 1 : next - 1;
+                }
+
+                _jump_dist[(x*_height + y)*8 + dir] = static_cast<int16>(dist);
+            }
+        }
+    }
+
+    _jump_dirty = false;
+}
+
+const hpa_graph *grid_map::get_hpa() const
+{
+    const grid_map *share = get_share();
+    if ( share ) return share->get_hpa();
+
+    return ( !_hpa || _hpa->is_dirty() ) ? NULL : _hpa;
+}
+
+// 构建抽象图，第一次构建全部，之后只重建被修改的簇
+void grid_map::build_hpa()
+{
+    if ( _share )
+    {
+        grid_map *share = get_share();
+        if ( share )
+        {
+            share->build_hpa();
+            return;
+        }
+
+        _share = NULL;
+    }
+
+    if ( !_chunk ) return;
+
+    if ( !_hpa ) _hpa = new hpa_graph();
+
+    _hpa->build( this );
 }
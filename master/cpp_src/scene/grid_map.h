@@ -6,15 +6,46 @@
 #ifndef __GRID_MAP_H__
 #define __GRID_MAP_H__
 
+#include <vector>
 #include "../global/global.h"
 
+/* 编译好的地图文件格式，由shell/map.sh从tiled导出的地图转换而来，按小端存放
+ * | map_header | cost[width*height] | 区域层region[width*height](可选) |
+ * 格子的排列和_grid_set一样，下标为x*height + y。各层的偏移都对齐到4字节
+ */
+#define MAP_FILE_MAGIC   0x50414D47 // "GMAP"
+#define MAP_FILE_VERSION 1
+
+struct map_header
+{
+    uint32 _magic;
+    uint16 _version;
+    uint16 _flags; // 保留
+    int32  _id;
+    uint16 _width;
+    uint16 _height;
+    uint32 _cost_offset; // 消耗层的偏移，每个格子int8
+    uint32 _region_offset; // 区域层的偏移，每个格子uint16，0表示没有区域层
+    uint32 _file_size;
+};
+
+/* 格子数据按块存放，每块4096个格子(一个内存页)。fork出来的地图和原地图共用格子数据，
+ * 修改时只复制被修改的块(copy-on-write)
+ */
+#define MAP_CHUNK_BITS 12
+#define MAP_CHUNK_SIZE (1 << MAP_CHUNK_BITS)
+#define MAP_CHUNK_MASK (MAP_CHUNK_SIZE - 1)
+
+class hpa_graph;
 class grid_map
 {
 public:
     grid_map();
     ~grid_map();
 
-    // 加载单个地图文件
+    /* 加载编译好的地图文件，用mmap只读映射，同一台机器上的进程共用同一份物理内存
+     * 映射的内存是只读的，fill时复制被修改的块
+     */
     bool load_file(const char *path);
     // 获取经过这个格子的消耗, < 0 表示不可行
     int8 get_pass_cost(int32 x,int32 y) const;
@@ -22,10 +53,70 @@ public:
     bool set( int32 id,uint16 width,uint16 height );
     // 填充地图信息
     bool fill( uint16 x,uint16 y,int8 cost );
+    /* 复制一份地图，和原地图共用格子数据，之后两个地图各自修改都只复制被修改的块
+     * 在复制出来的地图第一次修改前，跳跃距离、抽象图也直接用原地图的
+     * 原地图必须比复制出来的地图后销毁
+     */
+    bool fork( grid_map *base );
+    // 是否已经有地图数据(set、load_file、fork过)
+    bool has_data() const { return NULL != _chunk; }
+    // 获取格子所属的区域(安全区、传送点等，由地图编辑器设置)，没有区域层则为0
+    uint16 get_region(int32 x,int32 y) const;
 
     // 获取地图宽高
     uint16 get_width() const { return _width; }
     uint16 get_height() const { return _height; }
+
+    /* jps+预先计算的跳跃距离，每个格子8个方向，方向顺序见dir_offset
+     * > 0:该方向上第n个格子是跳点
+     * <= 0:该方向上没有跳点，-n表示该方向上连续n个格子可行走
+     * 地图数据修改后还没重新计算则返回NULL
+     */
+    const int16 *get_jump_dist() const
+    {
+        const grid_map *share = get_share();
+        if ( share ) return share->get_jump_dist();
+
+        return _jump_dirty ? NULL : _jump_dist;
+    }
+    // 计算跳跃距离，地图数据没有修改过则不会重新计算
+    void build_jump_dist();
+
+    /* 分层寻路(hpa*)用的抽象图
+     * 地图数据修改后只标记被修改的簇，还没重新构建则返回NULL
+     */
+    const hpa_graph *get_hpa() const;
+    // 构建抽象图，第一次构建全部，之后只重建被修改的簇
+    void build_hpa();
+
+    // 8个方向的向量，和a_star中的方向顺序一致
+    static const int32 dir_offset[8][2];
+    // 根据向量取方向
+    static inline int32 dir_index(int32 ox,int32 oy)
+    {
+        static const int32 dir[] = { 7,3,6,0,-1,2,4,1,5 };
+        return dir[(ox + 1)*3 + oy + 1];
+    }
+private:
+    // 根据_grid_set创建块索引，writable表示块是否可以直接修改
+    void init_chunk( bool writable );
+    // 取可以修改的块，共享的块先复制一份
+    int8 *write_chunk( int32 chunk );
+
+    /* fork出来的地图，自己和原地图都没修改过时，跳跃距离、抽象图用原地图的
+     * 任意一方修改后不再共用，用到时自己构建
+     */
+    inline grid_map *get_share() const
+    {
+        return (_share && _share->_data_ver == _share_ver) ? _share : NULL;
+    }
+    // 格子是否可行走
+    inline bool is_pass(int32 x,int32 y) const
+    {
+        return get_pass_cost(x,y) >= 0;
+    }
+    // 沿某个方向走到(x,y)时，该格子是否为跳点
+    bool is_jump_point(int32 x,int32 y,int32 dir) const;
 private:
     int32 _id;
     /* 现在的游戏都是精确到像素级别的
@@ -35,7 +126,24 @@ private:
      */
     uint16 _width;  // 地图的宽，格子坐标
     uint16 _height; // 地图的长度，格子坐标
-    int8 *_grid_set;// 格子数据集合
+    int8 *_grid_set;// 格子数据集合，fork出来的地图没有，用原地图的
+    int8 **_chunk;   // 按块索引的格子数据，读写格子都通过这里
+    uint8 *_writable;// 块是否可以直接修改，和别的地图共享的块修改前要先复制
+    int32 _chunk_cnt;
+    std::vector<int8 *> _alloc_chunk; // 修改时复制出来的块，析构时释放
+    const uint16 *_region_set; // 区域层，只有从文件加载的地图才有
+
+    void *_mmap;       // 从文件加载的地图，映射的内存
+    size_t _mmap_size; // 映射的内存大小
+
+    int16 *_jump_dist; // 跳跃距离，按(x*_height + y)*8 + 方向排列
+    bool _jump_dirty;  // 地图数据是否修改过，需要重新计算跳跃距离
+
+    class hpa_graph *_hpa; // 分层寻路的抽象图，用到时才构建
+
+    uint32 _data_ver;  // 地图数据的版本，每次修改加1
+    uint32 _share_ver; // fork时原地图的数据版本
+    grid_map *_share;  // fork的原地图，自己修改后置为NULL
 };
 
 #endif /* __GRID_MAP_H__ */
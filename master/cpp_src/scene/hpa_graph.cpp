@@ -0,0 +1,397 @@
+#include "hpa_graph.h"
+#include "grid_map.h"
+
+#define HPA_CLUSTER  16 // 簇的边长(格子数)
+#define HPA_ENTRANCE 6  // 入口长度超过这个值时两端各放一对抽象节点，否则放在中间
+
+#define IS_PASS(x,y) (map->get_pass_cost(x,y) >= 0)
+
+hpa_graph::hpa_graph()
+{
+    _width = 0;
+    _height = 0;
+    _cluster_w = 0;
+    _cluster_h = 0;
+
+    _has_dirty = false;
+}
+
+hpa_graph::~hpa_graph()
+{
+}
+
+int32 hpa_graph::cluster_idx(int32 x,int32 y) const
+{
+    return (x / HPA_CLUSTER) * _cluster_h + y / HPA_CLUSTER;
+}
+
+// 格子所在簇的范围
+void hpa_graph::get_cluster_rect(int32 x,int32 y,
+    int32 &x0,int32 &y0,int32 &x1,int32 &y1) const
+{
+    x0 = (x / HPA_CLUSTER) * HPA_CLUSTER;
+    y0 = (y / HPA_CLUSTER) * HPA_CLUSTER;
+    x1 = MATH_MIN(x0 + HPA_CLUSTER,_width) - 1;
+    y1 = MATH_MIN(y0 + HPA_CLUSTER,_height) - 1;
+}
+
+const struct hpa_graph::node *hpa_graph::get_node(int32 idx) const
+{
+    node_map_t::const_iterator iter = _node.find(idx);
+
+    return _node.end() == iter ? NULL : &(iter->second);
+}
+
+const struct hpa_graph::edge *hpa_graph::get_edge(int32 from,int32 to) const
+{
+    const struct node *nd = get_node(from);
+    if ( !nd ) return NULL;
+
+    std::vector<struct edge>::const_iterator iter = nd->edges.begin();
+    for ( ;iter != nd->edges.end();iter ++ )
+    {
+        if ( to == iter->to ) return &(*iter);
+    }
+
+    return NULL;
+}
+
+// 格子被修改，标记所在的簇需要重建
+void hpa_graph::invalidate(int32 x,int32 y)
+{
+    // 还没构建过的，构建时全部都会计算
+    if ( _cluster.empty() ) return;
+    if ( x < 0 || y < 0 || x >= _width || y >= _height ) return;
+
+    _has_dirty = true;
+    _dirty[cluster_idx(x,y)] = 1;
+}
+
+/* 构建抽象图
+ * 被修改的簇边界上的入口会改变，周围8个簇的抽象节点也会跟着变，因此重建的范围为被修改
+ * 的簇及周围的簇。范围内的抽象节点全部删除重新计算，范围外的簇只删除指向范围内节点的边
+ */
+void hpa_graph::build(const grid_map *map)
+{
+    if ( !is_dirty() ) return;
+
+    int32 count = 0;
+    if ( _cluster.empty() )
+    {
+        _width = map->get_width();
+        _height = map->get_height();
+        _cluster_w = (_width + HPA_CLUSTER - 1) / HPA_CLUSTER;
+        _cluster_h = (_height + HPA_CLUSTER - 1) / HPA_CLUSTER;
+
+        count = _cluster_w * _cluster_h;
+        _node.clear();
+        _cluster.assign( count,std::vector<int32>() );
+        _dirty.assign( count,1 );
+        _rebuild.assign( count,0 );
+    }
+    count = _cluster_w * _cluster_h;
+
+    for ( int32 c = 0;c < count;c ++ )
+    {
+        if ( !_dirty[c] ) continue;
+
+        int32 cx = c / _cluster_h;
+        int32 cy = c % _cluster_h;
+        for ( int32 nx = cx - 1;nx <= cx + 1;nx ++ )
+        {
+            for ( int32 ny = cy - 1;ny <= cy + 1;ny ++ )
+            {
+                if ( nx < 0 || ny < 0 || nx >= _cluster_w || ny >= _cluster_h )
+                {
+                    continue;
+                }
+                _rebuild[nx * _cluster_h + ny] = 1;
+            }
+        }
+    }
+
+    // 删除重建范围内的抽象节点
+    for ( int32 c = 0;c < count;c ++ )
+    {
+        if ( 1 != _rebuild[c] ) continue;
+
+        std::vector<int32>::const_iterator iter = _cluster[c].begin();
+        for ( ;iter != _cluster[c].end();iter ++ ) _node.erase( *iter );
+
+        _cluster[c].clear();
+    }
+
+    // 范围外的节点，删除指向范围内节点的边，扫描入口时会重新加上
+    for ( int32 c = 0;c < count;c ++ )
+    {
+        if ( 0 != _rebuild[c] ) continue;
+
+        std::vector<int32>::const_iterator iter = _cluster[c].begin();
+        for ( ;iter != _cluster[c].end();iter ++ )
+        {
+            std::vector<struct edge> &edges = _node[*iter].edges;
+            for ( size_t idx = 0;idx < edges.size(); )
+            {
+                int32 to = edges[idx].to;
+                if ( 1 == _rebuild[cluster_idx(to / _height,to % _height)] )
+                {
+                    edges[idx] = edges.back();
+                    edges.pop_back();
+                }
+                else
+                {
+                    idx ++;
+                }
+            }
+        }
+    }
+
+    // 扫描边界上的入口，只处理有一侧在重建范围内的
+    for ( int32 cx = 0;cx < _cluster_w;cx ++ )
+    {
+        for ( int32 cy = 0;cy < _cluster_h;cy ++ )
+        {
+            if ( cx > 0 ) scan_v_border( map,cx,cy );
+            if ( cy > 0 ) scan_h_border( map,cx,cy );
+        }
+    }
+
+    // 簇内的边
+    for ( int32 c = 0;c < count;c ++ )
+    {
+        if ( _rebuild[c] ) build_intra( map,c );
+    }
+
+    _has_dirty = false;
+    _dirty.assign( count,0 );
+    _rebuild.assign( count,0 );
+}
+
+/* 扫描簇(cx,cy)左边的边界，x = cx*HPA_CLUSTER
+ * 沿对角穿过边界的，只要x方向上跨过了这条边界，都在这里处理，包括穿过簇的角
+ */
+void hpa_graph::scan_v_border(const grid_map *map,int32 cx,int32 cy)
+{
+    // 两侧的簇及上下两个簇(穿过角的)都不在重建范围内，不需要处理
+    bool rebuild = false;
+    for ( int32 ny = cy - 1;ny <= cy + 1;ny ++ )
+    {
+        if ( ny < 0 || ny >= _cluster_h ) continue;
+        if ( _rebuild[(cx - 1) * _cluster_h + ny]
+            || _rebuild[cx * _cluster_h + ny] )
+        {
+            rebuild = true;
+        }
+    }
+    if ( !rebuild ) return;
+
+    int32 bx = cx * HPA_CLUSTER;
+    int32 y0 = cy * HPA_CLUSTER;
+    int32 y1 = MATH_MIN(y0 + HPA_CLUSTER,_height) - 1;
+
+    // 两侧都可行走的连续一段为一个入口
+    int32 beg = -1;
+    for ( int32 y = y0;y <= y1 + 1;y ++ )
+    {
+        if ( y <= y1 && IS_PASS(bx - 1,y) && IS_PASS(bx,y) )
+        {
+            if ( beg < 0 ) beg = y;
+            continue;
+        }
+
+        if ( beg >= 0 ) add_entrance( map,bx - 1,beg,bx,beg,y - beg,0,1 );
+        beg = -1;
+    }
+
+    // 只能沿对角穿过边界的
+    for ( int32 y = y0;y <= y1;y ++ )
+    {
+        if ( !IS_PASS(bx - 1,y) || IS_PASS(bx,y) ) continue;
+
+        for ( int32 oy = -1;oy <= 1;oy += 2 )
+        {
+            if ( IS_PASS(bx,y + oy) && !IS_PASS(bx - 1,y + oy) )
+            {
+                add_transition( map,bx - 1,y,bx,y + oy,a_star::move_cost(1,oy) );
+            }
+        }
+    }
+}
+
+/* 扫描簇(cx,cy)上边的边界，y = cy*HPA_CLUSTER
+ * 沿对角穿过边界并且x方向上也跨过边界的在scan_v_border处理
+ */
+void hpa_graph::scan_h_border(const grid_map *map,int32 cx,int32 cy)
+{
+    if ( !_rebuild[cx * _cluster_h + cy - 1]
+        && !_rebuild[cx * _cluster_h + cy] )
+    {
+        return;
+    }
+
+    int32 by = cy * HPA_CLUSTER;
+    int32 x0 = cx * HPA_CLUSTER;
+    int32 x1 = MATH_MIN(x0 + HPA_CLUSTER,_width) - 1;
+
+    int32 beg = -1;
+    for ( int32 x = x0;x <= x1 + 1;x ++ )
+    {
+        if ( x <= x1 && IS_PASS(x,by - 1) && IS_PASS(x,by) )
+        {
+            if ( beg < 0 ) beg = x;
+            continue;
+        }
+
+        if ( beg >= 0 ) add_entrance( map,beg,by - 1,beg,by,x - beg,1,0 );
+        beg = -1;
+    }
+
+    for ( int32 x = x0;x <= x1;x ++ )
+    {
+        if ( !IS_PASS(x,by - 1) || IS_PASS(x,by) ) continue;
+
+        for ( int32 ox = -1;ox <= 1;ox += 2 )
+        {
+            // x方向上跨过了簇的边界，已在scan_v_border处理
+            if ( x + ox < x0 || x + ox > x1 ) continue;
+
+            if ( IS_PASS(x + ox,by) && !IS_PASS(x + ox,by - 1) )
+            {
+                add_transition( map,x,by - 1,x + ox,by,a_star::move_cost(ox,1) );
+            }
+        }
+    }
+}
+
+/* 添加一个入口
+ * @px,py,qx,qy：入口起始位置两侧的格子
+ * @len：入口长度
+ * @ox,oy：入口沿边界的方向
+ */
+void hpa_graph::add_entrance(const grid_map *map,
+    int32 px,int32 py,int32 qx,int32 qy,int32 len,int32 ox,int32 oy)
+{
+    int32 cost = a_star::move_cost(qx - px,qy - py);
+    if ( len <= HPA_ENTRANCE )
+    {
+        int32 mid = (len - 1) / 2;
+        add_transition( map,px + ox*mid,py + oy*mid,qx + ox*mid,qy + oy*mid,cost );
+        return;
+    }
+
+    int32 end = len - 1;
+    add_transition( map,px,py,qx,qy,cost );
+    add_transition( map,px + ox*end,py + oy*end,qx + ox*end,qy + oy*end,cost );
+}
+
+// 添加一对抽象节点及它们之间的边
+void hpa_graph::add_transition(const grid_map *map,
+    int32 px,int32 py,int32 qx,int32 qy,int32 cost)
+{
+    if ( !is_rebuild(px,py) && !is_rebuild(qx,qy) ) return;
+
+    add_node( px,py );
+    add_node( qx,qy );
+
+    add_edge( px * _height + py,qx * _height + qy,cost );
+    add_edge( qx * _height + qy,px * _height + py,cost );
+}
+
+void hpa_graph::add_node(int32 x,int32 y)
+{
+    int32 idx = x * _height + y;
+    if ( _node.find(idx) != _node.end() ) return;
+
+    struct node &nd = _node[idx];
+    nd.x = static_cast<uint16>(x);
+    nd.y = static_cast<uint16>(y);
+
+    // 重建范围外的簇多了节点，也要重新计算簇内的边
+    int32 c = cluster_idx(x,y);
+    _cluster[c].push_back(idx);
+    if ( 0 == _rebuild[c] ) _rebuild[c] = 2;
+}
+
+void hpa_graph::add_edge(int32 from,int32 to,int32 cost)
+{
+    std::vector<struct edge> &edges = _node[from].edges;
+
+    std::vector<struct edge>::const_iterator iter = edges.begin();
+    for ( ;iter != edges.end();iter ++ )
+    {
+        if ( to == iter->to ) return;
+    }
+
+    edges.push_back( edge() );
+    edges.back().to = to;
+    edges.back().cost = cost;
+}
+
+// 重新计算簇内的边，每个抽象节点在簇内做一次dijkstra即可得到到其他节点的路径
+void hpa_graph::build_intra(const grid_map *map,int32 cluster)
+{
+    const std::vector<int32> &nodes = _cluster[cluster];
+    if ( nodes.empty() ) return;
+
+    // 先删除原来簇内的边
+    for ( size_t idx = 0;idx < nodes.size();idx ++ )
+    {
+        std::vector<struct edge> &edges = _node[nodes[idx]].edges;
+        for ( size_t e = 0;e < edges.size(); )
+        {
+            int32 to = edges[e].to;
+            if ( cluster == cluster_idx(to / _height,to % _height) )
+            {
+                edges[e] = edges.back();
+                edges.pop_back();
+            }
+            else
+            {
+                e ++;
+            }
+        }
+    }
+
+    const struct node &first = _node[nodes[0]];
+
+    int32 x0,y0,x1,y1;
+    get_cluster_rect( first.x,first.y,x0,y0,x1,y1 );
+
+    std::vector<uint8> steps;
+    for ( size_t i = 0;i < nodes.size();i ++ )
+    {
+        struct node &from = _node[nodes[i]];
+        _a_star.search_rect( map,from.x,from.y,x0,y0,x1,y1 );
+
+        for ( size_t j = i + 1;j < nodes.size();j ++ )
+        {
+            struct node &to = _node[nodes[j]];
+
+            int32 dist = _a_star.get_dist( to.x,to.y );
+            if ( dist < 0 ) continue;
+
+            _a_star.get_steps( to.x,to.y,steps );
+
+            from.edges.push_back( edge() );
+            struct edge &fe = from.edges.back();
+            fe.to = nodes[j];
+            fe.cost = dist;
+            fe.steps = steps;
+
+            // 反过来的路径，方向也要反过来
+            to.edges.push_back( edge() );
+            struct edge &te = to.edges.back();
+            te.to = nodes[i];
+            te.cost = dist;
+            te.steps.reserve( steps.size() );
+            for ( size_t k = steps.size();k > 0;k -- )
+            {
+                const int32 *offset = grid_map::dir_offset[steps[k - 1]];
+                te.steps.push_back(
+                    (uint8)grid_map::dir_index(-offset[0],-offset[1]) );
+            }
+        }
+    }
+}
+
+#undef IS_PASS
@@ -0,0 +1,102 @@
+/* 分层寻路(hpa*)用的地图抽象图
+ * https://webdocs.cs.ualberta.ca/~mmueller/ps/hpastar.pdf
+ *
+ * 1. 地图按HPA_CLUSTER*HPA_CLUSTER个格子分成簇。相邻两个簇之间连续可通过的一段边界
+ *    为一个入口，入口两侧的格子为抽象节点，两个格子之间为簇间的边
+ * 2. 同一个簇内的抽象节点之间预先用dijkstra算好距离和路径，即簇内的边，寻路细化时直接
+ *    使用缓存的路径
+ * 3. 允许沿对角行走并且不要求相邻的两个格子可行走(同a_star)，因此只能沿对角穿过边界的
+ *    地方也要加一对抽象节点
+ * 4. 修改地图格子后只把格子所在的簇标记为需要重建，下次寻路前只重建这些簇和周围的簇
+ * 5. 构建后只读，多个寻路对象可以同时使用
+ */
+
+#ifndef __HPA_GRAPH_H__
+#define __HPA_GRAPH_H__
+
+#include <vector>
+#include "a_star.h"
+
+class grid_map;
+class hpa_graph
+{
+public:
+    // 抽象图的边
+    struct edge
+    {
+        int32 to; // 目标抽象节点的格子下标
+        int32 cost;
+        // 簇内的路径，每一步为一个方向(见grid_map::dir_offset)。簇间的边两个格子相邻，为空
+        std::vector<uint8> steps;
+    };
+
+    // 抽象节点，即入口两侧的格子
+    struct node
+    {
+        uint16 x;
+        uint16 y;
+        std::vector<struct edge> edges;
+    };
+
+    // 以格子下标(x*height + y)为key
+    typedef map_t< int32,struct node > node_map_t;
+public:
+    hpa_graph();
+    ~hpa_graph();
+
+    // 是否有簇需要重建，从来没构建过也算
+    bool is_dirty() const { return _has_dirty || _cluster.empty(); }
+    // 格子被修改，标记所在的簇需要重建
+    void invalidate(int32 x,int32 y);
+    // 构建抽象图，第一次构建全部，之后只重建被修改的簇
+    void build(const grid_map *map);
+
+    const struct node *get_node(int32 idx) const;
+    const struct edge *get_edge(int32 from,int32 to) const;
+
+    // 格子所在簇的抽象节点(格子下标)
+    const std::vector<int32> &get_cluster_node(int32 x,int32 y) const
+    {
+        return _cluster[cluster_idx(x,y)];
+    }
+    // 格子所在簇的范围
+    void get_cluster_rect(int32 x,int32 y,
+        int32 &x0,int32 &y0,int32 &x1,int32 &y1) const;
+    bool is_same_cluster(int32 x,int32 y,int32 dx,int32 dy) const
+    {
+        return cluster_idx(x,y) == cluster_idx(dx,dy);
+    }
+private:
+    int32 cluster_idx(int32 x,int32 y) const;
+    // 簇是否在当前重建的范围内(整个簇重建)
+    bool is_rebuild(int32 x,int32 y) const
+    {
+        return 1 == _rebuild[cluster_idx(x,y)];
+    }
+
+    void scan_v_border(const grid_map *map,int32 cx,int32 cy);
+    void scan_h_border(const grid_map *map,int32 cx,int32 cy);
+    void add_entrance(const grid_map *map,
+        int32 px,int32 py,int32 qx,int32 qy,int32 len,int32 ox,int32 oy);
+    void add_transition(const grid_map *map,
+        int32 px,int32 py,int32 qx,int32 qy,int32 cost);
+    void add_node(int32 x,int32 y);
+    void add_edge(int32 from,int32 to,int32 cost);
+    // 重新计算簇内的边
+    void build_intra(const grid_map *map,int32 cluster);
+private:
+    uint16 _width;  // 地图宽度
+    uint16 _height; // 地图高度，格子下标为x*_height + y
+    int32 _cluster_w; // x方向上簇的数量
+    int32 _cluster_h; // y方向上簇的数量
+
+    bool _has_dirty;
+    std::vector<uint8> _dirty;   // 簇被修改过，需要重建
+    std::vector<uint8> _rebuild; // 本次重建的簇：1重建整个簇，2只重建簇内的边
+    std::vector< std::vector<int32> > _cluster; // 每个簇的抽象节点
+
+    node_map_t _node;
+    class a_star _a_star; // 构建时簇内寻路用
+};
+
+#endif /* __HPA_GRAPH_H__ */
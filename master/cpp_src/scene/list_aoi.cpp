@@ -0,0 +1,447 @@
+#include "list_aoi.h"
+#include "scene_include.h"
+#include "../system/static_global.h"
+
+object_pool< list_aoi::entity_ctx > list_aoi::_ctx_pool(10240,1024);
+object_pool< list_aoi::entity_vector_t > list_aoi::_vector_pool(10240,1024);
+
+typedef list_aoi::entity_ctx ctx_t;
+typedef ctx_t *ctx_t::*link_t; // 链表指针
+typedef int32 ctx_t::*pos_t; // 链表排序用的坐标
+
+// 十字链表中x、y方向链表的参数
+#define X_LIST \
+    &ctx_t::_pos_x,&ctx_t::_prev_x,&ctx_t::_next_x,_head_x,_tail_x
+#define Y_LIST \
+    &ctx_t::_pos_y,&ctx_t::_prev_y,&ctx_t::_next_y,_head_y,_tail_y
+
+// 从链表中删除
+static void list_unlink(ctx_t *ctx,
+    pos_t pos,link_t prev,link_t next,ctx_t *&head,ctx_t *&tail)
+{
+    UNUSED(pos);
+
+    if (ctx->*prev) (ctx->*prev)->*next = ctx->*next; else head = ctx->*next;
+    if (ctx->*next) (ctx->*next)->*prev = ctx->*prev; else tail = ctx->*prev;
+
+    ctx->*prev = NULL;
+    ctx->*next = NULL;
+}
+
+// 插入到after后面，after为NULL表示插入到链表头
+static void list_link_after(ctx_t *ctx,ctx_t *after,
+    link_t prev,link_t next,ctx_t *&head,ctx_t *&tail)
+{
+    ctx->*prev = after;
+    ctx->*next = after ? after->*next : head;
+
+    if (ctx->*next) (ctx->*next)->*prev = ctx; else tail = ctx;
+    if (after) after->*next = ctx; else head = ctx;
+}
+
+// 按坐标插入到链表，从链表尾开始查找位置
+static void list_insert(ctx_t *ctx,
+    pos_t pos,link_t prev,link_t next,ctx_t *&head,ctx_t *&tail)
+{
+    ctx_t *after = tail;
+    while (after && after->*pos > ctx->*pos) after = after->*prev;
+
+    list_link_after(ctx,after,prev,next,head,tail);
+}
+
+// 坐标改变后，从原来的位置往前或者往后移动到新的位置
+static void list_move(ctx_t *ctx,
+    pos_t pos,link_t prev,link_t next,ctx_t *&head,ctx_t *&tail)
+{
+    ctx_t *next_ctx = ctx->*next;
+    ctx_t *prev_ctx = ctx->*prev;
+    if (next_ctx && next_ctx->*pos < ctx->*pos)
+    {
+        list_unlink(ctx,pos,prev,next,head,tail);
+
+        ctx_t *after = next_ctx;
+        while (after->*next && (after->*next)->*pos < ctx->*pos)
+        {
+            after = after->*next;
+        }
+        list_link_after(ctx,after,prev,next,head,tail);
+    }
+    else if (prev_ctx && prev_ctx->*pos > ctx->*pos)
+    {
+        list_unlink(ctx,pos,prev,next,head,tail);
+
+        ctx_t *after = prev_ctx->*prev;
+        while (after && after->*pos > ctx->*pos) after = after->*prev;
+        list_link_after(ctx,after,prev,next,head,tail);
+    }
+}
+
+list_aoi::list_aoi()
+{
+    _width = 0; // 场景最大宽度(格子坐标)
+    _height = 0; // 场景最大高度(格子坐标)
+
+    _visual_width = 0; // 默认视野宽度格子数
+    _visual_height = 0; // 默认视野高度格子数
+
+    _max_visual_width = 0;
+    _max_visual_height = 0;
+
+    _mark_seq = 0;
+
+    _head_x = NULL;
+    _tail_x = NULL;
+    _head_y = NULL;
+    _tail_y = NULL;
+
+    C_OBJECT_ADD("list_aoi");
+}
+
+list_aoi::~list_aoi()
+{
+    entity_set_t::iterator iter = _entity_set.begin();
+    for (;iter != _entity_set.end();iter ++) del_entity_ctx(iter->second);
+
+    _entity_set.clear();
+
+    C_OBJECT_DEC("list_aoi");
+}
+
+list_aoi::entity_vector_t *list_aoi::new_entity_vector()
+{
+    entity_vector_t *vt = _vector_pool.construct();
+
+    vt->clear();
+    return vt;
+}
+
+void list_aoi::del_entity_vector(entity_vector_t *list)
+{
+    // 太大的直接删除，不要占着内存在缓存里
+    _vector_pool.destroy(list,list->capacity() > 512);
+}
+
+void list_aoi::del_entity_ctx(struct entity_ctx *ctx)
+{
+    // 列表太大的直接删除，不要占着内存在缓存里
+    _ctx_pool.destroy(ctx,
+        ctx->_watch_me.capacity() > 512 || ctx->_watching.capacity() > 512);
+}
+
+struct list_aoi::entity_ctx *list_aoi::new_entity_ctx()
+{
+    struct entity_ctx *ctx = _ctx_pool.construct();
+
+    ctx->_mark = 0;
+    ctx->_prev_x = NULL;
+    ctx->_next_x = NULL;
+    ctx->_prev_y = NULL;
+    ctx->_next_y = NULL;
+    ctx->_watch_me.clear();
+    ctx->_watching.clear();
+
+    return ctx;
+}
+
+// 设置默认视野
+// @width,@height 格子数
+void list_aoi::set_visual_range(int32 width,int32 height)
+{
+    _visual_width = width;
+    _visual_height = height;
+
+    if (width > _max_visual_width) _max_visual_width = width;
+    if (height > _max_visual_height) _max_visual_height = height;
+}
+
+// 设置宽高
+// @width,@height 像素
+int32 list_aoi::set_size(int32 width,int32 height)
+{
+    _width = PIX_TO_GRID(width);
+    _height = PIX_TO_GRID(height);
+
+    return 0;
+}
+
+void list_aoi::insert_list(struct entity_ctx *ctx)
+{
+    list_insert(ctx,X_LIST);
+    list_insert(ctx,Y_LIST);
+}
+
+void list_aoi::remove_list(struct entity_ctx *ctx)
+{
+    list_unlink(ctx,X_LIST);
+    list_unlink(ctx,Y_LIST);
+}
+
+void list_aoi::move_list(struct entity_ctx *ctx)
+{
+    list_move(ctx,X_LIST);
+    list_move(ctx,Y_LIST);
+}
+
+/* 获取某一范围内实体
+ * 底层这里只支持矩形，如果是其他形状的，上层根据实体位置再筛选即可
+ */
+int32 list_aoi::get_entitys(
+    entity_vector_t *list,int32 srcx,int32 srcy,int32 destx,int32 desty)
+{
+    // 4个坐标必须为矩形的对角像素坐标,这里转换为左上角和右下角坐标
+    int32 x = PIX_TO_GRID(MATH_MIN(srcx,destx));
+    int32 y = PIX_TO_GRID(MATH_MIN(srcy,desty));
+    int32 dx = PIX_TO_GRID(MATH_MAX(srcx,destx));
+    int32 dy = PIX_TO_GRID(MATH_MAX(srcy,desty));
+
+    // 限制越界
+    if (x < 0 || y < 0) return 1;
+    if (dx > _width || dy > _height) return 2;
+
+    // 按x链表遍历，链表是有序的，超过范围即可停止
+    struct entity_ctx *ctx = _head_x;
+    while (ctx && ctx->_pos_x < x) ctx = ctx->_next_x;
+
+    for (;ctx && ctx->_pos_x <= dx;ctx = ctx->_next_x)
+    {
+        if (ctx->_pos_y >= y && ctx->_pos_y <= dy) list->push_back(ctx);
+    }
+
+    return 0;
+}
+
+// 获取实体的ctx
+struct list_aoi::entity_ctx *list_aoi::get_entity_ctx(entity_id_t id)
+{
+    entity_set_t::const_iterator itr = _entity_set.find(id);
+    if (_entity_set.end() == itr) return NULL;
+
+    return itr->second;
+}
+
+/* 获取视野内的实体，不包含自己
+ * 同时在x、y两条链表上向两边遍历，某条链表在视野范围内的实体遍历完了，说明这条链表上
+ * 的候选实体比较少，直接用这条链表的结果再判断另一个方向的坐标即可
+ */
+void list_aoi::get_visual_entitys(
+    const struct entity_ctx *ctx,entity_vector_t *list)
+{
+    int32 rx = MATH_MAX(ctx->_visual_width,_max_visual_width);
+    int32 ry = MATH_MAX(ctx->_visual_height,_max_visual_height);
+
+    _cand_x.clear();
+    _cand_y.clear();
+
+    struct entity_ctx *prev_x = ctx->_prev_x;
+    struct entity_ctx *next_x = ctx->_next_x;
+    struct entity_ctx *prev_y = ctx->_prev_y;
+    struct entity_ctx *next_y = ctx->_next_y;
+
+    entity_vector_t *cand = NULL;
+    while (true)
+    {
+        bool more = false;
+        if (prev_x && ctx->_pos_x - prev_x->_pos_x <= rx)
+        {
+            more = true;
+            _cand_x.push_back(prev_x);
+            prev_x = prev_x->_prev_x;
+        }
+        if (next_x && next_x->_pos_x - ctx->_pos_x <= rx)
+        {
+            more = true;
+            _cand_x.push_back(next_x);
+            next_x = next_x->_next_x;
+        }
+        if (!more) { cand = &_cand_x;break; }
+
+        more = false;
+        if (prev_y && ctx->_pos_y - prev_y->_pos_y <= ry)
+        {
+            more = true;
+            _cand_y.push_back(prev_y);
+            prev_y = prev_y->_prev_y;
+        }
+        if (next_y && next_y->_pos_y - ctx->_pos_y <= ry)
+        {
+            more = true;
+            _cand_y.push_back(next_y);
+            next_y = next_y->_next_y;
+        }
+        if (!more) { cand = &_cand_y;break; }
+    }
+
+    entity_vector_t::const_iterator iter = cand->begin();
+    for (;iter != cand->end();iter ++)
+    {
+        if (is_visible(ctx,*iter)) list->push_back(*iter);
+    }
+}
+
+// 处理实体退出场景
+int32 list_aoi::exit_entity(entity_id_t id,entity_vector_t *list)
+{
+    entity_set_t::iterator iter = _entity_set.find(id);
+    if (_entity_set.end() == iter) return 1;
+
+    struct entity_ctx *ctx = iter->second;
+    _entity_set.erase(iter);
+
+    if (!ctx) return 2;
+
+    remove_list(ctx);
+
+    // 返回关注自己离开场景的实体列表，并从别人的watch_me列表删除自己
+    aoi_del_all_watch(ctx,list);
+
+    del_entity_ctx(ctx);
+
+    return 0;
+}
+
+// 处理实体进入场景
+int32 list_aoi::enter_entity(entity_id_t id,int32 x,int32 y,
+    uint8 type,uint8 event,entity_vector_t *list,
+    int32 visual_width,int32 visual_height)
+{
+    // 检测坐标
+    int32 gx = PIX_TO_GRID(x);
+    int32 gy = PIX_TO_GRID(y);
+    if (gx < 0 || gy < 0 || gx > _width || gy > _height) return 1;
+
+    // 防止重复进入场景
+    std::pair< entity_set_t::iterator,bool > ret;
+    ret = _entity_set.insert(
+        std::pair<entity_id_t,struct entity_ctx*>(id,NULL));
+    if (false == ret.second) return 2;
+
+    struct entity_ctx *ctx = new_entity_ctx();
+    ret.first->second = ctx;
+
+    ctx->_id = id;
+    ctx->_pos_x = gx;
+    ctx->_pos_y = gy;
+    ctx->_type = type;
+    ctx->_event = event;
+    ctx->_visual_width = visual_width < 0 ? _visual_width : visual_width;
+    ctx->_visual_height = visual_height < 0 ? _visual_height : visual_height;
+
+    if (ctx->_visual_width > _max_visual_width)
+    {
+        _max_visual_width = ctx->_visual_width;
+    }
+    if (ctx->_visual_height > _max_visual_height)
+    {
+        _max_visual_height = ctx->_visual_height;
+    }
+
+    insert_list(ctx);
+
+    entity_vector_t *visual = new_entity_vector();
+    get_visual_entitys(ctx,visual);
+
+    entity_vector_t::iterator iter = visual->begin();
+    for (;iter != visual->end();iter ++)
+    {
+        struct entity_ctx *other = *iter;
+        // 把自己加到别人的watch
+        if (ctx->_event) aoi_add_watch(ctx,other);
+        // 把别人加到自己的watch
+        if (other->_event)
+        {
+            aoi_add_watch(other,ctx);
+
+            // 返回需要触发aoi事件的实体
+            if (list) list->push_back(other);
+        }
+    }
+    del_entity_vector(visual);
+
+    return 0;
+}
+
+/* 删除已经不可见的关注关系
+ * @list:返回关注自己并且不再可见的实体
+ */
+void list_aoi::entity_exit_range(struct entity_ctx *ctx,entity_vector_t *list)
+{
+    // 倒序遍历，删除时用来替换的最后一个元素已经检查过了
+    watch_vector_t &watch_me = ctx->_watch_me;
+    for (int32 idx = (int32)watch_me.size() - 1;idx >= 0;idx --)
+    {
+        struct entity_ctx *other = watch_me[idx]._ctx;
+        if (is_visible(ctx,other)) continue;
+
+        if (list) list->push_back(other);
+        aoi_del_watch(ctx,idx);
+    }
+
+    watch_vector_t &watching = ctx->_watching;
+    for (int32 idx = (int32)watching.size() - 1;idx >= 0;idx --)
+    {
+        const watch_link &link = watching[idx];
+        if (is_visible(ctx,link._ctx)) continue;
+
+        aoi_del_watch(link._ctx,link._rev);
+    }
+}
+
+/* 更新实体位置
+ * @list_in:接收实体进入的实体列表
+ * @list_out:接收实体消失的实体列表
+ * @list:接收实体更新的实体列表
+ */
+int32 list_aoi::update_entity(entity_id_t id,
+        int32 x,int32 y,entity_vector_t *list,
+        entity_vector_t *list_in,entity_vector_t *list_out)
+{
+    // 检测坐标
+    int32 gx = PIX_TO_GRID(x);
+    int32 gy = PIX_TO_GRID(y);
+    if (gx < 0 || gy < 0 || gx > _width || gy > _height) return 1;
+
+    struct entity_ctx *ctx = get_entity_ctx(id);
+    if (!ctx) return 2;
+
+    // 在一个格子内移动不用处理
+    if (gx == ctx->_pos_x && gy == ctx->_pos_y) return 0;
+
+    ctx->_pos_x = gx;
+    ctx->_pos_y = gy;
+    move_list(ctx);
+
+    // 不再可见的，触发退出
+    entity_exit_range(ctx,list_out);
+
+    // 剩下的关注关系都是原来就可见的，标记起来。新视野内有标记的触发更新，没有的触发进入
+    if (0 == ++_mark_seq) _mark_seq = 1;
+
+    watch_vector_t::const_iterator witer = ctx->_watch_me.begin();
+    for (;witer != ctx->_watch_me.end();witer ++) witer->_ctx->_mark = _mark_seq;
+    witer = ctx->_watching.begin();
+    for (;witer != ctx->_watching.end();witer ++) witer->_ctx->_mark = _mark_seq;
+
+    entity_vector_t *visual = new_entity_vector();
+    get_visual_entitys(ctx,visual);
+
+    entity_vector_t::iterator iter = visual->begin();
+    for (;iter != visual->end();iter ++)
+    {
+        struct entity_ctx *other = *iter;
+        if (_mark_seq == other->_mark)
+        {
+            if (list && other->_event) list->push_back(other);
+            continue;
+        }
+
+        if (ctx->_event) aoi_add_watch(ctx,other);
+        if (other->_event)
+        {
+            aoi_add_watch(other,ctx);
+            if (list_in) list_in->push_back(other);
+        }
+    }
+    del_entity_vector(visual);
+
+    return 0;
+}
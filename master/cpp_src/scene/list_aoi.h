@@ -0,0 +1,136 @@
+/* 十字链表AOI(Area of Interest)算法
+ *
+ * 1. 所有实体按格子坐标分别在x、y两条双向链表上排序，不需要按地图大小分配格子，适用于
+ *    实体分布很不均匀的大地图
+ * 2. 每个实体可以有自己的视野(格子数)，两个实体之间取视野较大的那个判断是否可见，因此
+ *    可见关系是对称的，事件列表和grid_aoi的含义一样
+ * 3. 查找视野内的实体时同时在x、y两条链表上向两边遍历，哪条链表先遍历完就用哪条链表的
+ *    结果，实体只在某一个方向上密集时也不会遍历太多
+ * 4. watch_me关系同grid_aoi，双向记录(见aoi_watch.h)
+ * 5. 接口和grid_aoi一样，由laoi绑定到脚本，场景创建时选择用哪种算法
+ */
+
+#ifndef __LIST_AOI_H__
+#define __LIST_AOI_H__
+
+#include <vector>
+#include "aoi_watch.h"
+#include "../pool/object_pool.h"
+
+class list_aoi
+{
+public:
+    struct entity_ctx;
+
+    typedef int64 entity_id_t; // 用来标识实体的唯一id
+    typedef std::vector< struct entity_ctx* > entity_vector_t; // 实体列表
+
+    typedef struct aoi_link< struct entity_ctx > watch_link; // 关注关系
+    typedef std::vector< watch_link > watch_vector_t;
+
+    struct entity_ctx
+    {
+        uint8 _type; // 记录实体类型
+        uint8 _event; // 关注的事件
+        int32 _pos_x; // 格子坐标，x
+        int32 _pos_y; // 格子坐标，y
+        int32 _visual_width; // 视野宽度格子数
+        int32 _visual_height; // 视野高度格子数
+        uint32 _mark; // 更新位置时标记原来就可见的实体
+        entity_id_t _id;
+
+        // 十字链表
+        struct entity_ctx *_prev_x;
+        struct entity_ctx *_next_x;
+        struct entity_ctx *_prev_y;
+        struct entity_ctx *_next_y;
+
+        watch_vector_t _watch_me; // 关注我的实体列表，同grid_aoi
+        watch_vector_t _watching; // 我关注的实体列表，删除关系时用
+    };
+
+    typedef map_t< entity_id_t,struct entity_ctx* > entity_set_t;
+public:
+    list_aoi();
+    virtual ~list_aoi();
+
+    static void purge() { _ctx_pool.purge();_vector_pool.purge(); }
+
+    // 设置默认视野，格子数
+    void set_visual_range(int32 width,int32 height);
+    int32 set_size(int32 width,int32 height); // 设置宽高
+
+    struct entity_ctx *get_entity_ctx(entity_id_t id);
+    /* 获取某一范围内实体
+     * 底层这里只支持矩形，如果是其他形状的，上层根据实体位置再筛选即可
+     */
+    int32 get_entitys(entity_vector_t *list,
+        int32 srcx,int32 srcy,int32 destx,int32 desty);
+
+    int32 exit_entity(entity_id_t id,entity_vector_t *list = NULL);
+    /* 实体进入场景
+     * @visual_width,visual_height:实体自己的视野格子数，小于0表示使用默认视野
+     */
+    int32 enter_entity(entity_id_t id,int32 x,int32 y,uint8 type,uint8 event,
+        entity_vector_t *list = NULL,
+        int32 visual_width = -1,int32 visual_height = -1);
+    int32 update_entity(entity_id_t id,
+        int32 x,int32 y,entity_vector_t *list = NULL,
+        entity_vector_t *list_in = NULL,entity_vector_t *list_out = NULL);
+protected:
+    entity_vector_t *new_entity_vector();
+    void del_entity_vector(entity_vector_t *list);
+
+    struct entity_ctx *new_entity_ctx();
+    void del_entity_ctx(struct entity_ctx *ctx);
+private:
+    // 两个实体是否可见
+    inline bool is_visible(
+        const struct entity_ctx *ctx,const struct entity_ctx *other) const
+    {
+        int32 vw = MATH_MAX(ctx->_visual_width,other->_visual_width);
+        int32 vh = MATH_MAX(ctx->_visual_height,other->_visual_height);
+
+        return abs(ctx->_pos_x - other->_pos_x) <= vw
+            && abs(ctx->_pos_y - other->_pos_y) <= vh;
+    }
+
+    void insert_list(struct entity_ctx *ctx); // 插入到十字链表
+    void remove_list(struct entity_ctx *ctx); // 从十字链表删除
+    void move_list(struct entity_ctx *ctx); // 坐标改变后调整在链表中的位置
+
+    // 获取视野内的实体，不包含自己
+    void get_visual_entitys(
+        const struct entity_ctx *ctx,entity_vector_t *list);
+    // 删除已经不可见的关注关系
+    void entity_exit_range(struct entity_ctx *ctx,entity_vector_t *list);
+protected:
+    int32 _width; // 场景最大宽度(格子坐标)
+    int32 _height; // 场景最大高度(格子坐标)
+
+    int32 _visual_width; // 默认视野宽度格子数
+    int32 _visual_height; // 默认视野高度格子数
+
+    // 所有实体中最大的视野，遍历链表时超过这个范围就不需要再往下找了
+    int32 _max_visual_width;
+    int32 _max_visual_height;
+
+    uint32 _mark_seq; // 更新位置时标记实体用的序号
+
+    struct entity_ctx *_head_x;
+    struct entity_ctx *_tail_x;
+    struct entity_ctx *_head_y;
+    struct entity_ctx *_tail_y;
+
+    /* 记录所有实体的数据 */
+    entity_set_t _entity_set;
+
+    /* 遍历链表时的临时列表，避免每次分配 */
+    entity_vector_t _cand_x;
+    entity_vector_t _cand_y;
+
+    static object_pool< entity_ctx > _ctx_pool;
+    static object_pool< entity_vector_t > _vector_pool;
+};
+
+#endif /* __LIST_AOI_H__ */
@@ -6,6 +6,7 @@
 
 #include "../net/buffer.h"
 #include "../scene/grid_aoi.h"
+#include "../scene/list_aoi.h"
 
 /* 各个变量之间有依赖，要注意顺序
  * 同一个unit中的static对象，先声明的先初始化。销毁的时候则反过来
@@ -15,6 +16,7 @@ class static_global::initializer static_global::_initializer;
 class statistic static_global::_statistic;
 class lev static_global::_ev;
 class thread_mgr static_global::_thread_mgr;
+class task_pool static_global::_task_pool;
 class thread_log static_global::_async_log;
 class lstate static_global::_state;
 class codec_mgr static_global::_codec_mgr;
@@ -55,6 +57,7 @@ static_global::initializer::~initializer()
         /* 清除静态数据，以免影响内存检测 */
     buffer::purge();
     grid_aoi::purge();
+    list_aoi::purge();
 }
 
 void static_global::initialize()  /* 程序运行时初始化 */
@@ -66,6 +69,7 @@ void static_global::uninitialize() /* 程序结束时反初始化 */
 {
     _async_log.stop();
     _thread_mgr.stop();
+    _task_pool.stop();
 }
 
 
@@ -5,6 +5,7 @@
 #include "../log/thread_log.h"
 #include "../lua_cpplib/lev.h"
 #include "../net/io/ssl_mgr.h"
+#include "../thread/task_pool.h"
 #include "../thread/thread_mgr.h"
 #include "../lua_cpplib/lstate.h"
 #include "../net/codec/codec_mgr.h"
@@ -27,6 +28,7 @@ public:
     static class codec_mgr *codec_mgr() { return &_codec_mgr; }
     static class statistic *statistic() { return &_statistic; }
     static class thread_log *async_log() { return &_async_log; }
+    static class task_pool *task_pool() { return &_task_pool; }
     static class thread_mgr *thread_mgr() { return &_thread_mgr; }
     static class lnetwork_mgr *network_mgr() { return &_network_mgr; }
 private:
@@ -42,6 +44,7 @@ private:
     static class lev _ev;
     static class lstate _state;
     static class thread_mgr _thread_mgr;
+    static class task_pool _task_pool;
     static class thread_log _async_log;
     static class codec_mgr _codec_mgr;
     static class ssl_mgr _ssl_mgr;
@@ -37,3 +37,17 @@ void statistic::add_c_lua_obj(const char *what,int32 count)
         assert("add_c_lua_obj count < 0",counter._cur >= 0);
     }
 }
+
+void statistic::add_multicast(bool refer,int64 bytes)
+{
+    if (refer)
+    {
+        _multicast._refer ++;
+        _multicast._refer_bytes += bytes;
+    }
+    else
+    {
+        _multicast._copy ++;
+        _multicast._copy_bytes += bytes;
+    }
+}
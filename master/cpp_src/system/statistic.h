@@ -51,6 +51,24 @@ public:
         int64 _int_total; // 时间间隔内总数
     };
 
+    // 广播数据计数器，发往每个socket的数据是拷贝还是引用共享帧
+    class multicast_counter
+    {
+    public:
+        multicast_counter()
+        {
+            _copy = 0;
+            _copy_bytes = 0;
+            _refer = 0;
+            _refer_bytes = 0;
+        }
+    public:
+        int64 _copy;
+        int64 _copy_bytes;
+        int64 _refer;
+        int64 _refer_bytes;
+    };
+
     /* 所有统计的名称都是static字符串,不要传入一个临时字符串
      * 低版本的C++用std::string做key会每次申请内存都构造字符串
      */
@@ -61,13 +79,16 @@ public:
 
     void add_c_obj(const char *what,int32 count);
     void add_c_lua_obj(const char *what,int32 count);
+    void add_multicast(bool refer,int64 bytes);
 
     const statistic::base_counter_t &get_c_obj() const { return _c_obj; }
     const statistic::base_counter_t &get_c_lua_obj() const { return _c_lua_obj; }
+    const statistic::multicast_counter &get_multicast() const { return _multicast; }
 private:
 private:
     base_counter_t _c_obj; // c对象计数器
     base_counter_t _c_lua_obj; // 从c push到lua对象
+    multicast_counter _multicast; // 广播数据
 };
 
 #endif /* __STATISTIC_H__ */
@@ -0,0 +1,130 @@
+#ifndef __QUEUE_THREAD_H__
+#define __QUEUE_THREAD_H__
+
+#include <queue>
+#include <vector>
+
+#include "thread.h"
+#include "spsc_queue.h"
+
+/* 主线程提交请求、子线程按顺序处理并返回结果的线程，数据库、寻路线程共用
+ * 1.请求、结果都用无锁队列，主线程写请求读结果，子线程读请求写结果
+ * 2.请求队列满时先放到主线程的溢出队列，子线程处理完无锁队列后通知主线程
+ *   flush_query，溢出的请求按顺序写回无锁队列，不会打乱执行顺序
+ * 3.线程停止时主线程阻塞在join，子线程取完无锁队列后直接取溢出队列，停止前
+ *   提交的请求不会丢
+ * 4.结果队列满了怎么处理由子类决定，见各子类的push_result
+ */
+template<class Q,class R>
+class queue_thread : public thread
+{
+public:
+    explicit queue_thread( const char *name )
+        : thread(name),_query( THREAD_QUEUE ),_result( THREAD_QUEUE )
+    {
+        _query_full.store( false );
+    }
+
+    /* 以下函数只能在主线程调用 */
+    void push_query( const Q &query )
+    {
+        if ( expect_false( !_overflow.empty() ) ) flush_query();
+
+        if ( expect_false( !_overflow.empty() || !_query.push( query ) ) )
+        {
+            _overflow.push( query );
+            _query_full.store( true );
+        }
+
+        /* 通知是合并的，子线程处理之前的多次通知只有第一次产生系统调用 */
+        notify_child( NTF_CUSTOM );
+    }
+
+    /* 还没处理的请求数量，用于选择最闲的线程 */
+    size_t pending() const
+    {
+        return _query.size() + _overflow.size() + (is_busy() ? 1 : 0);
+    }
+
+    size_t busy_job( size_t *finished = NULL,size_t *unfinished = NULL )
+    {
+        /* 只在主线程调用，队列的数量只是一个近似值 */
+        size_t finished_sz = _result.size();
+        size_t unfinished_sz = _query.size() + _overflow.size();
+
+        if ( is_busy() ) unfinished_sz += 1;
+
+        if ( finished ) *finished = finished_sz;
+        if ( unfinished ) *unfinished = unfinished_sz;
+
+        return finished_sz + unfinished_sz;
+    }
+
+    /* 选择最闲的线程，没有积压的直接用 */
+    template<class T>
+    static T *least_pending( const std::vector<T *> &list )
+    {
+        size_t size = list.size();
+
+        T *worker = list.front();
+        size_t min_pending = worker->pending();
+        for ( size_t index = 1;index < size && min_pending > 0;index ++ )
+        {
+            size_t pending = list[index]->pending();
+            if ( pending < min_pending )
+            {
+                worker = list[index];
+                min_pending = pending;
+            }
+        }
+
+        return worker;
+    }
+protected:
+    /* 把溢出队列的请求写入无锁队列，在主线程收到NTF_CUSTOM时调用 */
+    void flush_query()
+    {
+        if ( _overflow.empty() ) return;
+
+        while ( !_overflow.empty() && _query.push( _overflow.front() ) )
+        {
+            _overflow.pop();
+        }
+
+        if ( !_overflow.empty() ) _query_full.store( true );
+
+        notify_child( NTF_CUSTOM );
+    }
+
+    /* 子线程取下一个请求。线程停止后主线程也可以调用，取出剩下的请求 */
+    bool pop_query( Q &query )
+    {
+        if ( _query.pop( query ) ) return true;
+
+        /* active为false时主线程阻塞在join或者已经join了，不会再访问溢出队列 */
+        if ( active() || _overflow.empty() ) return false;
+
+        query = _overflow.front();
+        _overflow.pop();
+
+        return true;
+    }
+
+    /* 子线程取完请求后调用，主线程有溢出的请求时通知主线程继续写入队列 */
+    void notify_query_full()
+    {
+        if ( expect_false( _query_full.exchange( false ) ) )
+        {
+            notify_parent( NTF_CUSTOM );
+        }
+    }
+protected:
+    spsc_queue<Q> _query ;
+    spsc_queue<R> _result;
+private:
+    /* 队列满时主线程的溢出队列，只在主线程访问(线程停止后由子线程取完) */
+    std::queue<Q> _overflow;
+    std::atomic<bool> _query_full;
+};
+
+#endif /* __QUEUE_THREAD_H__ */
@@ -0,0 +1,84 @@
+#ifndef __SPSC_QUEUE_H__
+#define __SPSC_QUEUE_H__
+
+#include <atomic>
+
+#include "../global/global.h"
+
+/* 单生产者单消费者的无锁环形队列
+ * 1.只能有一个线程push，一个线程pop，不需要加锁
+ * 2.容量在创建时确定，向上取2的n次方。满了push返回false，由调用者决定等待还是缓存
+ * 3._head只由消费者修改，_tail只由生产者修改，两者分开放到不同的cache line，避免伪共享
+ */
+template<class T>
+class spsc_queue
+{
+public:
+    explicit spsc_queue( uint32 size )
+    {
+        uint32 cap = 2;
+        while ( cap < size ) cap <<= 1;
+
+        _mask = cap - 1;
+        _ring = new T[cap];
+
+        _head.store( 0,std::memory_order_relaxed );
+        _tail.store( 0,std::memory_order_relaxed );
+    }
+
+    ~spsc_queue()
+    {
+        delete []_ring;
+        _ring = NULL;
+    }
+
+    /* 生产者线程调用，队列满返回false */
+    bool push( const T &val )
+    {
+        uint32 tail = _tail.load( std::memory_order_relaxed );
+        if ( tail - _head.load( std::memory_order_acquire ) > _mask )
+        {
+            return false;
+        }
+
+        _ring[tail & _mask] = val;
+        _tail.store( tail + 1,std::memory_order_release );
+
+        return true;
+    }
+
+    /* 消费者线程调用，队列空返回false */
+    bool pop( T &val )
+    {
+        uint32 head = _head.load( std::memory_order_relaxed );
+        if ( head == _tail.load( std::memory_order_acquire ) ) return false;
+
+        val = _ring[head & _mask];
+        _head.store( head + 1,std::memory_order_release );
+
+        return true;
+    }
+
+    /* 队列中的数量，另一个线程同时在操作时只是一个近似值 */
+    inline uint32 size() const
+    {
+        return _tail.load( std::memory_order_acquire )
+            - _head.load( std::memory_order_acquire );
+    }
+    inline bool empty() const { return 0 == size(); }
+    inline uint32 capacity() const { return _mask + 1; }
+private:
+    spsc_queue( const spsc_queue & );
+    spsc_queue &operator=( const spsc_queue & );
+private:
+    T *_ring;
+    uint32 _mask;
+
+    char _pad0[64];
+    std::atomic<uint32> _head; /* 消费者读取的位置 */
+    char _pad1[64];
+    std::atomic<uint32> _tail; /* 生产者写入的位置 */
+    char _pad2[64];
+};
+
+#endif /* __SPSC_QUEUE_H__ */
@@ -0,0 +1,150 @@
+#include "thread.h"
+#include "task_pool.h"
+
+task_pool::task_pool()
+{
+    pthread_mutex_init( &_mutex,NULL );
+    pthread_cond_init( &_task_cond,NULL );
+    pthread_cond_init( &_done_cond,NULL );
+
+    _routine = NULL;
+    _arg     = NULL;
+    _num     = 0;
+    _seq     = 0;
+    _pending = 0;
+    _quit    = false;
+}
+
+task_pool::~task_pool()
+{
+    stop();
+
+    pthread_mutex_destroy( &_mutex );
+    pthread_cond_destroy( &_task_cond );
+    pthread_cond_destroy( &_done_cond );
+}
+
+int32 task_pool::split( size_t count,size_t min_chunk,int32 max )
+{
+    size_t num = count / min_chunk;
+    if ( num > static_cast<size_t>( max ) ) num = max;
+
+    return num < 1 ? 1 : static_cast<int32>( num );
+}
+
+void task_pool::stop()
+{
+    if ( _worker.empty() ) return;
+
+    pthread_mutex_lock( &_mutex );
+    _quit = true;
+    pthread_cond_broadcast( &_task_cond );
+    pthread_mutex_unlock( &_mutex );
+
+    std::vector<struct worker *>::iterator itr = _worker.begin();
+    for ( ;itr != _worker.end();itr ++ )
+    {
+        pthread_join( (*itr)->tid,NULL );
+        delete *itr;
+    }
+    _worker.clear();
+
+    _quit = false;
+}
+
+/* 线程不够num个时补上，创建失败的下次再试 */
+void task_pool::spawn( int32 num )
+{
+    while ( _worker.size() < static_cast<size_t>( num ) )
+    {
+        struct worker *worker = new struct worker;
+        worker->pool  = this;
+        worker->index = static_cast<int32>( _worker.size() ) + 1;
+        worker->seq   = _seq;
+
+        if ( 0 != pthread_create( &worker->tid,NULL,start_routine,worker ) )
+        {
+            delete worker;
+            ERROR( "task pool create thread fail" );
+            return;
+        }
+
+        _worker.push_back( worker );
+    }
+}
+
+void task_pool::run( routine_t routine,void *arg,int32 num )
+{
+    assert( "task pool run reentrant",!_routine );
+
+    if ( num > 1 ) spawn( num - 1 );
+
+    int32 spawned = static_cast<int32>( _worker.size() );
+    if ( spawned > num - 1 ) spawned = num - 1;
+
+    if ( spawned > 0 )
+    {
+        pthread_mutex_lock( &_mutex );
+        _routine = routine;
+        _arg     = arg;
+        _num     = num;
+        _pending = spawned;
+        _seq ++;
+        pthread_cond_broadcast( &_task_cond );
+        pthread_mutex_unlock( &_mutex );
+    }
+
+    // 第0段和没有线程执行的段在当前线程执行
+    routine( 0,arg );
+    for ( int32 index = spawned + 1;index < num;index ++ )
+    {
+        routine( index,arg );
+    }
+
+    if ( spawned > 0 )
+    {
+        pthread_mutex_lock( &_mutex );
+        while ( _pending > 0 ) pthread_cond_wait( &_done_cond,&_mutex );
+
+        _routine = NULL;
+        _arg     = NULL;
+        pthread_mutex_unlock( &_mutex );
+    }
+}
+
+void task_pool::routine( struct worker *worker )
+{
+    pthread_mutex_lock( &_mutex );
+    while ( true )
+    {
+        while ( !_quit && worker->seq == _seq )
+        {
+            pthread_cond_wait( &_task_cond,&_mutex );
+        }
+        if ( _quit ) break;
+
+        // 这一批的段数比线程少时，多出来的线程不用执行
+        worker->seq = _seq;
+        if ( worker->index >= _num ) continue;
+
+        routine_t routine = _routine;
+        void *arg = _arg;
+        pthread_mutex_unlock( &_mutex );
+
+        routine( worker->index,arg );
+
+        pthread_mutex_lock( &_mutex );
+        if ( 0 == -- _pending ) pthread_cond_signal( &_done_cond );
+    }
+    pthread_mutex_unlock( &_mutex );
+}
+
+void *task_pool::start_routine( void *arg )
+{
+    struct worker *worker = static_cast<struct worker *>( arg );
+
+    thread::signal_block();  /* 子线程不处理外部信号 */
+    worker->pool->routine( worker );
+
+    return NULL;
+}
@@ -0,0 +1,60 @@
+#ifndef __TASK_POOL_H__
+#define __TASK_POOL_H__
+
+#include <vector>
+#include <pthread.h>
+#include "../global/global.h"
+
+/* 主线程把一批计算分段并行执行的线程池，用于批量过滤关键字、排行榜排序等
+ * 1.第0段在当前线程执行，其他的交给池里的线程，run返回时全部执行完
+ * 2.线程第一次用到时才创建，之后一直保留，不用每次调用都创建、销毁线程
+ * 3.创建线程失败的段在当前线程执行
+ * 4.只能在主线程调用，不可重入
+ */
+class task_pool
+{
+public:
+    /* @index:段的下标，从0开始
+     * @arg:run传入的参数
+     */
+    typedef void (*routine_t)( int32 index,void *arg );
+public:
+    task_pool();
+    ~task_pool();
+
+    /* 计算count个对象分多少段，每段至少min_chunk个，最多max段，至少1段 */
+    static int32 split( size_t count,size_t min_chunk,int32 max );
+
+    /* 执行routine( 0 ~ num - 1,arg )，返回时全部执行完 */
+    void run( routine_t routine,void *arg,int32 num );
+    /* 停止并销毁所有线程 */
+    void stop();
+private:
+    struct worker
+    {
+        class task_pool *pool;
+        int32 index; // 执行的段下标
+        uint32 seq;  // 已执行的批次
+        pthread_t tid;
+    };
+
+    void spawn( int32 num );
+    void routine( struct worker *worker );
+
+    static void *start_routine( void *arg );
+private:
+    pthread_mutex_t _mutex;
+    pthread_cond_t  _task_cond; // 通知池里的线程有新任务
+    pthread_cond_t  _done_cond; // 通知主线程任务都执行完了
+
+    routine_t _routine;
+    void *_arg;
+    int32 _num;
+    uint32 _seq;    // 批次，每次run加1，线程据此判断有没有新任务
+    int32 _pending; // 池里的线程还没执行完的段数
+    bool _quit;
+
+    std::vector<struct worker *> _worker;
+};
+
+#endif /* __TASK_POOL_H__ */
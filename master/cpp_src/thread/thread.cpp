@@ -1,17 +1,18 @@
+#include <poll.h>
 #include <signal.h>
-#include <arpa/inet.h>  /* htons */
-#include <sys/types.h>
-#include <sys/socket.h>
+#include <sys/eventfd.h>
 
 #include "thread.h"
 #include "../ev/ev_def.h"
-#include "../net/socket.h"
 #include "../system/static_global.h"
 
 thread::thread(const char *name)
 {
-    _fd[0] = -1 ;
-    _fd[1] = -1 ;
+    _child_fd  = -1;
+    _parent_fd = -1;
+    _timeout   = 1000;
+    _child_ntf.store( 0 );
+    _parent_ntf.store( 0 );
 
     _id    = 0;
     _run  = false;
@@ -32,7 +33,7 @@ thread::~thread()
 {
     assert( "thread still running",!_run );
     assert( "io watcher not close",!_watcher.is_active() );
-    assert( "socket pair not close", -1 == _fd[0] && -1 == _fd[1] );
+    assert( "eventfd not close", -1 == _child_fd && -1 == _parent_fd );
 
     if ( !_join ) pthread_detach( pthread_self() );
 
@@ -67,24 +68,23 @@ void thread::signal_block()
 /* 开始线程 */
 bool thread::start( int32 sec,int32 usec )
 {
-    /* fd[0]  父进程
-     * fd[1]  子线程
+    /* 主线程和子线程之间只用来唤醒，具体的通知类型记录在_child_ntf、_parent_ntf
+     * 用eventfd而不是socketpair，多次写入只会累加计数，不存在缓冲区满的问题
      */
-    if ( socketpair( AF_UNIX, SOCK_STREAM,IPPROTO_IP,_fd ) < 0 )
+    _child_fd  = eventfd( 0,EFD_NONBLOCK | EFD_CLOEXEC );
+    _parent_fd = eventfd( 0,EFD_NONBLOCK | EFD_CLOEXEC );
+    if ( _child_fd < 0 || _parent_fd < 0 )
     {
-        ERROR( "thread socketpair fail:%s",strerror(errno) );
+        ERROR( "thread eventfd fail:%s",strerror(errno) );
+        if ( _child_fd  >= 0 ) { ::close( _child_fd  );_child_fd  = -1; }
+        if ( _parent_fd >= 0 ) { ::close( _parent_fd );_parent_fd = -1; }
         return false;
     }
-    socket::non_block( _fd[0] );    /* 主线程fd需要为非阻塞并加入到主循环监听 */
 
-    /* 子线程设置一个超时，阻塞就可以了，没必要用poll(fd太大，不允许使用select) */
-    struct timeval tm;
-    tm.tv_sec  = sec;
-    tm.tv_usec = usec;
-    setsockopt(
-        _fd[1], SOL_SOCKET, SO_RCVTIMEO, &tm.tv_sec,sizeof(struct timeval) );
-    setsockopt(
-        _fd[1], SOL_SOCKET, SO_SNDTIMEO, &tm.tv_sec, sizeof(struct timeval) );
+    /* 子线程用poll等待，超时后运行一次routine */
+    _timeout = sec*1000 + usec/1000;
+    _child_ntf.store( 0 );
+    _parent_ntf.store( 0 );
 
     /* 为了防止子线程创建比主线程运行更快，需要先设置标识 */
     _run = true;
@@ -93,8 +93,10 @@ bool thread::start( int32 sec,int32 usec )
     if ( pthread_create( &_id,NULL,thread::start_routine,(void *)this ) )
     {
         _run = false;
-        ::close( _fd[0] );
-        ::close( _fd[1] );
+        ::close( _child_fd  );
+        ::close( _parent_fd );
+        _child_fd  = -1;
+        _parent_fd = -1;
 
         ERROR( "thread start,create fail:%s",strerror(errno) );
         return false;
@@ -102,7 +104,7 @@ bool thread::start( int32 sec,int32 usec )
 
     _watcher.set( static_global::ev() );
     _watcher.set<thread,&thread::io_cb>( this );
-    _watcher.start( _fd[0],EV_READ );
+    _watcher.start( _parent_fd,EV_READ );
 
     static_global::thread_mgr()->push( this );
 
@@ -135,54 +137,89 @@ void thread::stop()
     _join = true;
 
     if ( _watcher.is_active() ) _watcher.stop();
-    if ( _fd[0] >= 0 ) { ::close( _fd[0] );_fd[0] = -1; }
-    if ( _fd[1] >= 0 ) { ::close( _fd[1] );_fd[1] = -1; }
+    if ( _child_fd  >= 0 ) { ::close( _child_fd  );_child_fd  = -1; }
+    if ( _parent_fd >= 0 ) { ::close( _parent_fd );_parent_fd = -1; }
 
     static_global::thread_mgr()->pop( _id );
 }
 
 void thread::do_routine()
 {
+    struct pollfd pfd;
+    pfd.fd     = _child_fd;
+    pfd.events = POLLIN;
+
     while ( true )
     {
-        int8 notify = 0;
-        int32 sz = ::read( _fd[1],&notify,sizeof(int8) ); /* 阻塞 */
-        if ( sz < 0 )
+        pfd.revents = 0;
+        int32 rv = ::poll( &pfd,1,_timeout ); /* 阻塞 */
+        if ( rv < 0 )
         {
-            /* errno variable is thread safe */
-            if ( errno == EAGAIN || errno == EWOULDBLOCK )
-            {
-                this->routine( NTF_NONE );
-                continue;  // just timeout，超时，需要运行routine，里面有ping机制
-            }
-            else if ( errno == EINTR )
-            {
-                continue; // 系统中断，gdb调试的时候经常遇到
-            }
-
-            ERROR( "thread socketpair broken,"
+            if ( errno == EINTR ) continue; // 系统中断，gdb调试的时候经常遇到
+
+            ERROR_R( "thread poll error,"
                 "thread exit,code %d:%s",errno,strerror(errno) );
-            // socket error,can't notify( fd[0],ERROR );
             break;
         }
-        else if ( 0 == sz )
+        else if ( 0 == rv )
+        {
+            this->routine( NTF_NONE );
+            continue;  // just timeout，超时，需要运行routine，里面有ping机制
+        }
+
+        /* 必须先清空eventfd再取通知，否则取完通知后主线程的再次唤醒会被清掉 */
+        if ( drain( _child_fd ) < 0 )
         {
-            ERROR( "thread socketpair close,thread exit" );
+            ERROR_R( "thread eventfd broken,"
+                "thread exit,code %d:%s",errno,strerror(errno) );
             break;
         }
 
+        int32 ntf = _child_ntf.exchange( 0 );
+
         // TODO:这个变量是辅助用的，出错也没什么。暂不加锁
         _busy = true;
-        this->routine( static_cast<notify_t>(notify) );
+        for ( int32 notify = NTF_ERROR;notify < NTF_MAX;notify ++ )
+        {
+            if ( NTF_EXIT == notify || !(ntf & ntf_bit( notify )) ) continue;
+
+            this->routine( static_cast<notify_t>(notify) );
+        }
         _busy = false;
 
-        if ( NTF_EXIT == static_cast<notify_t>(notify) )
+        /* 退出通知放到最后，保证之前的通知都处理了 */
+        if ( ntf & ntf_bit( NTF_EXIT ) )
         {
+            this->routine( NTF_EXIT );
             break;
         }
     }
 }
 
+bool thread::wait_child( int32 msec )
+{
+    struct pollfd pfd;
+    pfd.fd      = _child_fd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+
+    /* 出错或者被中断都当作超时，调用者会重新计算剩余时间 */
+    if ( ::poll( &pfd,1,msec ) <= 0 ) return false;
+
+    if ( drain( _child_fd ) < 0 )
+    {
+        ERROR_R( "thread eventfd broken,code %d:%s",errno,strerror(errno) );
+        return false;
+    }
+
+    /* 清空eventfd后，保留的通知要重新唤醒，否则do_routine会一直等到超时 */
+    int32 ntf = _child_ntf.exchange( 0 );
+    int32 keep = ntf & ~( ntf_bit( NTF_NONE ) | ntf_bit( NTF_CUSTOM ) );
+    if ( keep && 0 == _child_ntf.fetch_or( keep ) ) wake( _child_fd );
+
+    return true;
+}
+
 /* 线程入口函数 */
 void *thread::start_routine( void *arg )
 {
@@ -208,13 +245,36 @@ void *thread::start_routine( void *arg )
     return NULL;
 }
 
+/* 唤醒对方，eventfd只累加计数，不会因为缓冲区满而失败 */
+int32 thread::wake( int32 fd )
+{
+    uint64 val = 1;
+    int32 sz = ::write( fd,&val,sizeof(val) );
+
+    return sizeof(val) == sz ? 0 : -1;
+}
+
+/* 清空eventfd计数 */
+int32 thread::drain( int32 fd )
+{
+    uint64 val = 0;
+    int32 sz = ::read( fd,&val,sizeof(val) );
+    if ( sz < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
 void thread::notify_child( notify_t notify )
 {
-    assert( "notify_child:socket pair not open",_fd[1] >= 0 );
+    assert( "notify_child:eventfd not open",_child_fd >= 0 );
 
-    int8 val = static_cast<int8>(notify);
-    int32 sz = ::write( _fd[0],&val,sizeof(int8) );
-    if ( sz != sizeof(int8) )
+    /* 之前已有通知未处理，说明已经唤醒过子线程，子线程取通知时会一并处理 */
+    if ( 0 != _child_ntf.fetch_or( ntf_bit( notify ) ) ) return;
+
+    if ( wake( _child_fd ) < 0 )
     {
         ERROR( "notify child error:%s",strerror(errno) );
     }
@@ -222,44 +282,31 @@ void thread::notify_child( notify_t notify )
 
 void thread::notify_parent( notify_t notify )
 {
-    assert( "notify_parent:socket pair not open",_fd[0] >= 0 );
+    assert( "notify_parent:eventfd not open",_parent_fd >= 0 );
+
+    if ( 0 != _parent_ntf.fetch_or( ntf_bit( notify ) ) ) return;
 
-    int8 val = static_cast<int8>(notify);
-    int32 sz = ::write( _fd[1],&val,sizeof(int8) );
-    if ( sz != sizeof(int8) )
+    if ( wake( _parent_fd ) < 0 )
     {
-        ERROR_R( "notify child error:%s",strerror(errno) );
+        ERROR_R( "notify parent error:%s",strerror(errno) );
     }
 }
 
 void thread::io_cb( ev_io &w,int32 revents )
 {
-    int8 event = 0;
-    int32 sz = ::read( _fd[0],&event,sizeof(int8) );
-    if ( sz < 0 )
+    if ( drain( _parent_fd ) < 0 )
     {
-        if ( errno == EAGAIN || errno == EWOULDBLOCK )
-        {
-            assert( "non-block socket,should not happen",false );
-            return;
-        }
-
-        FATAL( "thread socket pair broken:%s",strerror(errno) );
+        FATAL( "thread eventfd broken:%s",strerror(errno) );
 
         return;
     }
-    else if ( 0 == sz )
-    {
-        if ( _run ) FATAL( "thread socketpair should not close" );
 
-        return;
-    }
-    else if ( sizeof(int8) != sz )
+    int32 ntf = _parent_ntf.exchange( 0 );
+    for ( int32 notify = NTF_ERROR;notify < NTF_MAX;notify ++ )
     {
-        FATAL( "socketpair package incomplete,should not happen" );
-
-        return;
+        if ( ntf & ntf_bit( notify ) )
+        {
+            this->notification( static_cast<notify_t>(notify) );
+        }
     }
-
-    this->notification( static_cast<notify_t>(event) );
 }
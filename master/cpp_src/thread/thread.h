@@ -1,6 +1,7 @@
 #ifndef __THREAD_H__
 #define __THREAD_H__
 
+#include <atomic>
 #include <pthread.h>
 
 #include "../ev/ev_watcher.h"
@@ -12,8 +13,8 @@ public:
     virtual ~thread();
     explicit thread(const char *name);
 
-    /* 停止线程 */
-    void stop ();
+    /* 停止线程，子类可以重写以在停止前后处理主线程的缓存 */
+    virtual void stop ();
     /* 开始线程，可设置多长时间超时一次
      * @sec:秒
      * @usec:微秒
@@ -48,9 +49,19 @@ protected:
     virtual bool initialize() = 0;     /* 子线程初始化 */
     virtual bool uninitialize() = 0;    /* 子线程清理 */
 
+    /* 通知会按位合并，对方处理之前重复的通知不会再产生系统调用，因此可以每次
+     * 写入队列后都调用
+     */
     void notify_child( notify_t notify );     /* 通知子线程 */
     void notify_parent( notify_t notify );     /* 通知主线程 */
 
+    /* 在routine中等待主线程的通知，最多等待msec毫秒，用于子线程需要短暂等待更多
+     * 数据的情况，避免sleep轮询。NTF_CUSTOM在这里消耗掉，其他通知保留到routine
+     * 返回后照常处理
+     * return: true 收到通知，false 超时
+     */
+    bool wait_child( int32 msec );
+
     virtual void routine( notify_t notify ) = 0;    /* 子线程通知处理 */
     virtual void notification( notify_t notify ) = 0;    /* 主线程收到通知 */
 
@@ -61,8 +72,16 @@ protected:
 private:
     void do_routine();
     void io_cb( ev_io &w,int32 revents );
+
+    static int32 wake( int32 fd );
+    static int32 drain( int32 fd );
+    static inline int32 ntf_bit( int32 notify ) { return 1 << (notify + 1); }
 private:
-    int32 _fd[2]  ;
+    int32 _child_fd ; /* eventfd，子线程等待，主线程写入 */
+    int32 _parent_fd; /* eventfd，主线程监听，子线程写入 */
+    int32 _timeout  ; /* 子线程超时时间，毫秒 */
+    std::atomic<int32> _child_ntf ; /* 未处理的通知，按位合并 */
+    std::atomic<int32> _parent_ntf;
     ev_io _watcher;
     pthread_t _id;
     volatile bool _run;
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "rank.h"
 #include "../system/static_global.h"
 
@@ -209,48 +211,629 @@ base_rank::object_id_t insertion_rank::get_id_by_rank(object_id_t rank) const
     return _object_list[rank - 1]->_id;
 }
 
-// =========================== bucket rank ================================
-bucket_rank::bucket_rank()
-    : _bucket_list(key_comp)
+// =========================== skiplist rank ================================
+skiplist_rank::skiplist_rank()
 {
+    _max_count = 64; // 排行榜最大数量(默认64)
+    _max_factor = 0; // 当前排行榜使用到的最大排序因子数量
+
+    _level = 1;
+    _seq = 0;
+    _seed = 0x2545F491;
+
+    _tail = NULL;
+    _head = new_node(SKIPLIST_MAX_LEVEL);
+
+    C_OBJECT_ADD("skiplist_rank");
 }
 
-bucket_rank::~bucket_rank()
+skiplist_rank::~skiplist_rank()
 {
     clear();
 
+    del_node(_head);
+    _head = NULL;
+
+    C_OBJECT_DEC("skiplist_rank");
+}
+
+void skiplist_rank::clear()
+{
+    node_t *node = _head->next();
+    while (node)
+    {
+        node_t *next = node->next();
+        del_node(node);
+        node = next;
+    }
+    _object_set.clear();
+
+    for (int32 idx = 0;idx < SKIPLIST_MAX_LEVEL;idx ++)
+    {
+        _head->_level[idx]._forward = NULL;
+        _head->_level[idx]._span = 0;
+    }
+
+    _level = 1;
+    _seq = 0;
+    _tail = NULL;
+
+    _max_factor = 0;
     base_rank::clear();
 }
 
-void bucket_rank::clear()
+skiplist_rank::node_t *skiplist_rank::new_node(int32 level)
 {
-    bucket_list_t::const_iterator iter = _bucket_list.begin();
-    for (;iter != _bucket_list.end();iter ++)
+    node_t *node = new node_t();
+
+    node->_seq = 0;
+    node->_index = 0;
+    node->_backward = NULL;
+    node->_level_cnt = level;
+    node->_level = new level_t[level];
+    for (int32 idx = 0;idx < level;idx ++)
     {
-        delete []iter->first;
+        node->_level[idx]._forward = NULL;
+        node->_level[idx]._span = 0;
     }
 
-    _bucket_list.clear();
+    return node;
 }
 
-int32 bucket_rank::insert(object_id_t id,factor_t factor)
+void skiplist_rank::del_node(node_t *node)
+{
+    delete []node->_level;
+    delete node;
+}
+
+// 随机层数，层数越高概率越小(xorshift，不影响全局的rand)
+int32 skiplist_rank::random_level()
 {
-    bucket_list_t::iterator iter = _bucket_list.find(factor);
-    if (_bucket_list.end() == iter)
+    int32 level = 1;
+    while (level < SKIPLIST_MAX_LEVEL)
+    {
+        _seed ^= _seed << 13;
+        _seed ^= _seed >> 17;
+        _seed ^= _seed << 5;
+        if (0 != _seed % SKIPLIST_P) break;
+
+        level ++;
+    }
+
+    return level;
+}
+
+// 把节点插入到跳表中，节点的排序因子、序号必须已设置好
+void skiplist_rank::link(node_t *node)
+{
+    node_t *update[SKIPLIST_MAX_LEVEL];
+    int32 rank[SKIPLIST_MAX_LEVEL]; // 每一层update节点的排名
+
+    node_t *x = _head;
+    for (int32 idx = _level - 1;idx >= 0;idx --)
     {
-        raw_factor_t *new_factor = new factor_t();
-        for (int32 idx = 0;idx < MAX_RANK_FACTOR;idx ++)
+        rank[idx] = idx == _level - 1 ? 0 : rank[idx + 1];
+        while (x->_level[idx]._forward
+            && is_before(x->_level[idx]._forward,node))
         {
-            new_factor[idx] = factor[idx];
+            rank[idx] += x->_level[idx]._span;
+            x = x->_level[idx]._forward;
         }
-        _bucket_list[new_factor].push_back(id);
+        update[idx] = x;
+    }
+
+    int32 level = node->_level_cnt;
+    if (level > _level)
+    {
+        for (int32 idx = _level;idx < level;idx ++)
+        {
+            rank[idx] = 0;
+            update[idx] = _head;
+            update[idx]->_level[idx]._span = _count;
+        }
+        _level = level;
+    }
+
+    for (int32 idx = 0;idx < level;idx ++)
+    {
+        level_t &prev = update[idx]->_level[idx];
+
+        node->_level[idx]._forward = prev._forward;
+        node->_level[idx]._span = prev._span - (rank[0] - rank[idx]);
+
+        prev._forward = node;
+        prev._span = (rank[0] - rank[idx]) + 1;
+    }
+
+    // 更高的层跨过了这个节点
+    for (int32 idx = level;idx < _level;idx ++)
+    {
+        update[idx]->_level[idx]._span ++;
+    }
+
+    node->_backward = update[0] == _head ? NULL : update[0];
+    if (node->next())
+    {
+        node->next()->_backward = node;
     }
     else
     {
-        iter->second.push_back(id);
+        _tail = node;
+    }
+
+    _count ++;
+}
+
+// 把节点从跳表中移除，但不删除节点。必须在修改排序因子之前调用
+void skiplist_rank::unlink(node_t *node)
+{
+    node_t *update[SKIPLIST_MAX_LEVEL];
+
+    node_t *x = _head;
+    for (int32 idx = _level - 1;idx >= 0;idx --)
+    {
+        while (x->_level[idx]._forward
+            && is_before(x->_level[idx]._forward,node))
+        {
+            x = x->_level[idx]._forward;
+        }
+        update[idx] = x;
+    }
+    assert("skiplist rank unlink corrupt",update[0]->next() == node);
+
+    for (int32 idx = 0;idx < _level;idx ++)
+    {
+        level_t &prev = update[idx]->_level[idx];
+        if (prev._forward == node)
+        {
+            prev._span += node->_level[idx]._span - 1;
+            prev._forward = node->_level[idx]._forward;
+        }
+        else
+        {
+            prev._span --;
+        }
+    }
+
+    if (node->next())
+    {
+        node->next()->_backward = node->_backward;
+    }
+    else
+    {
+        _tail = node->_backward;
+    }
+
+    while (_level > 1 && !_head->_level[_level - 1]._forward) _level --;
+
+    _count --;
+}
+
+void skiplist_rank::raw_remove(node_t *node)
+{
+    unlink(node);
+
+    _object_set.erase(node->_id);
+    del_node(node);
+}
+
+int32 skiplist_rank::remove(object_id_t id)
+{
+    map_t< object_id_t,node_t* >::const_iterator iter = _object_set.find(id);
+    if (iter == _object_set.end()) return -1;
+
+    raw_remove(iter->second);
+
+    return 0;
+}
+
+// 插入一个排序对象，id不可重复
+int32 skiplist_rank::insert(object_id_t id,factor_t factor,int32 max_idx)
+{
+    if (expect_false(max_idx <= 0 || max_idx > MAX_RANK_FACTOR)) return 1;
+
+    if (expect_false(_max_count <= 0)) return 2;
+
+    // 防止重复
+    if (_object_set.find(id) != _object_set.end()) return 3;
+
+    if (expect_false(max_idx > _max_factor)) _max_factor = max_idx;
+
+    // 跳表中的顺序不能因为_max_factor变化而改变，因此总是对比所有因子，没用到的
+    // 因子置0
+    factor_t raw_factor = {0};
+    for (int32 idx = 0;idx < max_idx;idx ++) raw_factor[idx] = factor[idx];
+
+    // 排行榜已满处理
+    if (_count >= _max_count)
+    {
+        // 不在排名之内(因子相同时后插入的排后面)，丢弃
+        int32 cmp = object_t::compare_factor(raw_factor,_tail->_factor);
+        if (cmp <= 0) return 0;
+
+        // 删除掉最后一个,腾出一个空位
+        raw_remove(_tail);
+    }
+
+    node_t *node = new_node(random_level());
+
+    node->_id = id;
+    node->_seq = ++_seq;
+    for (int32 idx = 0;idx < MAX_RANK_FACTOR;idx ++)
+    {
+        node->_factor[idx] = raw_factor[idx];
+    }
+
+    link(node);
+    _object_set[id] = node;
+
+    return 0;
+}
+
+// 更新对象排序因子
+int32 skiplist_rank::update(
+    object_id_t id,raw_factor_t factor,int32 factor_idx)
+{
+    if (expect_false(factor_idx <= 0 || factor_idx > MAX_RANK_FACTOR)) return 1;
+
+    map_t< object_id_t,node_t* >::iterator iter = _object_set.find(id);
+    if (iter == _object_set.end()) return 2;
+
+    node_t *node = iter->second;
+    int32 raw_idx = factor_idx - 1;
+
+    if (node->_factor[raw_idx] == factor) return 0;
+    if (expect_false(factor_idx > _max_factor)) _max_factor = factor_idx;
+
+    int64 old_seq = node->_seq;
+    raw_factor_t old_factor = node->_factor[raw_idx];
+
+    // 排名不变的话直接修改，伤害排行这种频繁更新的，大部分情况下排名不变
+    node_t *next = node->next();
+    node_t *prev = node->_backward;
+
+    node->_factor[raw_idx] = factor;
+    node->_seq = ++_seq;
+    if ((!prev || is_before(prev,node)) && (!next || is_before(node,next)))
+    {
+        return 0;
+    }
+
+    // 需要移动，先用原来的因子、序号从跳表中移除
+    node->_factor[raw_idx] = old_factor;
+    node->_seq = old_seq;
+    unlink(node);
+
+    node->_factor[raw_idx] = factor;
+    node->_seq = _seq;
+    link(node);
+
+    return 0;
+}
+
+// 通过id取排名，返回排名(从1开始),出错返回 -1
+int32 skiplist_rank::get_rank_by_id(object_id_t id) const
+{
+    map_t< object_id_t,node_t* >::const_iterator iter = _object_set.find(id);
+    if (iter == _object_set.end()) return -1;
+
+    const node_t *node = iter->second;
+
+    int32 rank = 0;
+    const node_t *x = _head;
+    for (int32 idx = _level - 1;idx >= 0;idx --)
+    {
+        while (x->_level[idx]._forward
+            && !is_before(node,x->_level[idx]._forward))
+        {
+            rank += x->_level[idx]._span;
+            x = x->_level[idx]._forward;
+        }
+
+        if (x == node) return rank;
+    }
+
+    assert("skiplist rank get rank corrupt",false);
+    return -1;
+}
+
+// 根据id取排序因子
+const base_rank::raw_factor_t *skiplist_rank::get_factor(object_id_t id) const
+{
+    map_t< object_id_t,node_t* >::const_iterator iter = _object_set.find(id);
+    if (iter == _object_set.end()) return NULL;
+
+    return iter->second->_factor;
+}
+
+// 根据排名获取节点
+const skiplist_rank::node_t *skiplist_rank::get_node_by_rank(int32 rank) const
+{
+    if (rank <= 0 || rank > _count) return NULL;
+
+    int32 traversed = 0;
+    const node_t *x = _head;
+    for (int32 idx = _level - 1;idx >= 0;idx --)
+    {
+        while (x->_level[idx]._forward
+            && traversed + x->_level[idx]._span <= rank)
+        {
+            traversed += x->_level[idx]._span;
+            x = x->_level[idx]._forward;
+        }
+
+        if (traversed == rank) return x;
+    }
+
+    return NULL;
+}
+
+//  根据排名获取对象id
+base_rank::object_id_t skiplist_rank::get_id_by_rank(int32 rank) const
+{
+    const node_t *node = get_node_by_rank(rank);
+
+    return node ? node->_id : -1;
+}
+
+// =========================== bucket rank ================================
+// item a是否排在b前面(不含插入顺序，归并时由std::merge保证稳定)
+static inline bool radix_before(
+    const bucket_rank::item_t &a,const bucket_rank::item_t &b)
+{
+    return base_rank::object_t::compare_factor(a._factor,b._factor) > 0;
+}
+
+/* 对一段对象做稳定的基数排序，结果在items中
+ * @tmp:和items一样大小的缓冲区
+ */
+static void radix_sort(
+    bucket_rank::item_t *items,bucket_rank::item_t *tmp,size_t count)
+{
+    static const int32 BYTES = sizeof(uint64);
+    if (count < 2) return;
+
+    // 按max - factor升序即为因子降序，并且只需要排max - min范围内的位
+    base_rank::factor_t max_factor;
+    base_rank::factor_t min_factor;
+    for (int32 fi = 0;fi < MAX_RANK_FACTOR;fi ++)
+    {
+        max_factor[fi] = min_factor[fi] = items[0]._factor[fi];
+    }
+    for (size_t idx = 1;idx < count;idx ++)
+    {
+        for (int32 fi = 0;fi < MAX_RANK_FACTOR;fi ++)
+        {
+            base_rank::raw_factor_t factor = items[idx]._factor[fi];
+            if (factor > max_factor[fi]) max_factor[fi] = factor;
+            if (factor < min_factor[fi]) min_factor[fi] = factor;
+        }
+    }
+
+    bucket_rank::item_t *src = items;
+    bucket_rank::item_t *dst = tmp;
+    size_t bucket[256];
+    for (int32 fi = MAX_RANK_FACTOR - 1;fi >= 0;fi --)
+    {
+        uint64 max = static_cast<uint64>(max_factor[fi]);
+        uint64 range = max - static_cast<uint64>(min_factor[fi]);
+        for (int32 bi = 0;bi < BYTES && (range >> (bi * 8));bi ++)
+        {
+            int32 shift = bi * 8;
+
+            memset(bucket,0,sizeof(bucket));
+            for (size_t idx = 0;idx < count;idx ++)
+            {
+                uint64 key = max - static_cast<uint64>(src[idx]._factor[fi]);
+                bucket[(key >> shift) & 0xFF] ++;
+            }
+
+            // 所有对象这一位都一样，不用排
+            uint64 first = ((max - static_cast<uint64>(src[0]._factor[fi]))
+                >> shift) & 0xFF;
+            if (bucket[first] == count) continue;
+
+            size_t offset = 0;
+            for (int32 di = 0;di < 256;di ++)
+            {
+                size_t cnt = bucket[di];
+                bucket[di] = offset;
+                offset += cnt;
+            }
+
+            for (size_t idx = 0;idx < count;idx ++)
+            {
+                uint64 key = max - static_cast<uint64>(src[idx]._factor[fi]);
+                dst[bucket[(key >> shift) & 0xFF] ++] = src[idx];
+            }
+
+            bucket_rank::item_t *swap = src;
+            src = dst;
+            dst = swap;
+        }
     }
 
+    if (src != items)
+    {
+        memcpy(items,src,sizeof(bucket_rank::item_t) * count);
+    }
+}
+
+struct radix_task
+{
+    bucket_rank::item_t *items;
+    bucket_rank::item_t *tmp;
+    size_t count;
+};
+
+static void radix_routine(int32 index,void *arg)
+{
+    struct radix_task *task = static_cast<struct radix_task *>(arg) + index;
+    radix_sort(task->items,task->tmp,task->count);
+}
+
+bucket_rank::bucket_rank()
+{
+    _sorted = true;
+    _index_mask = 0;
+
+    C_OBJECT_ADD("bucket_rank");
+}
+
+bucket_rank::~bucket_rank()
+{
+    clear();
+
+    C_OBJECT_DEC("bucket_rank");
+}
+
+void bucket_rank::clear()
+{
+    _item.clear();
+    _index.clear();
+
+    _sorted = true;
+    _index_mask = 0;
+    base_rank::clear();
+}
+
+// 插入一个排序对象，id不可重复(不检查，重复的以排名靠前的为准)
+int32 bucket_rank::insert(object_id_t id,factor_t factor)
+{
+    item_t item;
+
+    item._id = id;
+    for (int32 idx = 0;idx < MAX_RANK_FACTOR;idx ++)
+    {
+        item._factor[idx] = factor[idx];
+    }
+    _item.push_back(item);
+
     _count ++;
+    _sorted = false;
 
     return 0;
 }
+
+void bucket_rank::sort(int32 thread_cnt)
+{
+    if (_sorted) return;
+
+    size_t count = _item.size();
+    if (count < 2)
+    {
+        build_index();
+        _sorted = true;
+        return;
+    }
+
+    // 排序用的缓冲区，不需要初始化
+    item_t *tmp = new item_t[count];
+
+    if (thread_cnt > RANK_SORT_THREAD_MAX) thread_cnt = RANK_SORT_THREAD_MAX;
+    int32 chunk_cnt = task_pool::split(count,RANK_SORT_MIN_CHUNK,thread_cnt);
+
+    // 平均分成chunk_cnt段，交给线程池并行排序
+    size_t bound[RANK_SORT_THREAD_MAX + 1];
+    for (int32 idx = 0;idx <= chunk_cnt;idx ++)
+    {
+        bound[idx] = count * idx / chunk_cnt;
+    }
+
+    struct radix_task task[RANK_SORT_THREAD_MAX];
+    for (int32 idx = 0;idx < chunk_cnt;idx ++)
+    {
+        task[idx].items = &_item[0] + bound[idx];
+        task[idx].tmp = tmp + bound[idx];
+        task[idx].count = bound[idx + 1] - bound[idx];
+    }
+    static_global::task_pool()->run(radix_routine,task,chunk_cnt);
+
+    // 相邻的两段两两归并，前一段在前面，因此因子相同的仍按插入顺序
+    item_t *src = &_item[0];
+    item_t *dst = tmp;
+    for (int32 step = 1;step < chunk_cnt;step *= 2)
+    {
+        for (int32 idx = 0;idx < chunk_cnt;idx += step * 2)
+        {
+            size_t begin = bound[idx];
+            size_t mid = bound[idx + step < chunk_cnt ? idx + step : chunk_cnt];
+            size_t end = bound[
+                idx + step * 2 < chunk_cnt ? idx + step * 2 : chunk_cnt];
+
+            std::merge(src + begin,src + mid,
+                src + mid,src + end,dst + begin,radix_before);
+        }
+
+        item_t *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != &_item[0])
+    {
+        memcpy(&_item[0],src,sizeof(item_t) * count);
+    }
+    delete []tmp;
+
+    build_index();
+    _sorted = true;
+}
+
+// 建立id到排名的索引，线性探测的开放寻址，负载不超过50%
+void bucket_rank::build_index()
+{
+    uint32 size = 16;
+    while (size < _item.size() * 2) size *= 2;
+
+    _index_mask = size - 1;
+    _index.assign(size,index_t()); // 值初始化，_rank都为0
+
+    int32 count = static_cast<int32>(_item.size());
+    for (int32 rank = 1;rank <= count;rank ++)
+    {
+        object_id_t id = _item[rank - 1]._id;
+
+        uint32 pos = hash_id(id);
+        while (_index[pos]._rank && _index[pos]._id != id)
+        {
+            pos = (pos + 1) & _index_mask;
+        }
+        if (_index[pos]._rank) continue; // 重复的id
+
+        _index[pos]._id = id;
+        _index[pos]._rank = rank;
+    }
+}
+
+// 通过id取排名，返回排名(从1开始),出错返回 -1
+int32 bucket_rank::get_rank_by_id(object_id_t id) const
+{
+    if (!_sorted || _index.empty()) return -1;
+
+    uint32 pos = hash_id(id);
+    while (_index[pos]._rank)
+    {
+        if (_index[pos]._id == id) return _index[pos]._rank;
+
+        pos = (pos + 1) & _index_mask;
+    }
+
+    return -1;
+}
+
+// 根据排名获取对象id
+base_rank::object_id_t bucket_rank::get_id_by_rank(int32 rank) const
+{
+    if (!_sorted || rank <= 0 || rank > _count) return -1;
+
+    return _item[rank - 1]._id;
+}
+
+// 根据id取排序因子
+const base_rank::raw_factor_t *bucket_rank::get_factor(object_id_t id) const
+{
+    int32 rank = get_rank_by_id(id);
+    if (rank <= 0) return NULL;
+
+    return _item[rank - 1]._factor;
+}
@@ -1,8 +1,7 @@
 #ifndef __RANK_H__
 #define __RANK_H__
 
-#include <map>
-#include <list>
+#include <vector>
 #include "../global/global.h"
 
 /* 排行榜底层数据结构
@@ -96,23 +95,117 @@ private:
     map_t< object_id_t,object_t* > _object_set;
 };
 
-/* 桶排序，只是桶分得比较细，演变成了有序hash map
- * 原本想用std::multimap来实现，但是在C++11之前的版本是无法保证同一个桶中的对象顺序的
- * http://www.cplusplus.com/reference/map/multimap/insert/
- * There are no guarantees on the relative order of equivalent elements
- * 适用场景：一次性大量数据排序，不删除对象，不更新对象，比如全服玩家定时排序
- * 缺点：
- * 1. 占用内存稍大
- * 2. 根据id取排名，根据排名取id都慢。排完序可考虑做缓存
+/* 跳表排序，适用于数量大、排名变化也大的排行榜，比如全服战力、等级排行
+ * insertion_rank在排名变化大时要在数组中逐个移动对象，数量大时插入、删除都是O(N)
+ * 跳表每一层记录到下一个节点跨过的对象数量(span)，插入、更新、删除、根据id取排名、
+ * 根据排名取id都是O(logN)，取某一页只需要定位到第一个再顺序往后取
+ * 1. 排序因子的规则和insertion_rank一样，因子越大越靠前
+ * 2. 因子完全相同时，先插入(或先更新到该值)的排前面
+ * https://en.wikipedia.org/wiki/Skip_list
  */
+#define SKIPLIST_MAX_LEVEL 32 // 最大层数
+#define SKIPLIST_P         4  // 每个节点有1/SKIPLIST_P的概率上升一层
+
+class skiplist_rank : public base_rank
+{
+public:
+    class node_t;
+    struct level_t
+    {
+        node_t *_forward; // 这一层的下一个节点
+        int32 _span;      // 到下一个节点跨过的对象数量
+    };
+
+    // 不使用object_t::_index，排名由跨度计算
+    class node_t : public object_t
+    {
+    public:
+        node_t *next() const { return _level[0]._forward; }
+    public:
+        int64 _seq; // 排序因子相同时，越小越靠前
+        node_t *_backward;
+        int32 _level_cnt;
+        level_t *_level;
+    };
+public:
+    skiplist_rank();
+    ~skiplist_rank();
+
+    void clear();
+
+    int32 remove(object_id_t id);
+    int32 insert(object_id_t id,factor_t factor,int32 max_idx = 1);
+    int32 update(object_id_t id,raw_factor_t factor,int32 factor_idx = 0);
+
+    // 设置排行榜上限，同insertion_rank::set_max_count
+    void set_max_count(int32 max) { _max_count = max; };
+
+    // 获取当前排行榜用到的排序因子数量
+    int32 get_max_factor() const { return _max_factor; };
+
+    int32 get_rank_by_id(object_id_t id) const;
+    const raw_factor_t *get_factor(object_id_t id) const;
+    object_id_t get_id_by_rank(int32 rank) const;
+    // 根据排名(从1开始)获取节点，取某一页时从这个节点开始用next往后遍历
+    const node_t *get_node_by_rank(int32 rank) const;
+private:
+    void link(node_t *node);
+    void unlink(node_t *node);
+    void raw_remove(node_t *node);
+
+    int32 random_level();
+    node_t *new_node(int32 level);
+    void del_node(node_t *node);
+
+    // a是否排在b前面
+    static bool is_before(const node_t *a,const node_t *b)
+    {
+        int32 cmp = object_t::compare_factor(a->_factor,b->_factor);
+        if (0 != cmp) return cmp > 0;
+
+        return a->_seq < b->_seq;
+    }
+private:
+    int32 _max_count; // 排行榜最大数量
+    uint8 _max_factor; // 当前排行榜使用到的最大排序因子数量(从1开始)
+
+    int32 _level; // 当前最大层数
+    int64 _seq;   // 插入、更新的序号
+    uint32 _seed; // 随机层数用的种子
+
+    node_t *_head; // 头节点，不存数据
+    node_t *_tail;
+    map_t< object_id_t,node_t* > _object_set;
+};
+
+/* 桶排序，即基数排序(LSD)，适用于一次性大量数据排序，比如全服玩家定时排序
+ * 1. insert只是把对象追加到数组，sort之后才能查询
+ * 2. 排序因子越大越靠前，因子相同的按插入顺序
+ * 3. 8位一个桶，从最后一个因子的最低位开始，所有对象在某一位上都相同的直接跳过，
+ *    因此因子的范围越小越快
+ * 4. 数量大时可以分给线程池(见task_pool)的多个线程各排一段，再归并
+ * 5. 排序后对象数组即为排名，另外建一个id到排名的开放寻址索引，根据排名取id、根据
+ *    id取排名都是O(1)
+ * 6. 不支持删除、更新，需要的话clear后重新插入再排序
+ */
+#define RANK_SORT_THREAD_MAX 16     // 排序最大线程数
+#define RANK_SORT_MIN_CHUNK  65536  // 每个线程至少排序的对象数量
 
 class bucket_rank : public base_rank
 {
 public:
-    typedef std::list<object_id_t> bucket_t;
-    typedef bool (*key_comp_t)(const factor_t src,const factor_t dest);
-    typedef std::map< raw_factor_t*,bucket_t,key_comp_t > bucket_list_t;
+    struct item_t
+    {
+        factor_t _factor;
+        object_id_t _id;
+    };
 
+    // id到排名的索引，_rank为0表示空位
+    struct index_t
+    {
+        object_id_t _id;
+        int32 _rank;
+    };
 public:
     bucket_rank();
     ~bucket_rank();
@@ -120,14 +213,30 @@ public:
     void clear();
     int32 insert(object_id_t id,factor_t factor);
 
-    // strict weak order,operator <
-    static bool key_comp(const factor_t src,const factor_t dest)
+    // 预先分配内存，批量插入前调用
+    void reserve(int32 count) { _item.reserve(count); }
+
+    /* 排序并建立索引
+     * @thread_cnt:最多使用的线程数，数量少时不会开线程
+     */
+    void sort(int32 thread_cnt = 1);
+    bool is_sorted() const { return _sorted; }
+
+    // 以下接口需要先排序，排名从1开始，出错返回 -1
+    int32 get_rank_by_id(object_id_t id) const;
+    object_id_t get_id_by_rank(int32 rank) const;
+    const raw_factor_t *get_factor(object_id_t id) const;
+private:
+    void build_index();
+    uint32 hash_id(object_id_t id) const
     {
-        // TODO:这里暂时没法按_max_factor来对比排序因子，只能全部都对比
-        return object_t::compare_factor(src,dest) < 0;
+        return (static_cast<uint32>(id) * 2654435761u) & _index_mask;
     }
 protected:
-    bucket_list_t _bucket_list;
+    bool _sorted;
+    std::vector<item_t> _item; // 排序后即为排名
+    uint32 _index_mask;
+    std::vector<index_t> _index;
 };
 
 #endif /* __RANK_H__ */
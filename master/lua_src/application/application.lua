@@ -156,6 +156,21 @@ end
 -- 加载各个子模块
 function Application:module_initialize()
     require "modules.module_header"
+
+    self:set_ev_backend()
+end
+
+-- 根据配置设置事件循环后端，已监听的fd、已启动的定时器会自动迁移到新后端
+function Application:set_ev_backend()
+    if "wheel" == g_setting.ev_timer then
+        ev:set_timer_backend( ev.TIMER_WHEEL )
+    end
+
+    if "uring" ~= g_setting.ev_backend then return end
+
+    if ev.BACKEND_URING ~= ev:set_backend( ev.BACKEND_URING ) then
+        ERROR( "io_uring backend not support,use epoll instead" )
+    end
 end
 
 -- 设置初始化后续动作
@@ -260,6 +275,9 @@ function Application:db_initialize()
     g_mongodb:start( g_setting.mongo_ip,
         g_setting.mongo_port,g_setting.mongo_user,
         g_setting.mongo_pwd,g_setting.mongo_db,callback )
+    if g_setting.mongo_batch then
+        g_mongodb:set_batch( g_setting.mongo_batch )
+    end
 end
 
 -- 加载自增id
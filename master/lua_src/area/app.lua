@@ -41,6 +41,7 @@ end
 
 -- 重写关服接口
 function App:shutdown()
+    g_map_mgr:stop_async() -- 关闭异步寻路线程
     Application.shutdown( self )
 end
 
@@ -1,8 +1,9 @@
 -- aoi算法测试
 
 local Aoi = require "Aoi"
+local ListAoi = require "ListAoi"
 
-local aoi = Aoi()
+local aoi = nil -- 当前测试的aoi，九宫格和十字链表用同一套测试
 
 local pix = 64 -- 一个格子边长64像素
 local width = 64 -- 地图格子宽度
@@ -12,9 +13,6 @@ local visual_height = 4 -- 视野高度格子数
 
 local is_valid = true -- 测试性能时不做校验
 
-aoi:set_size(width*pix,height*pix)
-aoi:set_visual_range(visual_width,visual_height)
-
 local entity_info = {}
 
 -- 实体类型
@@ -183,18 +181,22 @@ end
 -- 坐标传入的都是像素
 local max_width = width*pix
 local max_heigth = height*pix
-enter(99997,max_width,0,ET_NPC,1)
-enter(99998,0,max_heigth,ET_MONSTER,0)
-enter(99999,max_width,max_heigth,ET_PLAYER,1)
 
-update(99997,0,max_heigth) -- 进入同一个格子
-update(99998,max_width,max_heigth) -- 离开有人的格子
-update(99997,max_width,max_heigth) -- 三个实体在同一个格子
-update(99999,max_width - 1,max_heigth - 1) -- 测试视野范围内移动
+-- 临界测试
+local function boundary_test()
+    enter(99997,max_width,0,ET_NPC,1)
+    enter(99998,0,max_heigth,ET_MONSTER,0)
+    enter(99999,max_width,max_heigth,ET_PLAYER,1)
+
+    update(99997,0,max_heigth) -- 进入同一个格子
+    update(99998,max_width,max_heigth) -- 离开有人的格子
+    update(99997,max_width,max_heigth) -- 三个实体在同一个格子
+    update(99999,max_width - 1,max_heigth - 1) -- 测试视野范围内移动
 
-exit(99997)
-exit(99998)
-exit(99999)
+    exit(99997)
+    exit(99998)
+    exit(99999)
+end
 
 -- 上面做一些临界测试，下面开始做随机测试
 local max_entity = 2000
@@ -255,7 +257,117 @@ local function random_test()
     end
 end
 
-f_tm_start()
--- is_valid = false -- 仅在测试性能时为false
-random_test()
-f_tm_stop( "aoi cost") -- aoi cost        617882  microsecond
+
+-- 攻城战这种大量玩家挤在少数几个格子里的场景，主要测试格子和watch_me列表的删除
+-- 格子改为数组存放，删除不再遍历列表后，这个测试耗时大概降为原来的一半
+local max_crowd = 500
+local max_crowd_update = 20000
+local function crowd_test()
+    for id in pairs(entity_info) do exit(id) end
+
+    local span = 6*pix -- 所有实体挤在6x6个格子内
+    local sx = math.floor(max_width/2)
+    local sy = math.floor(max_heigth/2)
+    for idx = 1,max_crowd do
+        enter(idx,sx + math.random(0,span),sy + math.random(0,span),ET_PLAYER,1)
+    end
+
+    for idx = 1,max_crowd_update do
+        local id = math.random(1,max_crowd)
+        update(id,sx + math.random(0,span),sy + math.random(0,span))
+    end
+
+    for id in pairs(entity_info) do exit(id) end
+end
+
+-- 每帧大量怪物移动，测试逐个更新和批量更新的差别
+local max_tick = 100
+local max_tick_move = 300
+local function batch_test()
+    for id in pairs(entity_info) do exit(id) end
+
+    -- 少量玩家关注事件，大量怪物移动
+    for idx = 1,max_crowd do
+        local x = math.random(0,max_width)
+        local y = math.random(0,max_heigth)
+        if idx <= 50 then
+            enter(idx,x,y,ET_PLAYER,1)
+        else
+            enter(idx,x,y,ET_MONSTER,0)
+        end
+    end
+
+    local function random_move()
+        local id = math.random(51,max_crowd)
+        local et = entity_info[id]
+        et.x = math.max(0,math.min(max_width,et.x + math.random(-pix,pix)))
+        et.y = math.max(0,math.min(max_heigth,et.y + math.random(-pix,pix)))
+
+        return et
+    end
+
+    local list_in = {}
+    local list_out = {}
+    f_tm_start()
+    for tick = 1,max_tick do
+        for idx = 1,max_tick_move do
+            local et = random_move()
+            aoi:update_entity(et.id,et.x,et.y,nil,list_in,list_out)
+        end
+    end
+    f_tm_stop( "    single update cost")
+
+    local moves = {}
+    f_tm_start()
+    for tick = 1,max_tick do
+        local index = 0
+        for idx = 1,max_tick_move do
+            local et = random_move()
+            moves[index + 1] = et.id
+            moves[index + 2] = et.x
+            moves[index + 3] = et.y
+            index = index + 3
+        end
+        moves.n = index
+        local failed = aoi:update_entitys(moves,nil,list_in,list_out)
+        assert(not failed)
+
+        -- 按接收者分组:{接收者id,数量,实体id...}
+        local idx = 1
+        while idx <= list_in.n do
+            local watcher = entity_info[list_in[idx]]
+            assert(watcher and 0 ~= watcher.event)
+            idx = idx + 2 + list_in[idx + 1]
+        end
+        assert(idx == list_in.n + 1)
+    end
+    f_tm_stop( "    batch update cost")
+
+    for id in pairs(entity_info) do exit(id) end
+end
+
+-- 用同一套测试分别测试不同的aoi算法
+local function run_test(name,AoiClass)
+    aoi = AoiClass()
+    aoi:set_size(width*pix,height*pix)
+    aoi:set_visual_range(visual_width,visual_height)
+
+    is_valid = true
+    boundary_test()
+
+    f_tm_start()
+    -- is_valid = false -- 仅在测试性能时为false
+    random_test()
+    f_tm_stop( name .. " cost") -- aoi cost        617882  microsecond
+
+    is_valid = false
+    f_tm_start()
+    crowd_test()
+    f_tm_stop( name .. " crowd cost")
+
+    PRINT(name .. " batch test")
+    batch_test()
+end
+
+run_test("aoi",Aoi)
+run_test("list aoi",ListAoi)
@@ -830,3 +830,83 @@ f_tm_start()
 local xml_tb = xml.decode_from_file( "arena.xml" )
 f_tm_stop( "xml decode cost")
 -- vd( xml_tb )
+
+-- bson、自定义二进制流(stream)、pbc、upb编码对比，用的是邮件列表协议
+local network_mgr = network_mgr
+network_mgr:load_one_schema( network_mgr.CDC_PROTOBUF,"pb" )
+if network_mgr.CDC_UPB then -- 编译时USE_UPB=1才有
+    network_mgr:load_one_schema( network_mgr.CDC_UPB,"pb" )
+end
+network_mgr:load_one_schema( network_mgr.CDC_STREAM,"proto/stream_field.txt" )
+
+local mail_pkt = { mails = {} }
+for idx = 1,20 do
+    local mail = {
+        id = idx,title = "title" .. idx,ctx = string.rep( "c",64 ),new = true,
+        attachments = {}
+    }
+    for sub_idx = 1,4 do
+        table.insert( mail.attachments,
+            { uuid = "uuid" .. sub_idx,id = 10000 + sub_idx,count = sub_idx } )
+    end
+    table.insert( mail_pkt.mails,mail )
+end
+
+-- 执行times次，返回每秒次数
+local function ops_per_sec( times,func )
+    local sec,usec = util.timeofday()
+    for idx = 1,times do func() end
+    local end_sec,end_usec = util.timeofday()
+
+    local elapsed = (end_sec - sec) * 1000000 + end_usec - usec
+    return math.floor( times * 1000000 / math.max( elapsed,1 ) )
+end
+
+local codec_times = 10000
+local codec_list = {
+    { "bson",network_mgr.CDC_BSON },
+    { "stream",network_mgr.CDC_STREAM },
+    { "pbc",network_mgr.CDC_PROTOBUF },
+}
+if network_mgr.CDC_UPB then
+    table.insert( codec_list,{ "upb",network_mgr.CDC_UPB } )
+end
+for _,codec in pairs( codec_list ) do
+    local name,codec_ty = codec[1],codec[2]
+
+    local buffer
+    local encode_ops = ops_per_sec( codec_times,function()
+        buffer = network_mgr:encode(
+            codec_ty,"mail.pb","mail.SMailInfo",mail_pkt )
+    end )
+
+    local decode_pkt
+    local decode_ops = ops_per_sec( codec_times,function()
+        decode_pkt = network_mgr:decode(
+            codec_ty,"mail.pb","mail.SMailInfo",buffer )
+    end )
+
+    print( string.format( "%-8s size %5d,encode %8d ops/sec,decode %8d ops/sec",
+        name,#buffer,encode_ops,decode_ops ) )
+
+    assert( #decode_pkt.mails == #mail_pkt.mails )
+    assert( decode_pkt.mails[20].attachments[4].id == 10004 )
+end
+
+-- 客户端高频指令(移动)解码，字段名从缓存中取，table按字段数量预分配
+local move_pkt = { way = 1,pix_x = 1024,pix_y = 768 }
+local move_times = 100000
+for idx = 3,#codec_list do -- pbc、upb
+    local name,codec_ty = codec_list[idx][1],codec_list[idx][2]
+    local buffer = network_mgr:encode(
+        codec_ty,"entity.pb","entity.CMove",move_pkt )
+
+    local decode_pkt
+    local decode_ops = ops_per_sec( move_times,function()
+        decode_pkt = network_mgr:decode(
+            codec_ty,"entity.pb","entity.CMove",buffer )
+    end )
+    print( string.format( "%-8s CMove decode %8d ops/sec",name,decode_ops ) )
+
+    assert( decode_pkt.pix_x == move_pkt.pix_x )
+end
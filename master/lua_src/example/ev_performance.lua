@@ -0,0 +1,147 @@
+-- ev_performance.lua
+
+-- 事件循环后端测试：同样的连接、同样的收发，epoll和io_uring的耗时对比
+-- 建立max_conn对本地连接，其中active对互相收发，其余空闲，统计处理times个包的cpu时间
+
+local conn_mgr = require "network.conn_mgr"
+local timer_mgr = require "timer.timer_mgr"
+
+local network_mgr = network_mgr
+
+local ip = "127.0.0.1"
+local port = 10005
+local max_conn = 1000 -- 连接数
+local active = 50 -- 同时收发的连接数
+local times = 200000 -- 每个后端处理的包数量
+local cmd = 1
+
+local pkt = { ctx = "ping" }
+
+network_mgr:set_ss_cmd( cmd,"","" )
+
+local backends =
+{
+    { name = "epoll",backend = ev.BACKEND_EPOLL },
+    { name = "uring",backend = ev.BACKEND_URING },
+}
+
+local Bench = oo.class( nil,"Bench" )
+
+function Bench:__init()
+    self.clt_list = {}
+    self.srv_list = {}
+    self.connected = 0
+    self.running = false
+end
+
+local function set_conn_param( conn_id )
+    network_mgr:set_conn_io( conn_id,network_mgr.IOT_NONE )
+    network_mgr:set_conn_codec( conn_id,network_mgr.CDC_BSON )
+    network_mgr:set_conn_packet( conn_id,network_mgr.PKT_STREAM )
+end
+
+local Bench_conn = oo.class( nil,"Bench_conn" )
+
+function Bench_conn:__init( bench,conn_id )
+    self.bench = bench
+    self.conn_id = conn_id
+end
+
+function Bench_conn:conn_new( ecode )
+    if 0 ~= ecode then
+        PRINTF( "ev bench conn error:%d",ecode )
+        return
+    end
+
+    set_conn_param( self.conn_id )
+    self.bench:one_connected()
+end
+
+function Bench_conn:command_new()
+    local bench = self.bench
+    if not bench.running then return end
+
+    bench.count = bench.count + 1
+    if bench.count >= times then return bench:finish() end
+
+    network_mgr:send_s2s_packet( self.conn_id,cmd,0,pkt )
+end
+
+function Bench_conn:conn_del()
+end
+
+function Bench:one_connected()
+    self.connected = self.connected + 1
+    if self.connected < max_conn*2 then return end
+
+    self.index = 0
+    self:next_backend()
+end
+
+function Bench:conn_accept( new_conn_id )
+    set_conn_param( new_conn_id )
+
+    local new_conn = Bench_conn( self,new_conn_id )
+    table.insert( self.srv_list,new_conn )
+    self:one_connected()
+
+    return new_conn
+end
+
+-- 切换到下一个后端，已监听的连接会自动迁移
+function Bench:next_backend()
+    self.index = self.index + 1
+
+    local bk = backends[self.index]
+    if not bk then
+        -- 恢复配置中的后端
+        ev:set_backend( "uring" == g_setting.ev_backend
+            and ev.BACKEND_URING or ev.BACKEND_EPOLL )
+        return
+    end
+
+    if bk.backend ~= ev:set_backend( bk.backend ) then
+        PRINTF( "ev backend %s not support",bk.name )
+        return self:next_backend()
+    end
+
+    self.count = 0
+    self.running = true
+    self.beg = os.clock()
+    for idx = 1,active do
+        network_mgr:send_s2s_packet( self.clt_list[idx].conn_id,cmd,0,pkt )
+    end
+end
+
+function Bench:finish()
+    local cost = os.clock() - self.beg
+    self.running = false
+
+    PRINTF( "ev %s: %d conn,%d active,%d packets,cost %.3fs,%.0f packets/sec",
+        backends[self.index].name,max_conn,active,times,cost,times/cost )
+
+    -- 等还在路上的包收完再切换后端
+    self.timer = timer_mgr:new_timer( self,0.1 )
+    timer_mgr:start_timer( self.timer )
+end
+
+function Bench:do_timer()
+    timer_mgr:del_timer( self.timer )
+    self:next_backend()
+end
+
+function Bench:start()
+    self.conn_id = network_mgr:listen( ip,port,network_mgr.CNT_SSCN )
+    conn_mgr:set_conn( self.conn_id,self )
+
+    for idx = 1,max_conn do
+        local conn = Bench_conn( self )
+        conn.conn_id = network_mgr:connect( ip,port,network_mgr.CNT_SSCN )
+        conn_mgr:set_conn( conn.conn_id,conn )
+        table.insert( self.clt_list,conn )
+    end
+end
+
+-- 这里创建的对象要放到全局引用，不然会被释放掉，就没法回调了
+ev_bench = Bench()
+ev_bench:start()
@@ -117,6 +117,43 @@ function Mongo_performan:remove_test()
     g_mongodb:remove( collection,'{"_id":{"$gt":20,"$lt":30}}',true )
 end
 
+-- 模拟玩家定时存库，测试每秒完成的写操作数量(从发起到回调)
+-- @window 合并窗口，毫秒。0表示不合并，每个操作单独执行
+local max_save = 20000
+function Mongo_performan:save_test( window,on_done )
+    g_mongodb:set_batch( window )
+
+    local finish = 0
+    local sec,usec = util.timeofday()
+    local callback = function( ecode )
+        if 0 ~= ecode then ERROR( "save test error:%d",ecode ) end
+
+        finish = finish + 1
+        if finish < max_save then return end
+
+        local nsec,nusec = util.timeofday()
+        local msec = ((nsec - sec)*1000000 + nusec - usec)/1000
+        print( string.format( "save test window %dms:%d ops in %.1f msec,%.0f ops/sec",
+            window,max_save,msec,max_save*1000/msec ) )
+
+        if on_done then on_done() end
+    end
+
+    for i = 1,max_save do
+        local save = '{"$set":{"amount":' .. i*100 .. ',"op_time":' .. ev:time() .. '}}'
+        g_mongodb:update( "player_save",
+            '{"_id":' .. (i % 1000) .. '}',save,true,false,callback )
+    end
+end
+
+-- 对比不合并和合并后的吞吐量
+function Mongo_performan:batch_test()
+    print( "start batch test" )
+    self:save_test( 0,function()
+        self:save_test( 20,function() g_mongodb:set_batch( 0 ) end )
+    end )
+end
+
 Mongo_performan:table_insert_test()
 Mongo_performan:count_test()
 Mongo_performan:json_insertion_test()
@@ -124,3 +161,4 @@ Mongo_performan:find_test()
 Mongo_performan:update_test()
 Mongo_performan:sort_test()
 Mongo_performan:remove_test()
+Mongo_performan:batch_test()
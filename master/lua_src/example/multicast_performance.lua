@@ -0,0 +1,182 @@
+-- multicast_performance.lua
+
+-- 广播测试：同一个数据包发往大量连接时，拷贝和引用共享帧的字节数对比
+-- 一半的连接用普通发送缓冲区(每个连接拷贝一次)，另一半用分段发送缓冲区(引用共享帧)
+-- 服务器连接用srv_multicast，客户端连接用clt_multicast。每轮广播和单发交替，模拟场景里
+-- 实体广播和玩家自己的协议交错发送，每轮之间等主循环把数据发出去
+
+local conn_mgr = require "network.conn_mgr"
+local timer_mgr = require "timer.timer_mgr"
+
+local network_mgr = network_mgr
+
+local ip = "127.0.0.1"
+local srv_port = 10003
+local clt_port = 10004
+local max_conn = 256 -- 模拟一个场景256个玩家
+local rounds = 10 -- 轮数
+local burst = 16 -- 每轮广播、单发交替的次数
+local ss_cmd = 1
+local sc_cmd = 2
+
+-- 广播包体1k左右，比较接近场景中的实体广播，单发的包比较小
+local multicast_pkt = { ctx = string.rep( "m",1024 ) }
+local unicast_pkt = { ctx = string.rep( "u",32 ) }
+
+network_mgr:set_ss_cmd( ss_cmd,"","" )
+network_mgr:set_sc_cmd( sc_cmd,"","" )
+
+local function set_conn_param( conn_id )
+    network_mgr:set_conn_io( conn_id,network_mgr.IOT_NONE )
+    network_mgr:set_conn_codec( conn_id,network_mgr.CDC_BSON )
+    network_mgr:set_conn_packet( conn_id,network_mgr.PKT_STREAM )
+end
+
+local Bench_conn = oo.class( nil,"Bench_conn" )
+
+function Bench_conn:__init( conn_id )
+    self.conn_id = conn_id
+    self.recv = 0
+end
+
+function Bench_conn:connect( ip,port,conn_ty )
+    self.conn_id = network_mgr:connect( ip,port,conn_ty )
+    conn_mgr:set_conn( self.conn_id,self )
+end
+
+function Bench_conn:conn_new( ecode )
+    if 0 ~= ecode then
+        PRINTF( "multicast conn error:%d",ecode )
+        return
+    end
+
+    set_conn_param( self.conn_id )
+end
+
+function Bench_conn:command_new()
+    self.recv = self.recv + 1
+end
+
+function Bench_conn:conn_del()
+end
+
+-- 一次测试：accept的连接一半拷贝，一半引用，收包的连接用来校验所有包都收到了
+local Bench = oo.class( nil,"Bench" )
+
+function Bench:__init( name,conn_ty,cmd,multicast,unicast )
+    self.name = name
+    self.conn_ty = conn_ty
+    self.cmd = cmd
+    self.multicast = multicast
+    self.unicast = unicast
+
+    self.accept_list = {}
+    self.recv_list = {}
+end
+
+-- @list:发送的连接id
+-- @return:拷贝的字节数，引用的字节数，耗时
+function Bench:run_round( list )
+    local before = statistic.dump().multicast
+
+    local beg = os.clock()
+    for idx = 1,burst do
+        local sent = network_mgr[self.multicast](
+            network_mgr,list,network_mgr.CDC_BSON,self.cmd,0,multicast_pkt )
+        assert( sent == #list,"multicast not all sent" )
+
+        -- 发送失败时会直接抛错误
+        for _,conn_id in pairs( list ) do
+            network_mgr[self.unicast](
+                network_mgr,conn_id,self.cmd,0,unicast_pkt )
+        end
+    end
+    local cost = os.clock() - beg
+
+    local after = statistic.dump().multicast
+    return after.copy_bytes - before.copy_bytes,
+        after.refer_bytes - before.refer_bytes,cost
+end
+
+function Bench:start()
+    self.copy_list = {}
+    self.refer_list = {}
+    for idx,conn in pairs( self.accept_list ) do
+        if 0 == idx % 2 then
+            table.insert( self.copy_list,conn.conn_id )
+        else
+            network_mgr:set_send_segment( conn.conn_id,true )
+            table.insert( self.refer_list,conn.conn_id )
+        end
+    end
+
+    self.round = 0
+    self.copy = { bytes = 0,cost = 0 }
+    self.refer = { bytes = 0,cost = 0 }
+
+    -- 每轮之间让主循环把发送缓冲区的数据发出去
+    self.timer = timer_mgr:new_timer( self,0.05,0.05 )
+    timer_mgr:start_timer( self.timer )
+end
+
+function Bench:do_timer()
+    if self.round < rounds then
+        self.round = self.round + 1
+
+        local bytes,_,cost = self:run_round( self.copy_list )
+        self.copy.bytes = self.copy.bytes + bytes
+        self.copy.cost = self.copy.cost + cost
+
+        local _,bytes,cost = self:run_round( self.refer_list )
+        self.refer.bytes = self.refer.bytes + bytes
+        self.refer.cost = self.refer.cost + cost
+        return
+    end
+
+    -- 等所有连接收完
+    local expect = rounds*burst*2
+    for _,conn in pairs( self.recv_list ) do
+        if conn.recv < expect then return end
+        assert( conn.recv == expect,"receive more packet than sent" )
+    end
+
+    timer_mgr:del_timer( self.timer )
+
+    local times = rounds*burst
+    for _,result in pairs( { { "copy",self.copy },{ "refer",self.refer } } ) do
+        PRINTF( "%s %s %d conn %d times,cost %.3fs,%d bytes(%d per broadcast)",
+            self.name,result[1],max_conn//2,times,result[2].cost,
+            result[2].bytes,result[2].bytes//times )
+    end
+end
+
+function Bench:conn_accept( new_conn_id )
+    set_conn_param( new_conn_id )
+
+    local new_conn = Bench_conn( new_conn_id )
+    table.insert( self.accept_list,new_conn )
+    if #self.accept_list == max_conn then self:start() end
+
+    return new_conn
+end
+
+function Bench:listen( ip,port,recv_ty )
+    self.conn_id = network_mgr:listen( ip,port,self.conn_ty )
+    conn_mgr:set_conn( self.conn_id,self )
+    PRINTF( "%s multicast listen at %s:%d",self.name,ip,port )
+
+    for idx = 1,max_conn do
+        local conn = Bench_conn()
+        conn:connect( ip,port,recv_ty )
+        table.insert( self.recv_list,conn )
+    end
+end
+
+-- 这里创建的对象要放到全局引用，不然会被释放掉，就没法回调了
+srv_bench = Bench( "srv",network_mgr.CNT_SSCN,
+    ss_cmd,"srv_multicast","send_s2s_packet" )
+srv_bench:listen( ip,srv_port,network_mgr.CNT_SSCN )
+
+clt_bench = Bench( "clt",network_mgr.CNT_SCCN,
+    sc_cmd,"clt_multicast","send_clt_packet" )
+clt_bench:listen( ip,clt_port,network_mgr.CNT_CSCN )
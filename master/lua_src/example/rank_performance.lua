@@ -89,3 +89,101 @@ for idx = 1,#random_f do
     brank:insert(idx,random_f[idx])
 end
 f_tm_stop("bucket rank cost")
+
+f_tm_start()
+brank:make_cache()
+f_tm_stop("bucket rank sort cost")
+
+-- 全服批量排序：底层基数排序，可以多线程
+local Bucket_rank_core = require "Bucket_rank"
+local bcore = Bucket_rank_core()
+
+local max_player = 1000000
+local list = {}
+for idx = 1,max_player do
+    list[#list + 1] = idx
+    list[#list + 1] = math.random(1,200)        -- 等级
+    list[#list + 1] = math.random(1,max_random) -- 战力
+end
+
+for _,thread_cnt in pairs({1,4}) do
+    bcore:clear()
+    bcore:insert_list(list,2)
+
+    f_tm_start()
+    bcore:sort(thread_cnt)
+    f_tm_stop(string.format("bucket rank %d thread sort cost",thread_cnt))
+end
+
+for idx = 1,bcore:get_count() - 1 do
+    local lv1,power1 = bcore:get_factor(bcore:get_id_by_rank(idx))
+    local lv2,power2 = bcore:get_factor(bcore:get_id_by_rank(idx + 1))
+    assert(lv1 > lv2 or (lv1 == lv2 and power1 >= power2))
+end
+assert(bcore:get_rank_by_id(bcore:get_id_by_rank(100)) == 100)
+
+-- 跳表排行榜和插入法排行榜对比
+local Insertion_rank_core = require "Insertion_rank"
+local Skiplist_rank = require "Skiplist_rank"
+
+-- 先用不重复的因子检查两种排行榜的结果是否一致
+local icore = Insertion_rank_core()
+local srank = Skiplist_rank()
+icore:set_max_count(1000)
+srank:set_max_count(1000)
+for idx = 1,2000 do
+    local ft = idx * 7919 % 100003
+    icore:insert(idx,ft)
+    srank:insert(idx,ft)
+end
+for idx = 1,1000 do
+    local id = math.random(1,2000)
+    local ft = 100003 + idx
+    icore:update(id,ft)
+    srank:update(id,ft)
+end
+for idx = 1,500 do
+    local id = math.random(1,2000)
+    icore:remove(id)
+    srank:remove(id)
+end
+assert(icore:get_count() == srank:get_count())
+for idx = 1,icore:get_count() do
+    local id = icore:get_id_by_rank(idx)
+    assert(id == srank:get_id_by_rank(idx))
+    assert(idx == srank:get_rank_by_id(id))
+end
+
+-- 取第3页，每页20个
+local page = {}
+srank:get_range(41,60,page)
+for idx = 1,page.n do
+    assert(page[idx] == icore:get_id_by_rank(40 + idx))
+end
+
+local function rank_test(rank,name,max_object)
+    rank:clear()
+    rank:set_max_count(max_object)
+
+    f_tm_start()
+    for idx = 1,max_object do
+        rank:insert(idx,math.random(1,max_random),math.random(1,max_random))
+    end
+    for idx = 1,max_object do
+        rank:update(math.random(1,max_object),math.random(1,max_random))
+    end
+    for idx = 1,max_object do
+        local rank_id = rank:get_id_by_rank(math.random(1,max_object))
+        rank:get_rank_by_id(rank_id)
+    end
+    for idx = 1,max_object/2 do
+        rank:remove(math.random(1,max_object))
+    end
+    f_tm_stop(string.format("%s %d rank cost",name,max_object))
+end
+
+for _,max_object in pairs({1000,10000,100000}) do
+    rank_test(icore,"insertion",max_object)
+    rank_test(srank,"skiplist",max_object)
+end
+-- 在排名变化大的情况下，insertion_rank的插入、删除都是O(N)，数量越大差距越明显
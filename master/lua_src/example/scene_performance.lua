@@ -108,4 +108,177 @@ test_path(id,1,1,2,1,path,false)
 test_path(id,0,1,10,1,path,false)
 test_path(id,0,1,9,4,path,false)
 test_path(id,0,1,40,3,path,false)
-test_path(id,16,4,40,3,path,true)
\ No newline at end of file
+test_path(id,16,4,40,3,path,true)
+
+-- 256x256迷宫寻路测试，长路径会搜索大量格子，主要测试open set和格子内存池的效率
+local maze_id = 9998
+local maze_size = 256
+local max_maze_path = 1000
+
+-- 随机深度优先生成迷宫，奇数坐标为房间，偶数坐标为墙
+local function make_maze()
+    local maze = Map()
+    if not maze:set(maze_id,maze_size,maze_size) then
+        PRINT("create maze error")
+        return
+    end
+
+    local max_room = maze_size - 2
+    local visit = {}
+    local stack = {}
+
+    maze:fill(1,1,1)
+    visit[1*maze_size + 1] = true
+    table.insert(stack,{1,1})
+
+    local dirs = { {2,0},{-2,0},{0,2},{0,-2} }
+    while #stack > 0 do
+        local room = stack[#stack]
+        local x,y = room[1],room[2]
+
+        local next_room = {}
+        for _,dir in pairs(dirs) do
+            local nx,ny = x + dir[1],y + dir[2]
+            if nx > 0 and ny > 0 and nx <= max_room and ny <= max_room
+                and not visit[nx*maze_size + ny] then
+                table.insert(next_room,{nx,ny})
+            end
+        end
+
+        if #next_room > 0 then
+            local nr = next_room[math.random(1,#next_room)]
+            -- 打通两个房间之间的墙
+            maze:fill((x + nr[1])//2,(y + nr[2])//2,1)
+            maze:fill(nr[1],nr[2],1)
+            visit[nr[1]*maze_size + nr[2]] = true
+            table.insert(stack,nr)
+        else
+            table.remove(stack)
+        end
+    end
+
+    -- 再随机打通一些墙，让迷宫有多条路，寻路时open set会更大
+    for idx = 1,maze_size*maze_size//20 do
+        maze:fill(math.random(1,max_room),math.random(1,max_room),1)
+    end
+
+    return maze
+end
+
+-- @mode:寻路方式，Astar.ASTAR、Astar.JPS或者Astar.HPA
+local function maze_test(maze,name,mode)
+    -- 每种寻路方式用同样的起点和终点
+    math.randomseed(maze_id)
+
+    local function random_room()
+        local x = math.random(0,maze_size//2 - 2)*2 + 1
+        local y = math.random(0,maze_size//2 - 2)*2 + 1
+        return x,y
+    end
+
+    local found = 0
+    local grid = 0
+    local beg = os.clock()
+    for idx = 1,max_maze_path do
+        local x,y = random_room()
+        local dx,dy = random_room()
+        local cnt = astar:search(maze,x,y,dx,dy,path,mode)
+        if cnt and cnt > 0 then
+            found = found + 1
+            grid = grid + cnt
+        end
+    end
+    local cost = os.clock() - beg
+
+    PRINTF("%s maze %dx%d search %d paths(found %d,avg %d grids),\z
+        cost %.3fs,%.1f paths/sec",name,maze_size,maze_size,max_maze_path,
+        found,grid//math.max(1,found),cost,max_maze_path/cost)
+end
+
+local maze = make_maze()
+if maze then
+    maze_test(maze,"astar",Astar.ASTAR)
+    maze_test(maze,"jps",Astar.JPS)
+    maze_test(maze,"hpa",Astar.HPA)
+end
+
+-- 地图加载测试：对比set + fill动态创建和mmap加载编译好的地图文件的耗时、内存
+-- 文件格式见grid_map.h中的map_header，同shell/tiled_map.lua
+local load_id = 9997
+local load_size = 2048
+local load_path = "runtime/map_performance.map"
+
+-- 从/proc/self/status读取当前进程的常驻内存(KB)，RssAnon为自己分配的，RssFile为映射的文件
+local function read_rss()
+    local rss = {}
+    local file = io.open("/proc/self/status","r")
+    if not file then return rss end
+
+    for line in file:lines() do
+        local name,kb = string.match(line,"^(%w+):%s*(%d+) kB")
+        if name then rss[name] = tonumber(kb) end
+    end
+    file:close()
+
+    return rss
+end
+
+local function write_map_file(path,id,w,h,cost)
+    local header_fmt = "<I4I2I2i4I2I2I4I4I4"
+    local cost_offset = (string.packsize(header_fmt) + 3) // 4 * 4
+    local file_size = cost_offset + w*h
+
+    local file = io.open(path,"wb")
+    if not file then return false end
+
+    local header = string.pack(header_fmt,
+        0x50414D47,1,0,id,w,h,cost_offset,0,file_size)
+    file:write(header,string.rep("\0",cost_offset - #header),
+        string.rep(string.pack("i1",cost),w*h))
+    file:close()
+
+    return true
+end
+
+local function load_test()
+    if not write_map_file(load_path,load_id,load_size,load_size,1) then
+        PRINTF("write map file fail:%s",load_path)
+        return
+    end
+
+    collectgarbage()
+    local rss = read_rss()
+    local beg = os.clock()
+    local fill_map = Map()
+    fill_map:set(load_id,load_size,load_size)
+    for x = 0,load_size - 1 do
+        for y = 0,load_size - 1 do fill_map:fill(x,y,1) end
+    end
+    local fill_cost = os.clock() - beg
+    local fill_rss = read_rss()
+
+    beg = os.clock()
+    local load_map = Map()
+    if not load_map:load(load_path) then
+        PRINTF("load map file fail:%s",load_path)
+        return
+    end
+    local load_cost = os.clock() - beg
+    -- 映射的页第一次读到时才占用内存，每个页读一个格子，模拟地图被用到后的内存占用
+    -- 格子下标为x*height + y，一个页4096个格子
+    for x = 0,load_size - 1,math.max(1,4096//load_size) do
+        load_map:get_pass_cost(x,0)
+    end
+    local load_rss = read_rss()
+
+    PRINTF("map %dx%d set + fill cost %.3fs,RssAnon +%dKB",load_size,
+        load_size,fill_cost,(fill_rss.RssAnon or 0) - (rss.RssAnon or 0))
+    PRINTF("map %dx%d mmap load cost %.6fs,RssAnon +%dKB,RssFile +%dKB",
+        load_size,load_size,load_cost,
+        (load_rss.RssAnon or 0) - (fill_rss.RssAnon or 0),
+        (load_rss.RssFile or 0) - (fill_rss.RssFile or 0))
+
+    os.remove(load_path)
+end
+
+load_test()
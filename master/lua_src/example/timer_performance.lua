@@ -0,0 +1,93 @@
+-- timer_performance.lua
+
+-- 定时器测试：大量定时器频繁启动、停止时，二叉堆和时间轮的耗时对比
+-- 模拟场景中的buff、技能cd等，大部分定时器在触发前就被停止或者重置
+-- 另外测试时间轮中重复定时器的周期，见Period
+
+local Timer = require "Timer"
+local timer_mgr = require "timer.timer_mgr"
+
+local max_timer = 100000 -- 定时器数量
+local times = 1000000 -- 重置次数
+
+local timer_list = {}
+for idx = 1,max_timer do
+    table.insert( timer_list,Timer( idx ) )
+end
+
+local function run_timer( backend,name )
+    ev:set_timer_backend( backend )
+
+    math.randomseed( 1 )
+    local beg = os.clock()
+    for _,timer in pairs( timer_list ) do
+        timer:set( math.random( 1,3600 ) )
+        timer:start()
+    end
+    local start_cost = os.clock() - beg
+
+    beg = os.clock()
+    for idx = 1,times do
+        local timer = timer_list[math.random( 1,max_timer )]
+        timer:stop()
+        timer:set( math.random( 1,3600 ) )
+        timer:start()
+    end
+    local reset_cost = os.clock() - beg
+
+    beg = os.clock()
+    for _,timer in pairs( timer_list ) do timer:stop() end
+    local stop_cost = os.clock() - beg
+
+    PRINTF( "%s: start %d timer %.3fs,reset %d times %.3fs,stop %.3fs",
+        name,max_timer,start_cost,times,reset_cost,stop_cost )
+end
+
+-- 恢复配置中的定时器实现
+local function restore_backend()
+    ev:set_timer_backend(
+        "wheel" == g_setting.ev_timer and ev.TIMER_WHEEL or ev.TIMER_HEAP )
+end
+
+-- 重复定时器的周期：周期大于时间轮第一层(256毫秒)，每次触发前都要从上层cascade到
+-- 第一层。主循环繁忙时可以晚触发，但不能提前，也不能因为cascade或者浮点误差每次晚
+-- 一点累积起来，第n次触发的时间按启动时间 + n*周期计算
+local period = 300 -- 毫秒
+local period_times = 20
+
+local Period = oo.class( nil,"Period" )
+
+function Period:start()
+    ev:set_timer_backend( ev.TIMER_WHEEL )
+
+    self.count = 0
+    self.max_late = 0
+    self.beg = ev:ms_time()
+    self.timer = timer_mgr:new_timer( self,period/1000,period/1000 )
+    timer_mgr:start_timer( self.timer )
+end
+
+function Period:do_timer()
+    self.count = self.count + 1
+
+    local late = ev:ms_time() - self.beg - self.count*period
+    assert( late >= 0,"repeat timer fire early" )
+    if late > self.max_late then self.max_late = late end
+
+    if self.count < period_times then return end
+
+    timer_mgr:del_timer( self.timer )
+    restore_backend()
+
+    assert( self.max_late < period,"repeat timer delay accumulated" )
+    PRINTF( "wheel repeat timer %dms %d times,max late %dms",
+        period,period_times,self.max_late )
+end
+
+run_timer( ev.TIMER_HEAP,"heap" )
+run_timer( ev.TIMER_WHEEL,"wheel" )
+restore_backend()
+
+-- 这里创建的对象要放到全局引用，不然会被释放掉，就没法回调了
+period_test = Period()
+period_test:start()
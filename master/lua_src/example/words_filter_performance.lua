@@ -18,3 +18,37 @@ print( "acism worlds replace",acism:replace("出售枪支是非法的","~") )
 print( "acism worlds replace",acism:replace("出售枪支是非法的","") )
 print( "acism worlds replace",acism:replace("","") )
 print( "acism worlds replace",acism:replace("这句话是不应该发生内存拷贝的","***") )
+
+-- 批量过滤，和逐条调用对比
+local msg_list = {}
+local sample = { "this is nothing","this is something,找到了18Dy",
+    "出售枪支是非法的","这句话是不应该发生内存拷贝的" }
+for idx = 1,40000 do
+    msg_list[idx] = sample[idx % #sample + 1] .. idx
+end
+
+f_tm_start()
+for idx = 1,#msg_list do
+    acism:replace( msg_list[idx],"***" )
+end
+f_tm_stop( "acism replace one by one" )
+
+local rpl_list = {}
+for _,thread_cnt in pairs( {1,4} ) do
+    f_tm_start()
+    acism:replace_list( msg_list,"***",rpl_list,thread_cnt )
+    f_tm_stop( string.format( "acism replace_list %d thread",thread_cnt ) )
+end
+
+local pos_list = {}
+acism:scan_list( msg_list,pos_list )
+for idx = 1,#msg_list do
+    assert( pos_list[idx] == acism:scan( msg_list[idx] ) )
+    assert( rpl_list[idx] == acism:replace( msg_list[idx],"***" ) )
+end
+
+-- 热更关键字，在子线程构建，完成前仍使用旧的关键字，不阻塞主线程
+f_tm_start()
+acism:load_async( "config/illeagal_worlds.txt",false )
+f_tm_stop( "acism load_async" )
+print( "acism is loading",acism:is_loading() )
@@ -41,6 +41,11 @@ end
 
 -- 重写初始化结束入口
 function App:final_initialize()
+    -- 开启多线程io，必须在监听客户端之前
+    if g_setting.io_thread and g_setting.io_thread > 0 then
+        network_mgr:set_io_thread( g_setting.io_thread )
+    end
+
     if not g_network_mgr:clt_listen( g_setting.cip,g_setting.cport ) then
         ERROR( "gateway client listen fail,exit" )
         os.exit( 1 )
@@ -226,11 +226,12 @@ function Account_mgr:db_load()
         self:on_db_loaded( ... )
     end
 
-    g_mongodb:find( "account",nil,nil,callback )
+    -- 帐号数据随着开服时间增加会很多，分批加载
+    g_mongodb:find_stream( "account",nil,nil,nil,callback )
 end
 
--- db数据加载
-function Account_mgr:on_db_loaded( ecode,res )
+-- db数据加载，数据分多次返回，more为false时表示加载完成
+function Account_mgr:on_db_loaded( ecode,res,more )
     if 0 ~= ecode then
         ERROR( "account db load error" )
         return
@@ -249,6 +250,8 @@ function Account_mgr:on_db_loaded( ecode,res )
         self.account[sid][plat][account] = role_info
     end
 
+    if more then return end
+
     g_app:one_initialized( "acc_data",1 )
 end
 
@@ -61,15 +61,27 @@ function Command_mgr:__init()
     self.auth_pid = g_authorize:get_player_data()
 end
 
--- 加载二进制flatbuffers schema文件
+-- 加载protobuf(pbc、upb)、flatbuffers schema文件及stream字段列表
 function Command_mgr:load_schema()
     local pfs = network_mgr:load_one_schema( network_mgr.CDC_PROTOBUF,"pb" )
     PRINTF( "load protocol schema:%d",pfs )
 
+    -- upb和pbc用同一份.pb文件，连接可以通过set_conn_codec选择其中一种
+    -- upb是可选的，编译时没开启USE_UPB则没有CDC_UPB
+    if network_mgr.CDC_UPB then
+        local ufs = network_mgr:load_one_schema( network_mgr.CDC_UPB,"pb" )
+        PRINTF( "load upb protocol schema:%d",ufs )
+    end
+
     local ffs = network_mgr:load_one_schema( network_mgr.CDC_FLATBUF,"fbs" )
     PRINTF( "load flatbuffers schema:%d",ffs )
 
-    return (pfs >= 0 and ffs >= 0)
+    -- 自定义二进制流的字段列表，rpc默认用这种方式编码
+    local sfs = network_mgr:load_one_schema(
+        network_mgr.CDC_STREAM,"proto/stream_field.txt" )
+    PRINTF( "load stream field:%d",sfs )
+
+    return (pfs >= 0 and ufs >= 0 and ffs >= 0 and sfs >= 0)
 end
 
 -- 注册客户端协议处理
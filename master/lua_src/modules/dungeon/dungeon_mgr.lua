@@ -36,11 +36,14 @@ function Dungeon_mgr:init_static_dungeon()
     local test_width = 128
     local test_height = 64
     for id = 1,test_scene do
-        local map = g_map_mgr:create_map(id,test_width,test_height)
-
-        for width = 0,test_width - 1 do
-            for height = 0,test_height - 1 do
-                map:fill(width,height,1)
+        -- 优先加载shell/map.sh编译好的地图文件，没有的话才动态创建
+        if not g_map_mgr:load_map_file(id) then
+            local map = g_map_mgr:create_map(id,test_width,test_height)
+
+            for width = 0,test_width - 1 do
+                for height = 0,test_height - 1 do
+                    map:fill(width,height,1)
+                end
             end
         end
     end
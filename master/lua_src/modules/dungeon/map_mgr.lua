@@ -6,6 +6,8 @@
 
 local Map = require "Map"
 local Astar = require "Astar"
+local AstarPool = require "AstarPool"
+local Auto_id = require "modules.system.auto_id"
 
 local Map_mgr = oo.singleton( nil,... )
 
@@ -13,6 +15,10 @@ function Map_mgr:__init()
     self.map = {} -- map id为key
 
     self.astar = Astar() -- a星寻路算法，里面有缓存的，全局创建一个对象就可以了
+
+    self.auto_id = Auto_id()
+    self.async_cb = {} -- 异步寻路的回调，回调id为key
+    self.async_path = {} -- 异步寻路存放路径的table，回调id为key
 end
 
 -- 动态创建地图
@@ -30,11 +36,113 @@ function Map_mgr:create_map( id,width,height )
     return map
 end
 
+-- 加载编译好的地图文件(由shell/map.sh转换)，文件用mmap只读映射，同一台机器上的进程
+-- 共用同一份内存。加载的地图不能再fill
+-- @id:地图id，不能重复
+-- @path:地图文件路径
+function Map_mgr:load_map( id,path )
+    assert(nil == self.map[id])
+
+    local map = Map()
+    if not map:load(path) then
+        ERROR( "load map fail:%d,%s",id,path )
+        return
+    end
+
+    self.map[id] = map
+
+    return map
+end
+
+-- 从地图目录(master/map，见shell/map.sh)加载地图，文件名为地图id
+-- @return:地图对象，文件不存在或者加载失败返回nil
+function Map_mgr:load_map_file( id )
+    local path = string.format( "map/%d.map",id )
+
+    local file = io.open( path,"rb" )
+    if not file then return end
+    file:close()
+
+    return self:load_map( id,path )
+end
+
+-- 复制一份地图，用于副本里动态修改地图(可破坏的墙、副本里的阻挡等)
+-- 复制的地图和原地图共用格子数据，只有修改过的块才会复制，多个副本不会成倍占用内存
+-- @id:原地图id
+function Map_mgr:fork_map( id )
+    local base = self.map[id]
+    assert(base)
+
+    local map = Map()
+    map:fork(base)
+
+    return map
+end
+
 -- 获取地图对象
 function Map_mgr:get_map( id )
     return self.map[id]
 end
 
+-- 启动异步寻路线程
+-- @count:线程数量，默认1个
+function Map_mgr:start_async( count )
+    assert(nil == self.astar_pool)
+
+    self.astar_pool = AstarPool( 1 )
+    self.astar_pool:start( count or 1 )
+end
+
+-- 停止异步寻路线程，关服时调用
+function Map_mgr:stop_async()
+    if self.astar_pool then self.astar_pool:stop() end
+end
+
+-- 异步寻路，在子线程寻路，不占用主线程时间。寻路完成前地图不能修改
+-- @path:存放路径的table，格式同Astar:search，由调用者缓存
+-- @mode:寻路方式，Astar.ASTAR、Astar.JPS或者Astar.HPA
+-- @callback:回调函数，callback(path,cnt)，cnt为路径格子数，找不到路径为0
+function Map_mgr:async_find_path( map,x,y,dx,dy,path,mode,callback )
+    if not self.astar_pool then self:start_async() end
+
+    local id = self.auto_id:next_id( self.async_cb )
+    self.async_cb[id] = callback
+    self.async_path[id] = path
+
+    self.astar_pool:search( id,map,x,y,dx,dy,mode )
+end
+
+-- 底层一次返回多个寻路结果，格式见lastar_pool::invoke_result
+function Map_mgr:async_path_event( results,n )
+    local idx = 1
+    while idx < n do
+        local id = results[idx]
+        local cnt = results[idx + 1]
+        idx = idx + 2
+
+        local callback = self.async_cb[id]
+        local path = self.async_path[id]
+        self.async_cb[id] = nil
+        self.async_path[id] = nil
+
+        if callback then
+            for k = 1,cnt*2 do path[k] = results[idx + k - 1] end
+            path.n = cnt*2
+
+            xpcall( callback,__G__TRACKBACK__,path,cnt )
+        else
+            ERROR( "async path no call back found:%d",id )
+        end
+
+        idx = idx + cnt*2
+    end
+end
+
 local mm = Map_mgr()
 
+-- 底层回调很难回调到对应的对象，只能在这里做一次分发
+function astar_read_event( pool_id,results,n )
+    mm:async_path_event( results,n )
+end
+
 return mm
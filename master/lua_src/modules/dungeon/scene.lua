@@ -9,6 +9,7 @@ local visual_width = 3 -- 视野宽度格子数
 local visual_height = 4 -- 视野高度格子数
 
 local Aoi = require "Aoi"
+local ListAoi = require "ListAoi"
 local ET = require "modules.entity.entity_header"
 local scene_conf = require_kv_conf("dungeon_scene","id")
 
@@ -23,15 +24,21 @@ function Scene:__init(id,dungeon_id,dungeon_hdl)
     self.dungeon_id  = dungeon_id
     self.dungeon_hdl = dungeon_hdl
 
-    -- TODO:对于绝大多数地图，地图数据都是不变的，多个副本共用一份，则g_map_mgr管理就可以了
-    -- 一些场景可能会有动态地图，比如根据帮派改变可行走区域，这时就要用map:fork来复制一份
-    -- 地图数据根据程序处理了，这里暂不处理
+    -- 对于绝大多数地图，地图数据都是不变的，多个副本共用一份，则g_map_mgr管理就可以了
+    -- 一些场景可能会有动态地图，比如根据帮派改变可行走区域，这时就要用g_map_mgr:fork_map
+    -- 来复制一份，复制的地图只有修改过的块才占用内存。这里暂不处理
     local map_id = scene_conf[id].map
     local map = g_map_mgr:get_map( map_id )
 
     local width,height = map:get_size()
 
-    local aoi = Aoi()
+    -- 默认用九宫格aoi，地图很大或者实体分布很不均匀的场景配置为十字链表aoi
+    local aoi
+    if "list" == scene_conf[id].aoi then
+        aoi = ListAoi()
+    else
+        aoi = Aoi()
+    end
     aoi:set_size(width*pix,height*pix,pix)
     aoi:set_visual_range(visual_width,visual_height)
 
@@ -25,8 +25,16 @@ function Log_mgr:db_logger_init()
     end
 
     self.db_logger = g_mysql_mgr:new()
+
+    -- 频繁写入的日志用预处理语句，在连接上之前登记也可以
+    self.login_out_sid = self.db_logger:prepare(
+        "INSERT INTO `login_logout` (pid,op_type,op_time) values (?,?,?)" )
+    self.gold_sid = self.db_logger:prepare(
+        "INSERT INTO `gold` (pid,op_val,new_val,op_type,op_time,ext) values (?,?,?,?,?,?)" )
+
     self.db_logger:start( g_setting.mysql_ip,g_setting.mysql_port,
-    g_setting.mysql_user,g_setting.mysql_pwd,g_setting.mysql_db,callback )
+    g_setting.mysql_user,g_setting.mysql_pwd,g_setting.mysql_db,callback,
+    g_setting.mysql_pool )
 end
 
 -- db日志初始化完成
@@ -41,18 +49,15 @@ function Log_mgr:close()
 end
 
 -- 记录登录、退出日志
-local login_out_stmt = "INSERT INTO `login_logout` (pid,op_type,op_time) values (%d,%d,%d)"
 function Log_mgr:login_or_logout( pid,op_type )
-    self.db_logger:insert( string.format(login_out_stmt,pid,op_type,ev:time()) )
+    self.db_logger:exec_stmt( self.login_out_sid,pid,pid,op_type,ev:time() )
 end
 
 -- 元宝操作日志
--- 日志里不应该有特殊字符，故ext不做特殊处理
+-- 参数走二进制协议，ext中有特殊字符也不需要转义
 function Log_mgr:gold_log( pid,op_val,new_val,op_type,ext )
-    local stmt = string.format(
-        "INSERT INTO `gold` (pid,op_val,new_val,op_type,op_time,ext) values (%d,%d,%d,%d,%d,\"%s\")",
+    self.db_logger:exec_stmt( self.gold_sid,pid,
         pid,op_val,new_val,op_type,ev:time(),tostring(ext or "") )
-    self.db_logger:insert( stmt )
 end
 
 -- 记录添加邮件操作日志
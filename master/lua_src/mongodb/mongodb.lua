@@ -36,10 +36,11 @@ function Mongodb:do_timer()
     end
 end
 
-function Mongodb:read_event( qid,ecode,res )
+-- @more 流式查询后面还有数据，回调不能删除
+function Mongodb:read_event( qid,ecode,res,more )
     if self.cb[qid] then
-        xpcall( self.cb[qid],__G__TRACKBACK__,ecode,res )
-        self.cb[qid] = nil
+        xpcall( self.cb[qid],__G__TRACKBACK__,ecode,res,more )
+        if not more then self.cb[qid] = nil end
     else
         ERROR( "mongo event no call back found" )
     end
@@ -64,6 +65,13 @@ function Mongodb:valid()
     return self.mongodb:valid()
 end
 
+-- 设置批量写入，同一个collection的insert、update、remove在窗口内合并为一次bulk操作
+-- @window 合并窗口，毫秒。0表示不合并
+-- @max 一次bulk最多包含的操作数量，默认1000
+function Mongodb:set_batch( window,max )
+    return self.mongodb:set_batch( window,max )
+end
+
 function Mongodb:count( collection,query,skip,limit,callback )
     local id = self.auto_id:next_id( self.cb )
     self.cb[id] = callback
@@ -76,6 +84,15 @@ function Mongodb:find( collection,query,opts,callback )
     return self.mongodb:find( id,collection,query,opts )
 end
 
+-- 流式查询，数据量大时(比如开服加载所有帐号)避免一次返回卡住主线程
+-- 结果分多次回调callback( ecode,res,more )，more为false时表示已全部返回
+-- @batch 每次回调的最大文档数量，默认512
+function Mongodb:find_stream( collection,query,opts,batch,callback )
+    local id = self.auto_id:next_id( self.cb )
+    self.cb[id] = callback
+    return self.mongodb:find_stream( id,collection,query,opts,batch )
+end
+
 -- 查询对应的记录并修改
 -- @query 查询条件
 -- @sort 排序条件
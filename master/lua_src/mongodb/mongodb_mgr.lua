@@ -29,9 +29,9 @@ end
 
 local db_mgr = Mongodb_mgr()
 
-function mongodb_read_event( dbid,qid,ecode,res )
+function mongodb_read_event( dbid,qid,ecode,res,more )
     local db = db_mgr.mongodb[dbid]
-    db:read_event( qid,ecode,res )
+    db:read_event( qid,ecode,res,more )
 end
 
 return db_mgr
@@ -44,8 +44,9 @@ function Mysql:read_event( qid,ecode,res )
     end
 end
 
-function Mysql:start( ip,port,usr,pwd,db,callback )
-    self.sql:start( ip,port,usr,pwd,db )
+-- @pool:连接池的连接数量，默认1个
+function Mysql:start( ip,port,usr,pwd,db,callback,pool )
+    self.sql:start( ip,port,usr,pwd,db,pool or 1 )
 
     -- 连接成功后回调
     if callback then
@@ -59,23 +60,45 @@ function Mysql:stop()
     self.sql:stop()
 end
 
-function Mysql:exec_cmd( stmt )
-    return self.sql:do_sql( 0,stmt )
+-- 以下函数的key是可选的，一般为玩家pid。相同key的sql在同一个连接上按顺序执行，
+-- 不指定key的sql在连接池数量大于1时不保证顺序
+function Mysql:exec_cmd( stmt,key )
+    return self.sql:do_sql( 0,stmt,key )
 end
 
-function Mysql:select( this,method,stmt )
+function Mysql:select( this,method,stmt,key )
     local id = self.auto_id:next_id( self.query )
     self.query[id] = function( ... ) return method( this,... ) end
 
-    self.sql:do_sql( id,stmt )
+    self.sql:do_sql( id,stmt,key )
 end
 
-function Mysql:insert( stmt )
-    return self.sql:do_sql( 0,stmt )
+function Mysql:insert( stmt,key )
+    return self.sql:do_sql( 0,stmt,key )
 end
 
-function Mysql:update( stmt )
-    return self.sql:do_sql( 0,stmt )
+function Mysql:update( stmt,key )
+    return self.sql:do_sql( 0,stmt,key )
+end
+
+-- 预处理语句，返回语句id。语句中的参数用?表示，执行时按顺序传入
+-- 参数和结果走二进制协议，不需要拼接、转义sql，结果也不需要再解析字符串
+-- local sid = g_mysql:prepare( "SELECT * FROM `gold` WHERE pid = ?" )
+function Mysql:prepare( stmt )
+    return self.sql:prepare( stmt )
+end
+
+-- 执行预处理语句，不需要返回结果
+function Mysql:exec_stmt( sid,key,... )
+    return self.sql:do_stmt( 0,sid,key,... )
+end
+
+-- 执行预处理语句，结果回调到this.method
+function Mysql:select_stmt( this,method,sid,key,... )
+    local id = self.auto_id:next_id( self.query )
+    self.query[id] = function( ... ) return method( this,... ) end
+
+    self.sql:do_stmt( id,sid,key,... )
 end
 
 function Mysql:call( stmt )
@@ -121,6 +121,8 @@ function Clt_conn:conn_accept( new_conn_id )
     network_mgr:set_conn_io( new_conn_id,network_mgr.IOT_NONE )
     network_mgr:set_conn_codec( new_conn_id,network_mgr.CDC_PROTOBUF )
     network_mgr:set_conn_packet( new_conn_id,network_mgr.PKT_WSSTREAM )
+    -- 网关广播多，发送缓冲区使用分段模式，避免扩容时拷贝
+    network_mgr:set_send_segment( new_conn_id,true )
 
     local new_conn = Clt_conn( new_conn_id )
     g_network_mgr:clt_conn_accept( new_conn_id,new_conn )
@@ -37,6 +37,9 @@ function App:exec()
     -- require "example.scene_performance"
     -- require "example.aoi_performance"
     -- require "example.rank_performance"
+    -- require "example.multicast_performance"
+    -- require "example.timer_performance"
+    -- require "example.ev_performance"
     -- require "example.other_performance"
 
     vd( statistic.dump() )
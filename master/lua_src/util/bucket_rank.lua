@@ -2,30 +2,23 @@
 -- xzc
 -- 2018-11-11
 
--- 桶排序
+-- 桶排序(底层为基数排序)
 -- 适用一次性大量数据排序，比如每30分钟做一次全服排序榜
-
--- !!!
--- 这个设计比较失败，总是比insertion_rank要慢。即使在大量数据，排序因子较为集中的情况下
--- 暂时不要用，先留在这里，后面再看看是什么原因
--- !!!
+-- 插入完成后调用make_cache排序，之后根据id取排名、根据排名取id都是O(1)
+-- 不支持删除、更新，需要的话clear后重新插入
 
 local json = require "lua_parson"
-local Bucket_rank_core = require "Insertion_rank"
+local Bucket_rank_core = require "Bucket_rank"
 
 local Bucket_rank = oo.class( nil,... )
 
 function Bucket_rank:__init()
     self.object = {}
-    self.sort_id = {}
-    self.rank_id = {}
     self.rank = Bucket_rank_core()
 end
 
 function Bucket_rank:clear()
     self.object = {}
-    self.sort_id = {}
-    self.rank_id = {}
     return self.rank:clear()
 end
 
@@ -34,15 +27,18 @@ function Bucket_rank:get_count()
     return self.rank:get_count()
 end
 
--- 做个缓存，这样从id取排名，或者从排名取id就很快了
-function Bucket_rank:make_cache()
-    local count = self.rank:get_count()
-    local max_idx = self.rank:get_top_n(count,self.sort_id)
+-- 排序，插入完成后调用
+-- @thread_cnt:数量很大时可以用多个线程排序，默认1
+function Bucket_rank:make_cache( thread_cnt )
+    self.rank:sort( thread_cnt )
+end
 
-    for idx = 1,max_idx do
-        local id = self.sort_id[idx]
-        self.rank_id[id] = idx
-    end
+function Bucket_rank:get_rank_by_id( id )
+    return self.rank:get_rank_by_id( id )
+end
+
+function Bucket_rank:get_id_by_rank( rank )
+    return self.rank:get_id_by_rank( rank )
 end
 
 -- 插入一个排序对象，返回对象数据
@@ -63,7 +59,7 @@ function Bucket_rank:save( path )
     local sort_object = {}
     local count = self.rank:get_count();
     for idx = 1,count do
-        local id = self.sort_id[idx];
+        local id = self.rank:get_id_by_rank(idx);
         table.insert(sort_object,self.object[id])
     end
 
@@ -12,17 +12,27 @@ return
         cport = 10002,       -- s2s监听端口
         hip   = "127.0.0.1", -- http监听ip
         hport = 10003,       -- http监听端口
+        -- 事件循环后端：epoll、uring。uring需要linux 5.11以上，不支持时仍使用epoll
+        -- uring只用来代替epoll监听，收发仍是每个socket一次系统调用，并且活跃连接少时比
+        -- epoll慢(见example/ev_performance.lua)，默认不开启
+        ev_backend = "epoll",
+        -- 定时器实现：heap、wheel。定时器很多并且频繁增删时用时间轮
+        ev_timer = "wheel",
+        -- 处理客户端连接的io线程数量，0表示不开启多线程io，所有连接都在主线程处理
+        io_thread = 0,
         mongo_ip = "127.0.0.1", -- mongodb ip
         mongo_port = "27013", -- mongodb 端口
         mongo_db = "test_999", -- 需要连接的数据库
         mongo_user = "test", -- mongo 用户(以后弄个加密，以免明文保存)
         mongo_pwd  = "test", -- mongo 密码(以后弄个加密，以免明文保存)
+        mongo_batch = 0, -- mongo写操作合并窗口(毫秒)，0表示不合并
 
         mysql_ip   = "127.0.0.1";
         mysql_port = 3306,
         mysql_user = "test",
         mysql_pwd  = "test",
         mysql_db   = "test_999",
+        mysql_pool = 1, -- mysql连接数量，大于1时不同玩家的sql并行执行
 
         lang = "zh", -- 简体中文
     },
@@ -42,12 +52,14 @@ return
         mongo_db = "test_999", -- 需要连接的数据库
         mongo_user = "test", -- mongo 用户(以后弄个加密，以免明文保存)
         mongo_pwd  = "test", -- mongo 密码(以后弄个加密，以免明文保存)
+        mongo_batch = 0, -- mongo写操作合并窗口(毫秒)，0表示不合并
 
         mysql_ip   = "127.0.0.1";
         mysql_port = 3306,
         mysql_user = "test",
         mysql_pwd  = "test",
         mysql_db   = "test_999",
+        mysql_pool = 1, -- mysql连接数量，大于1时不同玩家的sql并行执行
 
         lang = "zh", -- 简体中文
     },
@@ -229,6 +229,27 @@ function build_flatbuffers()
     cd -
 }
 
+# upb已经合并到protobuf仓库，只编译libupb，不需要编译整个protobuf
+# descriptor.upb.h是预先生成的，没有install，需要手动复制
+# upb编码是可选的，默认不编译，需要时执行build_env.sh upb，再make USE_UPB=1
+function build_upb()
+{
+    cd $PKGDIR
+
+    UPB_VER=29.3
+    git clone --depth 1 -b v$UPB_VER https://github.com/protocolbuffers/protobuf.git protobuf-upb
+    cmake -Dprotobuf_BUILD_LIBUPB=ON -Dprotobuf_BUILD_TESTS=OFF \
+        -Dprotobuf_BUILD_PROTOC_BINARIES=OFF -Dprotobuf_BUILD_LIBPROTOC=OFF \
+        protobuf-upb -Bprotobuf-upb/build
+    make -C protobuf-upb/build libupb
+    make -C protobuf-upb/build install
+    cp -r protobuf-upb/upb/reflection/stage0/google /usr/local/include/
+    ldconfig -v
+
+    rm -R protobuf-upb
+    cd -
+}
+
 # 其实我们只需要一个protoc来编译proto文件，不需要源代码
 # 可以在github直接下载bin文件，尤其是在win下开始的时候
 # https://github.com/google/protobuf/releases
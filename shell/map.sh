@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# 把tiled导出的地图(Lua格式)转换为服务器用的地图文件，见tiled_map.lua
+
+set -e
+set -o pipefail
+
+SRC=../rawresource/rawmap
+DST=../master/map
+
+mkdir -p $DST
+
+counter=0
+for i in $SRC/*.lua
+do
+    [ -e "$i" ] || continue
+
+    name=$(basename ${i%.*})
+    echo compiling $name ...
+
+    lua tiled_map.lua $i $DST/$name".map"
+
+    counter=$[counter+1]
+done
+
+echo "map file compile finish,files:"$counter
@@ -0,0 +1,114 @@
+-- tiled_map.lua
+-- 把tiled(https://www.mapeditor.org/)导出的地图转换为服务器用的地图文件
+-- 用法：lua tiled_map.lua input.lua output.map [id]
+
+-- tiled中用"导出为Lua文件"，地图需要满足以下约定：
+-- 1. 名为cost的图块层为格子消耗，图块的自定义属性cost为消耗，没有该属性的为1，空格子
+--    为不可行走(-1)
+-- 2. 名为region的图块层(可选)为区域，图块的自定义属性region为区域id，空格子为0
+-- 3. 地图的自定义属性id为地图id，也可以在命令行指定
+-- 输出文件格式见grid_map.h中的map_header，格子下标为x*height + y
+
+local MAGIC = 0x50414D47 -- "GMAP"
+local VERSION = 1
+local HEADER_FMT = "<I4I2I2i4I2I2I4I4I4"
+local MAX_GRID = 4096 -- 同config.h中的MAX_MAP_GRID
+
+-- tiled的gid高3位是翻转标识
+local GID_MASK = 0x1FFFFFFF
+
+local function align4(offset)
+    return (offset + 3) // 4 * 4
+end
+
+-- 取所有图块的某个属性，以gid为key
+local function tile_property(tiled,name)
+    local props = {}
+    for _,tileset in pairs(tiled.tilesets or {}) do
+        for _,tile in pairs(tileset.tiles or {}) do
+            local value = tile.properties and tile.properties[name]
+            if value then props[tileset.firstgid + tile.id] = value end
+        end
+    end
+
+    return props
+end
+
+local function find_layer(tiled,name)
+    for _,layer in pairs(tiled.layers or {}) do
+        if "tilelayer" == layer.type and name == layer.name then
+            return layer
+        end
+    end
+end
+
+-- 把图块层转换为按x*height + y排列的格子数据
+-- @fmt:string.pack的格式
+-- @empty:空格子的值
+-- @default:图块没有该属性时的值
+local function pack_layer(tiled,layer,props,fmt,empty,default)
+    local width,height = tiled.width,tiled.height
+    assert(layer.width == width and layer.height == height,
+        "layer size not match:" .. layer.name)
+    assert("lua" == (layer.encoding or "lua"),
+        "layer encoding must be lua(csv):" .. layer.name)
+
+    local data = layer.data
+    local buffer = {}
+    for x = 0,width - 1 do
+        for y = 0,height - 1 do
+            -- tiled按行存放，下标从1开始
+            local gid = (data[y*width + x + 1] or 0) & GID_MASK
+
+            local value = empty
+            if 0 ~= gid then value = props[gid] or default end
+
+            buffer[#buffer + 1] = string.pack(fmt,value)
+        end
+    end
+
+    return table.concat(buffer)
+end
+
+local function main(input,output,id)
+    local tiled = dofile(input)
+    local width,height = tiled.width,tiled.height
+
+    assert("orthogonal" == tiled.orientation,"only orthogonal map support")
+    assert(width > 0 and width <= MAX_GRID and height > 0 and height <= MAX_GRID,
+        "map size illegal")
+
+    id = math.tointeger(id or (tiled.properties and tiled.properties.id))
+    assert(id,"map id not specified")
+
+    local cost_layer = find_layer(tiled,"cost")
+    assert(cost_layer,"cost layer not found")
+
+    local cost = pack_layer(tiled,cost_layer,tile_property(tiled,"cost"),"i1",-1,1)
+
+    local region
+    local region_layer = find_layer(tiled,"region")
+    if region_layer then
+        region = pack_layer(
+            tiled,region_layer,tile_property(tiled,"region"),"<I2",0,0)
+    end
+
+    local cost_offset = align4(string.packsize(HEADER_FMT))
+    local region_offset = region and align4(cost_offset + #cost) or 0
+    local file_size = region and (region_offset + #region) or (cost_offset + #cost)
+
+    local header = string.pack(HEADER_FMT,MAGIC,VERSION,0,id,
+        width,height,cost_offset,region_offset,file_size)
+
+    local file = assert(io.open(output,"wb"))
+    file:write(header,string.rep("\0",cost_offset - #header),cost)
+    if region then
+        file:write(string.rep("\0",region_offset - cost_offset - #cost),region)
+    end
+    file:close()
+
+    print(string.format("map %d(%dx%d) -> %s,%d bytes",
+        id,width,height,output,file_size))
+end
+
+main(...)